@@ -117,6 +117,65 @@ test_bitfields (void)
   return 0;
 }
 
+static int
+test_bitfield_runs (void)
+{
+  size_t i;
+  size_t n;
+  size_t * runs;
+  size_t bad[3];
+  const size_t bitCount = 100 + tr_cryptoWeakRandInt (1000);
+  tr_bitfield bf;
+  tr_bitfield bf2;
+
+  /* generate a random bitfield, with a long run of set bits in it */
+  tr_bitfieldConstruct (&bf, bitCount);
+  tr_bitfieldConstruct (&bf2, bitCount);
+  for (i=0, n=tr_cryptoWeakRandInt (bitCount); i<n; ++i)
+    tr_bitfieldAdd (&bf, tr_cryptoWeakRandInt (bitCount));
+  i = tr_cryptoWeakRandInt (bitCount);
+  tr_bitfieldAddRange (&bf, i, i + 1 + tr_cryptoWeakRandInt (bitCount - i));
+
+  /* the runs add up to bitCount and can rebuild the bitfield */
+  runs = tr_bitfieldGetRuns (&bf, &n);
+  check (n > 0);
+  check (tr_bitfieldSetRuns (&bf2, runs, n));
+  check_int_eq (tr_bitfieldCountTrueBits (&bf), tr_bitfieldCountTrueBits (&bf2));
+  for (i=0; i<bitCount; ++i)
+    check (tr_bitfieldHas (&bf, i) == tr_bitfieldHas (&bf2, i));
+  tr_free (runs);
+
+  /* runs that don't add up to bitCount are rejected */
+  bad[0] = 1;
+  bad[1] = bitCount;
+  check (!tr_bitfieldSetRuns (&bf2, bad, 2));
+  bad[1] = bitCount - 2;
+  check (!tr_bitfieldSetRuns (&bf2, bad, 2));
+  check (!tr_bitfieldSetRuns (&bf2, bad, 0));
+
+  /* all and none */
+  tr_bitfieldSetHasAll (&bf);
+  runs = tr_bitfieldGetRuns (&bf, &n);
+  check_int_eq (2, n);
+  check_int_eq (0, runs[0]);
+  check_int_eq (bitCount, runs[1]);
+  check (tr_bitfieldSetRuns (&bf2, runs, n));
+  check (tr_bitfieldHasAll (&bf2));
+  tr_free (runs);
+  tr_bitfieldSetHasNone (&bf);
+  runs = tr_bitfieldGetRuns (&bf, &n);
+  check_int_eq (1, n);
+  check_int_eq (bitCount, runs[0]);
+  check (tr_bitfieldSetRuns (&bf2, runs, n));
+  check (tr_bitfieldHasNone (&bf2));
+  tr_free (runs);
+
+  /* cleanup */
+  tr_bitfieldDestruct (&bf2);
+  tr_bitfieldDestruct (&bf);
+  return 0;
+}
+
 int
 main (void)
 {
@@ -132,5 +191,10 @@ main (void)
     if ((ret = test_bitfield_count_range ()))
       return ret;
 
+  /* bitfield runs */
+  for (l=0; l<1000; ++l)
+    if ((ret = test_bitfield_runs ()))
+      return ret;
+
   return 0;
 }
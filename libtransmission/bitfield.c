@@ -362,6 +362,134 @@ tr_bitfieldSetFromFlags (tr_bitfield * b, const bool * flags, size_t n)
   tr_bitfieldSetTrueCount (b, trueCount);
 }
 
+/***
+****  Runs
+****
+****  A bitfield can also be described by the lengths of its alternating
+****  runs of unset and set bits, starting with an unset run that may be
+****  empty. That's much smaller than the raw bits when a big torrent is
+****  nearly complete or nearly empty.
+***/
+
+/* find the first bit at or after `begin' that's set to `val' */
+static size_t
+findBit (const tr_bitfield * b, size_t begin, bool val)
+{
+  size_t i = begin;
+  const uint8_t skip = val ? 0x00 : 0xff;
+
+  while (i < b->bit_count)
+    {
+      const size_t byte = i >> 3u;
+      uint8_t bits;
+
+      if (byte >= b->alloc_count)
+        return val ? b->bit_count : i;
+
+      bits = b->bits[byte];
+
+      if (!(i & 7u) && (bits == skip))
+        i += 8;
+      else if (((bits << (i & 7u) & 0x80) != 0) == val)
+        return i;
+      else
+        ++i;
+    }
+
+  return b->bit_count;
+}
+
+size_t*
+tr_bitfieldGetRuns (const tr_bitfield * b, size_t * run_count)
+{
+  size_t n = 0;
+  size_t alloc = 16;
+  size_t * runs = tr_new (size_t, alloc);
+
+  assert (b->bit_count > 0);
+
+  if (tr_bitfieldHasAll (b))
+    {
+      runs[n++] = 0;
+      runs[n++] = b->bit_count;
+    }
+  else if (tr_bitfieldHasNone (b))
+    {
+      runs[n++] = b->bit_count;
+    }
+  else
+    {
+      size_t begin = 0;
+      bool val = false;
+
+      while (begin < b->bit_count)
+        {
+          const size_t end = findBit (b, begin, !val);
+
+          if (n == alloc)
+            {
+              alloc *= 2;
+              runs = tr_renew (size_t, runs, alloc);
+            }
+
+          runs[n++] = end - begin;
+          begin = end;
+          val = !val;
+        }
+    }
+
+  *run_count = n;
+  return runs;
+}
+
+bool
+tr_bitfieldSetRuns (tr_bitfield * b, const size_t * runs, size_t run_count)
+{
+  size_t i;
+  size_t begin;
+  size_t trueCount = 0;
+  uint8_t * bits;
+
+  /* the runs must add up to exactly bit_count */
+  for (i=0, begin=0; i<run_count; ++i)
+    {
+      if (runs[i] > b->bit_count - begin)
+        return false;
+      begin += runs[i];
+    }
+  if (begin != b->bit_count)
+    return false;
+
+  bits = tr_new0 (uint8_t, get_bytes_needed (b->bit_count));
+
+  for (i=1, begin=run_count ? runs[0] : 0; i<run_count; i+=2)
+    {
+      size_t end = begin + runs[i];
+
+      trueCount += runs[i];
+
+      /* set the partial bytes one bit at a time, and the rest with memset */
+      for (; begin<end && (begin & 7u); ++begin)
+        bits[begin >> 3u] |= (0x80 >> (begin & 7u));
+      if (end - begin >= 8)
+        {
+          memset (bits + (begin >> 3u), 0xff, (end - begin) >> 3u);
+          begin += (end - begin) & ~(size_t)7u;
+        }
+      for (; begin<end; ++begin)
+        bits[begin >> 3u] |= (0x80 >> (begin & 7u));
+
+      if (i + 1 < run_count)
+        begin += runs[i + 1];
+    }
+
+  tr_bitfieldFreeArray (b);
+  b->bits = bits;
+  b->alloc_count = get_bytes_needed (b->bit_count);
+  tr_bitfieldSetTrueCount (b, trueCount);
+  return true;
+}
+
 void
 tr_bitfieldAdd (tr_bitfield * b, size_t nth)
 {
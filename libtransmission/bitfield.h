@@ -75,6 +75,13 @@ void   tr_bitfieldSetRaw (tr_bitfield*, const void * bits, size_t byte_count, bo
 
 void*  tr_bitfieldGetRaw (const tr_bitfield * b, size_t * byte_count);
 
+/** @brief the lengths of b's alternating runs of unset and set bits,
+           starting with the unset bits. The array is from tr_malloc () */
+size_t* tr_bitfieldGetRuns (const tr_bitfield * b, size_t * run_count);
+
+/** @return false if the runs don't add up to the bitfield's bit_count */
+bool   tr_bitfieldSetRuns (tr_bitfield*, const size_t * runs, size_t run_count);
+
 /***
 ****
 ***/
@@ -0,0 +1,151 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <stdio.h>
+#include <string.h> /* memset () */
+
+#include "transmission.h"
+#include "catalog.h"
+#include "session.h"
+#include "torrent.h"
+#include "utils.h"
+
+#include "libtransmission-test.h"
+
+static void
+fake_info (tr_info * inf, int seed, const char * name)
+{
+  memset (inf, 0, sizeof (tr_info));
+  memset (inf->hash, seed, SHA_DIGEST_LENGTH);
+  inf->name = (char*) name;
+  inf->totalSize = seed * 1000;
+  inf->pieceCount = seed;
+}
+
+static int
+test_catalog_file (void)
+{
+  FILE * fp;
+  char * path;
+  tr_info inf;
+  tr_session * session;
+  tr_catalog * catalog;
+  const tr_catalog_entry * e;
+  uint8_t unknown[SHA_DIGEST_LENGTH];
+
+  session = libttest_session_init (NULL);
+  path = tr_buildPath (tr_sessionGetConfigDir (session), "test.catalog", NULL);
+  memset (unknown, 0xff, SHA_DIGEST_LENGTH);
+
+  /* a catalog that doesn't exist yet is empty */
+  catalog = tr_catalogNew (path);
+  check_int_eq (0, tr_catalogSize (catalog));
+  check (tr_catalogFind (catalog, unknown) == NULL);
+
+  /* entries can be found before they're saved... */
+  fake_info (&inf, 2, "two");
+  tr_catalogAdd (catalog, "two.torrent", 200, 2000, &inf);
+  fake_info (&inf, 1, "one");
+  tr_catalogAdd (catalog, "one.torrent", 100, 1000, &inf);
+  e = tr_catalogFind (catalog, inf.hash);
+  check (e != NULL);
+  check_streq ("one.torrent", tr_catalogGetFile (catalog, e));
+  check_int_eq (0, tr_catalogSize (catalog));
+
+  /* ...and after */
+  check_int_eq (0, tr_catalogSave (catalog, false));
+  check_int_eq (2, tr_catalogSize (catalog));
+  e = tr_catalogFind (catalog, inf.hash);
+  check (e != NULL);
+  check_streq ("one.torrent", tr_catalogGetFile (catalog, e));
+  check_streq ("one", tr_catalogGetName (catalog, e));
+  check_int_eq (1000, e->totalSize);
+  check_int_eq (1, e->pieceCount);
+  tr_catalogFree (catalog);
+
+  /* reopen it, and look entries up by file */
+  catalog = tr_catalogNew (path);
+  check_int_eq (2, tr_catalogSize (catalog));
+  check (tr_catalogFindFile (catalog, "one.torrent", 100, 1000) != NULL);
+  check (tr_catalogFindFile (catalog, "one.torrent", 101, 1000) == NULL);
+  check (tr_catalogFindFile (catalog, "one.torrent", 100, 1001) == NULL);
+  check (tr_catalogFindFile (catalog, "three.torrent", 100, 1000) == NULL);
+  e = tr_catalogFindFile (catalog, "two.torrent", 200, 2000);
+  check (e != NULL);
+  check_streq ("two", tr_catalogGetName (catalog, e));
+
+  /* merging keeps the old entries */
+  fake_info (&inf, 3, "three");
+  tr_catalogAdd (catalog, "three.torrent", 300, 3000, &inf);
+  check_int_eq (0, tr_catalogSave (catalog, false));
+  check_int_eq (3, tr_catalogSize (catalog));
+
+  /* replacing drops the ones that weren't kept */
+  e = tr_catalogFindFile (catalog, "two.torrent", 200, 2000);
+  check (e != NULL);
+  tr_catalogKeep (catalog, e);
+  check_int_eq (0, tr_catalogSave (catalog, true));
+  check_int_eq (1, tr_catalogSize (catalog));
+  check (tr_catalogFind (catalog, inf.hash) == NULL);
+  check (tr_catalogFindFile (catalog, "two.torrent", 200, 2000) != NULL);
+  tr_catalogFree (catalog);
+
+  /* a corrupt catalog is ignored */
+  fp = fopen (path, "r+");
+  fputs ("garbage", fp);
+  fclose (fp);
+  catalog = tr_catalogNew (path);
+  check_int_eq (0, tr_catalogSize (catalog));
+  tr_catalogFree (catalog);
+
+  tr_free (path);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+test_session_lookup (void)
+{
+  char * path;
+  tr_torrent * tor;
+  tr_session * session;
+  const tr_catalog_entry * e;
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+
+  /* the session finds the .torrent file it saved */
+  path = tr_sessionFindTorrentFile (session, tor->info.hashString);
+  check_streq (tor->info.torrent, path);
+  tr_free (path);
+  check (tr_sessionFindTorrentFile (session, "0000000000000000000000000000000000000000") == NULL);
+  check (tr_sessionFindTorrentFile (session, "") == NULL);
+  check (tr_sessionFindTorrentFile (session, "abc") == NULL);
+  check (tr_sessionFindTorrentFile (session, "zz39a3ee5e6b4b0d3255bfef95601890afd80709") == NULL);
+
+  /* and its catalog describes the torrent */
+  e = tr_catalogFind (session->catalog, tor->info.hash);
+  check (e != NULL);
+  check_streq (tor->info.name, tr_catalogGetName (session->catalog, e));
+  check_int_eq (tor->info.totalSize, e->totalSize);
+  check_int_eq (tor->info.pieceCount, e->pieceCount);
+
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+int
+main (void)
+{
+  const testFunc tests[] = { test_catalog_file,
+                             test_session_lookup };
+
+  return runTests (tests, NUM_TESTS (tests));
+}
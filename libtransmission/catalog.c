@@ -0,0 +1,538 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h> /* bsearch (), qsort () */
+#include <string.h>
+
+#include <unistd.h> /* close () */
+
+#ifdef WIN32
+ #include <w32api.h>
+ #define WINVER  WindowsXP
+ #include <windows.h>
+ #define PROT_READ      PAGE_READONLY
+ #define MAP_PRIVATE    FILE_MAP_COPY
+#endif
+
+#ifndef WIN32
+ #include <sys/mman.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+#include "catalog.h"
+#include "log.h"
+#include "ptrarray.h"
+#include "utils.h"
+
+#ifndef O_BINARY
+ #define O_BINARY 0
+#endif
+
+#ifndef MAP_FAILED
+ #define MAP_FAILED ((void *) -1)
+#endif
+
+/***
+****  PRIVATE
+***/
+
+/* The file is a header, the entries sorted by info hash, then a table of
+   nul-terminated strings. Like the blocklist's binary files it's stored
+   in host order, so a catalog from another machine is simply rebuilt. */
+
+#define CATALOG_MAGIC "TRCATLOG"
+#define CATALOG_VERSION 1
+
+struct tr_catalog_header
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t entrySize;
+  uint32_t entryCount;
+  uint32_t stringsSize;
+};
+
+struct catalog_file
+{
+  const char * file;
+  const tr_catalog_entry * entry;
+};
+
+/* an entry that hasn't been saved yet */
+struct catalog_pending
+{
+  tr_catalog_entry entry;
+  char * file;
+  char * name;
+};
+
+struct tr_catalog
+{
+  char * filename;
+
+  int fd;
+  void * map;
+  size_t mapSize;
+
+  const tr_catalog_entry * entries;
+  size_t entryCount;
+  const char * strings;
+  size_t stringsSize;
+
+  /* `entries' sorted by filename, built on demand */
+  struct catalog_file * byFile;
+
+  /* struct catalog_pending, sorted by info hash */
+  tr_ptrArray pending;
+};
+
+static int
+compareHashes (const void * va, const void * vb)
+{
+  return memcmp (va, vb, SHA_DIGEST_LENGTH);
+}
+
+static int
+comparePendingToHash (const void * va, const void * vb)
+{
+  const struct catalog_pending * a = va;
+
+  return compareHashes (a->entry.hash, vb);
+}
+
+static int
+comparePending (const void * va, const void * vb)
+{
+  const struct catalog_pending * b = vb;
+
+  return comparePendingToHash (va, b->entry.hash);
+}
+
+static void
+pendingFree (void * vp)
+{
+  struct catalog_pending * p = vp;
+
+  tr_free (p->file);
+  tr_free (p->name);
+  tr_free (p);
+}
+
+static bool
+isSaved (const tr_catalog * c, const tr_catalog_entry * e)
+{
+  return c->entryCount > 0
+      && e >= c->entries
+      && e < c->entries + c->entryCount;
+}
+
+static void
+catalogClose (tr_catalog * c)
+{
+  if (c->map != NULL)
+    {
+      munmap (c->map, c->mapSize);
+      close (c->fd);
+      c->map = NULL;
+      c->mapSize = 0;
+      c->fd = -1;
+    }
+
+  c->entries = NULL;
+  c->entryCount = 0;
+  c->strings = NULL;
+  c->stringsSize = 0;
+
+  tr_free (c->byFile);
+  c->byFile = NULL;
+}
+
+static bool
+catalogIsValid (const uint8_t * map, size_t mapSize)
+{
+  size_t i;
+  const tr_catalog_entry * entries;
+  struct tr_catalog_header header;
+
+  if (mapSize < sizeof (header))
+    return false;
+
+  memcpy (&header, map, sizeof (header));
+
+  if (memcmp (header.magic, CATALOG_MAGIC, sizeof (header.magic))
+      || (header.version != CATALOG_VERSION)
+      || (header.entrySize != sizeof (tr_catalog_entry))
+      || (mapSize != sizeof (header) + (uint64_t)header.entryCount * sizeof (tr_catalog_entry) + header.stringsSize))
+    return false;
+
+  if (header.entryCount == 0)
+    return true;
+
+  if ((header.stringsSize == 0) || (map[mapSize-1] != '\0'))
+    return false;
+
+  entries = (const tr_catalog_entry *)(map + sizeof (header));
+  for (i=0; i<header.entryCount; ++i)
+    {
+      if ((entries[i].file >= header.stringsSize) || (entries[i].name >= header.stringsSize))
+        return false;
+
+      if ((i > 0) && (compareHashes (entries[i-1].hash, entries[i].hash) >= 0))
+        return false;
+    }
+
+  return true;
+}
+
+static void
+catalogLoad (tr_catalog * c)
+{
+  int fd;
+  void * map;
+  struct stat st;
+  struct tr_catalog_header header;
+
+  catalogClose (c);
+
+  if (stat (c->filename, &st) == -1)
+    return;
+
+  if (st.st_size < (off_t) sizeof (header))
+    {
+      tr_logAddDebug ("Ignoring truncated catalog \"%s\"", c->filename);
+      return;
+    }
+
+  if ((fd = open (c->filename, O_RDONLY | O_BINARY)) == -1)
+    {
+      tr_logAddError (_("Couldn't read \"%1$s\": %2$s"), c->filename, tr_strerror (errno));
+      return;
+    }
+
+  map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      tr_logAddError (_("Couldn't read \"%1$s\": %2$s"), c->filename, tr_strerror (errno));
+      close (fd);
+      return;
+    }
+
+  if (!catalogIsValid (map, (size_t) st.st_size))
+    {
+      tr_logAddDebug ("Ignoring stale or corrupt catalog \"%s\"", c->filename);
+      munmap (map, (size_t) st.st_size);
+      close (fd);
+      return;
+    }
+
+  memcpy (&header, map, sizeof (header));
+  c->fd = fd;
+  c->map = map;
+  c->mapSize = (size_t) st.st_size;
+  c->entries = (const tr_catalog_entry *)((const uint8_t *)map + sizeof (header));
+  c->entryCount = header.entryCount;
+  c->strings = (const char *)(c->entries + c->entryCount);
+  c->stringsSize = header.stringsSize;
+
+  tr_logAddDebug ("Catalog \"%s\" has %"TR_PRIuSIZE" torrents", c->filename, c->entryCount);
+}
+
+/***
+****  PUBLIC
+***/
+
+tr_catalog *
+tr_catalogNew (const char * filename)
+{
+  tr_catalog * c = tr_new0 (tr_catalog, 1);
+
+  c->filename = tr_strdup (filename);
+  c->fd = -1;
+  c->pending = TR_PTR_ARRAY_INIT;
+  catalogLoad (c);
+
+  return c;
+}
+
+void
+tr_catalogFree (tr_catalog * c)
+{
+  if (c != NULL)
+    {
+      catalogClose (c);
+      tr_ptrArrayDestruct (&c->pending, pendingFree);
+      tr_free (c->filename);
+      tr_free (c);
+    }
+}
+
+int
+tr_catalogSize (const tr_catalog * c)
+{
+  return (int) c->entryCount;
+}
+
+const tr_catalog_entry *
+tr_catalogFind (const tr_catalog * c, const uint8_t * hash)
+{
+  const struct catalog_pending * p;
+
+  p = tr_ptrArrayFindSorted ((tr_ptrArray*)&c->pending, hash, comparePendingToHash);
+  if (p != NULL)
+    return &p->entry;
+
+  if (c->entryCount == 0)
+    return NULL;
+
+  return bsearch (hash, c->entries, c->entryCount, sizeof (tr_catalog_entry), compareHashes);
+}
+
+static int
+compareFiles (const void * va, const void * vb)
+{
+  const struct catalog_file * a = va;
+  const struct catalog_file * b = vb;
+
+  return strcmp (a->file, b->file);
+}
+
+const tr_catalog_entry *
+tr_catalogFindFile (tr_catalog * c,
+                    const char * file,
+                    time_t       mtime,
+                    uint64_t     fileSize)
+{
+  struct catalog_file key;
+  const struct catalog_file * match;
+
+  if (c->entryCount == 0)
+    return NULL;
+
+  if (c->byFile == NULL)
+    {
+      size_t i;
+
+      c->byFile = tr_new (struct catalog_file, c->entryCount);
+      for (i=0; i<c->entryCount; ++i)
+        {
+          c->byFile[i].file = c->strings + c->entries[i].file;
+          c->byFile[i].entry = &c->entries[i];
+        }
+
+      qsort (c->byFile, c->entryCount, sizeof (struct catalog_file), compareFiles);
+    }
+
+  key.file = file;
+  match = bsearch (&key, c->byFile, c->entryCount, sizeof (struct catalog_file), compareFiles);
+
+  if ((match == NULL)
+      || (match->entry->mtime != (int64_t) mtime)
+      || (match->entry->fileSize != fileSize))
+    return NULL;
+
+  return match->entry;
+}
+
+const char *
+tr_catalogGetFile (const tr_catalog * c, const tr_catalog_entry * e)
+{
+  if (isSaved (c, e))
+    return c->strings + e->file;
+
+  return ((const struct catalog_pending *) e)->file;
+}
+
+const char *
+tr_catalogGetName (const tr_catalog * c, const tr_catalog_entry * e)
+{
+  if (isSaved (c, e))
+    return c->strings + e->name;
+
+  return ((const struct catalog_pending *) e)->name;
+}
+
+static void
+catalogAddPending (tr_catalog             * c,
+                   const tr_catalog_entry * entry,
+                   const char             * file,
+                   const char             * name)
+{
+  struct catalog_pending * p;
+
+  p = tr_ptrArrayFindSorted (&c->pending, entry->hash, comparePendingToHash);
+  if (p != NULL)
+    {
+      tr_free (p->file);
+      tr_free (p->name);
+    }
+  else
+    {
+      p = tr_new0 (struct catalog_pending, 1);
+      memcpy (p->entry.hash, entry->hash, SHA_DIGEST_LENGTH);
+      tr_ptrArrayInsertSorted (&c->pending, p, comparePending);
+    }
+
+  p->entry.pieceCount = entry->pieceCount;
+  p->entry.totalSize = entry->totalSize;
+  p->entry.mtime = entry->mtime;
+  p->entry.fileSize = entry->fileSize;
+  p->file = tr_strdup (file);
+  p->name = tr_strdup (name ? name : "");
+}
+
+void
+tr_catalogAdd (tr_catalog    * c,
+               const char    * file,
+               time_t          mtime,
+               uint64_t        fileSize,
+               const tr_info * info)
+{
+  tr_catalog_entry e;
+
+  memset (&e, 0, sizeof (e));
+  memcpy (e.hash, info->hash, SHA_DIGEST_LENGTH);
+  e.pieceCount = info->pieceCount;
+  e.totalSize = info->totalSize;
+  e.mtime = mtime;
+  e.fileSize = fileSize;
+
+  catalogAddPending (c, &e, file, info->name);
+}
+
+void
+tr_catalogKeep (tr_catalog * c, const tr_catalog_entry * e)
+{
+  assert (isSaved (c, e));
+
+  catalogAddPending (c, e, c->strings + e->file, c->strings + e->name);
+}
+
+static void
+appendEntry (struct evbuffer        * entries,
+             struct evbuffer        * strings,
+             const tr_catalog_entry * e,
+             const char             * file,
+             const char             * name)
+{
+  tr_catalog_entry tmp = *e;
+
+  tmp.file = evbuffer_get_length (strings);
+  evbuffer_add (strings, file, strlen (file) + 1);
+  tmp.name = evbuffer_get_length (strings);
+  evbuffer_add (strings, name, strlen (name) + 1);
+
+  evbuffer_add (entries, &tmp, sizeof (tmp));
+}
+
+int
+tr_catalogSave (tr_catalog * c, bool replace)
+{
+  int i;
+  size_t j;
+  int err = 0;
+  size_t len;
+  uint8_t * content;
+  struct tr_catalog_header header;
+  struct evbuffer * buf = evbuffer_new ();
+  struct evbuffer * strings = evbuffer_new ();
+  const int n = tr_ptrArraySize (&c->pending);
+  struct catalog_pending ** pending = (struct catalog_pending **) tr_ptrArrayBase (&c->pending);
+
+  /* merge the pending entries with the saved ones, both sorted by hash */
+  memset (&header, 0, sizeof (header));
+  evbuffer_add (buf, &header, sizeof (header));
+  for (i=0, j=0; i<n || (!replace && j<c->entryCount); )
+    {
+      int cmp;
+
+      if (replace || j == c->entryCount)
+        cmp = -1;
+      else if (i == n)
+        cmp = 1;
+      else
+        cmp = compareHashes (pending[i]->entry.hash, c->entries[j].hash);
+
+      if (cmp <= 0)
+        {
+          appendEntry (buf, strings, &pending[i]->entry, pending[i]->file, pending[i]->name);
+          ++header.entryCount;
+          ++i;
+          if (cmp == 0)
+            ++j;
+        }
+      else
+        {
+          const tr_catalog_entry * e = &c->entries[j++];
+          appendEntry (buf, strings, e, c->strings + e->file, c->strings + e->name);
+          ++header.entryCount;
+        }
+    }
+
+  memcpy (header.magic, CATALOG_MAGIC, sizeof (header.magic));
+  header.version = CATALOG_VERSION;
+  header.entrySize = sizeof (tr_catalog_entry);
+  header.stringsSize = evbuffer_get_length (strings);
+  evbuffer_add_buffer (buf, strings);
+  len = evbuffer_get_length (buf);
+  content = evbuffer_pullup (buf, -1);
+  memcpy (content, &header, sizeof (header));
+
+  tr_ptrArrayDestruct (&c->pending, pendingFree);
+  c->pending = TR_PTR_ARRAY_INIT;
+
+  if ((len != c->mapSize) || memcmp (content, c->map, len))
+    {
+      FILE * out;
+      char * tmp = tr_strdup_printf ("%s.tmp", c->filename);
+
+      if ((out = fopen (tmp, "wb+")) == NULL)
+        {
+          err = errno;
+        }
+      else
+        {
+          if (fwrite (content, 1, len, out) != len)
+            err = errno;
+          if (fclose (out) && !err)
+            err = errno;
+        }
+
+      if (!err)
+        {
+          catalogClose (c);
+          if (tr_rename (tmp, c->filename))
+            err = errno;
+        }
+
+      if (err)
+        {
+          tr_logAddError (_("Couldn't save file \"%1$s\": %2$s"), c->filename, tr_strerror (err));
+          tr_remove (tmp);
+        }
+      else
+        {
+          tr_logAddDebug ("Saved catalog \"%s\" with %u torrents", c->filename, header.entryCount);
+        }
+
+      tr_free (tmp);
+      catalogLoad (c);
+    }
+
+  evbuffer_free (strings);
+  evbuffer_free (buf);
+  return err;
+}
@@ -0,0 +1,89 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#ifndef TR_CATALOG_H
+#define TR_CATALOG_H
+
+/**
+ * The session catalog is a memory-mapped index of the .torrent files in
+ * the config dir's torrents/ folder. It maps each info hash to the file
+ * that holds it, along with enough about the torrent to describe it
+ * without parsing the metainfo again.
+ *
+ * Changes are collected in memory and written by tr_catalogSave ().
+ * Each entry remembers the .torrent's mtime and size so that the
+ * catalog can be brought up to date by re-parsing only the files
+ * that changed.
+ */
+
+typedef struct tr_catalog tr_catalog;
+
+typedef struct tr_catalog_entry
+{
+  uint8_t  hash[SHA_DIGEST_LENGTH];
+  uint32_t pieceCount;
+  uint64_t totalSize;
+  int64_t  mtime;    /* of the .torrent file */
+  uint64_t fileSize; /* of the .torrent file */
+  uint32_t file;     /* string table offset of the .torrent's basename */
+  uint32_t name;     /* string table offset of the torrent's name */
+}
+tr_catalog_entry;
+
+tr_catalog             * tr_catalogNew      (const char       * filename);
+
+void                     tr_catalogFree     (tr_catalog       * catalog);
+
+/** @brief the number of entries in the saved catalog */
+int                      tr_catalogSize     (const tr_catalog * catalog);
+
+/** @brief find the entry for an info hash, whether saved or not */
+const tr_catalog_entry * tr_catalogFind     (const tr_catalog * catalog,
+                                             const uint8_t    * hash);
+
+/** @brief find a saved entry whose .torrent file hasn't changed since */
+const tr_catalog_entry * tr_catalogFindFile (tr_catalog       * catalog,
+                                             const char       * file,
+                                             time_t             mtime,
+                                             uint64_t           fileSize);
+
+const char *             tr_catalogGetFile  (const tr_catalog       * catalog,
+                                             const tr_catalog_entry * entry);
+
+const char *             tr_catalogGetName  (const tr_catalog       * catalog,
+                                             const tr_catalog_entry * entry);
+
+/** @brief add or replace the entry for `info' */
+void                     tr_catalogAdd      (tr_catalog       * catalog,
+                                             const char       * file,
+                                             time_t             mtime,
+                                             uint64_t           fileSize,
+                                             const tr_info    * info);
+
+/** @brief carry a saved entry over to the next tr_catalogSave (true) */
+void                     tr_catalogKeep     (tr_catalog             * catalog,
+                                             const tr_catalog_entry * entry);
+
+/**
+ * @brief write the catalog to disk and map the new file.
+ *
+ * If `replace' is true, the new catalog holds only the entries added or
+ * kept since the last save. Otherwise they're merged into the old one.
+ * Nothing is written if the contents didn't change.
+ *
+ * @return 0 on success, or an errno
+ */
+int                      tr_catalogSave     (tr_catalog       * catalog,
+                                             bool               replace);
+
+#endif
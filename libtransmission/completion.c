@@ -25,6 +25,7 @@ tr_cpReset (tr_completion * cp)
   cp->sizeWhenDoneIsDirty = true;
   cp->haveValidIsDirty = true;
   tr_bitfieldSetHasNone (&cp->blockBitfield);
+  ++cp->generation;
 }
 
 void
@@ -87,6 +88,7 @@ tr_cpPieceRem (tr_completion *  cp, tr_piece_index_t piece)
   cp->haveValidIsDirty = true;
   cp->sizeWhenDoneIsDirty = true;
   tr_bitfieldRemRange (&cp->blockBitfield, f, l+1);
+  ++cp->generation;
 }
 
 void
@@ -113,6 +115,7 @@ tr_cpBlockAdd (tr_completion * cp, tr_block_index_t block)
 
       cp->haveValidIsDirty = true;
       cp->sizeWhenDoneIsDirty |= tor->info.pieces[piece].dnd;
+      ++cp->generation;
     }
 }
 
@@ -288,21 +291,19 @@ tr_cpFileIsComplete (const tr_completion * cp, tr_file_index_t i)
     }
 }
 
-void *
-tr_cpCreatePieceBitfield (const tr_completion * cp, size_t * byte_count)
+static void
+buildPieceBitfield (const tr_completion * cp, tr_bitfield * pieces)
 {
-  void * ret;
   tr_piece_index_t n;
-  tr_bitfield pieces;
 
   assert (tr_torrentHasMetadata (cp->tor));
 
   n = cp->tor->info.pieceCount;
-  tr_bitfieldConstruct (&pieces, n);
+  tr_bitfieldConstruct (pieces, n);
 
   if (tr_cpHasAll (cp))
     {
-      tr_bitfieldSetHasAll (&pieces);
+      tr_bitfieldSetHasAll (pieces);
     }
   else if (!tr_cpHasNone (cp))
     {
@@ -310,15 +311,35 @@ tr_cpCreatePieceBitfield (const tr_completion * cp, size_t * byte_count)
       bool * flags = tr_new (bool, n);
       for (i=0; i<n; ++i)
         flags[i] = tr_cpPieceIsComplete (cp, i);
-      tr_bitfieldSetFromFlags (&pieces, flags, n);
+      tr_bitfieldSetFromFlags (pieces, flags, n);
       tr_free (flags);
     }
+}
 
+void *
+tr_cpCreatePieceBitfield (const tr_completion * cp, size_t * byte_count)
+{
+  void * ret;
+  tr_bitfield pieces;
+
+  buildPieceBitfield (cp, &pieces);
   ret = tr_bitfieldGetRaw (&pieces, byte_count);
   tr_bitfieldDestruct (&pieces);
   return ret;
 }
 
+size_t *
+tr_cpCreatePieceRuns (const tr_completion * cp, size_t * run_count)
+{
+  size_t * ret;
+  tr_bitfield pieces;
+
+  buildPieceBitfield (cp, &pieces);
+  ret = tr_bitfieldGetRuns (&pieces, run_count);
+  tr_bitfieldDestruct (&pieces);
+  return ret;
+}
+
 double
 tr_cpPercentComplete (const tr_completion * cp)
 {
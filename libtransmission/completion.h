@@ -42,6 +42,10 @@ typedef struct tr_completion
 
   /* number of bytes we want or have now. [0..sizeWhenDone] */
   uint64_t sizeNow;
+
+  /* bumped whenever blockBitfield changes, so that things
+     built from it (such as RPC's "pieces") know when to rebuild */
+  uint32_t generation;
 }
 tr_completion;
 
@@ -136,6 +140,8 @@ bool  tr_cpFileIsComplete (const tr_completion * cp, tr_file_index_t);
 
 void* tr_cpCreatePieceBitfield (const tr_completion * cp, size_t * byte_count);
 
+size_t* tr_cpCreatePieceRuns (const tr_completion * cp, size_t * run_count);
+
 static inline void
 tr_cpInvalidateDND (tr_completion * cp)
 {
@@ -0,0 +1,123 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <assert.h>
+
+#include "transmission.h"
+#include "crypto.h"
+#include "inout.h"
+#include "torrent.h"
+#include "utils.h"
+#include "variant.h"
+
+#include "libtransmission-test.h"
+
+static const uint32_t pieceSize = 32 * 1024;
+
+/* a torrent with lots of tiny files, some empty, and a few big ones */
+static tr_torrent *
+create_torrent_with_many_files (tr_session * session, int fileCount)
+{
+  int i;
+  int benc_len;
+  size_t len;
+  char * benc;
+  tr_ctor * ctor;
+  tr_torrent * tor;
+  tr_variant top;
+  tr_variant * info;
+  tr_variant * files;
+  uint8_t * pieces;
+  uint64_t totalSize = 0;
+  int err = 0;
+
+  tr_variantInitDict (&top, 1);
+  info = tr_variantDictAddDict (&top, TR_KEY_info, 4);
+  tr_variantDictAddStr (info, TR_KEY_name, "many-files");
+  tr_variantDictAddInt (info, TR_KEY_piece_length, pieceSize);
+  files = tr_variantDictAddList (info, TR_KEY_files, fileCount);
+  for (i=0; i<fileCount; ++i)
+    {
+      char name[32];
+      const int r = tr_cryptoWeakRandInt (100);
+      const uint64_t length = r < 10 ? 0
+                            : r < 95 ? 1 + tr_cryptoWeakRandInt (2000)
+                            : 1 + tr_cryptoWeakRandInt (4 * pieceSize);
+      tr_variant * file = tr_variantListAddDict (files, 2);
+
+      tr_snprintf (name, sizeof (name), "file%05d", i);
+      tr_variantDictAddInt (file, TR_KEY_length, length);
+      tr_variantListAddStr (tr_variantDictAddList (file, TR_KEY_path, 1), name);
+      totalSize += length;
+    }
+
+  /* the hashes don't matter; nothing is ever verified */
+  len = SHA_DIGEST_LENGTH * ((totalSize + pieceSize - 1) / pieceSize);
+  pieces = tr_new0 (uint8_t, len);
+  tr_variantDictAddRaw (info, TR_KEY_pieces, pieces, len);
+  tr_free (pieces);
+
+  benc = tr_variantToStr (&top, TR_VARIANT_FMT_BENC, &benc_len);
+  ctor = tr_ctorNew (session);
+  tr_ctorSetMetainfo (ctor, (uint8_t*)benc, benc_len);
+  tr_ctorSetPaused (ctor, TR_FORCE, true);
+  tor = tr_torrentNew (ctor, &err, NULL);
+  assert (!err);
+
+  tr_ctorFree (ctor);
+  tr_free (benc);
+  tr_variantFree (&top);
+  return tor;
+}
+
+static int
+test_find_file_location (void)
+{
+  uint64_t offset;
+  tr_file_index_t i = 0;
+  tr_session * session = libttest_session_init (NULL);
+  tr_torrent * tor = create_torrent_with_many_files (session, 2000);
+  const tr_info * inf = tr_torrentInfo (tor);
+
+  /* check bytes all through the torrent against a walk through the files */
+  for (offset=0; offset<inf->totalSize; offset+=1+tr_cryptoWeakRandInt (200))
+    {
+      tr_file_index_t fileIndex;
+      uint64_t fileOffset;
+      const tr_piece_index_t piece = offset / pieceSize;
+      const uint32_t pieceOffset = offset % pieceSize;
+
+      while (offset >= inf->files[i].offset + inf->files[i].length)
+        ++i;
+
+      tr_ioFindFileLocation (tor, piece, pieceOffset, &fileIndex, &fileOffset);
+      check_int_eq (i, fileIndex);
+      check_int_eq (offset - inf->files[i].offset, fileOffset);
+
+      /* a pieceOffset that's past the end of its piece works too */
+      if (piece > 0)
+        {
+          tr_ioFindFileLocation (tor, piece - 1, pieceOffset + pieceSize, &fileIndex, &fileOffset);
+          check_int_eq (i, fileIndex);
+          check_int_eq (offset - inf->files[i].offset, fileOffset);
+        }
+    }
+
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+int
+main (void)
+{
+  const testFunc tests[] = { test_find_file_location };
+
+  return runTests (tests, NUM_TESTS (tests));
+}
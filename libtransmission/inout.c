@@ -172,13 +172,21 @@ tr_ioFindFileLocation (const tr_torrent * tor,
                        uint64_t         * fileOffset)
 {
   const uint64_t  offset = tr_pieceOffset (tor, pieceIndex, pieceOffset, 0);
+  tr_file_index_t first;
+  tr_file_index_t last;
   const tr_file * file;
 
   assert (tr_isTorrent (tor));
   assert (offset < tor->info.totalSize);
 
+  /* only the files in the piece holding `offset' need to be searched.
+     That's usually pieceIndex, but callers may pass a pieceOffset that
+     runs on past the end of the piece */
+  pieceIndex = offset / tor->info.pieceSize;
+  first = tor->pieceFiles[pieceIndex];
+  last = MIN (tor->pieceFiles[pieceIndex + 1], tor->info.fileCount - 1);
   file = bsearch (&offset,
-                  tor->info.files, tor->info.fileCount, sizeof (tr_file),
+                  tor->info.files + first, last + 1 - first, sizeof (tr_file),
                   compareOffsetToFile);
 
   assert (file != NULL);
@@ -310,6 +318,7 @@ tr_ioTestPiece (tr_torrent * tor, tr_piece_index_t piece)
 {
   uint8_t hash[SHA_DIGEST_LENGTH];
 
-  return recalculateHash (tor, piece, hash)
-      && !memcmp (hash, tor->info.pieces[piece].hash, SHA_DIGEST_LENGTH);
+  return tr_torrentEnsurePieceHashes (tor)
+      && recalculateHash (tor, piece, hash)
+      && !memcmp (hash, tor->info.pieceHashes + piece * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH);
 }
@@ -0,0 +1,183 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <stdio.h>
+#include <string.h> /* memcmp () */
+
+#include "transmission.h"
+#include "journal.h"
+#include "resume.h"
+#include "session.h"
+#include "torrent.h"
+#include "utils.h"
+#include "variant.h"
+
+#include "libtransmission-test.h"
+
+static char *
+readFile (const char * dir, const char * name)
+{
+  size_t len;
+  char * path = tr_buildPath (dir, name, NULL);
+  char * contents = (char*) tr_loadFile (path, &len);
+  tr_free (path);
+  return contents;
+}
+
+static void
+writeFile (const char * dir, const char * name, const char * contents)
+{
+  char * path = tr_buildPath (dir, name, NULL);
+  FILE * fp = fopen (path, "wb+");
+  fputs (contents, fp);
+  fclose (fp);
+  tr_free (path);
+}
+
+static bool
+fileExists (const char * dir, const char * name)
+{
+  char * path = tr_buildPath (dir, name, NULL);
+  const bool exists = tr_fileExists (path, NULL);
+  tr_free (path);
+  return exists;
+}
+
+static int
+test_journal (void)
+{
+  char * str;
+  size_t len;
+  char * dir;
+  char * path;
+  tr_session * session;
+  tr_journal * journal;
+
+  session = libttest_session_init (NULL);
+  dir = tr_buildPath (tr_sessionGetConfigDir (session), "journaled", NULL);
+  tr_mkdirp (dir, 0777);
+  path = tr_buildPath (tr_sessionGetConfigDir (session), "test.journal", NULL);
+  writeFile (dir, "old", "old contents");
+
+  /* a journal knows nothing about the files that are already there */
+  journal = tr_journalNew (path, dir);
+  check (!tr_journalGet (journal, "old", &str, &len));
+
+  /* changes can be read back right away... */
+  tr_journalPut (journal, "one", tr_strdup ("first"), 5);
+  tr_journalPut (journal, "one", tr_strdup ("second"), 6);
+  tr_journalPut (journal, "old", NULL, 0);
+  check (tr_journalGet (journal, "one", &str, &len));
+  check_int_eq (6, len);
+  check (!memcmp ("second", str, len));
+  tr_free (str);
+  check (tr_journalGet (journal, "old", &str, &len));
+  check (str == NULL);
+
+  /* ...but only go into the journal file, not the files themselves */
+  tr_journalFlush (journal);
+  check (tr_fileExists (path, NULL));
+  check (!fileExists (dir, "one"));
+  check (fileExists (dir, "old"));
+
+  /* freeing the journal brings the files up to date */
+  tr_journalFree (journal);
+  check (!tr_fileExists (path, NULL));
+  str = readFile (dir, "one");
+  check_streq ("second", str);
+  tr_free (str);
+  check (!fileExists (dir, "old"));
+
+  /* a journal left behind by a crash is read back,
+     up to the first record that was cut short... */
+  writeFile (tr_sessionGetConfigDir (session), "test.journal",
+             "l3:two5:firste" "l3:one4:thise" "l3:two6:secondel3:one");
+  journal = tr_journalNew (path, dir);
+  check (tr_fileExists (path, NULL));
+  check (tr_journalGet (journal, "one", &str, &len));
+  check_int_eq (4, len);
+  check (!memcmp ("this", str, len));
+  tr_free (str);
+  check (tr_journalGet (journal, "two", &str, &len));
+  check_int_eq (6, len);
+  check (!memcmp ("second", str, len));
+  tr_free (str);
+
+  /* ...and can still be added to */
+  tr_journalPut (journal, "three", tr_strdup ("third"), 5);
+  tr_journalFlush (journal);
+  check (tr_journalGet (journal, "three", &str, &len));
+  check (!memcmp ("third", str, len));
+  tr_free (str);
+  check (tr_journalGet (journal, "two", &str, &len));
+  check (!memcmp ("second", str, len));
+  tr_free (str);
+  tr_journalFree (journal);
+  str = readFile (dir, "one");
+  check_streq ("this", str);
+  tr_free (str);
+  str = readFile (dir, "two");
+  check_streq ("second", str);
+  tr_free (str);
+  str = readFile (dir, "three");
+  check_streq ("third", str);
+  tr_free (str);
+
+  /* removals are read back too */
+  writeFile (tr_sessionGetConfigDir (session), "test.journal", "l3:twoe");
+  journal = tr_journalNew (path, dir);
+  check (tr_journalGet (journal, "two", &str, &len));
+  check (str == NULL);
+  tr_journalFree (journal);
+  check (!fileExists (dir, "two"));
+  check (fileExists (dir, "one"));
+
+  tr_free (path);
+  tr_free (dir);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+test_resume (void)
+{
+  const char * str;
+  tr_variant top;
+  tr_torrent * tor;
+  tr_session * session;
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+  check (session->resumeJournal != NULL);
+
+  /* resume files are saved through the journal */
+  tr_torrentSetDownloadDir (tor, "/dev/null");
+  tr_torrentSaveResume (tor);
+  check_int_eq (0, tr_torrentReadResume (tor, &top));
+  check (tr_variantDictFindStr (&top, TR_KEY_destination, &str, NULL));
+  check_streq ("/dev/null", str);
+  tr_variantFree (&top);
+
+  /* and removed through it */
+  tr_torrentRemoveResume (tor);
+  check (tr_torrentReadResume (tor, &top) != 0);
+
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+int
+main (void)
+{
+  const testFunc tests[] = { test_journal,
+                             test_resume };
+
+  return runTests (tests, NUM_TESTS (tests));
+}
@@ -0,0 +1,684 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <assert.h>
+#include <ctype.h> /* isdigit () */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h> /* strtoul () */
+#include <string.h>
+
+#include <unistd.h> /* close (), ftruncate (), write () */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include <event2/buffer.h>
+
+#include "transmission.h"
+#include "fdlimit.h" /* tr_pread () */
+#include "journal.h"
+#include "log.h"
+#include "platform.h" /* tr_lock, tr_threadNew () */
+#include "ptrarray.h"
+#include "utils.h"
+
+#ifndef O_BINARY
+ #define O_BINARY 0
+#endif
+
+/***
+****  PRIVATE
+***/
+
+/* The journal file is a sequence of bencoded lists, one per change:
+   "l<name><contents>e" to replace a file, or "l<name>e" to remove it.
+   Only the index of the latest change to each file is kept in memory;
+   the contents are read back from the journal when they're needed.
+   A record that was cut short by a crash is dropped when it's opened. */
+
+enum
+{
+  /* how long the writer waits for more changes before appending them */
+  GROUP_COMMIT_MSEC = 50,
+
+  /* The journal is folded back into its files once it's at least this
+     big and at least half of it has been superseded by newer records */
+  COMPACT_SIZE = (4 * 1024 * 1024)
+};
+
+struct journal_entry
+{
+  char * name;
+  char * contents;   /* set until this version's safely in the journal */
+  size_t len;
+  uint64_t offset;   /* where the contents are in the journal file */
+  unsigned int version;
+  bool removed;
+  bool written;      /* true once this version's been appended */
+};
+
+struct tr_journal
+{
+  char * filename;
+  char * dir;
+  int fd;            /* for appending. only the writer uses it */
+  int readFd;
+  uint64_t size;
+  uint64_t liveSize; /* the total length of the latest contents */
+  bool writerIsRunning;
+  tr_lock * lock;
+  tr_ptrArray entries; /* struct journal_entry, sorted by name */
+};
+
+static int
+compareEntryToName (const void * va, const void * vb)
+{
+  const struct journal_entry * a = va;
+  const char * name = vb;
+
+  return strcmp (a->name, name);
+}
+
+static int
+compareEntries (const void * va, const void * vb)
+{
+  const struct journal_entry * b = vb;
+
+  return compareEntryToName (va, b->name);
+}
+
+static void
+entryFree (void * ve)
+{
+  struct journal_entry * e = ve;
+
+  tr_free (e->contents);
+  tr_free (e->name);
+  tr_free (e);
+}
+
+static struct journal_entry *
+findEntry (tr_journal * j, const char * name)
+{
+  return tr_ptrArrayFindSorted (&j->entries, name, compareEntryToName);
+}
+
+static struct journal_entry *
+getEntry (tr_journal * j, const char * name, size_t namelen)
+{
+  struct journal_entry * e;
+  char * key = tr_strndup (name, namelen);
+
+  if ((e = findEntry (j, key)) == NULL)
+    {
+      e = tr_new0 (struct journal_entry, 1);
+      e->name = key;
+      tr_ptrArrayInsertSorted (&j->entries, e, compareEntries);
+    }
+  else
+    {
+      tr_free (key);
+    }
+
+  j->liveSize -= e->len;
+  return e;
+}
+
+static void
+removeEntry (tr_journal * j, struct journal_entry * e)
+{
+  j->liveSize -= e->len;
+  tr_ptrArrayRemoveSortedPointer (&j->entries, e, compareEntries);
+  entryFree (e);
+}
+
+/* adds e's record to `buf', which will be appended at `base' */
+static void
+appendRecord (struct evbuffer * buf, struct journal_entry * e, uint64_t base)
+{
+  const size_t namelen = strlen (e->name);
+
+  evbuffer_add_printf (buf, "l%"TR_PRIuSIZE":", namelen);
+  evbuffer_add (buf, e->name, namelen);
+  if (!e->removed)
+    {
+      evbuffer_add_printf (buf, "%"TR_PRIuSIZE":", e->len);
+      e->offset = base + evbuffer_get_length (buf);
+      evbuffer_add (buf, e->contents, e->len);
+    }
+  evbuffer_add (buf, "e", 1);
+}
+
+/* @return a tr_malloc ()ed copy of e's contents */
+static char *
+readContents (tr_journal * j, const struct journal_entry * e)
+{
+  char * ret;
+  size_t n;
+
+  if (e->contents != NULL)
+    return tr_memdup (e->contents, e->len);
+
+  ret = tr_new (char, e->len + 1);
+  for (n=0; n<e->len; )
+    {
+      const ssize_t got = tr_pread (j->readFd, ret + n, e->len - n, e->offset + n);
+      if (got <= 0)
+        break;
+      n += got;
+    }
+
+  if (n < e->len)
+    {
+      tr_logAddError (_("Couldn't read \"%1$s\": %2$s"), j->filename, tr_strerror (errno));
+      tr_free (ret);
+      return NULL;
+    }
+
+  return ret;
+}
+
+static int
+writeAll (int fd, const void * buf, size_t len)
+{
+  const char * walk = buf;
+
+  while (len > 0)
+    {
+      const ssize_t n = write (fd, walk, len);
+
+      if (n >= 0)
+        {
+          walk += n;
+          len -= n;
+        }
+      else if (errno != EAGAIN && errno != EINTR)
+        {
+          return errno;
+        }
+    }
+
+  return 0;
+}
+
+/* write `contents' to `filename' through a temporary file */
+static int
+writeFile (const char * filename, const void * contents, size_t len)
+{
+  int err = 0;
+  FILE * out;
+  char * tmp = tr_strdup_printf ("%s.tmp", filename);
+
+  if ((out = fopen (tmp, "wb+")) == NULL)
+    {
+      err = errno;
+    }
+  else
+    {
+      if (fwrite (contents, 1, len, out) != len)
+        err = errno;
+      if (fclose (out) && !err)
+        err = errno;
+    }
+
+  if (!err && tr_rename (tmp, filename))
+    err = errno;
+
+  if (err)
+    {
+      tr_logAddError (_("Couldn't save file \"%1$s\": %2$s"), filename, tr_strerror (err));
+      tr_remove (tmp);
+    }
+
+  tr_free (tmp);
+  return err;
+}
+
+static void
+journalClose (tr_journal * j)
+{
+  if (j->fd >= 0)
+    close (j->fd);
+  if (j->readFd >= 0)
+    close (j->readFd);
+
+  j->fd = j->readFd = -1;
+}
+
+static bool
+journalOpen (tr_journal * j)
+{
+  if (j->fd < 0)
+    {
+      j->fd = open (j->filename, O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0600);
+      if (j->fd >= 0)
+        j->readFd = open (j->filename, O_RDONLY | O_BINARY);
+
+      if (j->readFd < 0)
+        {
+          tr_logAddError (_("Couldn't open \"%1$s\": %2$s"), j->filename, tr_strerror (errno));
+          journalClose (j);
+        }
+    }
+
+  return j->fd >= 0;
+}
+
+/* Write the latest version of each entry to its file, then start a new
+   journal holding whatever couldn't be written or changed in the
+   meantime. The event thread can keep calling tr_journalPut () while
+   the files are being written. */
+static void
+journalCompact (tr_journal * j)
+{
+  int i, n;
+  int err = 0;
+  uint64_t * offsets;
+  struct evbuffer * buf;
+  struct compact_item { char * name; unsigned int version; bool saved; } * items;
+
+  tr_lockLock (j->lock);
+  n = tr_ptrArraySize (&j->entries);
+  items = tr_new (struct compact_item, n);
+  for (i=0; i<n; ++i)
+    {
+      const struct journal_entry * e = tr_ptrArrayNth (&j->entries, i);
+      items[i].name = tr_strdup (e->name);
+      items[i].version = e->version;
+      items[i].saved = false;
+    }
+  tr_lockUnlock (j->lock);
+
+  for (i=0; i<n; ++i)
+    {
+      char * path;
+      char * contents = NULL;
+      size_t len = 0;
+      bool removed = false;
+      struct journal_entry * e;
+
+      tr_lockLock (j->lock);
+      e = findEntry (j, items[i].name);
+      if (e != NULL && e->version == items[i].version)
+        {
+          removed = e->removed;
+          len = e->len;
+          if (!removed)
+            contents = readContents (j, e);
+        }
+      else
+        {
+          e = NULL; /* if it changed since, the new version stays in the journal */
+        }
+      tr_lockUnlock (j->lock);
+
+      if (e == NULL || (!removed && contents == NULL))
+        continue;
+
+      path = tr_buildPath (j->dir, items[i].name, NULL);
+      if (removed)
+        items[i].saved = !tr_remove (path) || errno == ENOENT;
+      else
+        items[i].saved = !writeFile (path, contents, len);
+      tr_free (path);
+      tr_free (contents);
+    }
+
+  tr_lockLock (j->lock);
+
+  for (i=0; i<n; ++i)
+    {
+      struct journal_entry * e;
+
+      if (items[i].saved && ((e = findEntry (j, items[i].name))) && (e->version == items[i].version))
+        removeEntry (j, e);
+
+      tr_free (items[i].name);
+    }
+
+  /* the new journal keeps the offsets of the old one's contents
+     until it's safely in place */
+  buf = evbuffer_new ();
+  n = tr_ptrArraySize (&j->entries);
+  offsets = tr_new (uint64_t, n);
+  for (i=0; i<n; ++i)
+    {
+      struct journal_entry * e = tr_ptrArrayNth (&j->entries, i);
+      const uint64_t offset = e->offset;
+
+      /* anything not written yet is left to the writer */
+      if (!e->written)
+        continue;
+
+      if (!e->removed && e->contents == NULL && (e->contents = readContents (j, e)) == NULL)
+        {
+          err = EIO;
+          break;
+        }
+
+      appendRecord (buf, e, 0);
+      offsets[i] = e->offset;
+      e->offset = offset;
+    }
+
+  if (!err)
+    {
+      journalClose (j);
+
+      if (evbuffer_get_length (buf) == 0)
+        tr_remove (j->filename);
+      else
+        err = writeFile (j->filename, evbuffer_pullup (buf, -1), evbuffer_get_length (buf));
+    }
+
+  for (i=0; i<n; ++i)
+    {
+      struct journal_entry * e = tr_ptrArrayNth (&j->entries, i);
+
+      if (!err && e->written)
+        {
+          e->offset = offsets[i];
+          tr_free (e->contents);
+          e->contents = NULL;
+        }
+    }
+
+  if (!err)
+    {
+      j->size = evbuffer_get_length (buf);
+      if (j->size > 0)
+        journalOpen (j);
+    }
+  else if (j->fd < 0)
+    {
+      /* the old journal and its offsets are still good */
+      journalOpen (j);
+    }
+
+  tr_lockUnlock (j->lock);
+
+  evbuffer_free (buf);
+  tr_free (offsets);
+  tr_free (items);
+}
+
+static void
+journalWriterFunc (void * vj)
+{
+  tr_journal * j = vj;
+
+  for (;;)
+    {
+      int i, n;
+      int err = 0;
+      size_t len;
+      bool compact;
+      struct evbuffer * buf;
+      struct batch_item { struct journal_entry * e; unsigned int version; } * batch;
+      int batchCount = 0;
+
+      /* let the rest of a burst of changes catch up */
+      tr_wait_msec (GROUP_COMMIT_MSEC);
+
+      buf = evbuffer_new ();
+      tr_lockLock (j->lock);
+      n = tr_ptrArraySize (&j->entries);
+      batch = tr_new (struct batch_item, n);
+      for (i=0; i<n; ++i)
+        {
+          struct journal_entry * e = tr_ptrArrayNth (&j->entries, i);
+
+          if (!e->written)
+            {
+              appendRecord (buf, e, j->size);
+              e->written = true;
+              batch[batchCount].e = e;
+              batch[batchCount].version = e->version;
+              ++batchCount;
+            }
+        }
+      len = evbuffer_get_length (buf);
+      if (len == 0)
+        j->writerIsRunning = false;
+      tr_lockUnlock (j->lock);
+
+      if (len == 0)
+        {
+          evbuffer_free (buf);
+          tr_free (batch);
+          break;
+        }
+
+      if (!journalOpen (j))
+        {
+          err = EIO;
+        }
+      else if ((err = writeAll (j->fd, evbuffer_pullup (buf, -1), len)))
+        {
+          tr_logAddError (_("Couldn't save file \"%1$s\": %2$s"), j->filename, tr_strerror (err));
+          if (ftruncate (j->fd, j->size)) /* drop the partial record */
+            journalClose (j);
+        }
+      evbuffer_free (buf);
+
+      tr_lockLock (j->lock);
+      if (!err)
+        {
+          /* the journal has these now, so let go of them
+             unless they've been replaced in the meantime */
+          for (i=0; i<batchCount; ++i)
+            {
+              struct journal_entry * e = batch[i].e;
+
+              if (e->version == batch[i].version)
+                {
+                  tr_free (e->contents);
+                  e->contents = NULL;
+                }
+            }
+
+          j->size += len;
+        }
+      compact = err || (j->size >= COMPACT_SIZE && j->size >= 2 * j->liveSize);
+      tr_lockUnlock (j->lock);
+      tr_free (batch);
+
+      /* if the journal couldn't be written, the changes are still
+         in memory and compacting will try their own files instead */
+      if (compact)
+        journalCompact (j);
+    }
+}
+
+static int
+parseStr (const uint8_t * buf, const uint8_t * end,
+          const uint8_t ** setme_str, size_t * setme_len)
+{
+  char * colon;
+  size_t len;
+
+  if (buf >= end || !isdigit (*buf))
+    return 0;
+
+  errno = 0;
+  len = strtoul ((const char *) buf, &colon, 10);
+  if (errno || (const uint8_t *) colon >= end || *colon != ':' || len > (size_t)(end - (const uint8_t *) colon - 1))
+    return 0;
+
+  *setme_str = (const uint8_t *) colon + 1;
+  *setme_len = len;
+  return (*setme_str + len) - buf;
+}
+
+/* index the records in the journal file, dropping any torn tail */
+static void
+journalReplay (tr_journal * j)
+{
+  size_t len;
+  uint8_t * content;
+  const uint8_t * walk;
+  const uint8_t * end;
+  int count = 0;
+
+  if ((content = tr_loadFile (j->filename, &len)) == NULL)
+    return;
+
+  walk = content;
+  end = content + len;
+  while (walk < end)
+    {
+      int n;
+      const uint8_t * rec = walk;
+      const uint8_t * name;
+      const uint8_t * contents = NULL;
+      size_t namelen, contentslen = 0;
+      struct journal_entry * e;
+
+      if (*rec != 'l' || !(n = parseStr (rec + 1, end, &name, &namelen)) || !namelen)
+        break;
+      rec += 1 + n;
+      if (rec < end && *rec != 'e')
+        {
+          if (!(n = parseStr (rec, end, &contents, &contentslen)))
+            break;
+          rec += n;
+        }
+      if (rec >= end || *rec != 'e')
+        break;
+      walk = rec + 1;
+
+      e = getEntry (j, (const char *) name, namelen);
+      tr_free (e->contents);
+      e->contents = NULL;
+      e->removed = contents == NULL;
+      e->len = contentslen;
+      e->offset = contents ? (uint64_t)(contents - content) : 0;
+      e->written = true;
+      j->liveSize += e->len;
+      ++count;
+    }
+
+  j->size = walk - content;
+  if (j->size < len)
+    tr_logAddDebug ("Dropping the last %"TR_PRIuSIZE" bytes of \"%s\"", len - (size_t)j->size, j->filename);
+  tr_logAddDebug ("Found %d changes in \"%s\"", count, j->filename);
+  tr_free (content);
+
+  if (journalOpen (j) && j->size < len && ftruncate (j->fd, j->size))
+    tr_logAddError (_("Couldn't truncate \"%1$s\": %2$s"), j->filename, tr_strerror (errno));
+}
+
+/***
+****  PUBLIC
+***/
+
+tr_journal *
+tr_journalNew (const char * filename, const char * dir)
+{
+  tr_journal * j = tr_new0 (tr_journal, 1);
+
+  j->filename = tr_strdup (filename);
+  j->dir = tr_strdup (dir);
+  j->fd = j->readFd = -1;
+  j->lock = tr_lockNew ();
+  j->entries = TR_PTR_ARRAY_INIT;
+
+  journalReplay (j);
+
+  return j;
+}
+
+void
+tr_journalFree (tr_journal * j)
+{
+  if (j == NULL)
+    return;
+
+  tr_journalFlush (j);
+  journalCompact (j);
+  journalClose (j);
+
+  tr_ptrArrayDestruct (&j->entries, entryFree);
+  tr_lockFree (j->lock);
+  tr_free (j->dir);
+  tr_free (j->filename);
+  tr_free (j);
+}
+
+void
+tr_journalPut (tr_journal * j, const char * name, char * contents, size_t len)
+{
+  struct journal_entry * e;
+
+  assert (j != NULL);
+  assert (name && *name);
+
+  tr_lockLock (j->lock);
+
+  e = getEntry (j, name, strlen (name));
+  tr_free (e->contents);
+  e->contents = contents;
+  e->removed = contents == NULL;
+  e->len = contents ? len : 0;
+  e->version++;
+  e->written = false;
+  j->liveSize += e->len;
+
+  if (!j->writerIsRunning)
+    {
+      j->writerIsRunning = true;
+      tr_threadNew (journalWriterFunc, j);
+    }
+
+  tr_lockUnlock (j->lock);
+}
+
+bool
+tr_journalGet (tr_journal * j, const char * name, char ** setme, size_t * setme_len)
+{
+  bool found = false;
+  const struct journal_entry * e;
+
+  assert (j != NULL);
+  assert (setme != NULL);
+
+  tr_lockLock (j->lock);
+
+  if ((e = findEntry (j, name)) != NULL)
+    {
+      *setme = NULL;
+      found = e->removed || ((*setme = readContents (j, e)) != NULL);
+      if (setme_len != NULL)
+        *setme_len = e->len;
+    }
+
+  tr_lockUnlock (j->lock);
+
+  return found;
+}
+
+void
+tr_journalFlush (tr_journal * j)
+{
+  for (;;)
+    {
+      bool running;
+
+      tr_lockLock (j->lock);
+      running = j->writerIsRunning;
+      tr_lockUnlock (j->lock);
+
+      if (!running)
+        break;
+
+      tr_wait_msec (10);
+    }
+}
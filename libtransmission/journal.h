@@ -0,0 +1,67 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#ifndef TR_JOURNAL_H
+#define TR_JOURNAL_H
+
+/**
+ * A journal puts off writing a directory of small files.
+ *
+ * tr_journalPut () only records the new contents in memory. A writer
+ * thread appends whatever changed to one journal file a moment later,
+ * so a burst of changes costs a single write () instead of a temporary
+ * file and a rename per file. When the journal grows too big, and when
+ * it's freed, its records are folded back into the files themselves, so
+ * the directory always ends up looking the same as if each file had
+ * been written directly. Until then, tr_journalGet () finds the records
+ * that are newer than their files, including ones left by an earlier
+ * session.
+ */
+
+typedef struct tr_journal tr_journal;
+
+/** @brief open the journal `filename' for the files in `dir',
+           indexing the records an earlier session left in it */
+tr_journal * tr_journalNew   (const char * filename,
+                              const char * dir);
+
+/** @brief write everything to the files in `dir' and free the journal */
+void         tr_journalFree  (tr_journal * journal);
+
+/**
+ * @brief replace the contents of `dir/name'.
+ *
+ * The journal takes ownership of `contents', which must come from
+ * tr_malloc (). A NULL `contents' removes the file.
+ */
+void         tr_journalPut   (tr_journal * journal,
+                              const char * name,
+                              char       * contents,
+                              size_t       len);
+
+/**
+ * @brief look for contents that may not be in `dir/name' yet.
+ *
+ * @return false if the journal has nothing newer than the file.
+ *         Otherwise `setme' is a tr_malloc ()ed copy of the contents,
+ *         or NULL if the file has been removed.
+ */
+bool         tr_journalGet   (tr_journal * journal,
+                              const char * name,
+                              char      ** setme,
+                              size_t     * setme_len);
+
+/** @brief block until all pending changes are in the journal file */
+void         tr_journalFlush (tr_journal * journal);
+
+#endif
@@ -7,6 +7,7 @@
  * $Id$
  */
 
+#include <errno.h> /* EILSEQ */
 #include <string.h> /* strlen () */
 
 #include <locale.h> /* setlocale() */
@@ -229,6 +230,178 @@ test_unescape (void)
     return 0;
 }
 
+static int
+test_malformed (void)
+{
+    size_t i;
+    const char * inputs[] = { "{", "[", "}", "]", "[1,]", "{\"a\":1,}", "[,1]",
+                              "{\"a\" 1}", "{\"a\":}", "{1:2}", "[1 2]", "[\"a\" \"b\"]",
+                              "[01]", "[1.]", "[-]", "[.5]", "[1e]", "[tru]", "[nullx]",
+                              "[\"unterminated]", "[\"a\\\"]", "[]]", "{} x", "{}{}",
+                              "\"string\"", "5", "true" };
+
+    for (i=0; i<sizeof (inputs) / sizeof (inputs[0]); ++i)
+    {
+        tr_variant top;
+        const int err = tr_variantFromJson (&top, inputs[i], strlen (inputs[i]));
+        check_int_eq (EILSEQ, err);
+        check (!tr_variantIsDict (&top));
+        check (!tr_variantIsList (&top));
+    }
+
+    return 0;
+}
+
+static int
+test_nesting (void)
+{
+    int i;
+    char in[256];
+    tr_variant top;
+    tr_variant * v;
+
+    /* as deep as we allow */
+    for (i=0; i<64; ++i)
+    {
+        in[i] = '[';
+        in[64+i] = ']';
+    }
+    check (!tr_variantFromJson (&top, in, 128));
+    for (i=0, v=&top; tr_variantIsList (v) && tr_variantListSize (v) == 1; ++i)
+        v = tr_variantListChild (v, 0);
+    check_int_eq (63, i);
+    check (tr_variantIsList (v));
+    tr_variantFree (&top);
+
+    /* one level too deep */
+    memmove (in + 1, in, 128);
+    in[0] = '[';
+    in[129] = ']';
+    check_int_eq (EILSEQ, tr_variantFromJson (&top, in, 130));
+
+    return 0;
+}
+
+static int
+test_numbers (void)
+{
+    int64_t i;
+    double d;
+    tr_variant top;
+    const char * in = "[0, -0, 12345678901234, -42, 1.5, -0.25, 1e3, 2.5E-1, 1E+2]";
+
+    check (!tr_variantFromJson (&top, in, strlen (in)));
+    check_int_eq (9, tr_variantListSize (&top));
+    check (tr_variantGetInt (tr_variantListChild (&top, 0), &i));
+    check_int_eq (0, i);
+    check (tr_variantGetInt (tr_variantListChild (&top, 1), &i));
+    check_int_eq (0, i);
+    check (tr_variantGetInt (tr_variantListChild (&top, 2), &i));
+    check_int_eq (INT64_C (12345678901234), i);
+    check (tr_variantGetInt (tr_variantListChild (&top, 3), &i));
+    check_int_eq (-42, i);
+    check (tr_variantIsReal (tr_variantListChild (&top, 4)));
+    check (tr_variantGetReal (tr_variantListChild (&top, 4), &d));
+    check_int_eq (150, (int)(d * 100));
+    check (tr_variantGetReal (tr_variantListChild (&top, 5), &d));
+    check_int_eq (-25, (int)(d * 100));
+    check (tr_variantIsReal (tr_variantListChild (&top, 6)));
+    check (tr_variantGetReal (tr_variantListChild (&top, 6), &d));
+    check_int_eq (1000, (int)d);
+    check (tr_variantGetReal (tr_variantListChild (&top, 7), &d));
+    check_int_eq (25, (int)(d * 100));
+    check (tr_variantGetReal (tr_variantListChild (&top, 8), &d));
+    check_int_eq (100, (int)d);
+    tr_variantFree (&top);
+
+    /* longer than the parser's scratch buffer */
+    in = "[2.00000000000000000000000000000000000000000000000000000000000000000000000001]";
+    check (!tr_variantFromJson (&top, in, strlen (in)));
+    check (tr_variantGetReal (tr_variantListChild (&top, 0), &d));
+    check_int_eq (200, (int)(d * 100));
+    tr_variantFree (&top);
+
+    return 0;
+}
+
+/* RPC bodies aren't NUL-terminated, so neither is the input here */
+static int
+test_truncated (void)
+{
+    size_t i;
+    const char * inputs[] = { "[12345678", "[-1.5e3", "{\"a\":42", "[true" };
+
+    for (i=0; i<sizeof (inputs) / sizeof (inputs[0]); ++i)
+    {
+        tr_variant top;
+        const size_t len = strlen (inputs[i]);
+        char * in = tr_memdup (inputs[i], len);
+        check_int_eq (EILSEQ, tr_variantFromJson (&top, in, len));
+        tr_free (in);
+    }
+
+    return 0;
+}
+
+/* the parser reads its input 64 bytes at a time, so make sure
+   quotes and backslashes work wherever they fall in a block */
+static int
+test_block_boundaries (void)
+{
+    int pad;
+    int slashes;
+
+    for (pad=0; pad<140; ++pad)
+    {
+        for (slashes=0; slashes<4; ++slashes)
+        {
+            int j;
+            char str[256];
+            char * json;
+            size_t len;
+            size_t str_len;
+            const char * val;
+            tr_variant top;
+            tr_variant * list;
+
+            /* a string with runs of backslashes and quotes in it */
+            for (j=0; j<pad; ++j)
+                str[j] = 'a';
+            for (j=0; j<slashes; ++j)
+                str[pad+j] = '\\';
+            str[pad+slashes] = '"';
+            str[pad+slashes+1] = ',';
+            str[pad+slashes+2] = ']';
+            str[pad+slashes+3] = '\0';
+            str_len = pad + slashes + 3;
+
+            tr_variantInitDict (&top, 2);
+            list = tr_variantDictAddList (&top, toQuark ("list"), 3);
+            tr_variantListAddStr (list, str);
+            tr_variantListAddInt (list, pad);
+            tr_variantListAddStr (list, "after");
+            tr_variantDictAddBool (&top, toQuark ("done"), true);
+            json = tr_variantToStr (&top, TR_VARIANT_FMT_JSON_LEAN, NULL);
+            tr_variantFree (&top);
+
+            check (!tr_variantFromJson (&top, json, strlen (json)));
+            list = tr_variantDictFind (&top, toQuark ("list"));
+            check (list != NULL);
+            check_int_eq (3, tr_variantListSize (list));
+            check (tr_variantGetStr (tr_variantListChild (list, 0), &val, &len));
+            check_int_eq (str_len, len);
+            check (!memcmp (str, val, len));
+            check (tr_variantGetStr (tr_variantListChild (list, 2), &val, NULL));
+            check_streq ("after", val);
+            check (tr_variantDictFind (&top, toQuark ("done")) != NULL);
+            tr_variantFree (&top);
+            tr_free (json);
+        }
+    }
+
+    return 0;
+}
+
 int
 main (void)
 {
@@ -245,7 +418,12 @@ main (void)
                              test1,
                              test2,
                              test3,
-                             test_unescape };
+                             test_unescape,
+                             test_malformed,
+                             test_nesting,
+                             test_numbers,
+                             test_truncated,
+                             test_block_boundaries };
 
   /* run the tests in a locale with a decimal point of '.' */
   setlocale (LC_NUMERIC, "C");
@@ -7,9 +7,17 @@
  * $Id$
  */
 
+#include <string.h> /* memset () */
+#include <time.h> /* time () */
+
 #include "transmission.h"
+#include "crypto.h"
 #include "magnet.h"
+#include "net.h"
+#include "torrent.h"
+#include "torrent-magnet.h"
 #include "utils.h"
+#include "variant.h"
 
 #include "libtransmission-test.h"
 
@@ -64,5 +72,143 @@ test1 (void)
     return 0;
 }
 
-MAIN_SINGLE_TEST (test1)
+/* an info dict that's big enough to take several metadata pieces */
+static char *
+create_info_dict (int * setme_len)
+{
+    int i;
+    char * ret;
+    tr_variant info;
+    tr_variant * files;
+    uint8_t pieces[SHA_DIGEST_LENGTH];
+
+    tr_variantInitDict (&info, 4);
+    tr_variantDictAddStr (&info, TR_KEY_name, "metadata-test");
+    tr_variantDictAddInt (&info, TR_KEY_piece_length, 32768);
+    files = tr_variantDictAddList (&info, TR_KEY_files, 3000);
+    for (i=0; i<3000; ++i)
+    {
+        char name[32];
+        tr_variant * file = tr_variantListAddDict (files, 2);
+        tr_snprintf (name, sizeof (name), "file%05d", i);
+        tr_variantDictAddInt (file, TR_KEY_length, i == 0 ? 1 : 0);
+        tr_variantListAddStr (tr_variantDictAddList (file, TR_KEY_path, 1), name);
+    }
+    memset (pieces, 0, sizeof (pieces));
+    tr_variantDictAddRaw (&info, TR_KEY_pieces, pieces, sizeof (pieces));
+
+    ret = tr_variantToStr (&info, TR_VARIANT_FMT_BENC, setme_len);
+    tr_variantFree (&info);
+    return ret;
+}
+
+static void
+set_piece (tr_torrent * tor, const tr_address * addr,
+           const char * metadata, int metadata_len, int piece)
+{
+    const int offset = piece * METADATA_PIECE_SIZE;
+    const int len = MIN (METADATA_PIECE_SIZE, metadata_len - offset);
+    tr_torrentSetMetadataPiece (tor, addr, piece, metadata + offset, len);
+}
+
+static int
+test_metadata_fetch (void)
+{
+    int i;
+    int n;
+    int piece;
+    int len;
+    char * link;
+    char * metadata;
+    char * bad;
+    char hex[SHA_DIGEST_LENGTH*2 + 1];
+    uint8_t hash[SHA_DIGEST_LENGTH];
+    tr_address a, b, c;
+    tr_ctor * ctor;
+    tr_torrent * tor;
+    tr_session * session;
+    time_t now = time (NULL);
+
+    session = libttest_session_init (NULL);
+    metadata = create_info_dict (&len);
+    n = (len + METADATA_PIECE_SIZE - 1) / METADATA_PIECE_SIZE;
+    check (n >= 3);
+    tr_sha1 (hash, metadata, len, NULL);
+    tr_sha1_to_hex (hex, hash);
+    link = tr_strdup_printf ("magnet:?xt=urn:btih:%s", hex);
+    tr_address_from_string (&a, "10.0.0.1");
+    tr_address_from_string (&b, "10.0.0.2");
+    tr_address_from_string (&c, "10.0.0.3");
+
+    ctor = tr_ctorNew (session);
+    tr_ctorSetMetainfoFromMagnetLink (ctor, link);
+    tr_ctorSetPaused (ctor, TR_FORCE, true);
+    tor = tr_torrentNew (ctor, NULL, NULL);
+    tr_ctorFree (ctor);
+    check (tor != NULL);
+    check (!tr_torrentHasMetadata (tor));
+    tr_torrentSetMetadataSizeHint (tor, len);
+
+    /* one peer can have all the pieces requested at once */
+    for (i=0; i<n; ++i)
+    {
+        check (tr_torrentGetNextMetadataRequest (tor, &a, now, &piece));
+        check_int_eq (i, piece);
+    }
+    check (!tr_torrentGetNextMetadataRequest (tor, &b, now, &piece));
+
+    /* a rejected piece can be asked for again right away */
+    tr_torrentMetadataRequestRejected (tor, 1);
+    check (tr_torrentGetNextMetadataRequest (tor, &b, now, &piece));
+    check_int_eq (1, piece);
+
+    /* a bad piece costs everything... */
+    bad = tr_memdup (metadata, len);
+    bad[METADATA_PIECE_SIZE + 1] ^= 1;
+    set_piece (tor, &a, metadata, len, 0);
+    set_piece (tor, &b, bad, len, 1);
+    for (i=2; i<n; ++i)
+        set_piece (tor, &a, metadata, len, i);
+    check (!tr_torrentHasMetadata (tor));
+    check (tr_torrentGetMetadataPercent (tor) < 0.01);
+
+    /* ...and then a single peer fetches it alone */
+    now += 60;
+    check (tr_torrentGetNextMetadataRequest (tor, &c, now, &piece));
+    check (!tr_torrentGetNextMetadataRequest (tor, &a, now, &piece));
+    set_piece (tor, &a, metadata, len, 0);
+    check (tr_torrentGetMetadataPercent (tor) < 0.01);
+    set_piece (tor, &c, metadata, len, 0);
+    set_piece (tor, &c, metadata, len, 1);
+    check (tr_torrentGetMetadataPercent (tor) > 0.01);
+
+    /* pieces are saved and picked up again later */
+    tr_torrentSaveIncompleteMetadata (tor);
+    tr_torrentFreeIncompleteMetadata (tor);
+    check (tr_torrentGetMetadataPercent (tor) < 0.01);
+    tr_torrentSetMetadataSizeHint (tor, len);
+    check_int_eq ((int)(100.0 * 2 / n), (int)(100.0 * tr_torrentGetMetadataPercent (tor)));
+
+    /* the rest of the pieces finish it */
+    for (i=2; i<n; ++i)
+        set_piece (tor, &b, metadata, len, i);
+    check (tr_torrentHasMetadata (tor));
+    check_int_eq (3000, tor->info.fileCount);
+
+    tr_torrentRemove (tor, false, NULL);
+    libttest_session_close (session);
+    tr_free (bad);
+    tr_free (link);
+    tr_free (metadata);
+    return 0;
+}
+
+int
+main (void)
+{
+    const testFunc tests[] = { test1,
+                               test_metadata_fetch };
+
+    return runTests (tests, NUM_TESTS (tests));
+}
 
@@ -0,0 +1,177 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <stdio.h>
+#include <string.h> /* memcmp () */
+#include <unistd.h> /* unlink () */
+
+#include "transmission.h"
+#include "crypto.h"
+#include "makemeta.h"
+#include "utils.h"
+#include "variant.h"
+
+#include "libtransmission-test.h"
+
+/* big enough that the pieces are read in several chunks */
+static const size_t fileSizes[] = { 5 * 1024 * 1024 + 1, 7, 5 * 1024 * 1024 - 3 };
+
+#define FILE_COUNT (sizeof (fileSizes) / sizeof (fileSizes[0]))
+
+static const uint32_t pieceSize = 16 * 1024;
+
+/* write the test files into `dir' and return their contents, end to end */
+static uint8_t *
+createFiles (const char * dir, size_t * setme_len)
+{
+  size_t i;
+  size_t j;
+  size_t len = 0;
+  uint8_t * contents;
+
+  for (i=0; i<FILE_COUNT; ++i)
+    len += fileSizes[i];
+  contents = tr_new (uint8_t, len);
+  for (j=0; j<len; ++j)
+    contents[j] = (uint8_t) tr_cryptoWeakRandInt (256);
+
+  tr_mkdirp (dir, 0777);
+  for (i=0, j=0; i<FILE_COUNT; j+=fileSizes[i], ++i)
+    {
+      char name[16];
+      char * path;
+      FILE * fp;
+
+      tr_snprintf (name, sizeof (name), "file%d", (int)i);
+      path = tr_buildPath (dir, name, NULL);
+      fp = fopen (path, "wb+");
+      fwrite (contents + j, 1, fileSizes[i], fp);
+      fclose (fp);
+      tr_free (path);
+    }
+
+  *setme_len = len;
+  return contents;
+}
+
+static tr_metainfo_builder *
+makeMetaInfo (const char * dir, const char * outfile, int threadCount)
+{
+  tr_metainfo_builder * b = tr_metaInfoBuilderCreate (dir);
+
+  tr_metaInfoBuilderSetPieceSize (b, pieceSize);
+  tr_metaInfoBuilderSetThreadCount (b, threadCount);
+  tr_makeMetaInfo (b, outfile, NULL, 0, NULL, false);
+  while (!b->isDone)
+    tr_wait_msec (10);
+
+  return b;
+}
+
+static int
+test_hashes (void)
+{
+  int i;
+  size_t len;
+  size_t off;
+  uint8_t * contents;
+  uint8_t * expected;
+  uint8_t * walk;
+  char * dir;
+  char * outfile;
+  tr_session * session;
+  const int threadCounts[] = { 1, 4 };
+
+  session = libttest_session_init (NULL);
+  dir = tr_buildPath (tr_sessionGetConfigDir (session), "data", NULL);
+  outfile = tr_buildPath (tr_sessionGetConfigDir (session), "data.torrent", NULL);
+  contents = createFiles (dir, &len);
+
+  /* hash the pieces here, the slow way */
+  expected = tr_new (uint8_t, SHA_DIGEST_LENGTH * (len / pieceSize + 1));
+  for (walk=expected, off=0; off<len; off+=pieceSize, walk+=SHA_DIGEST_LENGTH)
+    tr_sha1 (walk, contents + off, (int) MIN (pieceSize, len - off), NULL);
+
+  /* however many threads hash the pieces, they're in the same order */
+  for (i=0; i<(int)(sizeof (threadCounts) / sizeof (threadCounts[0])); ++i)
+    {
+      tr_variant top;
+      tr_variant * info;
+      const uint8_t * pieces;
+      size_t pieces_len;
+      tr_metainfo_builder * b = makeMetaInfo (dir, outfile, threadCounts[i]);
+
+      check_int_eq (TR_MAKEMETA_OK, b->result);
+      check_int_eq (FILE_COUNT, b->fileCount);
+      check_int_eq (b->pieceCount, b->pieceIndex);
+      check_int_eq (walk - expected, SHA_DIGEST_LENGTH * b->pieceCount);
+      check_int_eq (0, tr_variantFromFile (&top, TR_VARIANT_FMT_BENC, outfile));
+      check (tr_variantDictFindDict (&top, TR_KEY_info, &info));
+      check (tr_variantDictFindRaw (info, TR_KEY_pieces, &pieces, &pieces_len));
+      check_int_eq (walk - expected, pieces_len);
+      check (!memcmp (expected, pieces, pieces_len));
+
+      tr_variantFree (&top);
+      tr_metaInfoBuilderFree (b);
+      unlink (outfile);
+    }
+
+  tr_free (expected);
+  tr_free (contents);
+  tr_free (outfile);
+  tr_free (dir);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+test_read_error (void)
+{
+  size_t len;
+  char * dir;
+  char * path;
+  char * outfile;
+  uint8_t * contents;
+  tr_session * session;
+  tr_metainfo_builder * b;
+
+  session = libttest_session_init (NULL);
+  dir = tr_buildPath (tr_sessionGetConfigDir (session), "data", NULL);
+  outfile = tr_buildPath (tr_sessionGetConfigDir (session), "data.torrent", NULL);
+  contents = createFiles (dir, &len);
+
+  /* a file that's gone by the time it's read is reported */
+  b = tr_metaInfoBuilderCreate (dir);
+  path = tr_buildPath (b->top, "file2", NULL);
+  unlink (path);
+  tr_metaInfoBuilderSetThreadCount (b, 4);
+  tr_makeMetaInfo (b, outfile, NULL, 0, NULL, false);
+  while (!b->isDone)
+    tr_wait_msec (10);
+  check_int_eq (TR_MAKEMETA_IO_READ, b->result);
+  check_streq (path, b->errfile);
+  check (!tr_fileExists (outfile, NULL));
+  tr_metaInfoBuilderFree (b);
+
+  tr_free (path);
+  tr_free (contents);
+  tr_free (outfile);
+  tr_free (dir);
+  libttest_session_close (session);
+  return 0;
+}
+
+int
+main (void)
+{
+  const testFunc tests[] = { test_hashes,
+                             test_read_error };
+
+  return runTests (tests, NUM_TESTS (tests));
+}
@@ -161,6 +161,7 @@ tr_metaInfoBuilderCreate (const char * topFileArg)
          builderFileCompare);
 
   tr_metaInfoBuilderSetPieceSize (ret, bestPieceSize (ret->totalSize));
+  ret->threadCount = tr_getCpuCount ();
 
   return ret;
 }
@@ -176,6 +177,12 @@ tr_metaInfoBuilderSetPieceSize (tr_metainfo_builder * b,
     ++b->pieceCount;
 }
 
+void
+tr_metaInfoBuilderSetThreadCount (tr_metainfo_builder * b,
+                                  int                   count)
+{
+  b->threadCount = count > 0 ? count : tr_getCpuCount ();
+}
 
 void
 tr_metaInfoBuilderFree (tr_metainfo_builder * builder)
@@ -202,97 +209,310 @@ tr_metaInfoBuilderFree (tr_metainfo_builder * builder)
 *****
 ****/
 
+/* Pieces are read in chunks of at least this many bytes so that small
+   pieces don't turn into lots of small reads. Each chunk holds a whole
+   number of pieces and is hashed by one worker. */
+#define HASH_CHUNK_SIZE (4 * 1024 * 1024)
+
+/* how many chunks each worker can have waiting to be hashed */
+#define HASH_CHUNKS_PER_WORKER 2
+
+/* the disk is usually the bottleneck long before this many threads are,
+   and each of them needs chunks of its own */
+#define MAX_HASH_WORKERS 8
+
+/* cap on the memory held in chunks, whatever the piece size */
+#define MAX_HASH_BUFFER_BYTES (64 * 1024 * 1024)
+
+/* the threads poll for chunks, backing off up to this long when idle */
+#define MAX_HASH_WAIT_MSEC 8
+
+enum
+{
+  CHUNK_EMPTY,
+  CHUNK_FULL,
+  CHUNK_HASHING
+};
+
+struct hash_chunk
+{
+  int state;
+  uint8_t * buf;
+  uint64_t len;
+  uint32_t firstPiece;
+};
+
+struct hash_data
+{
+  tr_metainfo_builder * b;
+  uint8_t * hashes;
+  tr_lock * lock;
+  struct hash_chunk * chunks;
+  int chunkCount;
+  int runningWorkers;
+  bool done;
+};
+
+static void
+waitForChunk (int * msec)
+{
+  tr_wait_msec (*msec);
+  *msec = MIN (*msec * 2, MAX_HASH_WAIT_MSEC);
+}
+
+static void
+hashChunk (const tr_metainfo_builder * b,
+           uint8_t                   * hashes,
+           const struct hash_chunk   * chunk)
+{
+  uint64_t off;
+  uint8_t * walk = hashes + SHA_DIGEST_LENGTH * (size_t)chunk->firstPiece;
+
+  for (off=0; off<chunk->len; off+=b->pieceSize)
+    {
+      const uint32_t thisPieceSize = (uint32_t) MIN (b->pieceSize, chunk->len - off);
+      tr_sha1 (walk, chunk->buf + off, thisPieceSize, NULL);
+      walk += SHA_DIGEST_LENGTH;
+    }
+}
+
+static uint32_t
+getChunkPieceCount (const tr_metainfo_builder * b, const struct hash_chunk * chunk)
+{
+  return (uint32_t)((chunk->len + b->pieceSize - 1) / b->pieceSize);
+}
+
+static void
+hashWorkerFunc (void * vdata)
+{
+  struct hash_data * data = vdata;
+  tr_metainfo_builder * b = data->b;
+  int msec = 1;
+
+  tr_lockLock (data->lock);
+
+  for (;;)
+    {
+      int i;
+      struct hash_chunk * chunk = NULL;
+
+      for (i=0; chunk==NULL && i<data->chunkCount; ++i)
+        if (data->chunks[i].state == CHUNK_FULL)
+          chunk = &data->chunks[i];
+
+      if (chunk != NULL)
+        {
+          chunk->state = CHUNK_HASHING;
+          tr_lockUnlock (data->lock);
+
+          hashChunk (b, data->hashes, chunk);
+
+          tr_lockLock (data->lock);
+          chunk->state = CHUNK_EMPTY;
+          b->pieceIndex += getChunkPieceCount (b, chunk);
+          msec = 1;
+        }
+      else if (data->done)
+        {
+          break;
+        }
+      else
+        {
+          tr_lockUnlock (data->lock);
+          waitForChunk (&msec);
+          tr_lockLock (data->lock);
+        }
+    }
+
+  --data->runningWorkers;
+  tr_lockUnlock (data->lock);
+}
+
+/* fill `chunk' with the next chunk->len bytes of the files,
+   moving on to the next file whenever one runs out */
+static bool
+readChunk (tr_metainfo_builder * b,
+           struct hash_chunk   * chunk,
+           tr_file_index_t     * fileIndex,
+           uint64_t            * off,
+           int                 * fd)
+{
+  uint64_t left = chunk->len;
+  uint8_t * bufptr = chunk->buf;
+
+  while (left)
+    {
+      size_t n_this_pass;
+      ssize_t n_read;
+
+      if (*fd < 0)
+        {
+          *fd = tr_open_file_for_scanning (b->files[*fileIndex].filename);
+          if (*fd < 0)
+            break;
+        }
+
+      n_this_pass = (size_t) MIN (b->files[*fileIndex].size - *off, left);
+      n_read = read (*fd, bufptr, n_this_pass);
+      if (n_read <= 0)
+        {
+          if (n_read == 0)
+            errno = EIO; /* the file shrank since the builder was made */
+          break;
+        }
+
+      bufptr += n_read;
+      *off += n_read;
+      left -= n_read;
+
+      if (*off == b->files[*fileIndex].size)
+        {
+          *off = 0;
+          tr_close_file (*fd);
+          *fd = -1;
+          ++*fileIndex;
+        }
+    }
+
+  if (left)
+    {
+      b->my_errno = errno;
+      tr_strlcpy (b->errfile,
+                  b->files[*fileIndex].filename,
+                  sizeof (b->errfile));
+      b->result = TR_MAKEMETA_IO_READ;
+      return false;
+    }
+
+  return true;
+}
+
+/* One thread reads the files from start to finish in big sequential
+   chunks, and up to b->threadCount workers (but no more than
+   MAX_HASH_WORKERS) hash the chunks it's read.
+   Each chunk's hashes go straight to their place in the pieces list, so
+   the order the workers finish in doesn't matter. */
 static uint8_t*
 getHashInfo (tr_metainfo_builder * b)
 {
-  uint32_t fileIndex = 0;
-  uint8_t *ret = tr_new0 (uint8_t, SHA_DIGEST_LENGTH * b->pieceCount);
-  uint8_t *walk = ret;
-  uint8_t *buf;
-  uint64_t totalRemain;
+  int i;
+  int fd = -1;
+  int msec;
+  int workerCount;
+  int maxChunks;
   uint64_t off = 0;
-  int fd;
+  uint64_t totalRemain;
+  uint64_t chunkSize;
+  uint32_t piece = 0;
+  tr_file_index_t fileIndex = 0;
+  struct hash_data data;
+  bool ok = true;
+  uint8_t *ret = tr_new0 (uint8_t, SHA_DIGEST_LENGTH * b->pieceCount);
+
+  b->pieceIndex = 0;
 
   if (!b->totalSize)
     return ret;
 
-  buf = tr_valloc (b->pieceSize);
-  b->pieceIndex = 0;
-  totalRemain = b->totalSize;
-  fd = tr_open_file_for_scanning (b->files[fileIndex].filename);
-  if (fd < 0)
+  chunkSize = b->pieceSize * (uint64_t) MAX (1, HASH_CHUNK_SIZE / b->pieceSize);
+  maxChunks = (int) MAX (2, MAX_HASH_BUFFER_BYTES / chunkSize);
+  workerCount = b->threadCount > 0 ? b->threadCount : tr_getCpuCount ();
+  workerCount = MIN (workerCount, MAX_HASH_WORKERS);
+  workerCount = MIN (workerCount, maxChunks - 1); /* leave one for the reader */
+  workerCount = (int) MIN ((uint64_t)workerCount, (b->totalSize + chunkSize - 1) / chunkSize);
+
+  memset (&data, 0, sizeof (data));
+  data.b = b;
+  data.hashes = ret;
+  data.lock = tr_lockNew ();
+  data.chunkCount = workerCount > 1 ? MIN (workerCount * HASH_CHUNKS_PER_WORKER, maxChunks) : 1;
+  data.chunks = tr_new0 (struct hash_chunk, data.chunkCount);
+  for (i=0; i<data.chunkCount; ++i)
+    data.chunks[i].buf = tr_valloc (chunkSize);
+
+  /* with only one thread to use, there's nothing to gain
+     from handing the chunks off to another one */
+  if (workerCount > 1)
     {
-      b->my_errno = errno;
-      tr_strlcpy (b->errfile,
-                  b->files[fileIndex].filename,
-                  sizeof (b->errfile));
-      b->result = TR_MAKEMETA_IO_READ;
-      tr_free (buf);
-      tr_free (ret);
-      return NULL;
+      data.runningWorkers = workerCount;
+      for (i=0; i<workerCount; ++i)
+        tr_threadNew (hashWorkerFunc, &data);
     }
 
-  while (totalRemain)
+  totalRemain = b->totalSize;
+  for (i=0; ok && totalRemain; i=(i+1)%data.chunkCount)
     {
-      uint8_t * bufptr = buf;
-      const uint32_t thisPieceSize = (uint32_t) MIN (b->pieceSize, totalRemain);
-      uint32_t leftInPiece = thisPieceSize;
+      struct hash_chunk * chunk = &data.chunks[i];
 
-      assert (b->pieceIndex < b->pieceCount);
+      if (b->abortFlag)
+        {
+          b->result = TR_MAKEMETA_CANCELLED;
+          ok = false;
+          break;
+        }
 
-      while (leftInPiece)
+      /* wait for a worker to finish with this chunk */
+      msec = 1;
+      tr_lockLock (data.lock);
+      while (chunk->state != CHUNK_EMPTY)
         {
-          const size_t n_this_pass = (size_t) MIN ((b->files[fileIndex].size - off), leftInPiece);
-          const ssize_t n_read = read (fd, bufptr, n_this_pass);
-          bufptr += n_read;
-          off += n_read;
-          leftInPiece -= n_read;
-          if (off == b->files[fileIndex].size)
-            {
-              off = 0;
-              tr_close_file (fd);
-              fd = -1;
-              if (++fileIndex < b->fileCount)
-                {
-                  fd = tr_open_file_for_scanning (b->files[fileIndex].filename);
-                  if (fd < 0)
-                    {
-                      b->my_errno = errno;
-                      tr_strlcpy (b->errfile,
-                                  b->files[fileIndex].filename,
-                                  sizeof (b->errfile));
-                      b->result = TR_MAKEMETA_IO_READ;
-                      tr_free (buf);
-                      tr_free (ret);
-                      return NULL;
-                    }
-                }
-            }
+          tr_lockUnlock (data.lock);
+          waitForChunk (&msec);
+          tr_lockLock (data.lock);
         }
+      tr_lockUnlock (data.lock);
 
-      assert (bufptr - buf == (int)thisPieceSize);
-      assert (leftInPiece == 0);
-      tr_sha1 (walk, buf, thisPieceSize, NULL);
-      walk += SHA_DIGEST_LENGTH;
+      chunk->len = MIN (chunkSize, totalRemain);
+      chunk->firstPiece = piece;
+      ok = readChunk (b, chunk, &fileIndex, &off, &fd);
 
-      if (b->abortFlag)
+      if (ok)
         {
-          b->result = TR_MAKEMETA_CANCELLED;
-          break;
+          totalRemain -= chunk->len;
+          piece += getChunkPieceCount (b, chunk);
+
+          if (workerCount > 1)
+            {
+              tr_lockLock (data.lock);
+              chunk->state = CHUNK_FULL;
+              tr_lockUnlock (data.lock);
+            }
+          else
+            {
+              hashChunk (b, ret, chunk);
+              b->pieceIndex = piece;
+            }
         }
+    }
 
-      totalRemain -= thisPieceSize;
-      ++b->pieceIndex;
+  /* let the workers finish what's been read, then wait for them to exit */
+  msec = 1;
+  tr_lockLock (data.lock);
+  data.done = true;
+  while (data.runningWorkers > 0)
+    {
+      tr_lockUnlock (data.lock);
+      waitForChunk (&msec);
+      tr_lockLock (data.lock);
     }
+  tr_lockUnlock (data.lock);
 
-  assert (b->abortFlag
-        || (walk - ret == (int)(SHA_DIGEST_LENGTH * b->pieceCount)));
-  assert (b->abortFlag || !totalRemain);
+  assert (!ok || (piece == b->pieceCount));
+  assert (!ok || (b->pieceIndex == b->pieceCount));
 
   if (fd >= 0)
     tr_close_file (fd);
+  for (i=0; i<data.chunkCount; ++i)
+    tr_free (data.chunks[i].buf);
+  tr_free (data.chunks);
+  tr_lockFree (data.lock);
+
+  if (!ok && (b->result != TR_MAKEMETA_CANCELLED))
+    {
+      tr_free (ret);
+      ret = NULL;
+    }
 
-  tr_free (buf);
   return ret;
 }
 
@@ -46,6 +46,7 @@ typedef struct tr_metainfo_builder
     uint32_t                    pieceSize;
     uint32_t                    pieceCount;
     int                         isSingleFile;
+    int                         threadCount;
 
     /**
     ***  These are set inside tr_makeMetaInfo ()
@@ -97,6 +98,15 @@ tr_metainfo_builder * tr_metaInfoBuilderCreate (const char * topFile);
 void tr_metaInfoBuilderSetPieceSize (tr_metainfo_builder * builder,
                                      uint32_t              bytes);
 
+/**
+ * Call this before tr_makeMetaInfo() to change how many threads hash
+ * the pieces. tr_metainfoBuilderCreate() defaults to one per CPU,
+ * which is also what a count of 0 or less means. No more than 8 are
+ * used, and fewer for very large pieces, to bound the memory they need.
+ */
+void tr_metaInfoBuilderSetThreadCount (tr_metainfo_builder * builder,
+                                       int                   count);
+
 void tr_metaInfoBuilderFree (tr_metainfo_builder*);
 
 /**
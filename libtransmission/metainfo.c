@@ -17,9 +17,10 @@
 
 #include <event2/buffer.h>
 
+#include <openssl/sha.h>
+
 #include "transmission.h"
 #include "session.h"
-#include "crypto.h" /* tr_sha1 */
 #include "log.h"
 #include "metainfo.h"
 #include "platform.h" /* tr_getTorrentDir () */
@@ -422,15 +423,28 @@ tr_metainfoParseImpl (const tr_session  * session,
     }
   else
     {
-      int len;
-      char * bstr = tr_variantToStr (infoDict, TR_VARIANT_FMT_BENC, &len);
-      tr_sha1 (inf->hash, bstr, len, NULL);
+      int n;
+      int chunk;
+      SHA_CTX sha;
+      struct evbuffer_iovec * vec;
+      struct evbuffer * buf = tr_variantToBuf (infoDict, TR_VARIANT_FMT_BENC);
+
+      /* hash the bencoded dict where it lies, rather than
+         copying the whole thing (and its pieces) into one string */
+      n = evbuffer_peek (buf, -1, NULL, NULL, 0);
+      vec = tr_new (struct evbuffer_iovec, n);
+      evbuffer_peek (buf, -1, NULL, vec, n);
+      SHA1_Init (&sha);
+      for (chunk=0; chunk<n; ++chunk)
+        SHA1_Update (&sha, vec[chunk].iov_base, vec[chunk].iov_len);
+      SHA1_Final (inf->hash, &sha);
       tr_sha1_to_hex (inf->hashString, inf->hash);
 
       if (infoDictLength != NULL)
-        *infoDictLength = len;
+        *infoDictLength = evbuffer_get_length (buf);
 
-      tr_free (bstr);
+      tr_free (vec);
+      evbuffer_free (buf);
     }
 
   /* name */
@@ -493,8 +507,7 @@ tr_metainfoParseImpl (const tr_session  * session,
 
       inf->pieceCount = len / SHA_DIGEST_LENGTH;
       inf->pieces = tr_new0 (tr_piece, inf->pieceCount);
-      for (i=0; i<inf->pieceCount; i++)
-        memcpy (inf->pieces[i].hash, &raw[i * SHA_DIGEST_LENGTH], SHA_DIGEST_LENGTH);
+      inf->pieceHashes = tr_memdup (raw, len);
     }
 
   /* files */
@@ -562,6 +575,7 @@ tr_metainfoFree (tr_info * inf)
 
   tr_free (inf->webseeds);
   tr_free (inf->pieces);
+  tr_free (inf->pieceHashes);
   tr_free (inf->files);
   tr_free (inf->comment);
   tr_free (inf->creator);
@@ -145,6 +145,42 @@ peer_io_push_datatype (tr_peerIo * io, struct tr_datatype * datatype)
 ****
 ***/
 
+/* When the backend supports it, a TCP socket's read and write events are
+ * registered once as persistent and edge-triggered, and pendingEvents becomes
+ * a userspace gate: enabling or disabling a direction (which bandwidth
+ * allocation does for every peer, every period) no longer costs an
+ * event_add ()/event_del () and the epoll_ctl () behind it.
+ * Since an edge is only reported once, readiness that arrives while the
+ * gate is closed is remembered in readyEvents and replayed on enable.
+ * A short read or write doesn't prove the socket is drained, since
+ * evbuffer caps reads and bandwidth caps both, so readiness is only
+ * cleared when the socket says EAGAIN. */
+static bool
+io_is_edge_triggered (const tr_peerIo * io)
+{
+    return (event_base_get_features (io->session->event_base) & EV_FEATURE_ET) != 0;
+}
+
+/* returns false if the gate for this direction is closed */
+static bool
+io_gate_event (tr_peerIo * io, short event)
+{
+    if (io_is_edge_triggered (io))
+    {
+        io->readyEvents |= event;
+
+        if (! (io->pendingEvents & event))
+            return false;
+    }
+
+    io->pendingEvents &= ~event;
+    return true;
+}
+
+/***
+****
+***/
+
 static void
 didWriteWrapper (tr_peerIo * io, unsigned int bytes_transferred)
 {
@@ -258,7 +294,8 @@ event_read_cb (evutil_socket_t fd, short event UNUSED, void * vio)
     assert (tr_isPeerIo (io));
     assert (io->socket >= 0);
 
-    io->pendingEvents &= ~EV_READ;
+    if (!io_gate_event (io, EV_READ))
+        return;
 
     curlen = evbuffer_get_length (io->inbuf);
     howmuch = curlen >= max ? 0 : max - curlen;
@@ -292,6 +329,8 @@ event_read_cb (evutil_socket_t fd, short event UNUSED, void * vio)
             what |= BEV_EVENT_EOF;
         else if (res == -1) {
             if (e == EAGAIN || e == EINTR) {
+                if (e == EAGAIN)
+                    io->readyEvents &= ~EV_READ;
                 tr_peerIoSetEnabled (io, dir, true);
                 return;
             }
@@ -335,7 +374,8 @@ event_write_cb (evutil_socket_t fd, short event UNUSED, void * vio)
     assert (tr_isPeerIo (io));
     assert (io->socket >= 0);
 
-    io->pendingEvents &= ~EV_WRITE;
+    if (!io_gate_event (io, EV_WRITE))
+        return;
 
     dbgmsg (io, "libevent says this peer is ready to write");
 
@@ -354,8 +394,11 @@ event_write_cb (evutil_socket_t fd, short event UNUSED, void * vio)
     e = EVUTIL_SOCKET_ERROR ();
 
     if (res == -1) {
-        if (!e || e == EAGAIN || e == EINTR || e == EINPROGRESS)
+        if (!e || e == EAGAIN || e == EINTR || e == EINPROGRESS) {
+            if (e == EAGAIN)
+                io->readyEvents &= ~EV_WRITE;
             goto reschedule;
+        }
         /* error case */
         what |= BEV_EVENT_ERROR;
     } else if (res == 0) {
@@ -389,6 +432,28 @@ event_write_cb (evutil_socket_t fd, short event UNUSED, void * vio)
 ***
 **/
 
+static void
+io_new_socket_events (tr_peerIo * io)
+{
+    struct event_base * base = io->session->event_base;
+
+    io->pendingEvents = 0;
+    io->readyEvents = 0;
+
+    if (io_is_edge_triggered (io))
+    {
+        io->event_read = event_new (base, io->socket, EV_READ | EV_PERSIST | EV_ET, event_read_cb, io);
+        io->event_write = event_new (base, io->socket, EV_WRITE | EV_PERSIST | EV_ET, event_write_cb, io);
+        event_add (io->event_read, NULL);
+        event_add (io->event_write, NULL);
+    }
+    else
+    {
+        io->event_read = event_new (base, io->socket, EV_READ, event_read_cb, io);
+        io->event_write = event_new (base, io->socket, EV_WRITE, event_write_cb, io);
+    }
+}
+
 static void
 maybeSetCongestionAlgorithm (int socket, const char * algorithm)
 {
@@ -631,10 +696,7 @@ tr_peerIoNew (tr_session       * session,
     dbgmsg (io, "socket is %d, utp_socket is %p", socket, (void*)utp_socket);
 
     if (io->socket >= 0) {
-        io->event_read = event_new (session->event_base,
-                                    io->socket, EV_READ, event_read_cb, io);
-        io->event_write = event_new (session->event_base,
-                                     io->socket, EV_WRITE, event_write_cb, io);
+        io_new_socket_events (io);
     }
 #ifdef WITH_UTP
     else {
@@ -720,7 +782,12 @@ event_enable (tr_peerIo * io, short event)
     {
         dbgmsg (io, "enabling ready-to-read polling");
         if (io->socket >= 0)
-            event_add (io->event_read, NULL);
+        {
+            if (!io_is_edge_triggered (io))
+                event_add (io->event_read, NULL);
+            else if (io->readyEvents & EV_READ)
+                event_active (io->event_read, EV_READ, 0);
+        }
         io->pendingEvents |= EV_READ;
     }
 
@@ -728,7 +795,12 @@ event_enable (tr_peerIo * io, short event)
     {
         dbgmsg (io, "enabling ready-to-write polling");
         if (io->socket >= 0)
-            event_add (io->event_write, NULL);
+        {
+            if (!io_is_edge_triggered (io))
+                event_add (io->event_write, NULL);
+            else if ((io->readyEvents & EV_WRITE) && evbuffer_get_length (io->outbuf))
+                event_active (io->event_write, EV_WRITE, 0);
+        }
         io->pendingEvents |= EV_WRITE;
     }
 }
@@ -749,7 +821,7 @@ event_disable (struct tr_peerIo * io, short event)
     if ((event & EV_READ) && (io->pendingEvents & EV_READ))
     {
         dbgmsg (io, "disabling ready-to-read polling");
-        if (io->socket >= 0)
+        if (io->socket >= 0 && !io_is_edge_triggered (io))
             event_del (io->event_read);
         io->pendingEvents &= ~EV_READ;
     }
@@ -757,7 +829,7 @@ event_disable (struct tr_peerIo * io, short event)
     if ((event & EV_WRITE) && (io->pendingEvents & EV_WRITE))
     {
         dbgmsg (io, "disabling ready-to-write polling");
-        if (io->socket >= 0)
+        if (io->socket >= 0 && !io_is_edge_triggered (io))
             event_del (io->event_write);
         io->pendingEvents &= ~EV_WRITE;
     }
@@ -936,11 +1008,10 @@ tr_peerIoReconnect (tr_peerIo * io)
     io_close_socket (io);
 
     io->socket = tr_netOpenPeerSocket (session, &io->addr, io->port, io->isSeed);
-    io->event_read = event_new (session->event_base, io->socket, EV_READ, event_read_cb, io);
-    io->event_write = event_new (session->event_base, io->socket, EV_WRITE, event_write_cb, io);
 
     if (io->socket >= 0)
     {
+        io_new_socket_events (io);
         event_enable (io, pendingEvents);
         tr_netSetTOS (io->socket, session->peerSocketTOS);
         maybeSetCongestionAlgorithm (io->socket, session->peer_congestion_algorithm);
@@ -1036,6 +1107,8 @@ tr_peerIoSetEncryption (tr_peerIo * io, tr_encryption_type encryption_type)
     assert (encryption_type == PEER_ENCRYPTION_NONE
          || encryption_type == PEER_ENCRYPTION_RC4);
 
+    assert (io->inbuf_decrypted == 0);
+
     io->encryption_type = encryption_type;
 }
 
@@ -1128,40 +1201,81 @@ evbuffer_add_uint64 (struct evbuffer * outbuf, uint64_t addme_hll)
 ****
 ***/
 
+static void
+decrypt_evbuffer_range (tr_crypto * crypto, struct evbuffer * buf, size_t offset, size_t len)
+{
+    struct evbuffer_ptr pos;
+    struct evbuffer_iovec iovec;
+
+    evbuffer_ptr_set (buf, &pos, offset, EVBUFFER_PTR_SET);
+    while (len > 0 && evbuffer_peek (buf, len, &pos, &iovec, 1) > 0)
+    {
+        const size_t n = MIN (iovec.iov_len, len);
+        tr_cryptoDecrypt (crypto, n, iovec.iov_base, iovec.iov_base);
+        len -= n;
+        if (evbuffer_ptr_set (buf, &pos, n, EVBUFFER_PTR_ADD))
+            break;
+    }
+}
+
+void
+tr_peerIoDecryptReadBuffer (tr_peerIo * io)
+{
+    const size_t inlen = evbuffer_get_length (io->inbuf);
+
+    assert (tr_isPeerIo (io));
+    assert (io->inbuf_decrypted <= inlen);
+
+    if (io->encryption_type == PEER_ENCRYPTION_RC4 && io->inbuf_decrypted < inlen)
+        decrypt_evbuffer_range (&io->crypto, io->inbuf, io->inbuf_decrypted, inlen - io->inbuf_decrypted);
+
+    io->inbuf_decrypted = inlen;
+}
+
+/* Of the next byteCount bytes being removed from inbuf,
+ * returns how many were already decrypted by tr_peerIoDecryptReadBuffer () */
+static size_t
+consume_decrypted (tr_peerIo * io, const struct evbuffer * inbuf, size_t byteCount)
+{
+    size_t n = 0;
+
+    if (inbuf == io->inbuf)
+    {
+        n = MIN (byteCount, io->inbuf_decrypted);
+        io->inbuf_decrypted -= n;
+    }
+
+    return n;
+}
+
 void
 tr_peerIoReadBytesToBuf (tr_peerIo * io, struct evbuffer * inbuf, struct evbuffer * outbuf, size_t byteCount)
 {
-    struct evbuffer * tmp;
+    size_t decrypted;
     const size_t old_length = evbuffer_get_length (outbuf);
 
     assert (tr_isPeerIo (io));
     assert (evbuffer_get_length (inbuf) >= byteCount);
 
-    /* append it to outbuf */
-    tmp = evbuffer_new ();
-    evbuffer_remove_buffer (inbuf, tmp, byteCount);
-    evbuffer_add_buffer (outbuf, tmp);
-    evbuffer_free (tmp);
+    /* move the chains from inbuf to outbuf; no copying */
+    decrypted = consume_decrypted (io, inbuf, byteCount);
+    evbuffer_remove_buffer (inbuf, outbuf, byteCount);
 
     /* decrypt if needed */
-    if (io->encryption_type == PEER_ENCRYPTION_RC4) {
-        struct evbuffer_ptr pos;
-        struct evbuffer_iovec iovec;
-        evbuffer_ptr_set (outbuf, &pos, old_length, EVBUFFER_PTR_SET);
-        do {
-            evbuffer_peek (outbuf, byteCount, &pos, &iovec, 1);
-            tr_cryptoDecrypt (&io->crypto, iovec.iov_len, iovec.iov_base, iovec.iov_base);
-            byteCount -= iovec.iov_len;
-        } while (!evbuffer_ptr_set (outbuf, &pos, iovec.iov_len, EVBUFFER_PTR_ADD));
-    }
+    if (io->encryption_type == PEER_ENCRYPTION_RC4 && decrypted < byteCount)
+        decrypt_evbuffer_range (&io->crypto, outbuf, old_length + decrypted, byteCount - decrypted);
 }
 
 void
 tr_peerIoReadBytes (tr_peerIo * io, struct evbuffer * inbuf, void * bytes, size_t byteCount)
 {
+    size_t decrypted;
+
     assert (tr_isPeerIo (io));
     assert (evbuffer_get_length (inbuf)  >= byteCount);
 
+    decrypted = consume_decrypted (io, inbuf, byteCount);
+
     switch (io->encryption_type)
     {
         case PEER_ENCRYPTION_NONE:
@@ -1170,7 +1284,10 @@ tr_peerIoReadBytes (tr_peerIo * io, struct evbuffer * inbuf, void * bytes, size_
 
         case PEER_ENCRYPTION_RC4:
             evbuffer_remove (inbuf, bytes, byteCount);
-            tr_cryptoDecrypt (&io->crypto, byteCount, bytes, bytes);
+            if (decrypted < byteCount)
+                tr_cryptoDecrypt (&io->crypto, byteCount - decrypted,
+                                  (uint8_t*)bytes + decrypted,
+                                  (uint8_t*)bytes + decrypted);
             break;
 
         default:
@@ -1204,7 +1321,19 @@ tr_peerIoDrain (tr_peerIo       * io,
 {
     char buf[4096];
     const size_t buflen = sizeof (buf);
+    const size_t decrypted = consume_decrypted (io, inbuf, byteCount);
+
+    /* bytes that don't need decrypting can be dropped without a copy */
+    if (io->encryption_type == PEER_ENCRYPTION_NONE)
+    {
+        evbuffer_drain (inbuf, byteCount);
+        return;
+    }
+
+    evbuffer_drain (inbuf, decrypted);
+    byteCount -= decrypted;
 
+    /* the rest must still run through the cipher to keep it in sync */
     while (byteCount > 0)
     {
         const size_t thisPass = MIN (byteCount, buflen);
@@ -79,6 +79,7 @@ typedef struct tr_peerIo
     tr_priority_t         priority;
 
     short int             pendingEvents;
+    short int             readyEvents;
 
     int                   magicNumber;
 
@@ -108,6 +109,7 @@ typedef struct tr_peerIo
 
     struct evbuffer     * inbuf;
     struct evbuffer     * outbuf;
+    size_t                inbuf_decrypted; /* bytes at the front of inbuf already decrypted in place */
     struct tr_datatype  * outbuf_datatypes;
 
     struct event        * event_read;
@@ -342,6 +344,13 @@ void      tr_peerIoDrain (tr_peerIo        * io,
                           struct evbuffer  * inbuf,
                           size_t             byteCount);
 
+/**
+ * Decrypt everything currently in the read buffer in one pass, so that
+ * later reads can remove whole messages without decrypting field by field.
+ * Only safe once the encryption type is settled, i.e. after the handshake.
+ */
+void tr_peerIoDecryptReadBuffer (tr_peerIo * io);
+
 /**
 ***
 **/
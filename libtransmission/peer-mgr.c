@@ -32,6 +32,7 @@
 #include "peer-mgr.h"
 #include "peer-msgs.h"
 #include "ptrarray.h"
+#include "rate-history.h"
 #include "session.h"
 #include "stats.h" /* tr_statsAddUploaded, tr_statsAddDownloaded */
 #include "torrent.h"
@@ -1714,6 +1715,7 @@ peerCallbackFunc (tr_peer * peer, const tr_peer_event * e, void * vs)
           tr_torrentSetActivityDate (tor, now);
           tr_torrentSetDirty (tor);
           tr_statsAddUploaded (tor->session, e->length);
+          tr_rateHistoryAdd (tor->session->rateHistory, tor->historySeries, now, TR_UP, e->length);
 
           if (peer->atom != NULL)
             peer->atom->piece_data_time = now;
@@ -1731,6 +1733,7 @@ peerCallbackFunc (tr_peer * peer, const tr_peer_event * e, void * vs)
           tr_torrentSetDirty (tor);
 
           tr_statsAddDownloaded (tor->session, e->length);
+          tr_rateHistoryAdd (tor->session->rateHistory, tor->historySeries, now, TR_DOWN, e->length);
 
           if (peer->atom != NULL)
             peer->atom->piece_data_time = now;
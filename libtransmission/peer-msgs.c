@@ -76,6 +76,12 @@ enum
 
   METADATA_REQQ           = 64,
 
+  /* how many ut_metadata requests to keep pending with each peer */
+  METADATA_PIPELINE       = 8,
+
+  /* give up waiting on ut_metadata requests after this long */
+  METADATA_REQUEST_TIMEOUT_SECS = 30,
+
   MAGIC_NUMBER            = 21549,
 
   /* used in lowering the outMessages queue period */
@@ -230,6 +236,9 @@ struct tr_peerMsgs
   int peerAskedForMetadata[METADATA_REQQ];
   int peerAskedForMetadataCount;
 
+  int clientAskedForMetadataCount;
+  time_t clientAskedForMetadataAt;
+
   tr_pex * pex;
   tr_pex * pex6;
 
@@ -1101,9 +1110,16 @@ parseUtMetadata (tr_peerMsgs * msgs, int msglen, struct evbuffer * inbuf)
     dbgmsg (msgs, "got ut_metadata msg: type %d, piece %d, total_size %d",
           (int)msg_type, (int)piece, (int)total_size);
 
-    if (msg_type == METADATA_MSG_TYPE_REJECT)
+    if ((msg_type == METADATA_MSG_TYPE_REJECT) || (msg_type == METADATA_MSG_TYPE_DATA))
+    {
+        if (msgs->clientAskedForMetadataCount > 0)
+            --msgs->clientAskedForMetadataCount;
+    }
+
+    if ((msg_type == METADATA_MSG_TYPE_REJECT)
+        && (!tr_torrentHasMetadata (msgs->torrent)))
     {
-        /* NOOP */
+        tr_torrentMetadataRequestRejected (msgs->torrent, piece);
     }
 
     if ((msg_type == METADATA_MSG_TYPE_DATA)
@@ -1112,7 +1128,8 @@ parseUtMetadata (tr_peerMsgs * msgs, int msglen, struct evbuffer * inbuf)
         && (piece * METADATA_PIECE_SIZE + (msg_end - benc_end) <= total_size))
     {
         const int pieceLen = msg_end - benc_end;
-        tr_torrentSetMetadataPiece (msgs->torrent, piece, benc_end, pieceLen);
+        tr_torrentSetMetadataPiece (msgs->torrent, tr_peerIoGetAddress (msgs->io, NULL),
+                                    piece, benc_end, pieceLen);
     }
 
     if (msg_type == METADATA_MSG_TYPE_REQUEST)
@@ -1251,10 +1268,12 @@ parseLtep (tr_peerMsgs * msgs, int msglen, struct evbuffer  * inbuf)
     else
     {
         dbgmsg (msgs, "skipping unknown ltep message (%d)", (int)ltep_msgid);
-        evbuffer_drain (inbuf, msglen);
+        tr_peerIoDrain (msgs->io, inbuf, msglen);
     }
 }
 
+static int readBtId (tr_peerMsgs *, struct evbuffer *, size_t);
+
 static int
 readBtLength (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
 {
@@ -1271,6 +1290,11 @@ readBtLength (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
     {
         msgs->incoming.length = len;
         msgs->state = AWAITING_BT_ID;
+
+        /* if the id is already here, keep going instead of
+           bouncing back out through canReadWrapper () */
+        if (inlen > sizeof (len))
+            return readBtId (msgs, inbuf, inlen - sizeof (len));
     }
 
     return READ_NOW;
@@ -1295,12 +1319,13 @@ readBtId (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
         msgs->state = AWAITING_BT_PIECE;
         return READ_NOW;
     }
-    else if (msgs->incoming.length != 1)
+    else
     {
         msgs->state = AWAITING_BT_MESSAGE;
-        return READ_NOW;
+        if (inlen - 1 < msgs->incoming.length - 1)
+            return READ_NOW;
+        return readBtMessage (msgs, inbuf, inlen - 1);
     }
-    else return readBtMessage (msgs, inbuf, inlen - 1);
 }
 
 static void
@@ -1410,6 +1435,30 @@ static int clientGotBlock (tr_peerMsgs *               msgs,
                            struct evbuffer *           block,
                            const struct peer_request * req);
 
+static inline uint16_t
+readUint16 (const uint8_t * buf)
+{
+    uint16_t tmp;
+    memcpy (&tmp, buf, sizeof (tmp));
+    return ntohs (tmp);
+}
+
+static inline uint32_t
+readUint32 (const uint8_t * buf)
+{
+    uint32_t tmp;
+    memcpy (&tmp, buf, sizeof (tmp));
+    return ntohl (tmp);
+}
+
+static inline void
+readPeerRequest (const uint8_t * buf, struct peer_request * setme)
+{
+    setme->index = readUint32 (buf);
+    setme->offset = readUint32 (buf + 4);
+    setme->length = readUint32 (buf + 8);
+}
+
 static int
 readBtPiece (tr_peerMsgs      * msgs,
              struct evbuffer  * inbuf,
@@ -1423,11 +1472,14 @@ readBtPiece (tr_peerMsgs      * msgs,
 
     if (!req->length)
     {
-        if (inlen < 8)
+        uint8_t header[8];
+
+        if (inlen < sizeof (header))
             return READ_LATER;
 
-        tr_peerIoReadUint32 (msgs->io, inbuf, &req->index);
-        tr_peerIoReadUint32 (msgs->io, inbuf, &req->offset);
+        tr_peerIoReadBytes (msgs->io, inbuf, header, sizeof (header));
+        req->index = readUint32 (header);
+        req->offset = readUint32 (header + 4);
         req->length = msgs->incoming.length - 9;
         dbgmsg (msgs, "got incoming block header %u:%u->%u", req->index, req->offset, req->length);
         return READ_NOW;
@@ -1474,6 +1526,7 @@ static int
 readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
 {
     uint32_t      ui32;
+    uint8_t       payload[12];
     uint32_t      msglen = msgs->incoming.length;
     const uint8_t id = msgs->incoming.id;
 #ifndef NDEBUG
@@ -1495,6 +1548,11 @@ readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
         return READ_ERR;
     }
 
+    /* all the fixed-size messages are small enough to pull out
+       of the read buffer in a single read, then parse in place */
+    if ((id != BT_BITFIELD) && (id != BT_LTEP) && (msglen <= sizeof (payload)))
+        tr_peerIoReadBytes (msgs->io, inbuf, payload, msglen);
+
     switch (id)
     {
         case BT_CHOKE:
@@ -1525,7 +1583,7 @@ readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
             break;
 
         case BT_HAVE:
-            tr_peerIoReadUint32 (msgs->io, inbuf, &ui32);
+            ui32 = readUint32 (payload);
             dbgmsg (msgs, "got Have: %u", ui32);
             if (tr_torrentHasMetadata (msgs->torrent)
                     && (ui32 >= msgs->torrent->info.pieceCount))
@@ -1556,9 +1614,7 @@ readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
         case BT_REQUEST:
         {
             struct peer_request r;
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.index);
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.offset);
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.length);
+            readPeerRequest (payload, &r);
             dbgmsg (msgs, "got Request: %u:%u->%u", r.index, r.offset, r.length);
             peerMadeRequest (msgs, &r);
             break;
@@ -1568,9 +1624,7 @@ readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
         {
             int i;
             struct peer_request r;
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.index);
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.offset);
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.length);
+            readPeerRequest (payload, &r);
             tr_historyAdd (&msgs->peer.cancelsSentToClient, tr_time (), 1);
             dbgmsg (msgs, "got a Cancel %u:%u->%u", r.index, r.offset, r.length);
 
@@ -1592,7 +1646,7 @@ readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
 
         case BT_PORT:
             dbgmsg (msgs, "Got a BT_PORT");
-            tr_peerIoReadUint16 (msgs->io, inbuf, &msgs->dht_port);
+            msgs->dht_port = readUint16 (payload);
             if (msgs->dht_port > 0)
                 tr_dhtAddNode (getSession (msgs),
                                tr_peerAddress (&msgs->peer),
@@ -1601,7 +1655,7 @@ readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
 
         case BT_FEXT_SUGGEST:
             dbgmsg (msgs, "Got a BT_FEXT_SUGGEST");
-            tr_peerIoReadUint32 (msgs->io, inbuf, &ui32);
+            ui32 = readUint32 (payload);
             if (fext)
                 fireClientGotSuggest (msgs, ui32);
             else {
@@ -1612,7 +1666,7 @@ readBtMessage (tr_peerMsgs * msgs, struct evbuffer * inbuf, size_t inlen)
 
         case BT_FEXT_ALLOWED_FAST:
             dbgmsg (msgs, "Got a BT_FEXT_ALLOWED_FAST");
-            tr_peerIoReadUint32 (msgs->io, inbuf, &ui32);
+            ui32 = readUint32 (payload);
             if (fext)
                 fireClientGotAllowedFast (msgs, ui32);
             else {
@@ -1650,9 +1704,7 @@ assert (tr_bitfieldHasAll (&msgs->peer.have));
         {
             struct peer_request r;
             dbgmsg (msgs, "Got a BT_FEXT_REJECT");
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.index);
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.offset);
-            tr_peerIoReadUint32 (msgs->io, inbuf, &r.length);
+            readPeerRequest (payload, &r);
             if (fext)
                 fireGotRej (msgs, &r);
             else {
@@ -1669,7 +1721,8 @@ assert (tr_bitfieldHasAll (&msgs->peer.have));
 
         default:
             dbgmsg (msgs, "peer sent us an UNKNOWN: %d", (int)id);
-            tr_peerIoDrain (msgs->io, inbuf, msglen);
+            if (msglen > sizeof (payload))
+                tr_peerIoDrain (msgs->io, inbuf, msglen);
             break;
     }
 
@@ -1746,6 +1799,9 @@ canRead (tr_peerIo * io, void * vmsgs, size_t * piece)
 
     dbgmsg (msgs, "canRead: inlen is %"TR_PRIuSIZE", msgs->state is %d", inlen, msgs->state);
 
+    /* decrypt all the new input at once rather than field by field */
+    tr_peerIoDecryptReadBuffer (io);
+
     if (!inlen)
     {
         ret = READ_LATER;
@@ -1838,9 +1894,16 @@ static void
 updateMetadataRequests (tr_peerMsgs * msgs, time_t now)
 {
     int piece;
+    const tr_address * addr = tr_peerIoGetAddress (msgs->io, NULL);
+
+    /* peers don't have to answer, so don't wait forever */
+    if (msgs->clientAskedForMetadataAt + METADATA_REQUEST_TIMEOUT_SECS < now)
+        msgs->clientAskedForMetadataCount = 0;
 
-    if (msgs->peerSupportsMetadataXfer
-        && tr_torrentGetNextMetadataRequest (msgs->torrent, now, &piece))
+    /* keep several requests pending so the peer's never idle */
+    while (msgs->peerSupportsMetadataXfer
+        && (msgs->clientAskedForMetadataCount < METADATA_PIPELINE)
+        && tr_torrentGetNextMetadataRequest (msgs->torrent, addr, now, &piece))
     {
         tr_variant tmp;
         struct evbuffer * payload;
@@ -1853,6 +1916,8 @@ updateMetadataRequests (tr_peerMsgs * msgs, time_t now)
         payload = tr_variantToBuf (&tmp, TR_VARIANT_FMT_BENC);
 
         dbgmsg (msgs, "requesting metadata piece #%d", piece);
+        ++msgs->clientAskedForMetadataCount;
+        msgs->clientAskedForMetadataAt = now;
 
         /* write it out as a LTEP message to our outMessages buffer */
         evbuffer_add_uint32 (out, 2 * sizeof (uint8_t) + evbuffer_get_length (payload));
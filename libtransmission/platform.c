@@ -133,6 +133,22 @@ tr_threadNew (void (*func)(void *), void * arg)
   return t;
 }
 
+int
+tr_getCpuCount (void)
+{
+  int count = 1;
+
+#ifdef WIN32
+  SYSTEM_INFO system_info;
+  GetSystemInfo (&system_info);
+  count = system_info.dwNumberOfProcessors;
+#elif defined (_SC_NPROCESSORS_ONLN)
+  count = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+
+  return count > 0 ? count : 1;
+}
+
 /***
 ****  LOCKS
 ***/
@@ -56,6 +56,9 @@ tr_thread* tr_threadNew (void (*func)(void *), void * arg);
     @param thread the thread being tested */
 bool tr_amInThread (const tr_thread *);
 
+/** @brief Return the number of processors that are online, or 1 if unknown */
+int tr_getCpuCount (void);
+
 /***
 ****
 ***/
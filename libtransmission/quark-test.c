@@ -7,10 +7,12 @@
  * $Id$
  */
 
+#include <stdio.h> /* snprintf() */
 #include <string.h> /* strlen() */
 
 #include "transmission.h"
 #include "quark.h"
+#include "utils.h" /* tr_strdup_printf() */
 #include "libtransmission-test.h"
 
 static int
@@ -44,4 +46,77 @@ test_static_quarks (void)
   return 0;
 }
 
-MAIN_SINGLE_TEST(test_static_quarks)
+static int
+test_lookup_misses (void)
+{
+  tr_quark q;
+  const char * str;
+  size_t len;
+
+  check (tr_quark_lookup ("", 0, &q));
+  check_int_eq (TR_KEY_NONE, q);
+
+  /* near misses of a static quark */
+  str = tr_quark_get_string (TR_KEY_downloadDir, &len);
+  check (!tr_quark_lookup (str, len-1, &q));
+  check (!tr_quark_lookup ("downloaddir", len, &q));
+  check (!tr_quark_lookup ("downloadDirX", len+1, &q));
+
+  /* the string doesn't need to be zero-terminated */
+  check (tr_quark_lookup ("downloadDir-and-then-some", len, &q));
+  check_int_eq (TR_KEY_downloadDir, q);
+
+  check (!tr_quark_lookup ("not-a-quark-before-this-test", 28, &q));
+
+  return 0;
+}
+
+static int
+test_runtime_quarks (void)
+{
+  int i;
+  enum { N = 1000 };
+  tr_quark quarks[N];
+
+  /* enough to make the runtime table grow a few times */
+  for (i=0; i<N; i++)
+    {
+      char buf[64];
+      const int len = snprintf (buf, sizeof (buf), "runtime-quark-%d", i);
+      quarks[i] = tr_quark_new (buf, len);
+      check (quarks[i] >= TR_N_KEYS);
+    }
+
+  for (i=0; i<N; i++)
+    {
+      tr_quark q;
+      size_t len;
+      char * str = tr_strdup_printf ("runtime-quark-%d", i);
+
+      check (tr_quark_lookup (str, strlen (str), &q));
+      check_int_eq (quarks[i], q);
+      check_int_eq (quarks[i], tr_quark_new (str, -1));
+      check_streq (str, tr_quark_get_string (q, &len));
+      check_int_eq (strlen (str), len);
+      if (i > 0)
+        check (quarks[i] != quarks[i-1]);
+
+      tr_free (str);
+    }
+
+  /* static quarks aren't duplicated */
+  check_int_eq (TR_KEY_name, tr_quark_new ("name", -1));
+  check_int_eq (TR_KEY_NONE, tr_quark_new (NULL, 0));
+
+  return 0;
+}
+
+int
+main (void)
+{
+  const testFunc tests[] = { test_static_quarks,
+                             test_lookup_misses,
+                             test_runtime_quarks };
+
+  return runTests (tests, NUM_TESTS (tests));
+}
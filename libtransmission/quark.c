@@ -8,10 +8,10 @@
  */
 
 #include <assert.h>
-#include <stdlib.h> /* bsearch() */
 #include <string.h> /* memcmp() */
 
 #include "transmission.h"
+#include "platform.h" /* tr_lock */
 #include "ptrarray.h"
 #include "quark.h"
 #include "utils.h" /* tr_memdup(), tr_strndup() */
@@ -110,6 +110,7 @@ static const struct tr_key_struct my_static[] =
   { "errorString", 11 },
   { "eta", 3 },
   { "etaIdle", 7 },
+  { "events", 6 },
   { "failure reason", 14 },
   { "fields", 6 },
   { "fileStats", 9 },
@@ -201,11 +202,13 @@ static const struct tr_key_struct my_static[] =
   { "method", 6 },
   { "min interval", 12 },
   { "min_request_interval", 20 },
+  { "missed", 6 },
   { "move", 4 },
   { "msg_type", 8 },
   { "mtimes", 6 },
   { "name", 4 },
   { "name.utf-8", 10 },
+  { "next", 4 },
   { "nextAnnounceTime", 16 },
   { "nextScrapeTime", 14 },
   { "nodes", 5 },
@@ -240,7 +243,9 @@ static const struct tr_key_struct my_static[] =
   { "pex-enabled", 11 },
   { "piece", 5 },
   { "piece length", 12 },
+  { "piece-check-threads", 19 },
   { "pieceCount", 10 },
+  { "pieceRuns", 9 },
   { "pieceSize", 9 },
   { "pieces", 6 },
   { "play-download-complete-sound", 28 },
@@ -286,6 +291,7 @@ static const struct tr_key_struct my_static[] =
   { "rename-partial-files", 20 },
   { "reqq", 4 },
   { "result", 6 },
+  { "revision", 8 },
   { "rpc-authentication-required", 27 },
   { "rpc-bind-address", 16 },
   { "rpc-enabled", 11 },
@@ -325,6 +331,7 @@ static const struct tr_key_struct my_static[] =
   { "show-statusbar", 14 },
   { "show-toolbar", 12 },
   { "show-tracker-scrapes", 20 },
+  { "since", 5 },
   { "size-bytes", 10 },
   { "size-units", 10 },
   { "sizeWhenDone", 12 },
@@ -370,6 +377,7 @@ static const struct tr_key_struct my_static[] =
   { "trackers", 8 },
   { "trash-can-enabled", 17 },
   { "trash-original-torrent-files", 28 },
+  { "type", 4 },
   { "umask", 5 },
   { "units", 5 },
   { "upload-slots-per-torrent", 24 },
@@ -402,62 +410,240 @@ static const struct tr_key_struct my_static[] =
   { "webseedsSendingToUs", 19 }
 };
 
-static int
-compareKeys (const void * va, const void * vb)
+/***
+****  Lookup
+****
+****  The static quarks are found with a minimal perfect hash: a hash of
+****  the string picks a bucket, the bucket's displacement picks a slot,
+****  and one memcmp () confirms the match. The table is built from
+****  my_static the first time it's needed, which takes a fraction of a
+****  millisecond, so a new quark only needs to be added to the list above.
+****
+****  Quarks added at runtime are kept in an open-addressed hash table.
+***/
+
+/* 64-bit FNV-1a */
+static uint64_t
+quarkHash (const void * str, size_t len)
 {
-  int ret;
-  const struct tr_key_struct * a = va;
-  const struct tr_key_struct * b = vb;
+  const uint8_t * walk = str;
+  const uint8_t * const end = walk + len;
+  uint64_t hash = UINT64_C (14695981039346656037);
 
-  ret = memcmp (a->str, b->str, MIN (a->len, b->len));
+  while (walk != end)
+    {
+      hash ^= *walk++;
+      hash *= UINT64_C (1099511628211);
+    }
 
-  if (!ret && (a->len != b->len))
-    ret = a->len < b->len ? -1 : 1;
+  return hash;
+}
 
-  return ret;
+static bool
+keyEquals (const struct tr_key_struct * key, const void * str, size_t len)
+{
+  return (key->len == len) && ((len == 0) || !memcmp (key->str, str, len));
 }
 
-static tr_ptrArray my_runtime = TR_PTR_ARRAY_INIT_STATIC;
+static uint32_t my_static_displacements[TR_N_KEYS];
+static uint16_t my_static_slots[TR_N_KEYS];
+static bool my_static_table_built = false;
 
-bool
-tr_quark_lookup (const void * str, size_t len, tr_quark * setme)
+static size_t
+staticBucket (uint64_t hash)
 {
-  struct tr_key_struct tmp;
-  struct tr_key_struct * match;
-  static const size_t n_static = sizeof(my_static) / sizeof(struct tr_key_struct);
-  bool success = false;
+  return (size_t)(hash % TR_N_KEYS);
+}
 
-  assert (n_static == TR_N_KEYS);
+static size_t
+staticSlot (uint64_t hash, uint32_t displacement)
+{
+  /* mix the displacement into the hash's other half with murmur3's finalizer */
+  uint32_t x = (uint32_t)(hash >> 32) ^ displacement;
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x % TR_N_KEYS;
+}
+
+static void
+buildStaticTable (void)
+{
+  size_t i;
+  size_t size;
+  size_t max_size = 0;
+  uint64_t hashes[TR_N_KEYS];
+  size_t bucket_sizes[TR_N_KEYS];
+  size_t bucket_first[TR_N_KEYS];
+  uint16_t by_bucket[TR_N_KEYS];
+  bool taken[TR_N_KEYS];
 
-  tmp.str = str;
-  tmp.len = len;
+  assert (TR_N_KEYS <= UINT16_MAX);
 
-  /* is it in our static array? */
-  match = bsearch (&tmp, my_static, n_static, sizeof(struct tr_key_struct), compareKeys);
-  if (match != NULL)
+  memset (bucket_sizes, 0, sizeof (bucket_sizes));
+  memset (taken, 0, sizeof (taken));
+
+  /* sort the keys by bucket */
+  for (i=0; i<TR_N_KEYS; ++i)
+    {
+      hashes[i] = quarkHash (my_static[i].str, my_static[i].len);
+      ++bucket_sizes[staticBucket (hashes[i])];
+    }
+  for (i=0, size=0; i<TR_N_KEYS; ++i)
+    {
+      bucket_first[i] = size;
+      size += bucket_sizes[i];
+      max_size = MAX (max_size, bucket_sizes[i]);
+      bucket_sizes[i] = 0;
+    }
+  for (i=0; i<TR_N_KEYS; ++i)
     {
-      *setme = match - my_static;
-      success = true;
+      const size_t b = staticBucket (hashes[i]);
+      by_bucket[bucket_first[b] + bucket_sizes[b]++] = i;
     }
 
-  /* was it added during runtime? */
-  if (!success && !tr_ptrArrayEmpty(&my_runtime))
+  /* place the biggest buckets first, while there's the most room.
+     for each one, try displacements until all its keys land in free slots */
+  for (size=max_size; size>0; --size)
     {
-      size_t i;
-      struct tr_key_struct ** runtime = (struct tr_key_struct **) tr_ptrArrayBase (&my_runtime);
-      const size_t n_runtime = tr_ptrArraySize (&my_runtime);
-      for (i=0; i<n_runtime; ++i)
+      for (i=0; i<TR_N_KEYS; ++i)
         {
-          if (compareKeys (&tmp, runtime[i]) == 0)
+          uint32_t displacement;
+          const uint16_t * keys = by_bucket + bucket_first[i];
+
+          if (bucket_sizes[i] != size)
+            continue;
+
+          for (displacement=0; ; ++displacement)
             {
-              *setme = TR_N_KEYS + i;
-              success = true;
-              break;
+              size_t j;
+              size_t k;
+              size_t slots[TR_N_KEYS];
+
+              for (j=0; j<size; ++j)
+                {
+                  slots[j] = staticSlot (hashes[keys[j]], displacement);
+                  if (taken[slots[j]])
+                    break;
+                  for (k=0; k<j; ++k)
+                    if (slots[k] == slots[j])
+                      break;
+                  if (k < j)
+                    break;
+                }
+
+              if (j == size)
+                {
+                  for (j=0; j<size; ++j)
+                    {
+                      taken[slots[j]] = true;
+                      my_static_slots[slots[j]] = keys[j];
+                    }
+                  my_static_displacements[i] = displacement;
+                  break;
+                }
             }
         }
     }
 
-  return success;
+  my_static_table_built = true;
+}
+
+/* guards the lazy build of the static table and all access to the
+   runtime quarks, since torrents and resume files are parsed off the
+   event thread when a session loads its torrents */
+static tr_lock *
+getQuarkLock (void)
+{
+  static tr_lock * l = NULL;
+
+  if (!l)
+    l = tr_lockNew ();
+
+  return l;
+}
+
+static bool
+staticLookup (const void * str, size_t len, uint64_t hash, tr_quark * setme)
+{
+  size_t q;
+
+  if (!my_static_table_built)
+    {
+      tr_lockLock (getQuarkLock ());
+      if (!my_static_table_built)
+        buildStaticTable ();
+      tr_lockUnlock (getQuarkLock ());
+    }
+
+  q = my_static_slots[staticSlot (hash, my_static_displacements[staticBucket (hash)])];
+  if (!keyEquals (&my_static[q], str, len))
+    return false;
+
+  *setme = q;
+  return true;
+}
+
+static tr_ptrArray my_runtime = TR_PTR_ARRAY_INIT_STATIC;
+
+/* runtime quarks by hash. 0 is an empty slot, since TR_KEY_NONE is static */
+static tr_quark * my_runtime_table = NULL;
+static size_t my_runtime_table_size = 0; /* a power of 2 */
+
+static const struct tr_key_struct *
+runtimeKey (tr_quark q)
+{
+  return tr_ptrArrayNth (&my_runtime, q - TR_N_KEYS);
+}
+
+static void
+runtimeTableAdd (tr_quark q, uint64_t hash)
+{
+  size_t i = (size_t)hash & (my_runtime_table_size - 1);
+
+  while (my_runtime_table[i] != 0)
+    i = (i + 1) & (my_runtime_table_size - 1);
+
+  my_runtime_table[i] = q;
+}
+
+static bool
+runtimeLookup (const void * str, size_t len, uint64_t hash, tr_quark * setme)
+{
+  size_t i;
+
+  if (my_runtime_table == NULL)
+    return false;
+
+  for (i = (size_t)hash & (my_runtime_table_size - 1);
+       my_runtime_table[i] != 0;
+       i = (i + 1) & (my_runtime_table_size - 1))
+    {
+      if (keyEquals (runtimeKey (my_runtime_table[i]), str, len))
+        {
+          *setme = my_runtime_table[i];
+          return true;
+        }
+    }
+
+  return false;
+}
+
+bool
+tr_quark_lookup (const void * str, size_t len, tr_quark * setme)
+{
+  bool found;
+  const uint64_t hash = quarkHash (str, len);
+
+  if (staticLookup (str, len, hash, setme))
+    return true;
+
+  tr_lockLock (getQuarkLock ());
+  found = runtimeLookup (str, len, hash, setme);
+  tr_lockUnlock (getQuarkLock ());
+  return found;
 }
 
 static tr_quark
@@ -465,11 +651,31 @@ append_new_quark (const void * str, size_t len)
 {
   tr_quark ret;
   struct tr_key_struct * tmp;
+  const size_t n_runtime = tr_ptrArraySize (&my_runtime);
+
   tmp = tr_new (struct tr_key_struct, 1);
   tmp->str = tr_strndup (str, len);
   tmp->len = len;
-  ret = TR_N_KEYS + tr_ptrArraySize (&my_runtime);
+  ret = TR_N_KEYS + n_runtime;
   tr_ptrArrayAppend (&my_runtime, tmp);
+
+  /* keep the hash table at most half full */
+  if ((n_runtime + 1) * 2 > my_runtime_table_size)
+    {
+      size_t i;
+
+      my_runtime_table_size = my_runtime_table_size ? my_runtime_table_size * 2 : 64;
+      tr_free (my_runtime_table);
+      my_runtime_table = tr_new0 (tr_quark, my_runtime_table_size);
+
+      for (i=0; i<n_runtime; ++i)
+        {
+          const struct tr_key_struct * key = runtimeKey (TR_N_KEYS + i);
+          runtimeTableAdd (TR_N_KEYS + i, quarkHash (key->str, key->len));
+        }
+    }
+
+  runtimeTableAdd (ret, quarkHash (str, len));
   return ret;
 }
 
@@ -484,7 +690,12 @@ tr_quark_new (const void * str, size_t len)
     len = strlen (str);
 
   if (!tr_quark_lookup (str, len, &ret))
-    ret = append_new_quark (str, len);
+    {
+      tr_lockLock (getQuarkLock ());
+      if (!runtimeLookup (str, len, quarkHash (str, len), &ret))
+        ret = append_new_quark (str, len);
+      tr_lockUnlock (getQuarkLock ());
+    }
 
   return ret;
 }
@@ -495,9 +706,15 @@ tr_quark_get_string (tr_quark q, size_t * len)
   const struct tr_key_struct * tmp;
 
   if (q < TR_N_KEYS)
-    tmp = &my_static[q];
+    {
+      tmp = &my_static[q];
+    }
   else
-    tmp = tr_ptrArrayNth (&my_runtime, q-TR_N_KEYS);
+    {
+      tr_lockLock (getQuarkLock ());
+      tmp = runtimeKey (q);
+      tr_lockUnlock (getQuarkLock ());
+    }
 
   if (len != NULL)
     *len = tmp->len;
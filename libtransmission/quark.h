@@ -108,6 +108,7 @@ enum
   TR_KEY_errorString,
   TR_KEY_eta,
   TR_KEY_etaIdle,
+  TR_KEY_events,
   TR_KEY_failure_reason,
   TR_KEY_fields,
   TR_KEY_fileStats,
@@ -199,11 +200,13 @@ enum
   TR_KEY_method,
   TR_KEY_min_interval,
   TR_KEY_min_request_interval,
+  TR_KEY_missed,
   TR_KEY_move,
   TR_KEY_msg_type,
   TR_KEY_mtimes,
   TR_KEY_name,
   TR_KEY_name_utf_8,
+  TR_KEY_next,
   TR_KEY_nextAnnounceTime,
   TR_KEY_nextScrapeTime,
   TR_KEY_nodes,
@@ -238,7 +241,9 @@ enum
   TR_KEY_pex_enabled,
   TR_KEY_piece,
   TR_KEY_piece_length,
+  TR_KEY_piece_check_threads,
   TR_KEY_pieceCount,
+  TR_KEY_pieceRuns,
   TR_KEY_pieceSize,
   TR_KEY_pieces,
   TR_KEY_play_download_complete_sound,
@@ -284,6 +289,7 @@ enum
   TR_KEY_rename_partial_files,
   TR_KEY_reqq,
   TR_KEY_result,
+  TR_KEY_revision,
   TR_KEY_rpc_authentication_required,
   TR_KEY_rpc_bind_address,
   TR_KEY_rpc_enabled,
@@ -323,6 +329,7 @@ enum
   TR_KEY_show_statusbar,
   TR_KEY_show_toolbar,
   TR_KEY_show_tracker_scrapes,
+  TR_KEY_since,
   TR_KEY_size_bytes,
   TR_KEY_size_units,
   TR_KEY_sizeWhenDone,
@@ -368,6 +375,7 @@ enum
   TR_KEY_trackers,
   TR_KEY_trash_can_enabled,
   TR_KEY_trash_original_torrent_files,
+  TR_KEY_type,
   TR_KEY_umask,
   TR_KEY_units,
   TR_KEY_upload_slots_per_torrent,
@@ -0,0 +1,185 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <stdio.h>
+#include <string.h> /* memset () */
+
+#include "transmission.h"
+#include "crypto.h" /* SHA_DIGEST_LENGTH */
+#include "rate-history.h"
+#include "utils.h"
+
+#include "libtransmission-test.h"
+
+/* the start of an hour, so that all three resolutions line up */
+#define T0 ((time_t) 3600 * 400000)
+
+static int
+getLast (const tr_rateHistory * h, int series, int resolution, time_t now, tr_rate_sample * setme)
+{
+  tr_rate_sample samples[168];
+  const int n = tr_rateHistorySampleCount (resolution);
+
+  tr_rateHistoryGet (h, series, resolution, now, samples);
+  *setme = samples[n-1];
+  return n;
+}
+
+static int
+test_rates (void)
+{
+  int a;
+  int b;
+  tr_rate_sample s;
+  tr_rate_sample samples[168];
+  uint8_t hash[SHA_DIGEST_LENGTH];
+  tr_session * session;
+  tr_rateHistory * h;
+  char * path;
+
+  session = libttest_session_init (NULL);
+  path = tr_buildPath (tr_sessionGetConfigDir (session), "test.history", NULL);
+  h = tr_rateHistoryNew (path);
+
+  /* each torrent gets its own series */
+  memset (hash, 'a', sizeof (hash));
+  a = tr_rateHistoryOpenSeries (h, hash);
+  memset (hash, 'b', sizeof (hash));
+  b = tr_rateHistoryOpenSeries (h, hash);
+  check (a != TR_HISTORY_SESSION);
+  check (b != TR_HISTORY_SESSION);
+  check (a != b);
+  check_int_eq (b, tr_rateHistoryOpenSeries (h, hash));
+
+  /* bytes go to the torrent and to the session, at every resolution */
+  tr_rateHistoryAdd (h, a, T0, TR_UP, 100);
+  tr_rateHistoryAdd (h, b, T0 + 1, TR_DOWN, 50);
+  tr_rateHistorySetPeers (h, a, T0, 5);
+  tr_rateHistorySetPeers (h, a, T0, 3);
+  check_int_eq (60, getLast (h, a, TR_HISTORY_SECONDS, T0, &s));
+  check_int_eq (100, s.uploadedBytes);
+  check_int_eq (5, s.peersConnected);
+  tr_rateHistoryGet (h, TR_HISTORY_SESSION, TR_HISTORY_SECONDS, T0 + 1, samples);
+  check_int_eq (100, samples[58].uploadedBytes);
+  check_int_eq (0, samples[58].downloadedBytes);
+  check_int_eq (0, samples[59].uploadedBytes);
+  check_int_eq (50, samples[59].downloadedBytes);
+  check_int_eq (60, getLast (h, TR_HISTORY_SESSION, TR_HISTORY_MINUTES, T0 + 1, &s));
+  check_int_eq (100, s.uploadedBytes);
+  check_int_eq (50, s.downloadedBytes);
+  check_int_eq (168, getLast (h, b, TR_HISTORY_HOURS, T0 + 1, &s));
+  check_int_eq (0, s.uploadedBytes);
+  check_int_eq (50, s.downloadedBytes);
+
+  /* old samples slide out of the finer resolutions first */
+  tr_rateHistoryAdd (h, a, T0 + 120, TR_UP, 7);
+  tr_rateHistoryGet (h, a, TR_HISTORY_SECONDS, T0 + 120, samples);
+  check_int_eq (0, samples[0].uploadedBytes);
+  check_int_eq (7, samples[59].uploadedBytes);
+  tr_rateHistoryGet (h, a, TR_HISTORY_MINUTES, T0 + 120, samples);
+  check_int_eq (100, samples[57].uploadedBytes);
+  check_int_eq (0, samples[58].uploadedBytes);
+  check_int_eq (7, samples[59].uploadedBytes);
+  check (getLast (h, a, TR_HISTORY_HOURS, T0 + 120, &s));
+  check_int_eq (107, s.uploadedBytes);
+  tr_rateHistoryGet (h, a, TR_HISTORY_HOURS, T0 + 3600 * 167, samples);
+  check_int_eq (107, samples[0].uploadedBytes);
+  tr_rateHistoryGet (h, a, TR_HISTORY_HOURS, T0 + 3600 * 168, samples);
+  check_int_eq (0, samples[0].uploadedBytes);
+  tr_rateHistoryAdd (h, a, T0 + 3600 * 200, TR_UP, 1);
+  tr_rateHistoryGet (h, a, TR_HISTORY_HOURS, T0 + 3600 * 200, samples);
+  check_int_eq (0, samples[0].uploadedBytes);
+  check_int_eq (1, samples[167].uploadedBytes);
+
+  /* the history survives being closed and reopened */
+  tr_rateHistoryFree (h);
+  h = tr_rateHistoryNew (path);
+  check_int_eq (b, tr_rateHistoryOpenSeries (h, hash));
+  check (getLast (h, b, TR_HISTORY_MINUTES, T0 + 1, &s));
+  check_int_eq (50, s.downloadedBytes);
+  check (getLast (h, TR_HISTORY_SESSION, TR_HISTORY_HOURS, T0 + 3600 * 200, &s));
+  check_int_eq (1, s.uploadedBytes);
+
+  /* a removed series' record is reused, empty */
+  tr_rateHistoryRemoveSeries (h, b);
+  memset (hash, 'c', sizeof (hash));
+  check_int_eq (b, tr_rateHistoryOpenSeries (h, hash));
+  check (getLast (h, b, TR_HISTORY_MINUTES, T0 + 1, &s));
+  check_int_eq (0, s.downloadedBytes);
+
+  tr_rateHistoryFree (h);
+  tr_free (path);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+test_grow (void)
+{
+  int i;
+  int series[100];
+  tr_rate_sample s;
+  uint8_t hash[SHA_DIGEST_LENGTH];
+  tr_session * session;
+  tr_rateHistory * h;
+  char * path;
+  FILE * fp;
+
+  session = libttest_session_init (NULL);
+  path = tr_buildPath (tr_sessionGetConfigDir (session), "test.history", NULL);
+
+  /* a corrupt file is replaced */
+  fp = fopen (path, "wb+");
+  fputs ("this is not a rate history", fp);
+  fclose (fp);
+  h = tr_rateHistoryNew (path);
+  check (getLast (h, TR_HISTORY_SESSION, TR_HISTORY_SECONDS, T0, &s));
+  check_int_eq (0, s.uploadedBytes);
+
+  /* the file grows as torrents are added */
+  for (i=0; i<100; ++i)
+    {
+      memset (hash, 0, sizeof (hash));
+      memcpy (hash, &i, sizeof (i));
+      series[i] = tr_rateHistoryOpenSeries (h, hash);
+      tr_rateHistoryAdd (h, series[i], T0, TR_UP, i);
+    }
+  for (i=0; i<100; ++i)
+    {
+      check (getLast (h, series[i], TR_HISTORY_SECONDS, T0, &s));
+      check_int_eq (i, s.uploadedBytes);
+    }
+  tr_rateHistoryFree (h);
+
+  h = tr_rateHistoryNew (path);
+  for (i=0; i<100; ++i)
+    {
+      memset (hash, 0, sizeof (hash));
+      memcpy (hash, &i, sizeof (i));
+      check_int_eq (series[i], tr_rateHistoryOpenSeries (h, hash));
+      check (getLast (h, series[i], TR_HISTORY_MINUTES, T0, &s));
+      check_int_eq (i, s.uploadedBytes);
+    }
+  check (getLast (h, TR_HISTORY_SESSION, TR_HISTORY_HOURS, T0, &s));
+  check_int_eq (99 * 100 / 2, s.uploadedBytes);
+  tr_rateHistoryFree (h);
+
+  tr_free (path);
+  libttest_session_close (session);
+  return 0;
+}
+
+int
+main (void)
+{
+  const testFunc tests[] = { test_rates,
+                             test_grow };
+
+  return runTests (tests, NUM_TESTS (tests));
+}
@@ -0,0 +1,650 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h> /* close (), ftruncate () */
+
+#ifndef WIN32
+ #include <sys/mman.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "transmission.h"
+#include "crypto.h" /* SHA_DIGEST_LENGTH */
+#include "log.h"
+#include "rate-history.h"
+#include "utils.h"
+
+#ifndef O_BINARY
+ #define O_BINARY 0
+#endif
+
+#ifndef MAP_FAILED
+ #define MAP_FAILED ((void *) -1)
+#endif
+
+/***
+****  PRIVATE
+***/
+
+/* The file is a header followed by fixed-size records, one per series.
+   Record 0 is the session's. A sample's slot in its ring comes from the
+   time it covers, so a record only needs to remember when it was last
+   written to know which of its slots are stale. Like the catalog, it's
+   stored in host order. */
+
+#define HISTORY_MAGIC "TRRATES1"
+#define HISTORY_VERSION 1
+
+enum
+{
+  SAMPLES_PER_SERIES = 60 + 60 + 168,
+
+  /* how many records to add when the file is full */
+  MIN_GROWTH = 16
+};
+
+static const struct
+{
+  int interval;
+  int count;
+  int offset;
+}
+resolutions[TR_HISTORY_RESOLUTION_COUNT] =
+{
+  {    1,  60,   0 },
+  {   60,  60,  60 },
+  { 3600, 168, 120 }
+};
+
+struct history_header
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t recordCount;
+  uint32_t reserved;
+};
+
+struct history_record
+{
+  uint8_t        hash[SHA_DIGEST_LENGTH];
+  uint32_t       inUse;
+  int64_t        updated; /* the last time a sample was written */
+  tr_rate_sample samples[SAMPLES_PER_SERIES];
+};
+
+/* sorted by hash so that a torrent finds its record quickly */
+struct history_key
+{
+  uint8_t hash[SHA_DIGEST_LENGTH];
+  int series;
+};
+
+struct tr_rateHistory
+{
+  char * filename;
+
+  /* if the file couldn't be mapped, `map' is a heap copy of it
+     that's written out by tr_rateHistorySave () */
+  int fd;
+  bool isMapped;
+  bool isDirty;
+  uint8_t * map;
+  size_t mapSize;
+
+  uint32_t recordCount;
+  uint32_t unusedCount;
+
+  struct history_key * keys;
+  int keyCount;
+  int keyAlloc;
+};
+
+static struct history_record *
+getRecord (const tr_rateHistory * h, int series)
+{
+  assert (series >= 0);
+  assert ((uint32_t) series < h->recordCount);
+
+  return (struct history_record *)(h->map + sizeof (struct history_header)) + series;
+}
+
+static size_t
+getFileSize (uint32_t recordCount)
+{
+  return sizeof (struct history_header) + (size_t) recordCount * sizeof (struct history_record);
+}
+
+static void
+setRecordCount (tr_rateHistory * h, uint32_t recordCount)
+{
+  struct history_header header;
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, HISTORY_MAGIC, sizeof (header.magic));
+  header.version = HISTORY_VERSION;
+  header.recordSize = sizeof (struct history_record);
+  header.recordCount = recordCount;
+  memcpy (h->map, &header, sizeof (header));
+
+  h->recordCount = recordCount;
+}
+
+static bool
+historyIsValid (const uint8_t * map, size_t mapSize)
+{
+  struct history_header header;
+
+  if (mapSize < sizeof (header))
+    return false;
+
+  memcpy (&header, map, sizeof (header));
+
+  return !memcmp (header.magic, HISTORY_MAGIC, sizeof (header.magic))
+      && (header.version == HISTORY_VERSION)
+      && (header.recordSize == sizeof (struct history_record))
+      && (header.recordCount > 0)
+      && (mapSize == getFileSize (header.recordCount));
+}
+
+static void *
+mapFile (int fd, size_t size)
+{
+#ifdef WIN32
+  (void) fd;
+  (void) size;
+  return MAP_FAILED;
+#else
+  return mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#endif
+}
+
+static void
+unmapFile (void * map, size_t size)
+{
+#ifdef WIN32
+  (void) map;
+  (void) size;
+#else
+  munmap (map, size);
+#endif
+}
+
+static int
+compareKeyToHash (const void * hash, const void * vkey)
+{
+  const struct history_key * key = vkey;
+
+  return memcmp (hash, key->hash, SHA_DIGEST_LENGTH);
+}
+
+static int
+findKey (const tr_rateHistory * h, const uint8_t * hash, bool * exact)
+{
+  if (h->keyCount == 0)
+    {
+      *exact = false;
+      return 0;
+    }
+
+  return tr_lowerBound (hash, h->keys, h->keyCount, sizeof (struct history_key), compareKeyToHash, exact);
+}
+
+static bool
+addKey (tr_rateHistory * h, const uint8_t * hash, int series)
+{
+  bool exact;
+  const int pos = findKey (h, hash, &exact);
+
+  if (exact)
+    return false;
+
+  if (h->keyCount == h->keyAlloc)
+    {
+      h->keyAlloc = h->keyAlloc ? h->keyAlloc * 2 : MIN_GROWTH;
+      h->keys = tr_renew (struct history_key, h->keys, h->keyAlloc);
+    }
+
+  memmove (h->keys + pos + 1, h->keys + pos, sizeof (struct history_key) * (h->keyCount - pos));
+  memcpy (h->keys[pos].hash, hash, SHA_DIGEST_LENGTH);
+  h->keys[pos].series = series;
+  ++h->keyCount;
+  return true;
+}
+
+static void
+removeKey (tr_rateHistory * h, const uint8_t * hash)
+{
+  bool exact;
+  const int pos = findKey (h, hash, &exact);
+
+  if (exact)
+    {
+      --h->keyCount;
+      memmove (h->keys + pos, h->keys + pos + 1, sizeof (struct history_key) * (h->keyCount - pos));
+    }
+}
+
+/* switch from the mapped file to a heap copy of it */
+static void
+historyUnmap (tr_rateHistory * h, size_t heapSize)
+{
+  uint8_t * heap = tr_new0 (uint8_t, heapSize);
+
+  memcpy (heap, h->map, MIN (h->mapSize, heapSize));
+
+  if (h->isMapped)
+    unmapFile (h->map, h->mapSize);
+  else
+    tr_free (h->map);
+
+  if (h->fd != -1)
+    {
+      close (h->fd);
+      h->fd = -1;
+    }
+
+  h->map = heap;
+  h->mapSize = heapSize;
+  h->isMapped = false;
+  h->isDirty = true;
+}
+
+static void
+historyGrow (tr_rateHistory * h, uint32_t recordCount)
+{
+  const size_t size = getFileSize (recordCount);
+
+  if (h->isMapped)
+    {
+      void * map = MAP_FAILED;
+
+      if (!ftruncate (h->fd, (off_t) size))
+        map = mapFile (h->fd, size);
+
+      if (map == MAP_FAILED)
+        {
+          tr_logAddError (_("Couldn't save \"%1$s\": %2$s"), h->filename, tr_strerror (errno));
+          historyUnmap (h, size);
+        }
+      else
+        {
+          unmapFile (h->map, h->mapSize);
+          h->map = map;
+          h->mapSize = size;
+        }
+    }
+  else
+    {
+      h->map = tr_renew (uint8_t, h->map, size);
+      memset (h->map + h->mapSize, 0, size - h->mapSize);
+      h->mapSize = size;
+      h->isDirty = true;
+    }
+
+  h->unusedCount += recordCount - h->recordCount;
+  setRecordCount (h, recordCount);
+}
+
+static void
+historyLoad (tr_rateHistory * h)
+{
+  int fd;
+  uint32_t i;
+  struct stat st;
+  struct history_header header;
+  void * map = MAP_FAILED;
+  const size_t newSize = getFileSize (MIN_GROWTH);
+
+  fd = open (h->filename, O_RDWR | O_CREAT | O_BINARY, 0600);
+  if (fd == -1)
+    tr_logAddError (_("Couldn't read \"%1$s\": %2$s"), h->filename, tr_strerror (errno));
+
+  if ((fd != -1) && !fstat (fd, &st) && (st.st_size > 0))
+    {
+      map = mapFile (fd, (size_t) st.st_size);
+
+      if ((map != MAP_FAILED) && historyIsValid (map, (size_t) st.st_size))
+        {
+          h->map = map;
+          h->mapSize = (size_t) st.st_size;
+          h->isMapped = true;
+        }
+      else if (map == MAP_FAILED)
+        {
+          size_t len;
+          uint8_t * contents = tr_loadFile (h->filename, &len);
+
+          if ((contents != NULL) && historyIsValid (contents, len))
+            {
+              h->map = contents;
+              h->mapSize = len;
+            }
+          else
+            {
+              tr_free (contents);
+            }
+        }
+      else
+        {
+          unmapFile (map, (size_t) st.st_size);
+        }
+
+      if (h->map == NULL)
+        tr_logAddDebug ("Ignoring stale or corrupt rate history \"%s\"", h->filename);
+    }
+
+  if ((h->map == NULL) && (fd != -1) && !ftruncate (fd, 0) && !ftruncate (fd, (off_t) newSize))
+    {
+      map = mapFile (fd, newSize);
+
+      if (map != MAP_FAILED)
+        {
+          h->map = map;
+          h->mapSize = newSize;
+          h->isMapped = true;
+          setRecordCount (h, MIN_GROWTH);
+        }
+    }
+
+  if (h->map == NULL)
+    {
+      h->map = tr_new0 (uint8_t, newSize);
+      h->mapSize = newSize;
+      h->isDirty = true;
+      setRecordCount (h, MIN_GROWTH);
+    }
+
+  if (h->isMapped)
+    h->fd = fd;
+  else if (fd != -1)
+    close (fd);
+
+  /* index the torrents' records */
+  memcpy (&header, h->map, sizeof (header));
+  h->recordCount = header.recordCount;
+  for (i=1; i<h->recordCount; ++i)
+    {
+      struct history_record * r = getRecord (h, (int) i);
+
+      if (!r->inUse || !addKey (h, r->hash, (int) i))
+        {
+          memset (r, 0, sizeof (struct history_record));
+          ++h->unusedCount;
+        }
+    }
+
+  getRecord (h, TR_HISTORY_SESSION)->inUse = true;
+
+  tr_logAddDebug ("Rate history \"%s\" has %d torrents", h->filename, h->keyCount);
+}
+
+/* clear the slots that have gone stale since the record was last written */
+static struct history_record *
+advance (const tr_rateHistory * h, int series, time_t now)
+{
+  int i;
+  struct history_record * r = getRecord (h, series);
+
+  if (now <= r->updated)
+    return r;
+
+  for (i=0; i<TR_HISTORY_RESOLUTION_COUNT; ++i)
+    {
+      const int interval = resolutions[i].interval;
+      const int count = resolutions[i].count;
+      const int64_t newest = now / interval;
+      int64_t b = r->updated / interval;
+      const int64_t last = MIN (newest, b + count);
+
+      while (++b <= last)
+        memset (&r->samples[resolutions[i].offset + (int)(b % count)], 0, sizeof (tr_rate_sample));
+    }
+
+  r->updated = now;
+  return r;
+}
+
+static tr_rate_sample *
+getSample (struct history_record * r, int resolution)
+{
+  const int interval = resolutions[resolution].interval;
+  const int count = resolutions[resolution].count;
+
+  return &r->samples[resolutions[resolution].offset + (int)((r->updated / interval) % count)];
+}
+
+static void
+addBytes (tr_rateHistory * h, int series, time_t now, tr_direction direction, uint32_t bytes)
+{
+  int i;
+  struct history_record * r = advance (h, series, now);
+
+  for (i=0; i<TR_HISTORY_RESOLUTION_COUNT; ++i)
+    {
+      tr_rate_sample * s = getSample (r, i);
+
+      if (direction == TR_UP)
+        s->uploadedBytes += bytes;
+      else
+        s->downloadedBytes += bytes;
+    }
+
+  if (!h->isMapped)
+    h->isDirty = true;
+}
+
+/***
+****  PUBLIC
+***/
+
+tr_rateHistory *
+tr_rateHistoryNew (const char * filename)
+{
+  tr_rateHistory * h = tr_new0 (tr_rateHistory, 1);
+
+  h->filename = tr_strdup (filename);
+  h->fd = -1;
+  historyLoad (h);
+
+  return h;
+}
+
+void
+tr_rateHistorySave (tr_rateHistory * h)
+{
+  if (h->isMapped)
+    {
+#ifndef WIN32
+      msync (h->map, h->mapSize, MS_ASYNC);
+#endif
+    }
+  else if (h->isDirty)
+    {
+      int err = 0;
+      FILE * out;
+      char * tmp = tr_strdup_printf ("%s.tmp", h->filename);
+
+      if ((out = fopen (tmp, "wb+")) == NULL)
+        {
+          err = errno;
+        }
+      else
+        {
+          if (fwrite (h->map, 1, h->mapSize, out) != h->mapSize)
+            err = errno;
+          if (fclose (out) && !err)
+            err = errno;
+        }
+
+      if (!err && tr_rename (tmp, h->filename))
+        err = errno;
+
+      if (err)
+        {
+          tr_logAddError (_("Couldn't save \"%1$s\": %2$s"), h->filename, tr_strerror (err));
+          tr_remove (tmp);
+        }
+      else
+        {
+          h->isDirty = false;
+        }
+
+      tr_free (tmp);
+    }
+}
+
+void
+tr_rateHistoryFree (tr_rateHistory * h)
+{
+  if (h != NULL)
+    {
+      tr_rateHistorySave (h);
+
+      if (h->isMapped)
+        {
+          unmapFile (h->map, h->mapSize);
+          close (h->fd);
+        }
+      else
+        {
+          tr_free (h->map);
+        }
+
+      tr_free (h->keys);
+      tr_free (h->filename);
+      tr_free (h);
+    }
+}
+
+int
+tr_rateHistoryOpenSeries (tr_rateHistory * h, const uint8_t * hash)
+{
+  bool exact;
+  int series;
+  struct history_record * r;
+  const int pos = findKey (h, hash, &exact);
+
+  if (exact)
+    return h->keys[pos].series;
+
+  if (h->unusedCount == 0)
+    historyGrow (h, h->recordCount + MAX (MIN_GROWTH, h->recordCount / 2));
+
+  for (series=1; getRecord (h, series)->inUse; )
+    ++series;
+
+  r = getRecord (h, series);
+  memset (r, 0, sizeof (struct history_record));
+  memcpy (r->hash, hash, SHA_DIGEST_LENGTH);
+  r->inUse = true;
+  --h->unusedCount;
+  h->isDirty = true;
+  addKey (h, hash, series);
+
+  return series;
+}
+
+void
+tr_rateHistoryRemoveSeries (tr_rateHistory * h, int series)
+{
+  struct history_record * r;
+
+  if (series == TR_HISTORY_SESSION)
+    return;
+
+  r = getRecord (h, series);
+  if (r->inUse)
+    {
+      removeKey (h, r->hash);
+      memset (r, 0, sizeof (struct history_record));
+      ++h->unusedCount;
+      h->isDirty = true;
+    }
+}
+
+void
+tr_rateHistoryAdd (tr_rateHistory * h,
+                   int              series,
+                   time_t           now,
+                   tr_direction     direction,
+                   uint32_t         bytes)
+{
+  assert (tr_isDirection (direction));
+
+  addBytes (h, TR_HISTORY_SESSION, now, direction, bytes);
+
+  if (series != TR_HISTORY_SESSION)
+    addBytes (h, series, now, direction, bytes);
+}
+
+void
+tr_rateHistorySetPeers (tr_rateHistory * h, int series, time_t now, int peerCount)
+{
+  int i;
+  struct history_record * r = advance (h, series, now);
+
+  for (i=0; i<TR_HISTORY_RESOLUTION_COUNT; ++i)
+    {
+      tr_rate_sample * s = getSample (r, i);
+
+      s->peersConnected = MAX (s->peersConnected, (uint32_t) peerCount);
+    }
+
+  if (!h->isMapped)
+    h->isDirty = true;
+}
+
+int
+tr_rateHistoryInterval (int resolution)
+{
+  assert (0 <= resolution && resolution < TR_HISTORY_RESOLUTION_COUNT);
+
+  return resolutions[resolution].interval;
+}
+
+int
+tr_rateHistorySampleCount (int resolution)
+{
+  assert (0 <= resolution && resolution < TR_HISTORY_RESOLUTION_COUNT);
+
+  return resolutions[resolution].count;
+}
+
+void
+tr_rateHistoryGet (const tr_rateHistory * h,
+                   int                    series,
+                   int                    resolution,
+                   time_t                 now,
+                   tr_rate_sample       * setme)
+{
+  int i;
+  const struct history_record * r = getRecord (h, series);
+  const int interval = resolutions[resolution].interval;
+  const int count = resolutions[resolution].count;
+  const int64_t updated = r->updated / interval;
+  const int64_t newest = MAX (now, r->updated) / interval;
+
+  for (i=0; i<count; ++i)
+    {
+      const int64_t b = newest - count + 1 + i;
+
+      if ((r->updated == 0) || (b > updated) || (b <= updated - count))
+        memset (&setme[i], 0, sizeof (tr_rate_sample));
+      else
+        setme[i] = r->samples[resolutions[resolution].offset + (int)(b % count)];
+    }
+}
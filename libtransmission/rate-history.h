@@ -0,0 +1,99 @@
+/*
+ * This file Copyright (C) 2014 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#ifndef TR_RATE_HISTORY_H
+#define TR_RATE_HISTORY_H
+
+/**
+ * The rate history remembers how many bytes were transferred, and how
+ * many peers were connected, for the session and for each torrent.
+ *
+ * Every series keeps three rings of samples: the last minute by the
+ * second, the last hour by the minute and the last week by the hour.
+ * Bytes are added to all three as they're transferred, so nothing needs
+ * to be rolled up later. The rings live in a memory-mapped file in the
+ * config dir, so the history survives restarts and a series can be read
+ * without looking at any other.
+ */
+
+enum
+{
+  TR_HISTORY_SECONDS,
+  TR_HISTORY_MINUTES,
+  TR_HISTORY_HOURS,
+  TR_HISTORY_RESOLUTION_COUNT
+};
+
+/** @brief the session's own series. It counts every torrent's bytes. */
+#define TR_HISTORY_SESSION 0
+
+typedef struct tr_rate_sample
+{
+  uint64_t uploadedBytes;
+  uint64_t downloadedBytes;
+  uint32_t peersConnected; /* the most seen at once */
+  uint32_t reserved;
+}
+tr_rate_sample;
+
+typedef struct tr_rateHistory tr_rateHistory;
+
+tr_rateHistory * tr_rateHistoryNew          (const char           * filename);
+
+/** @brief save the history and free it */
+void             tr_rateHistoryFree         (tr_rateHistory       * history);
+
+/** @brief make sure the history file is up to date */
+void             tr_rateHistorySave         (tr_rateHistory       * history);
+
+/** @brief find the series for an info hash, adding it if it's new */
+int              tr_rateHistoryOpenSeries   (tr_rateHistory       * history,
+                                             const uint8_t        * hash);
+
+/** @brief forget a torrent's series */
+void             tr_rateHistoryRemoveSeries (tr_rateHistory       * history,
+                                             int                    series);
+
+/** @brief count bytes towards a torrent's series and the session's */
+void             tr_rateHistoryAdd          (tr_rateHistory       * history,
+                                             int                    series,
+                                             time_t                 now,
+                                             tr_direction           direction,
+                                             uint32_t               bytes);
+
+/** @brief note how many peers a series has connected right now */
+void             tr_rateHistorySetPeers     (tr_rateHistory       * history,
+                                             int                    series,
+                                             time_t                 now,
+                                             int                    peerCount);
+
+/** @return how many seconds one sample covers at `resolution' */
+int              tr_rateHistoryInterval     (int                    resolution);
+
+/** @return how many samples a series keeps at `resolution' */
+int              tr_rateHistorySampleCount  (int                    resolution);
+
+/**
+ * @brief copy a series' samples at `resolution', oldest first.
+ *
+ * `setme' must have room for tr_rateHistorySampleCount () samples.
+ * The last one is the sample that `now' falls in. Samples from
+ * before the series was started are zero.
+ */
+void             tr_rateHistoryGet          (const tr_rateHistory * history,
+                                             int                    series,
+                                             int                    resolution,
+                                             time_t                 now,
+                                             tr_rate_sample       * setme);
+
+#endif
@@ -7,10 +7,12 @@
  * $Id$
  */
 
+#include <errno.h>
 #include <string.h>
 
 #include "transmission.h"
 #include "completion.h"
+#include "journal.h"
 #include "log.h"
 #include "metainfo.h" /* tr_metainfoGetBasename () */
 #include "peer-mgr.h" /* pex */
@@ -27,11 +29,19 @@ enum
 };
 
 static char*
-getResumeFilename (const tr_torrent * tor)
+getResumeBasename (const tr_torrent * tor)
 {
   char * base = tr_metainfoGetBasename (tr_torrentInfo (tor));
-  char * filename = tr_strdup_printf ("%s" TR_PATH_DELIMITER_STR "%s.resume",
-                                      tr_getResumeDir (tor->session), base);
+  char * name = tr_strdup_printf ("%s.resume", base);
+  tr_free (base);
+  return name;
+}
+
+static char*
+getResumeFilename (const tr_torrent * tor)
+{
+  char * base = getResumeBasename (tor);
+  char * filename = tr_buildPath (tr_getResumeDir (tor->session), base, NULL);
   tr_free (base);
   return filename;
 }
@@ -419,23 +429,61 @@ loadFilenames (tr_variant * dict, tr_torrent * tor)
 ***/
 
 static void
-bitfieldToBenc (const tr_bitfield * b, tr_variant * benc)
+bitfieldToBenc (const tr_bitfield * b, tr_variant * dict, const tr_quark key)
 {
   if (tr_bitfieldHasAll (b))
     {
-      tr_variantInitStr (benc, "all", 3);
+      tr_variantDictAddStr (dict, key, "all");
     }
   else if (tr_bitfieldHasNone (b))
     {
-      tr_variantInitStr (benc, "none", 4);
+      tr_variantDictAddStr (dict, key, "none");
     }
   else
     {
-      size_t byte_count = 0;
-      uint8_t * raw = tr_bitfieldGetRaw (b, &byte_count);
-      tr_variantInitRaw (benc, raw, byte_count);
-      tr_free (raw);
+      size_t i, n;
+      size_t * runs = tr_bitfieldGetRuns (b, &n);
+
+      /* A torrent that's nearly done or barely started takes far fewer
+         bytes as a list of runs. Each one is at most "i4294967295e",
+         but usually much shorter, so compare with a cheaper guess. */
+      if (n * 6 < b->bit_count / 8)
+        {
+          tr_variant * l = tr_variantDictAddList (dict, key, n);
+          for (i=0; i<n; ++i)
+            tr_variantListAddInt (l, runs[i]);
+        }
+      else
+        {
+          size_t byte_count = 0;
+          uint8_t * raw = tr_bitfieldGetRaw (b, &byte_count);
+          tr_variantDictAddRaw (dict, key, raw, byte_count);
+          tr_free (raw);
+        }
+
+      tr_free (runs);
+    }
+}
+
+/* the inverse of bitfieldToBenc ()'s list of runs */
+static bool
+bitfieldFromRuns (tr_bitfield * b, tr_variant * list)
+{
+  size_t i;
+  bool ok = true;
+  const size_t n = tr_variantListSize (list);
+  size_t * runs = tr_new (size_t, n);
+
+  for (i=0; ok && i<n; ++i)
+    {
+      int64_t run;
+      ok = tr_variantGetInt (tr_variantListChild (list, i), &run) && (run >= 0);
+      runs[i] = ok ? (size_t) run : 0;
     }
+
+  ok = ok && tr_bitfieldSetRuns (b, runs, n);
+  tr_free (runs);
+  return ok;
 }
 
 
@@ -506,7 +554,7 @@ saveProgress (tr_variant * dict, tr_torrent * tor)
     tr_variantDictAddStr (prog, TR_KEY_have, "all");
 
   /* add the blocks bitfield */
-  bitfieldToBenc (&tor->completion.blockBitfield, tr_variantDictAdd (prog, TR_KEY_blocks));
+  bitfieldToBenc (&tor->completion.blockBitfield, prog, TR_KEY_blocks);
 }
 
 static uint64_t
@@ -610,7 +658,12 @@ loadProgress (tr_variant * dict, tr_torrent * tor)
           size_t buflen;
           const uint8_t * buf;
 
-          if (!tr_variantGetRaw (b, &buf, &buflen))
+          if (tr_variantIsList (b))
+            {
+              if (!bitfieldFromRuns (&blocks, b))
+                err = "Invalid value for \"blocks\"";
+            }
+          else if (!tr_variantGetRaw (b, &buf, &buflen))
             err = "Invalid value for \"blocks\"";
           else if ((buflen == 3) && !memcmp (buf, "all", 3))
             tr_bitfieldSetHasAll (&blocks);
@@ -658,7 +711,7 @@ tr_torrentSaveResume (tr_torrent * tor)
   if (!tr_isTorrent (tor))
     return;
 
-  tr_variantInitDict (&top, 50); /* arbitrary "big enough" number */
+  tr_variantInitArenaDict (&top, 50); /* arbitrary "big enough" number */
   tr_variantDictAddInt (&top, TR_KEY_seeding_time_seconds, tor->secondsSeeding);
   tr_variantDictAddInt (&top, TR_KEY_downloading_time_seconds, tor->secondsDownloading);
   tr_variantDictAddInt (&top, TR_KEY_activity_date, tor->activityDate);
@@ -686,49 +739,72 @@ tr_torrentSaveResume (tr_torrent * tor)
   saveFilenames (&top, tor);
   saveName (&top, tor);
 
-  filename = getResumeFilename (tor);
-  if ((err = tr_variantToFile (&top, TR_VARIANT_FMT_BENC, filename)))
-    tr_torrentSetLocalError (tor, "Unable to save resume file: %s", tr_strerror (err));
-  tr_free (filename);
+  if (tor->session->resumeJournal != NULL)
+    {
+      /* the journal writes it out later, along with the other torrents' */
+      int len;
+      char * str = tr_variantToStr (&top, TR_VARIANT_FMT_BENC, &len);
+      char * name = getResumeBasename (tor);
+      tr_journalPut (tor->session->resumeJournal, name, str, len);
+      tr_free (name);
+    }
+  else
+    {
+      filename = getResumeFilename (tor);
+      if ((err = tr_variantToFile (&top, TR_VARIANT_FMT_BENC, filename)))
+        tr_torrentSetLocalError (tor, "Unable to save resume file: %s", tr_strerror (err));
+      tr_free (filename);
+    }
 
   tr_variantFree (&top);
 }
 
+int
+tr_torrentReadResume (const tr_torrent * tor, tr_variant * setme)
+{
+  int err;
+  char * filename = getResumeFilename (tor);
+  char * name = getResumeBasename (tor);
+  char * pending;
+  size_t len;
+
+  /* the newest version may still be waiting in the journal */
+  if (tor->session->resumeJournal && tr_journalGet (tor->session->resumeJournal, name, &pending, &len))
+    err = pending ? tr_variantFromBencInPlace (setme, pending, len) : ENOENT;
+  else
+    err = tr_variantFromFile (setme, TR_VARIANT_FMT_BENC, filename);
+
+  if (err)
+    tr_logAddTorDbg (tor, "Couldn't read \"%s\"", filename);
+  else
+    tr_logAddTorDbg (tor, "Read resume file \"%s\"", filename);
+
+  tr_free (name);
+  tr_free (filename);
+  return err;
+}
+
 static uint64_t
-loadFromFile (tr_torrent * tor, uint64_t fieldsToLoad)
+loadFromVariant (tr_torrent * tor, uint64_t fieldsToLoad, tr_variant * top)
 {
   size_t len;
   int64_t  i;
   const char * str;
-  char * filename;
-  tr_variant top;
   bool boolVal;
   uint64_t fieldsLoaded = 0;
   const bool wasDirty = tor->isDirty;
 
   assert (tr_isTorrent (tor));
 
-  filename = getResumeFilename (tor);
-
-  if (tr_variantFromFile (&top, TR_VARIANT_FMT_BENC, filename))
-    {
-      tr_logAddTorDbg (tor, "Couldn't read \"%s\"", filename);
-
-      tr_free (filename);
-      return fieldsLoaded;
-    }
-
-  tr_logAddTorDbg (tor, "Read resume file \"%s\"", filename);
-
   if ((fieldsToLoad & TR_FR_CORRUPT)
-      && tr_variantDictFindInt (&top, TR_KEY_corrupt, &i))
+      && tr_variantDictFindInt (top, TR_KEY_corrupt, &i))
     {
       tor->corruptPrev = i;
       fieldsLoaded |= TR_FR_CORRUPT;
     }
 
   if ((fieldsToLoad & (TR_FR_PROGRESS | TR_FR_DOWNLOAD_DIR))
-      && (tr_variantDictFindStr (&top, TR_KEY_destination, &str, &len))
+      && (tr_variantDictFindStr (top, TR_KEY_destination, &str, &len))
       && (str && *str))
     {
       const bool is_current_dir = tor->currentDir == tor->downloadDir;
@@ -740,7 +816,7 @@ loadFromFile (tr_torrent * tor, uint64_t fieldsToLoad)
     }
 
   if ((fieldsToLoad & (TR_FR_PROGRESS | TR_FR_INCOMPLETE_DIR))
-      && (tr_variantDictFindStr (&top, TR_KEY_incomplete_dir, &str, &len))
+      && (tr_variantDictFindStr (top, TR_KEY_incomplete_dir, &str, &len))
       && (str && *str))
     {
       const bool is_current_dir = tor->currentDir == tor->incompleteDir;
@@ -752,70 +828,70 @@ loadFromFile (tr_torrent * tor, uint64_t fieldsToLoad)
     }
 
   if ((fieldsToLoad & TR_FR_DOWNLOADED)
-      && tr_variantDictFindInt (&top, TR_KEY_downloaded, &i))
+      && tr_variantDictFindInt (top, TR_KEY_downloaded, &i))
     {
       tor->downloadedPrev = i;
       fieldsLoaded |= TR_FR_DOWNLOADED;
     }
 
   if ((fieldsToLoad & TR_FR_UPLOADED)
-      && tr_variantDictFindInt (&top, TR_KEY_uploaded, &i))
+      && tr_variantDictFindInt (top, TR_KEY_uploaded, &i))
     {
       tor->uploadedPrev = i;
       fieldsLoaded |= TR_FR_UPLOADED;
     }
 
   if ((fieldsToLoad & TR_FR_MAX_PEERS)
-      && tr_variantDictFindInt (&top, TR_KEY_max_peers, &i))
+      && tr_variantDictFindInt (top, TR_KEY_max_peers, &i))
     {
       tor->maxConnectedPeers = i;
       fieldsLoaded |= TR_FR_MAX_PEERS;
     }
 
   if ((fieldsToLoad & TR_FR_RUN)
-      && tr_variantDictFindBool (&top, TR_KEY_paused, &boolVal))
+      && tr_variantDictFindBool (top, TR_KEY_paused, &boolVal))
     {
       tor->isRunning = !boolVal;
       fieldsLoaded |= TR_FR_RUN;
     }
 
   if ((fieldsToLoad & TR_FR_ADDED_DATE)
-      && tr_variantDictFindInt (&top, TR_KEY_added_date, &i))
+      && tr_variantDictFindInt (top, TR_KEY_added_date, &i))
     {
       tor->addedDate = i;
       fieldsLoaded |= TR_FR_ADDED_DATE;
     }
 
   if ((fieldsToLoad & TR_FR_DONE_DATE)
-      && tr_variantDictFindInt (&top, TR_KEY_done_date, &i))
+      && tr_variantDictFindInt (top, TR_KEY_done_date, &i))
     {
       tor->doneDate = i;
       fieldsLoaded |= TR_FR_DONE_DATE;
     }
 
   if ((fieldsToLoad & TR_FR_ACTIVITY_DATE)
-      && tr_variantDictFindInt (&top, TR_KEY_activity_date, &i))
+      && tr_variantDictFindInt (top, TR_KEY_activity_date, &i))
     {
       tr_torrentSetActivityDate (tor, i);
       fieldsLoaded |= TR_FR_ACTIVITY_DATE;
     }
 
   if ((fieldsToLoad & TR_FR_TIME_SEEDING)
-      && tr_variantDictFindInt (&top, TR_KEY_seeding_time_seconds, &i))
+      && tr_variantDictFindInt (top, TR_KEY_seeding_time_seconds, &i))
     {
       tor->secondsSeeding = i;
       fieldsLoaded |= TR_FR_TIME_SEEDING;
     }
 
   if ((fieldsToLoad & TR_FR_TIME_DOWNLOADING)
-      && tr_variantDictFindInt (&top, TR_KEY_downloading_time_seconds, &i))
+      && tr_variantDictFindInt (top, TR_KEY_downloading_time_seconds, &i))
     {
       tor->secondsDownloading = i;
       fieldsLoaded |= TR_FR_TIME_DOWNLOADING;
     }
 
   if ((fieldsToLoad & TR_FR_BANDWIDTH_PRIORITY)
-      && tr_variantDictFindInt (&top, TR_KEY_bandwidth_priority, &i)
+      && tr_variantDictFindInt (top, TR_KEY_bandwidth_priority, &i)
       && tr_isPriority (i))
     {
       tr_torrentSetPriority (tor, i);
@@ -823,39 +899,37 @@ loadFromFile (tr_torrent * tor, uint64_t fieldsToLoad)
     }
 
   if (fieldsToLoad & TR_FR_PEERS)
-    fieldsLoaded |= loadPeers (&top, tor);
+    fieldsLoaded |= loadPeers (top, tor);
 
   if (fieldsToLoad & TR_FR_FILE_PRIORITIES)
-    fieldsLoaded |= loadFilePriorities (&top, tor);
+    fieldsLoaded |= loadFilePriorities (top, tor);
 
   if (fieldsToLoad & TR_FR_PROGRESS)
-    fieldsLoaded |= loadProgress (&top, tor);
+    fieldsLoaded |= loadProgress (top, tor);
 
   if (fieldsToLoad & TR_FR_DND)
-    fieldsLoaded |= loadDND (&top, tor);
+    fieldsLoaded |= loadDND (top, tor);
 
   if (fieldsToLoad & TR_FR_SPEEDLIMIT)
-    fieldsLoaded |= loadSpeedLimits (&top, tor);
+    fieldsLoaded |= loadSpeedLimits (top, tor);
 
   if (fieldsToLoad & TR_FR_RATIOLIMIT)
-    fieldsLoaded |= loadRatioLimits (&top, tor);
+    fieldsLoaded |= loadRatioLimits (top, tor);
 
   if (fieldsToLoad & TR_FR_IDLELIMIT)
-    fieldsLoaded |= loadIdleLimits (&top, tor);
+    fieldsLoaded |= loadIdleLimits (top, tor);
 
   if (fieldsToLoad & TR_FR_FILENAMES)
-    fieldsLoaded |= loadFilenames (&top, tor);
+    fieldsLoaded |= loadFilenames (top, tor);
 
   if (fieldsToLoad & TR_FR_NAME)
-    fieldsLoaded |= loadName (&top, tor);
+    fieldsLoaded |= loadName (top, tor);
 
   /* loading the resume file triggers of a lot of changes,
    * but none of them needs to trigger a re-saving of the
    * same resume information... */
   tor->isDirty = wasDirty;
 
-  tr_variantFree (&top);
-  tr_free (filename);
   return fieldsLoaded;
 }
 
@@ -907,9 +981,10 @@ useFallbackFields (tr_torrent * tor, uint64_t fields, const tr_ctor * ctor)
 }
 
 uint64_t
-tr_torrentLoadResume (tr_torrent *    tor,
-                      uint64_t        fieldsToLoad,
-                      const tr_ctor * ctor)
+tr_torrentLoadResumeFrom (tr_torrent *    tor,
+                          uint64_t        fieldsToLoad,
+                          const tr_ctor * ctor,
+                          tr_variant    * resume)
 {
   uint64_t ret = 0;
 
@@ -917,17 +992,48 @@ tr_torrentLoadResume (tr_torrent *    tor,
 
   ret |= useManditoryFields (tor, fieldsToLoad, ctor);
   fieldsToLoad &= ~ret;
-  ret |= loadFromFile (tor, fieldsToLoad);
+  if (resume != NULL)
+    ret |= loadFromVariant (tor, fieldsToLoad, resume);
   fieldsToLoad &= ~ret;
   ret |= useFallbackFields (tor, fieldsToLoad, ctor);
 
   return ret;
 }
 
+uint64_t
+tr_torrentLoadResume (tr_torrent *    tor,
+                      uint64_t        fieldsToLoad,
+                      const tr_ctor * ctor)
+{
+  uint64_t ret;
+  tr_variant top;
+
+  if (tr_torrentReadResume (tor, &top))
+    {
+      ret = tr_torrentLoadResumeFrom (tor, fieldsToLoad, ctor, NULL);
+    }
+  else
+    {
+      ret = tr_torrentLoadResumeFrom (tor, fieldsToLoad, ctor, &top);
+      tr_variantFree (&top);
+    }
+
+  return ret;
+}
+
 void
 tr_torrentRemoveResume (const tr_torrent * tor)
 {
-  char * filename = getResumeFilename (tor);
-  tr_remove (filename);
-  tr_free (filename);
+  if (tor->session->resumeJournal != NULL)
+    {
+      char * name = getResumeBasename (tor);
+      tr_journalPut (tor->session->resumeJournal, name, NULL, 0);
+      tr_free (name);
+    }
+  else
+    {
+      char * filename = getResumeFilename (tor);
+      tr_remove (filename);
+      tr_free (filename);
+    }
 }
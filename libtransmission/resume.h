@@ -47,6 +47,25 @@ uint64_t tr_torrentLoadResume   (tr_torrent        * tor,
                                  uint64_t            fieldsToLoad,
                                  const tr_ctor     * ctor);
 
+struct tr_variant;
+
+/**
+ * Read and parse the .resume file without applying it.
+ * This doesn't touch the session, so it can be called from any thread.
+ * Returns 0 on success, or an errno.
+ */
+int      tr_torrentReadResume   (const tr_torrent  * tor,
+                                 struct tr_variant * setme);
+
+/**
+ * Like tr_torrentLoadResume (), but with a .resume file that was already
+ * read by tr_torrentReadResume (). `resume' may be NULL if there isn't one.
+ */
+uint64_t tr_torrentLoadResumeFrom (tr_torrent      * tor,
+                                   uint64_t          fieldsToLoad,
+                                   const tr_ctor   * ctor,
+                                   struct tr_variant * resume);
+
 void     tr_torrentSaveResume   (tr_torrent        * tor);
 
 void     tr_torrentRemoveResume (const tr_torrent  * tor);
@@ -11,6 +11,7 @@
 #include <errno.h>
 #include <string.h> /* memcpy */
 
+#include <sys/stat.h>  /* stat */
 #include <unistd.h>    /* close */
 
 #ifdef HAVE_ZLIB
@@ -18,8 +19,10 @@
 #endif
 
 #include <event2/buffer.h>
+#include <event2/bufferevent.h>
 #include <event2/event.h>
 #include <event2/http.h>
+#include <event2/keyvalq_struct.h>
 #include <event2/http_struct.h> /* TODO: eventually remove this */
 
 #include "transmission.h"
@@ -28,11 +31,12 @@
 #include "list.h"
 #include "log.h"
 #include "net.h"
-#include "platform.h" /* tr_getWebClientDir () */
+#include "platform.h" /* tr_getWebClientDir (), tr_lock () */
 #include "ptrarray.h"
 #include "rpcimpl.h"
 #include "rpc-server.h"
 #include "session.h"
+#include "torrent.h"
 #include "trevent.h"
 #include "utils.h"
 #include "variant.h"
@@ -67,9 +71,31 @@ struct tr_rpc_server
     char             * sessionId;
     time_t             sessionIdExpiresAt;
 
+    /* the /events endpoint */
+    struct tr_rpc_event * events;
+    int64_t            eventSeq;
+    tr_ptrArray        eventClients;
+    struct event     * eventTimer;
+    bool               eventsArePrimed;
+    time_t             eventsWantedUntil;
+    time_t             eventHeartbeatAt;
+    unsigned int       eventSpeed_Bps[2];
+    int                eventTorrentCount;
+    int                eventActiveCount;
+
+    /* the web client's files, in memory and pre-gzipped */
+    tr_ptrArray        webFiles;
+    size_t             webFilesBytes;
+
 #ifdef HAVE_ZLIB
     bool               isStreamInitialized;
     z_stream           stream;
+
+    /* large responses are compressed on a worker thread */
+    tr_lock          * compressLock;
+    tr_list          * compressJobs;
+    size_t             compressBytesQueued;
+    bool               compressThreadRunning;
 #endif
 };
 
@@ -325,82 +351,353 @@ mimetype_guess (const char * path)
   return "application/octet-stream";
 }
 
-static void
-add_response (struct evhttp_request * req,
-              struct tr_rpc_server  * server,
-              struct evbuffer       * out,
-              struct evbuffer       * content)
+/***
+****  Compressing responses
+***/
+
+enum
 {
-#ifndef HAVE_ZLIB
-  evbuffer_add_buffer (out, content);
-#else
-  const char * key = "Accept-Encoding";
-  const char * encoding = evhttp_find_header (req->input_headers, key);
-  const int do_compress = encoding && strstr (encoding, "gzip");
+  /* responses smaller than this aren't worth compressing */
+  COMPRESS_MIN_BYTES = 1024,
 
-  if (!do_compress)
-    {
-      evbuffer_add_buffer (out, content);
-    }
-  else
+  /* responses at least this big are compressed on a worker thread */
+  COMPRESS_OFFLOAD_MIN_BYTES = 64 * 1024,
+
+  /* responses at least this big get the fastest compression */
+  COMPRESS_FAST_MIN_BYTES = 1024 * 1024,
+
+  /* if the worker falls this far behind, compress in the event thread */
+  COMPRESS_MAX_BYTES_QUEUED = 32 * 1024 * 1024,
+
+  COMPRESS_CHUNK_SIZE = 16 * 1024
+};
+
+#ifdef HAVE_ZLIB
+
+/* walk the Accept-Encoding list, e.g. "gzip;q=1.0, identity; q=0.5, *;q=0" */
+static bool
+client_accepts_gzip (struct evhttp_request * req)
+{
+  bool accepts = false;
+  bool explicit = false;
+  const char * str = evhttp_find_header (req->input_headers, "Accept-Encoding");
+
+  while (str && *str && !explicit)
     {
-      int state;
-      struct evbuffer_iovec iovec[1];
-      void * content_ptr = evbuffer_pullup (content, -1);
-      const size_t content_len = evbuffer_get_length (content);
+      const size_t len = strcspn (str, ",");
+      char * token = tr_strndup (str, len);
+      char * name = token + strspn (token, " \t");
+      char * q = strchr (name, ';');
+
+      if (q != NULL)
+        *q++ = '\0';
+      name[strcspn (name, " \t")] = '\0';
+
+      explicit = !strcmp (name, "gzip") || !strcmp (name, "x-gzip");
 
-      if (!server->isStreamInitialized)
+      if (explicit || !strcmp (name, "*"))
         {
-          int compressionLevel;
+          const char * val = q ? strstr (q, "q=") : NULL;
+          accepts = !val || (strtod (val + 2, NULL) > 0);
+        }
+
+      tr_free (token);
+      str = str[len] ? str + len + 1 : NULL;
+    }
+
+  return accepts;
+}
+
+/* small responses are cheap to compress well, but big ones
+   would keep the worker (or the event thread) busy for too long */
+static int
+get_compression_level (size_t len)
+{
+  if (len >= COMPRESS_FAST_MIN_BYTES)
+    return Z_BEST_SPEED;
 
-          server->isStreamInitialized = true;
-          server->stream.zalloc = (alloc_func) Z_NULL;
-          server->stream.zfree = (free_func) Z_NULL;
-          server->stream.opaque = (voidpf) Z_NULL;
+  if (len >= COMPRESS_OFFLOAD_MIN_BYTES)
+    return Z_DEFAULT_COMPRESSION;
 
-          /* zlib's manual says: "Add 16 to windowBits to write a simple gzip header
-           * and trailer around the compressed data instead of a zlib wrapper." */
 #ifdef TR_LIGHTWEIGHT
-          compressionLevel = Z_DEFAULT_COMPRESSION;
+  return Z_DEFAULT_COMPRESSION;
 #else
-          compressionLevel = Z_BEST_COMPRESSION;
+  return Z_BEST_COMPRESSION;
 #endif
-          deflateInit2 (&server->stream, compressionLevel, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY);
-        }
+}
 
-      server->stream.next_in = content_ptr;
-      server->stream.avail_in = content_len;
+static void
+gzip_stream_init (z_stream * stream)
+{
+  memset (stream, 0, sizeof (z_stream));
+  stream->zalloc = (alloc_func) Z_NULL;
+  stream->zfree = (free_func) Z_NULL;
+  stream->opaque = (voidpf) Z_NULL;
+
+  /* zlib's manual says: "Add 16 to windowBits to write a simple gzip header
+   * and trailer around the compressed data instead of a zlib wrapper." */
+  deflateInit2 (stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY);
+}
 
-      /* allocate space for the raw data and call deflate () just once --
-       * we won't use the deflated data if it's longer than the raw data,
-       * so it's okay to let deflate () run out of output buffer space */
-      evbuffer_reserve_space (out, content_len, iovec, 1);
-      server->stream.next_out = iovec[0].iov_base;
-      server->stream.avail_out = iovec[0].iov_len;
-      state = deflate (&server->stream, Z_FINISH);
+/**
+ * Gzip `in' into `out' a chunk at a time, without flattening `in' first.
+ * Returns true on success. Returns false, leaving `out' untouched,
+ * if the result wouldn't be smaller than the original.
+ */
+static bool
+gzip_evbuffer (z_stream        * stream,
+               int               level,
+               struct evbuffer * in,
+               struct evbuffer * out)
+{
+  int i;
+  int n;
+  int state = Z_OK;
+  struct evbuffer_iovec * in_vec;
+  struct evbuffer * tmp = evbuffer_new ();
+  const size_t in_len = evbuffer_get_length (in);
+  bool success;
+
+  n = evbuffer_peek (in, -1, NULL, NULL, 0);
+  in_vec = tr_new (struct evbuffer_iovec, n);
+  evbuffer_peek (in, -1, NULL, in_vec, n);
+
+  deflateReset (stream);
+  deflateParams (stream, level, Z_DEFAULT_STRATEGY);
+
+  for (i=0; i<n && state==Z_OK && evbuffer_get_length (tmp)<in_len; ++i)
+    {
+      const int flush = i == n-1 ? Z_FINISH : Z_NO_FLUSH;
 
-      if (state == Z_STREAM_END)
+      stream->next_in = in_vec[i].iov_base;
+      stream->avail_in = in_vec[i].iov_len;
+
+      do
         {
-          iovec[0].iov_len -= server->stream.avail_out;
+          struct evbuffer_iovec out_vec;
+
+          evbuffer_reserve_space (tmp, COMPRESS_CHUNK_SIZE, &out_vec, 1);
+          stream->next_out = out_vec.iov_base;
+          stream->avail_out = out_vec.iov_len;
+          state = deflate (stream, flush);
+          out_vec.iov_len -= stream->avail_out;
+          evbuffer_commit_space (tmp, &out_vec, 1);
+
+          /* not an error -- just nothing left to do until the next chunk */
+          if (state == Z_BUF_ERROR && flush == Z_NO_FLUSH)
+            state = Z_OK;
+        }
+      while (state == Z_OK && (stream->avail_in > 0 || stream->avail_out == 0 || flush == Z_FINISH));
+    }
+
+  success = state == Z_STREAM_END && evbuffer_get_length (tmp) < in_len;
 
 #if 0
-          fprintf (stderr, "compressed response is %.2f of original (raw==%"TR_PRIuSIZE" bytes; compressed==%"TR_PRIuSIZE")\n",
-                   (double)evbuffer_get_length (out)/content_len,
-                   content_len, evbuffer_get_length (out));
+  fprintf (stderr, "compressed response is %.2f of original (raw==%"TR_PRIuSIZE" bytes; compressed==%"TR_PRIuSIZE")\n",
+           (double)evbuffer_get_length (tmp)/in_len, in_len, evbuffer_get_length (tmp));
 #endif
-          evhttp_add_header (req->output_headers,
-                             "Content-Encoding", "gzip");
-        }
-      else
+
+  if (success)
+    evbuffer_add_buffer (out, tmp);
+
+  evbuffer_free (tmp);
+  tr_free (in_vec);
+  return success;
+}
+
+static z_stream*
+get_server_stream (struct tr_rpc_server * server)
+{
+  if (!server->isStreamInitialized)
+    {
+      server->isStreamInitialized = true;
+      gzip_stream_init (&server->stream);
+    }
+
+  return &server->stream;
+}
+
+struct compress_job
+{
+  struct evhttp_request * req;
+  struct evbuffer       * content;
+  struct evbuffer       * gzipped;
+  bool                    success;
+};
+
+static void
+compress_job_free (struct compress_job * job)
+{
+  evbuffer_free (job->gzipped);
+  evbuffer_free (job->content);
+  tr_free (job);
+}
+
+/* the client went away before its response was ready */
+static void
+on_compress_job_closed (struct evhttp_connection * evcon UNUSED, void * vjob)
+{
+  ((struct compress_job*)vjob)->req = NULL;
+}
+
+static void
+compress_job_done (void * vjob)
+{
+  struct compress_job * job = vjob;
+
+  if (job->req != NULL)
+    {
+      evhttp_connection_set_closecb (evhttp_request_get_connection (job->req), NULL, NULL);
+
+      if (job->success)
+        evhttp_add_header (job->req->output_headers, "Content-Encoding", "gzip");
+      evhttp_send_reply (job->req, HTTP_OK, "OK", job->success ? job->gzipped : job->content);
+    }
+
+  compress_job_free (job);
+}
+
+static void
+compress_thread_func (void * vserver)
+{
+  z_stream stream;
+  struct compress_job * job;
+  tr_rpc_server * server = vserver;
+
+  gzip_stream_init (&stream);
+
+  tr_lockLock (server->compressLock);
+
+  while ((job = tr_list_pop_front (&server->compressJobs)))
+    {
+      const size_t len = evbuffer_get_length (job->content);
+
+      tr_lockUnlock (server->compressLock);
+      job->success = gzip_evbuffer (&stream, get_compression_level (len), job->content, job->gzipped);
+      tr_lockLock (server->compressLock);
+
+      server->compressBytesQueued -= len;
+      tr_runInEventThread (server->session, compress_job_done, job);
+    }
+
+  /* cleared while still holding the lock,
+     so that stop_compressing () can tell when we're done */
+  server->compressThreadRunning = false;
+  tr_lockUnlock (server->compressLock);
+
+  deflateEnd (&stream);
+}
+
+/* hand a big response off to the worker thread. Returns false if it's too backed up */
+static bool
+queue_compress_job (struct tr_rpc_server  * server,
+                    struct evhttp_request * req,
+                    struct evbuffer       * content)
+{
+  bool queued;
+  const size_t len = evbuffer_get_length (content);
+
+  if (server->compressLock == NULL)
+    server->compressLock = tr_lockNew ();
+
+  tr_lockLock (server->compressLock);
+
+  queued = server->compressBytesQueued + len <= COMPRESS_MAX_BYTES_QUEUED;
+
+  if (queued)
+    {
+      struct compress_job * job = tr_new0 (struct compress_job, 1);
+      job->req = req;
+      job->content = evbuffer_new ();
+      job->gzipped = evbuffer_new ();
+      evbuffer_add_buffer (job->content, content);
+      evhttp_connection_set_closecb (evhttp_request_get_connection (req), on_compress_job_closed, job);
+
+      server->compressBytesQueued += len;
+      tr_list_append (&server->compressJobs, job);
+
+      if (!server->compressThreadRunning)
         {
-          memcpy (iovec[0].iov_base, content_ptr, content_len);
-          iovec[0].iov_len = content_len;
+          server->compressThreadRunning = true;
+          tr_threadNew (compress_thread_func, server);
         }
+    }
+
+  tr_lockUnlock (server->compressLock);
+  return queued;
+}
+
+/* drop the queued jobs, then wait for the worker to finish */
+static void
+stop_compressing (struct tr_rpc_server * server)
+{
+  struct compress_job * job;
+
+  if (server->compressLock == NULL)
+    return;
 
-      evbuffer_commit_space (out, iovec, 1);
-      deflateReset (&server->stream);
+  tr_lockLock (server->compressLock);
+
+  while ((job = tr_list_pop_front (&server->compressJobs)))
+    {
+      server->compressBytesQueued -= evbuffer_get_length (job->content);
+      evhttp_connection_set_closecb (evhttp_request_get_connection (job->req), NULL, NULL);
+      compress_job_free (job);
+    }
+
+  while (server->compressThreadRunning)
+    {
+      tr_lockUnlock (server->compressLock);
+      tr_wait_msec (10);
+      tr_lockLock (server->compressLock);
+    }
+
+  tr_lockUnlock (server->compressLock);
+}
+
+#endif /* HAVE_ZLIB */
+
+/**
+ * Send `content' as a 200 OK, gzipped if it's big enough and the client
+ * accepts that. Big responses are compressed on a worker thread, so the
+ * reply may go out after this returns. `content' is drained either way.
+ */
+static void
+send_response (struct evhttp_request * req,
+               struct tr_rpc_server  * server,
+               struct evbuffer       * content)
+{
+#ifdef HAVE_ZLIB
+  const size_t len = evbuffer_get_length (content);
+
+  if (len >= COMPRESS_MIN_BYTES)
+    {
+      evhttp_add_header (req->output_headers, "Vary", "Accept-Encoding");
+
+      if (client_accepts_gzip (req))
+        {
+          struct evbuffer * gzipped;
+
+          if ((len >= COMPRESS_OFFLOAD_MIN_BYTES) && queue_compress_job (server, req, content))
+            return;
+
+          gzipped = evbuffer_new ();
+
+          if (gzip_evbuffer (get_server_stream (server), get_compression_level (len), content, gzipped))
+            {
+              evhttp_add_header (req->output_headers, "Content-Encoding", "gzip");
+              evhttp_send_reply (req, HTTP_OK, "OK", gzipped);
+              evbuffer_drain (content, len);
+              evbuffer_free (gzipped);
+              return;
+            }
+
+          evbuffer_free (gzipped);
+        }
     }
 #endif
+
+  evhttp_send_reply (req, HTTP_OK, "OK", content);
 }
 
 static void
@@ -416,12 +713,127 @@ add_time_header (struct evkeyvalq  * headers,
   evhttp_add_header (headers, key, buf);
 }
 
+/***
+****  The web client's files
+***/
+
+enum
+{
+  /* how much of the web client to keep in memory */
+#ifdef TR_LIGHTWEIGHT
+  WEB_FILES_MAX_BYTES = 2 * 1024 * 1024
+#else
+  WEB_FILES_MAX_BYTES = 16 * 1024 * 1024
+#endif
+};
+
+struct web_file
+{
+  char   * filename;
+  time_t   mtime;
+  size_t   len;
+  void   * content;
+  void   * gzipped; /* NULL if gzipping doesn't make it any smaller */
+  size_t   gzipped_len;
+};
+
+static int
+compare_web_files (const void * va, const void * vb)
+{
+  const struct web_file * a = va;
+  const struct web_file * b = vb;
+
+  return strcmp (a->filename, b->filename);
+}
+
 static void
-evbuffer_ref_cleanup_tr_free (const void  * data UNUSED,
-                              size_t        datalen UNUSED,
-                              void        * extra)
+web_file_free (void * vfile)
+{
+  struct web_file * file = vfile;
+
+  tr_free (file->gzipped);
+  tr_free (file->content);
+  tr_free (file->filename);
+  tr_free (file);
+}
+
+static size_t
+web_file_bytes (const struct web_file * file)
+{
+  return file->len + file->gzipped_len;
+}
+
+/**
+ * Get a file from the cache, (re)loading it if it's new or has changed
+ * on disk. If the cache is full, the file is loaded anyway but not kept,
+ * and `is_cached' is set to false so the caller knows to free it.
+ * Returns NULL and sets errno if the file can't be read.
+ */
+static struct web_file*
+get_web_file (struct tr_rpc_server * server,
+              const char           * filename,
+              bool                 * is_cached)
 {
-  tr_free (extra);
+  struct stat sb;
+  struct web_file key;
+  struct web_file * file;
+
+  key.filename = (char*) filename;
+  file = tr_ptrArrayFindSorted (&server->webFiles, &key, compare_web_files);
+
+  if (!stat (filename, &sb) && file && (file->mtime == sb.st_mtime) && (file->len == (size_t)sb.st_size))
+    {
+      *is_cached = true;
+      return file;
+    }
+
+  if (file != NULL) /* stale */
+    {
+      tr_ptrArrayRemoveSortedPointer (&server->webFiles, file, compare_web_files);
+      server->webFilesBytes -= web_file_bytes (file);
+      web_file_free (file);
+    }
+
+  file = tr_new0 (struct web_file, 1);
+  file->content = tr_loadFile (filename, &file->len);
+  if (file->content == NULL)
+    {
+      const int err = errno;
+      web_file_free (file);
+      errno = err;
+      return NULL;
+    }
+
+  file->filename = tr_strdup (filename);
+  file->mtime = sb.st_mtime;
+
+#ifdef HAVE_ZLIB
+  /* it'll be sent over and over, so it's worth compressing as well as we can */
+  if (file->len >= COMPRESS_MIN_BYTES)
+    {
+      struct evbuffer * in = evbuffer_new ();
+      struct evbuffer * out = evbuffer_new ();
+
+      evbuffer_add_reference (in, file->content, file->len, NULL, NULL);
+      if (gzip_evbuffer (get_server_stream (server), Z_BEST_COMPRESSION, in, out))
+        {
+          file->gzipped_len = evbuffer_get_length (out);
+          file->gzipped = tr_memdup (evbuffer_pullup (out, -1), file->gzipped_len);
+        }
+
+      evbuffer_free (out);
+      evbuffer_free (in);
+    }
+#endif
+
+  *is_cached = server->webFilesBytes + web_file_bytes (file) <= WEB_FILES_MAX_BYTES;
+  if (*is_cached)
+    {
+      tr_ptrArrayInsertSorted (&server->webFiles, file, compare_web_files);
+      server->webFilesBytes += web_file_bytes (file);
+    }
+
+  return file;
 }
 
 static void
@@ -436,18 +848,14 @@ serve_file (struct evhttp_request  * req,
     }
   else
     {
-      void * file;
-      size_t file_len;
-      struct evbuffer * content;
+      bool is_cached;
+      struct web_file * file;
       const int error = errno;
 
       errno = 0;
-      file_len = 0;
-      file = tr_loadFile (filename, &file_len);
-      content = evbuffer_new ();
-      evbuffer_add_reference (content, file, file_len, evbuffer_ref_cleanup_tr_free, file);
+      file = get_web_file (server, filename, &is_cached);
 
-      if (errno)
+      if (file == NULL)
         {
           char * tmp = tr_strdup_printf ("%s (%s)", filename, tr_strerror (errno));
           send_simple_response (req, HTTP_NOTFOUND, tmp);
@@ -463,13 +871,28 @@ serve_file (struct evhttp_request  * req,
           evhttp_add_header (req->output_headers, "Content-Type", mimetype_guess (filename));
           add_time_header (req->output_headers, "Date", now);
           add_time_header (req->output_headers, "Expires", now+ (24*60*60));
-          add_response (req, server, out, content);
-          evhttp_send_reply (req, HTTP_OK, "OK", out);
 
+#ifdef HAVE_ZLIB
+          if (file->gzipped != NULL)
+            evhttp_add_header (req->output_headers, "Vary", "Accept-Encoding");
+
+          if ((file->gzipped != NULL) && client_accepts_gzip (req))
+            {
+              evhttp_add_header (req->output_headers, "Content-Encoding", "gzip");
+              evbuffer_add (out, file->gzipped, file->gzipped_len);
+            }
+          else
+#endif
+            {
+              evbuffer_add (out, file->content, file->len);
+            }
+
+          evhttp_send_reply (req, HTTP_OK, "OK", out);
           evbuffer_free (out);
-        }
 
-      evbuffer_free (content);
+          if (!is_cached)
+            web_file_free (file);
+        }
     }
 }
 
@@ -530,14 +953,11 @@ rpc_response_func (tr_session      * session UNUSED,
                    void            * user_data)
 {
   struct rpc_response_data * data = user_data;
-  struct evbuffer * buf = evbuffer_new ();
 
-  add_response (data->req, data->server, buf, response);
   evhttp_add_header (data->req->output_headers,
                      "Content-Type", "application/json; charset=UTF-8");
-  evhttp_send_reply (data->req, HTTP_OK, "OK", buf);
+  send_response (data->req, data->server, response);
 
-  evbuffer_free (buf);
   tr_free (data);
 }
 
@@ -580,6 +1000,616 @@ handle_rpc (struct evhttp_request * req, struct tr_rpc_server  * server)
     }
 }
 
+/***
+****  The event stream
+****
+****  Events are kept in a ring, numbered in the order they happened.
+****  A Server-Sent Events client has a cursor into the ring, and whatever's
+****  new is written to it as it arrives. A long-poll client says which
+****  event it wants to start from, and its request is held until there's
+****  something to send or it times out.
+****
+****  If an SSE client reads too slowly, we stop writing to it until it
+****  catches up. If it falls so far behind that the ring wraps past its
+****  cursor, it's sent an "overflow" event saying how many events it
+****  missed so that it knows to resync with torrent-get.
+***/
+
+enum
+{
+  EVENT_RING_SIZE = 4096,
+
+  /* stop writing to an SSE client while this many bytes are still unsent */
+  EVENT_CLIENT_MAX_PENDING = (256 * 1024),
+
+  /* the most events in a single long-poll reply */
+  EVENT_POLL_MAX_EVENTS = 512,
+
+  EVENT_POLL_TIMEOUT_SEC = 30,
+  EVENT_POLL_MAX_TIMEOUT_SEC = 300,
+
+  EVENT_HEARTBEAT_SEC = 15,
+
+  /* Keep watching torrents for this long after the last client goes away,
+     so that long-poll clients don't miss anything in between their polls */
+  EVENT_LINGER_SEC = 120
+};
+
+static const char * event_names[TR_RPC_EVENT_TYPE_COUNT] =
+{
+  "torrent-added",
+  "torrent-removed",
+  "torrent-completed",
+  "torrent-state",
+  "torrent-rates",
+  "session-stats",
+  "overflow"
+};
+
+struct tr_rpc_event
+{
+  int64_t seq;
+  tr_rpc_event_type type;
+  int torrent_id; /* 0 for session-wide events */
+  char * json;
+  size_t json_len;
+};
+
+struct tr_rpc_event_client
+{
+  struct evhttp_request * req;
+  struct tr_rpc_server * server;
+  bool is_poll;
+  int64_t cursor; /* the next event to look at */
+  unsigned int types; /* bitmask of the tr_rpc_event_types wanted */
+  int * ids; /* sorted ids of the torrents wanted, or NULL for all of them */
+  int id_count;
+  struct event * poll_timer;
+};
+
+static bool
+is_events_uri (const struct tr_rpc_server * server, const char * uri)
+{
+  const size_t url_len = strlen (server->url);
+
+  return !strncmp (uri, server->url, url_len)
+      && !strncmp (uri + url_len, "events", 6)
+      && (uri[url_len+6] == '\0' || uri[url_len+6] == '?');
+}
+
+static void
+event_writer_begin (tr_json_writer * w, struct evbuffer * buf, tr_rpc_event_type type)
+{
+  tr_jsonWriterInit (w, buf);
+  tr_jsonWriterDictBegin (w);
+  tr_jsonWriterDictAddStr (w, TR_KEY_type, event_names[type]);
+}
+
+/* add an event to the ring. The caller holds the session lock */
+static void
+post_event (tr_rpc_server * server, tr_rpc_event_type type, int torrent_id, tr_json_writer * w)
+{
+  struct tr_rpc_event * e = &server->events[server->eventSeq % EVENT_RING_SIZE];
+
+  tr_jsonWriterDictEnd (w);
+
+  tr_free (e->json);
+  e->seq = server->eventSeq++;
+  e->type = type;
+  e->torrent_id = torrent_id;
+  e->json_len = evbuffer_get_length (w->out);
+  e->json = tr_strndup (evbuffer_pullup (w->out, -1), e->json_len);
+  evbuffer_drain (w->out, e->json_len);
+}
+
+static int64_t
+oldest_event_seq (const tr_rpc_server * server)
+{
+  return MAX (1, server->eventSeq - EVENT_RING_SIZE);
+}
+
+static bool
+client_wants_event (const struct tr_rpc_event_client * client,
+                    const struct tr_rpc_event        * e)
+{
+  if (!(client->types & (1u << e->type)))
+    return false;
+
+  if (client->ids != NULL && e->torrent_id != 0
+      && !bsearch (&e->torrent_id, client->ids, client->id_count, sizeof (int), compareInt))
+    return false;
+
+  return true;
+}
+
+static size_t
+get_pending_output (struct evhttp_request * req)
+{
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+  struct evhttp_connection * evcon = evhttp_request_get_connection (req);
+
+  if (evcon != NULL)
+    return evbuffer_get_length (bufferevent_get_output (evhttp_connection_get_bufferevent (evcon)));
+#endif
+
+  return 0;
+}
+
+static void
+event_client_free (struct tr_rpc_event_client * client)
+{
+  int i;
+  tr_ptrArray * clients = &client->server->eventClients;
+
+  for (i=0; i<tr_ptrArraySize (clients); ++i)
+    if (tr_ptrArrayNth (clients, i) == client)
+      tr_ptrArrayRemove (clients, i--);
+
+  if (client->poll_timer != NULL)
+    event_free (client->poll_timer);
+
+  tr_free (client->ids);
+  tr_free (client);
+}
+
+/* the client hung up. libevent will free the request */
+static void
+on_event_client_closed (struct evhttp_connection * evcon UNUSED, void * vclient)
+{
+  event_client_free (vclient);
+}
+
+static void
+event_client_detach (struct tr_rpc_event_client * client)
+{
+  struct evhttp_connection * evcon = evhttp_request_get_connection (client->req);
+
+  if (evcon != NULL)
+    evhttp_connection_set_closecb (evcon, NULL, NULL);
+}
+
+static void
+write_sse_event (struct evbuffer * out, int64_t seq, tr_rpc_event_type type,
+                 const char * json, size_t json_len)
+{
+  evbuffer_add_printf (out, "id: %" PRId64 "\nevent: %s\ndata: ", seq, event_names[type]);
+  evbuffer_add (out, json, json_len);
+  evbuffer_add (out, "\n\n", 2);
+}
+
+/* if the ring has wrapped past the client's cursor,
+   move it up to the oldest event and return how many were missed */
+static int64_t
+event_client_catch_up (struct tr_rpc_event_client * client)
+{
+  int64_t missed = 0;
+  const int64_t oldest = oldest_event_seq (client->server);
+
+  if (client->cursor < oldest)
+    {
+      missed = oldest - client->cursor;
+      client->cursor = oldest;
+    }
+
+  return missed;
+}
+
+static void
+flush_sse_client (struct tr_rpc_event_client * client)
+{
+  int64_t missed;
+  struct evbuffer * out;
+  tr_rpc_server * server = client->server;
+
+  if (get_pending_output (client->req) >= EVENT_CLIENT_MAX_PENDING)
+    return;
+
+  out = evbuffer_new ();
+
+  if ((missed = event_client_catch_up (client)))
+    {
+      tr_json_writer w;
+      struct evbuffer * json = evbuffer_new ();
+
+      event_writer_begin (&w, json, TR_RPC_EVENT_OVERFLOW);
+      tr_jsonWriterDictAddInt (&w, TR_KEY_missed, missed);
+      tr_jsonWriterDictEnd (&w);
+      write_sse_event (out, client->cursor - 1, TR_RPC_EVENT_OVERFLOW,
+                       (const char*) evbuffer_pullup (json, -1), evbuffer_get_length (json));
+      evbuffer_free (json);
+    }
+
+  while ((client->cursor < server->eventSeq) && (evbuffer_get_length (out) < EVENT_CLIENT_MAX_PENDING))
+    {
+      const struct tr_rpc_event * e = &server->events[client->cursor++ % EVENT_RING_SIZE];
+
+      if (client_wants_event (client, e))
+        write_sse_event (out, e->seq, e->type, e->json, e->json_len);
+    }
+
+  if (evbuffer_get_length (out) > 0)
+    evhttp_send_reply_chunk (client->req, out);
+
+  evbuffer_free (out);
+}
+
+/* Answers a long-poll client if there's anything to tell it, or if `force' is set.
+   Returns true if the client was answered and freed */
+static bool
+answer_poll_client (struct tr_rpc_event_client * client, bool force)
+{
+  int count = 0;
+  int64_t missed;
+  tr_json_writer w;
+  struct evbuffer * json;
+  tr_rpc_server * server = client->server;
+
+  missed = event_client_catch_up (client);
+
+  json = evbuffer_new ();
+  tr_jsonWriterInit (&w, json);
+  tr_jsonWriterDictBegin (&w);
+  tr_jsonWriterDictAddList (&w, TR_KEY_events);
+  while ((client->cursor < server->eventSeq) && (count < EVENT_POLL_MAX_EVENTS))
+    {
+      const struct tr_rpc_event * e = &server->events[client->cursor++ % EVENT_RING_SIZE];
+
+      if (client_wants_event (client, e))
+        {
+          /* copied, since the reply may be compressed on another thread */
+          struct evbuffer * tmp = evbuffer_new ();
+          evbuffer_add (tmp, e->json, e->json_len);
+          tr_jsonWriterRaw (&w, tmp);
+          evbuffer_free (tmp);
+          ++count;
+        }
+    }
+  tr_jsonWriterListEnd (&w);
+
+  if (!count && !missed && !force)
+    {
+      evbuffer_free (json);
+      return false;
+    }
+
+  if (missed)
+    tr_jsonWriterDictAddInt (&w, TR_KEY_missed, missed);
+  tr_jsonWriterDictAddInt (&w, TR_KEY_next, client->cursor);
+  tr_jsonWriterDictEnd (&w);
+
+  event_client_detach (client);
+  evhttp_add_header (client->req->output_headers, "Content-Type", "application/json; charset=UTF-8");
+  send_response (client->req, server, json);
+  evbuffer_free (json);
+
+  event_client_free (client);
+  return true;
+}
+
+static void
+deliver_events (void * vserver)
+{
+  int i;
+  tr_rpc_server * server = vserver;
+  tr_ptrArray * clients = &server->eventClients;
+
+  tr_sessionLock (server->session);
+
+  for (i=0; i<tr_ptrArraySize (clients); )
+    {
+      struct tr_rpc_event_client * client = tr_ptrArrayNth (clients, i);
+
+      if (!client->is_poll)
+        flush_sse_client (client);
+      else if (answer_poll_client (client, false))
+        continue;
+
+      ++i;
+    }
+
+  tr_sessionUnlock (server->session);
+}
+
+void
+tr_rpcPostTorrentEvent (tr_rpc_server      * server,
+                        tr_rpc_event_type    type,
+                        const tr_torrent   * tor)
+{
+  tr_json_writer w;
+  struct evbuffer * buf;
+
+  assert ((type == TR_RPC_EVENT_TORRENT_ADDED)
+       || (type == TR_RPC_EVENT_TORRENT_REMOVED)
+       || (type == TR_RPC_EVENT_TORRENT_COMPLETED));
+
+  if ((server == NULL) || !server->isEnabled)
+    return;
+
+  tr_sessionLock (server->session);
+
+  buf = evbuffer_new ();
+  event_writer_begin (&w, buf, type);
+  if (type != TR_RPC_EVENT_TORRENT_REMOVED)
+    tr_jsonWriterDictAddStr (&w, TR_KEY_hashString, tor->info.hashString);
+  tr_jsonWriterDictAddInt (&w, TR_KEY_id, tor->uniqueId);
+  if (type != TR_RPC_EVENT_TORRENT_REMOVED)
+    tr_jsonWriterDictAddStr (&w, TR_KEY_name, tr_torrentName (tor));
+  post_event (server, type, tor->uniqueId, &w);
+  evbuffer_free (buf);
+
+  tr_sessionUnlock (server->session);
+
+  if (tr_amInEventThread (server->session))
+    deliver_events (server);
+  else
+    tr_runInEventThread (server->session, deliver_events, server);
+}
+
+/* Look for changes in the things that we don't get told about directly:
+   torrents' states and speeds, and the session's stats. When `prime' is
+   set, just remember how things are now without posting any events */
+static void
+sample_events (tr_rpc_server * server, bool prime)
+{
+  tr_json_writer w;
+  tr_torrent * tor = NULL;
+  tr_session * session = server->session;
+  const uint64_t now = tr_time_msec ();
+  struct evbuffer * buf = evbuffer_new ();
+  int torrentCount = 0;
+  int activeCount = 0;
+  unsigned int speed_Bps[2];
+
+  while ((tor = tr_torrentNext (session, tor)))
+    {
+      const tr_torrent_activity activity = tr_torrentGetActivity (tor);
+      const unsigned int down_Bps = tr_bandwidthGetPieceSpeed_Bps (&tor->bandwidth, now, TR_DOWN);
+      const unsigned int up_Bps = tr_bandwidthGetPieceSpeed_Bps (&tor->bandwidth, now, TR_UP);
+
+      if (!prime && tor->rpcEventSampled)
+        {
+          if (activity != tor->rpcEventActivity)
+            {
+              event_writer_begin (&w, buf, TR_RPC_EVENT_TORRENT_STATE);
+              tr_jsonWriterDictAddInt (&w, TR_KEY_id, tor->uniqueId);
+              tr_jsonWriterDictAddInt (&w, TR_KEY_status, activity);
+              post_event (server, TR_RPC_EVENT_TORRENT_STATE, tor->uniqueId, &w);
+            }
+
+          if ((down_Bps != tor->rpcEventSpeed_Bps[TR_DOWN]) || (up_Bps != tor->rpcEventSpeed_Bps[TR_UP]))
+            {
+              event_writer_begin (&w, buf, TR_RPC_EVENT_TORRENT_RATES);
+              tr_jsonWriterDictAddInt (&w, TR_KEY_id, tor->uniqueId);
+              tr_jsonWriterDictAddInt (&w, TR_KEY_rateDownload, down_Bps);
+              tr_jsonWriterDictAddInt (&w, TR_KEY_rateUpload, up_Bps);
+              post_event (server, TR_RPC_EVENT_TORRENT_RATES, tor->uniqueId, &w);
+            }
+        }
+
+      tor->rpcEventSampled = true;
+      tor->rpcEventActivity = activity;
+      tor->rpcEventSpeed_Bps[TR_DOWN] = down_Bps;
+      tor->rpcEventSpeed_Bps[TR_UP] = up_Bps;
+
+      ++torrentCount;
+      if (tor->isRunning)
+        ++activeCount;
+    }
+
+  speed_Bps[TR_DOWN] = tr_sessionGetPieceSpeed_Bps (session, TR_DOWN);
+  speed_Bps[TR_UP] = tr_sessionGetPieceSpeed_Bps (session, TR_UP);
+
+  if (!prime && ((torrentCount != server->eventTorrentCount)
+              || (activeCount != server->eventActiveCount)
+              || (speed_Bps[TR_DOWN] != server->eventSpeed_Bps[TR_DOWN])
+              || (speed_Bps[TR_UP] != server->eventSpeed_Bps[TR_UP])))
+    {
+      event_writer_begin (&w, buf, TR_RPC_EVENT_SESSION_STATS);
+      tr_jsonWriterDictAddInt (&w, TR_KEY_activeTorrentCount, activeCount);
+      tr_jsonWriterDictAddInt (&w, TR_KEY_downloadSpeed, speed_Bps[TR_DOWN]);
+      tr_jsonWriterDictAddInt (&w, TR_KEY_pausedTorrentCount, torrentCount - activeCount);
+      tr_jsonWriterDictAddInt (&w, TR_KEY_torrentCount, torrentCount);
+      tr_jsonWriterDictAddInt (&w, TR_KEY_uploadSpeed, speed_Bps[TR_UP]);
+      post_event (server, TR_RPC_EVENT_SESSION_STATS, 0, &w);
+    }
+
+  server->eventTorrentCount = torrentCount;
+  server->eventActiveCount = activeCount;
+  server->eventSpeed_Bps[TR_DOWN] = speed_Bps[TR_DOWN];
+  server->eventSpeed_Bps[TR_UP] = speed_Bps[TR_UP];
+
+  evbuffer_free (buf);
+}
+
+static void
+send_heartbeats (tr_rpc_server * server)
+{
+  int i;
+  struct evbuffer * out = evbuffer_new ();
+
+  for (i=0; i<tr_ptrArraySize (&server->eventClients); ++i)
+    {
+      struct tr_rpc_event_client * client = tr_ptrArrayNth (&server->eventClients, i);
+
+      if (!client->is_poll && !get_pending_output (client->req))
+        {
+          evbuffer_add (out, ":\n\n", 3);
+          evhttp_send_reply_chunk (client->req, out);
+        }
+    }
+
+  evbuffer_free (out);
+}
+
+static void
+on_event_timer (evutil_socket_t foo UNUSED, short bar UNUSED, void * vserver)
+{
+  tr_rpc_server * server = vserver;
+  const time_t now = tr_time ();
+
+  if (!tr_ptrArrayEmpty (&server->eventClients))
+    server->eventsWantedUntil = now + EVENT_LINGER_SEC;
+
+  if (now > server->eventsWantedUntil) /* no one's listening */
+    {
+      server->eventsArePrimed = false;
+    }
+  else
+    {
+      tr_sessionLock (server->session);
+      sample_events (server, !server->eventsArePrimed);
+      server->eventsArePrimed = true;
+      tr_sessionUnlock (server->session);
+
+      deliver_events (server);
+
+      if (now >= server->eventHeartbeatAt)
+        {
+          send_heartbeats (server);
+          server->eventHeartbeatAt = now + EVENT_HEARTBEAT_SEC;
+        }
+    }
+
+  tr_timerAdd (server->eventTimer, 1, 0);
+}
+
+static void
+on_poll_timeout (evutil_socket_t foo UNUSED, short bar UNUSED, void * vclient)
+{
+  tr_session * session = ((struct tr_rpc_event_client*)vclient)->server->session;
+
+  tr_sessionLock (session);
+  answer_poll_client (vclient, true);
+  tr_sessionUnlock (session);
+}
+
+static unsigned int
+parse_event_types (const char * str)
+{
+  unsigned int types = 0;
+
+  while (str && *str)
+    {
+      int i;
+      const char * end = strchr (str, ',');
+      const size_t len = end ? (size_t)(end - str) : strlen (str);
+
+      for (i=0; i<TR_RPC_EVENT_OVERFLOW; ++i)
+        if (strlen (event_names[i]) == len && !memcmp (event_names[i], str, len))
+          types |= (1u << i);
+
+      str = end ? end + 1 : NULL;
+    }
+
+  return types;
+}
+
+/**
+ * GET {url}events streams events to the client.
+ *
+ * Query arguments, all optional:
+ * - "types": comma-separated list of the event types wanted. Default is all of them.
+ * - "ids": torrent ids wanted, as in "1,3-5". Default is all of them.
+ * - "mode": "sse" for Server-Sent Events (the default) or "poll" for long-polling.
+ * - "since": for long-polling, the "next" from the previous reply.
+ * - "timeout": for long-polling, how many seconds to wait for an event.
+ */
+static void
+handle_events (struct evhttp_request * req, struct tr_rpc_server * server)
+{
+  const char * str;
+  const char * q;
+  struct evkeyvalq query;
+  struct evhttp_connection * evcon;
+  struct tr_rpc_event_client * client;
+
+  if (req->type != EVHTTP_REQ_GET)
+    {
+      evhttp_add_header (req->output_headers, "Allow", "GET");
+      send_simple_response (req, 405, NULL);
+      return;
+    }
+
+  q = strchr (req->uri, '?');
+  if (evhttp_parse_query_str (q ? q+1 : "", &query))
+    {
+      evhttp_clear_headers (&query);
+      send_simple_response (req, HTTP_BADREQUEST, NULL);
+      return;
+    }
+
+  tr_sessionLock (server->session);
+
+  client = tr_new0 (struct tr_rpc_event_client, 1);
+  client->req = req;
+  client->server = server;
+  client->cursor = server->eventSeq;
+  client->types = ~0u;
+
+  if ((str = evhttp_find_header (&query, "types")))
+    client->types = parse_event_types (str);
+  client->types |= (1u << TR_RPC_EVENT_OVERFLOW);
+
+  if ((str = evhttp_find_header (&query, "ids")))
+    {
+      client->ids = tr_parseNumberRange (str, -1, &client->id_count);
+      if (client->ids == NULL) /* nothing matches */
+        client->ids = tr_new0 (int, 1);
+    }
+
+  client->is_poll = ((str = evhttp_find_header (&query, "mode"))) && !strcmp (str, "poll");
+
+  if (client->is_poll)
+    {
+      int timeout = EVENT_POLL_TIMEOUT_SEC;
+
+      if ((str = evhttp_find_header (&query, "since")))
+        client->cursor = MIN (MAX (1, strtoll (str, NULL, 10)), server->eventSeq);
+      if ((str = evhttp_find_header (&query, "timeout")))
+        timeout = MIN (MAX (0, atoi (str)), EVENT_POLL_MAX_TIMEOUT_SEC);
+
+      client->poll_timer = evtimer_new (server->session->event_base, on_poll_timeout, client);
+      tr_timerAdd (client->poll_timer, timeout, 0);
+    }
+  else
+    {
+      /* if the client's reconnecting, pick up where it left off */
+      if ((str = evhttp_find_header (req->input_headers, "Last-Event-ID")))
+        client->cursor = MIN (MAX (1, strtoll (str, NULL, 10) + 1), server->eventSeq);
+
+      evhttp_add_header (req->output_headers, "Content-Type", "text/event-stream");
+      evhttp_add_header (req->output_headers, "Cache-Control", "no-cache");
+      evhttp_send_reply_start (req, HTTP_OK, "OK");
+    }
+
+  evhttp_clear_headers (&query);
+
+  evcon = evhttp_request_get_connection (req);
+  evhttp_connection_set_closecb (evcon, on_event_client_closed, client);
+  tr_ptrArrayAppend (&server->eventClients, client);
+  server->eventsWantedUntil = tr_time () + EVENT_LINGER_SEC;
+
+  /* send anything that's already waiting */
+  if (!client->is_poll)
+    flush_sse_client (client);
+  else
+    answer_poll_client (client, false);
+
+  tr_sessionUnlock (server->session);
+}
+
+static void
+close_event_clients (tr_rpc_server * server)
+{
+  struct tr_rpc_event_client * client;
+
+  while ((client = tr_ptrArrayBack (&server->eventClients)))
+    {
+      event_client_detach (client);
+      event_client_free (client);
+    }
+}
+
 static bool
 isAddressAllowed (const tr_rpc_server * server, const char * address)
 {
@@ -600,7 +1630,23 @@ test_session_id (struct tr_rpc_server * server, struct evhttp_request * req)
 {
   const char * ours = get_current_session_id (server);
   const char * theirs = evhttp_find_header (req->input_headers, TR_RPC_SESSION_ID_HEADER);
-  const bool success =  theirs && !strcmp (theirs, ours);
+  bool success = theirs && !strcmp (theirs, ours);
+
+  /* browsers' EventSource can't set headers,
+     so the event stream can take it in the query string instead */
+  if (!success && !theirs && is_events_uri (server, req->uri))
+    {
+      struct evkeyvalq query;
+      const char * q = strchr (req->uri, '?');
+
+      if (!evhttp_parse_query_str (q ? q+1 : "", &query))
+        {
+          theirs = evhttp_find_header (&query, "session-id");
+          success = theirs && !strcmp (theirs, ours);
+        }
+      evhttp_clear_headers (&query);
+    }
+
   return success;
 }
 
@@ -687,6 +1733,10 @@ handle_request (struct evhttp_request * req, void * arg)
         {
           handle_rpc (req, server);
         }
+      else if (is_events_uri (server, req->uri))
+        {
+          handle_events (req, server);
+        }
       else
         {
           send_simple_response (req, HTTP_NOTFOUND, req->uri);
@@ -709,6 +1759,9 @@ startServer (void * vserver)
       server->httpd = evhttp_new (server->session->event_base);
       evhttp_bind_socket (server->httpd, tr_address_to_string (&addr), server->port);
       evhttp_set_gencb (server->httpd, handle_request, server);
+
+      server->eventTimer = evtimer_new (server->session->event_base, on_event_timer, server);
+      tr_timerAdd (server->eventTimer, 1, 0);
     }
 }
 
@@ -717,6 +1770,14 @@ stopServer (tr_rpc_server * server)
 {
   if (server->httpd)
     {
+      close_event_clients (server);
+      event_free (server->eventTimer);
+      server->eventTimer = NULL;
+
+#ifdef HAVE_ZLIB
+      stop_compressing (server);
+#endif
+
       evhttp_free (server->httpd);
       server->httpd = NULL;
     }
@@ -917,15 +1978,23 @@ tr_rpcGetBindAddress (const tr_rpc_server * server)
 static void
 closeServer (void * vserver)
 {
+  int i;
   void * tmp;
   tr_rpc_server * s = vserver;
 
   stopServer (s);
   while ((tmp = tr_list_pop_front (&s->whitelist)))
     tr_free (tmp);
+  for (i=0; i<EVENT_RING_SIZE; ++i)
+    tr_free (s->events[i].json);
+  tr_free (s->events);
+  tr_ptrArrayDestruct (&s->eventClients, NULL);
+  tr_ptrArrayDestruct (&s->webFiles, web_file_free);
 #ifdef HAVE_ZLIB
   if (s->isStreamInitialized)
     deflateEnd (&s->stream);
+  if (s->compressLock != NULL)
+    tr_lockFree (s->compressLock);
 #endif
   tr_free (s->url);
   tr_free (s->sessionId);
@@ -961,6 +2030,10 @@ tr_rpcInit (tr_session  * session, tr_variant * settings)
 
   s = tr_new0 (tr_rpc_server, 1);
   s->session = session;
+  s->events = tr_new0 (struct tr_rpc_event, EVENT_RING_SIZE);
+  s->eventSeq = 1;
+  s->eventClients = TR_PTR_ARRAY_INIT;
+  s->webFiles = TR_PTR_ARRAY_INIT;
 
   key = TR_KEY_rpc_enabled;
   if (!tr_variantDictFindBool (settings, key, &boolVal))
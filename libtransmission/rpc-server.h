@@ -65,4 +65,24 @@ bool            tr_rpcIsPasswordEnabled (const tr_rpc_server * session);
 
 const char*     tr_rpcGetBindAddress (const tr_rpc_server * server);
 
+/* events sent to clients of the {url}events stream */
+typedef enum
+{
+  TR_RPC_EVENT_TORRENT_ADDED,
+  TR_RPC_EVENT_TORRENT_REMOVED,
+  TR_RPC_EVENT_TORRENT_COMPLETED,
+  TR_RPC_EVENT_TORRENT_STATE,
+  TR_RPC_EVENT_TORRENT_RATES,
+  TR_RPC_EVENT_SESSION_STATS,
+  TR_RPC_EVENT_OVERFLOW,
+  TR_RPC_EVENT_TYPE_COUNT
+}
+tr_rpc_event_type;
+
+/* Tell event stream clients that a torrent was added, removed, or completed.
+   The other event types are found by the server itself. `server' may be NULL */
+void            tr_rpcPostTorrentEvent (tr_rpc_server     * server,
+                                        tr_rpc_event_type   type,
+                                        const tr_torrent  * tor);
+
 #endif
@@ -12,7 +12,10 @@
 #include <event2/buffer.h>
 
 #include "transmission.h"
+#include "rate-history.h"
 #include "rpcimpl.h"
+#include "session.h"
+#include "torrent.h"
 #include "utils.h"
 #include "variant.h"
 
@@ -162,11 +165,574 @@ test_session_get_and_set (void)
 ****
 ***/
 
+static void
+rpc_response_str_func (tr_session      * session    UNUSED,
+                       struct evbuffer * response,
+                       void            * setme)
+{
+  *(char**)setme = tr_strndup (evbuffer_pullup (response, -1), evbuffer_get_length (response));
+}
+
+static size_t
+dict_size (tr_variant * dict)
+{
+  size_t n = 0;
+  tr_quark key;
+  tr_variant * val;
+
+  while (tr_variantDictChild (dict, n, &key, &val))
+    ++n;
+
+  return n;
+}
+
+/* torrent-get and session-stats are streamed instead of being built as
+   a tr_variant first, so check that the replies still come out exactly
+   the way tr_variantToBuf () would have written them */
+static int
+check_streamed_reply (const char * reply, tr_variant * setme)
+{
+  char * reserialized;
+
+  check (reply != NULL);
+  check (!tr_variantFromJson (setme, reply, strlen (reply)));
+  reserialized = tr_variantToStr (setme, TR_VARIANT_FMT_JSON_LEAN, NULL);
+  check_streq (reserialized, reply);
+  tr_free (reserialized);
+
+  return 0;
+}
+
+static int
+test_torrent_get (void)
+{
+  tr_session * session;
+  tr_torrent * tor;
+  const char * json;
+  char * reply = NULL;
+  tr_variant response;
+  tr_variant * args;
+  tr_variant * torrents;
+  tr_variant * t;
+  tr_variant * files;
+  const char * str;
+  int64_t i;
+  double d;
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+  check (tor != NULL);
+
+  /* the unknown field is skipped, and the repeated one is only written once */
+  json = "{\"method\":\"torrent-get\",\"tag\":7,\"arguments\":{\"fields\":"
+         "[\"name\",\"id\",\"files\",\"peersFrom\",\"percentDone\",\"wanted\","
+         "\"isPrivate\",\"trackers\",\"no-such-field\",\"id\"]}}";
+  tr_rpc_request_exec_json (session, json, strlen (json), rpc_response_str_func, &reply);
+  check (!check_streamed_reply (reply, &response));
+
+  check (tr_variantDictFindStr (&response, TR_KEY_result, &str, NULL));
+  check_streq ("success", str);
+  check (tr_variantDictFindInt (&response, TR_KEY_tag, &i));
+  check_int_eq (7, i);
+  check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+  check (tr_variantDictFind (args, TR_KEY_removed) == NULL);
+  check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents));
+  check_int_eq (1, tr_variantListSize (torrents));
+  t = tr_variantListChild (torrents, 0);
+  check (tr_variantIsDict (t));
+  check_int_eq (8, dict_size (t));
+  check (tr_variantDictFindStr (t, TR_KEY_name, &str, NULL));
+  check_streq (tr_torrentName (tor), str);
+  check (tr_variantDictFindInt (t, TR_KEY_id, &i));
+  check_int_eq (tr_torrentId (tor), i);
+  check (tr_variantDictFindList (t, TR_KEY_files, &files));
+  check_int_eq (tor->info.fileCount, tr_variantListSize (files));
+  check (tr_variantDictFindStr (tr_variantListChild (files, 0), TR_KEY_name, &str, NULL));
+  check_streq (tor->info.files[0].name, str);
+  check (tr_variantDictFindList (t, TR_KEY_wanted, &files));
+  check_int_eq (tor->info.fileCount, tr_variantListSize (files));
+  check (tr_variantDictFindDict (t, TR_KEY_peersFrom, &args));
+  check_int_eq (7, dict_size (args));
+  check (tr_variantDictFindReal (t, TR_KEY_percentDone, &d));
+  check (tr_variantDictFindList (t, TR_KEY_trackers, &files));
+  check_int_eq (tor->info.trackerCount, tr_variantListSize (files));
+  tr_variantFree (&response);
+  tr_free (reply);
+
+  /* no fields */
+  json = "{\"method\":\"torrent-get\",\"arguments\":{\"ids\":\"recently-active\"}}";
+  tr_rpc_request_exec_json (session, json, strlen (json), rpc_response_str_func, &reply);
+  check (!check_streamed_reply (reply, &response));
+  check (tr_variantDictFindStr (&response, TR_KEY_result, &str, NULL));
+  check_streq ("no fields specified", str);
+  check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+  check (tr_variantDictFindList (args, TR_KEY_removed, &files));
+  check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents));
+  check_int_eq (0, tr_variantListSize (torrents));
+  tr_variantFree (&response);
+  tr_free (reply);
+
+  /* "pieces" is rebuilt when the torrent's completion changes */
+  json = "{\"method\":\"torrent-get\",\"arguments\":{\"fields\":[\"pieces\"]}}";
+  for (i=0; i<2; ++i)
+    {
+      size_t byte_count = 0;
+      void * bytes = tr_torrentCreatePieceBitfield (tor, &byte_count);
+      char * expected = tr_base64_encode (bytes, byte_count, NULL);
+
+      tr_rpc_request_exec_json (session, json, strlen (json), rpc_response_str_func, &reply);
+      check (!check_streamed_reply (reply, &response));
+      check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+      check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents));
+      check (tr_variantDictFindStr (tr_variantListChild (torrents, 0), TR_KEY_pieces, &str, NULL));
+      check_streq (expected, str);
+      tr_variantFree (&response);
+      tr_free (reply);
+      tr_free (expected);
+      tr_free (bytes);
+
+      tr_cpPieceAdd (&tor->completion, 0);
+    }
+
+  /* "pieceRuns" describes the same pieces as alternating runs */
+  json = "{\"method\":\"torrent-get\",\"arguments\":{\"fields\":[\"pieceRuns\"]}}";
+  {
+    size_t j;
+    size_t run_count = 0;
+    size_t * runs = tr_torrentCreatePieceRuns (tor, &run_count);
+    tr_variant * list;
+
+    tr_rpc_request_exec_json (session, json, strlen (json), rpc_response_str_func, &reply);
+    check (!check_streamed_reply (reply, &response));
+    check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+    check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents));
+    check (tr_variantDictFindList (tr_variantListChild (torrents, 0), TR_KEY_pieceRuns, &list));
+    check_int_eq (run_count, tr_variantListSize (list));
+    for (j=0; j<run_count; ++j)
+      {
+        int64_t run;
+        check (tr_variantGetInt (tr_variantListChild (list, j), &run));
+        check_int_eq (runs[j], run);
+      }
+    tr_variantFree (&response);
+    tr_free (reply);
+    tr_free (runs);
+  }
+
+  /* cleanup */
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+test_session_stats (void)
+{
+  tr_session * session;
+  tr_torrent * tor;
+  const char * json;
+  char * reply = NULL;
+  tr_variant response;
+  tr_variant * args;
+  tr_variant * stats;
+  int64_t i;
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+  check (tor != NULL);
+
+  json = "{\"method\":\"session-stats\"}";
+  tr_rpc_request_exec_json (session, json, strlen (json), rpc_response_str_func, &reply);
+  check (!check_streamed_reply (reply, &response));
+
+  check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+  check (tr_variantDictFindInt (args, TR_KEY_torrentCount, &i));
+  check_int_eq (1, i);
+  check (tr_variantDictFind (args, TR_KEY_activeTorrentCount) != NULL);
+  check (tr_variantDictFind (args, TR_KEY_pausedTorrentCount) != NULL);
+  check (tr_variantDictFind (args, TR_KEY_downloadSpeed) != NULL);
+  check (tr_variantDictFind (args, TR_KEY_uploadSpeed) != NULL);
+  check (tr_variantDictFindDict (args, TR_KEY_cumulative_stats, &stats));
+  check_int_eq (5, dict_size (stats));
+  check (tr_variantDictFindDict (args, TR_KEY_current_stats, &stats));
+  check (tr_variantDictFindInt (stats, TR_KEY_sessionCount, &i));
+  check_int_eq (1, i);
+  tr_variantFree (&response);
+  tr_free (reply);
+
+  /* cleanup */
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+test_session_history (void)
+{
+  tr_session * session;
+  tr_torrent * tor;
+  const char * json;
+  char * request;
+  char * reply = NULL;
+  tr_variant response;
+  tr_variant * args;
+  tr_variant * list;
+  tr_variant * torrents;
+  const char * str;
+  const time_t now = tr_time ();
+  int64_t i;
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+  check (tor != NULL);
+  tr_rateHistoryAdd (session->rateHistory, tor->historySeries, now, TR_DOWN, 1000);
+
+  /* the session's samples, and those of the torrents that were asked for */
+  request = tr_strdup_printf ("{\"method\":\"session-history\",\"arguments\":{\"interval\":60,\"ids\":[%d]}}", tr_torrentId (tor));
+  tr_rpc_request_exec_json (session, request, strlen (request), rpc_response_str_func, &reply);
+  tr_free (request);
+  check (!check_streamed_reply (reply, &response));
+  check (tr_variantDictFindStr (&response, TR_KEY_result, &str, NULL));
+  check_streq ("success", str);
+  check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+  check (tr_variantDictFindInt (args, TR_KEY_interval, &i));
+  check_int_eq (60, i);
+  check (tr_variantDictFindInt (args, TR_KEY_date, &i));
+  check_int_eq (now - (now % 60), i);
+  check (tr_variantDictFindList (args, TR_KEY_downloadedBytes, &list));
+  check_int_eq (60, tr_variantListSize (list));
+  check (tr_variantGetInt (tr_variantListChild (list, 59), &i));
+  check_int_eq (1000, i);
+  check (tr_variantDictFindList (args, TR_KEY_uploadedBytes, &list));
+  check_int_eq (60, tr_variantListSize (list));
+  check (tr_variantDictFindList (args, TR_KEY_peersConnected, &list));
+  check_int_eq (60, tr_variantListSize (list));
+  check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents));
+  check_int_eq (1, tr_variantListSize (torrents));
+  check (tr_variantDictFindInt (tr_variantListChild (torrents, 0), TR_KEY_id, &i));
+  check_int_eq (tr_torrentId (tor), i);
+  check (tr_variantDictFindList (tr_variantListChild (torrents, 0), TR_KEY_downloadedBytes, &list));
+  check (tr_variantGetInt (tr_variantListChild (list, 59), &i));
+  check_int_eq (1000, i);
+  tr_variantFree (&response);
+  tr_free (reply);
+
+  /* without ids, only the session's samples are sent */
+  json = "{\"method\":\"session-history\",\"arguments\":{\"interval\":3600}}";
+  tr_rpc_request_exec_json (session, json, strlen (json), rpc_response_str_func, &reply);
+  check (!check_streamed_reply (reply, &response));
+  check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+  check (tr_variantDictFindList (args, TR_KEY_downloadedBytes, &list));
+  check_int_eq (168, tr_variantListSize (list));
+  check (tr_variantDictFind (args, TR_KEY_torrents) == NULL);
+  tr_variantFree (&response);
+  tr_free (reply);
+
+  json = "{\"method\":\"session-history\",\"arguments\":{\"interval\":7}}";
+  tr_rpc_request_exec_json (session, json, strlen (json), rpc_response_str_func, &reply);
+  check (!tr_variantFromJson (&response, reply, strlen (reply)));
+  check (tr_variantDictFindStr (&response, TR_KEY_result, &str, NULL));
+  check_streq ("invalid interval", str);
+  tr_variantFree (&response);
+  tr_free (reply);
+
+  /* cleanup */
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+test_torrent_get_since (void)
+{
+  tr_session * session;
+  tr_torrent * tor;
+  int id;
+  char json[256];
+  tr_variant response;
+  tr_variant * args;
+  tr_variant * torrents;
+  tr_variant * removed;
+  tr_variant * t;
+  const char * str;
+  int64_t i;
+  int64_t revision;
+  time_t deadline;
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+  check (tor != NULL);
+  id = tr_torrentId (tor);
+
+#define TORRENT_GET_SINCE(since) \
+  do { \
+    tr_snprintf (json, sizeof (json), "{\"method\":\"torrent-get\",\"arguments\":" \
+                 "{\"fields\":[\"name\",\"downloadDir\",\"totalSize\"],\"since\":%"PRId64"}}", \
+                 (int64_t)(since)); \
+    tr_rpc_request_exec_json (session, json, -1, rpc_response_func, &response); \
+    check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args)); \
+    check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents)); \
+  } while (0)
+
+  /* a `since' of 0 gets everything, and no "removed" list */
+  TORRENT_GET_SINCE (0);
+  check (tr_variantDictFindInt (args, TR_KEY_revision, &revision));
+  check (tr_variantDictFind (args, TR_KEY_removed) == NULL);
+  check_int_eq (1, tr_variantListSize (torrents));
+  t = tr_variantListChild (torrents, 0);
+  check_int_eq (4, dict_size (t));
+  check (tr_variantDictFindInt (t, TR_KEY_id, &i));
+  check_int_eq (id, i);
+  tr_variantFree (&response);
+
+  /* nothing's changed */
+  TORRENT_GET_SINCE (revision);
+  check (tr_variantDictFindInt (args, TR_KEY_revision, &i));
+  check (i > revision);
+  revision = i;
+  check (tr_variantDictFindList (args, TR_KEY_removed, &removed));
+  check_int_eq (0, tr_variantListSize (removed));
+  check_int_eq (0, tr_variantListSize (torrents));
+  tr_variantFree (&response);
+
+  /* only the field that changed is sent, along with the id */
+  tr_torrentSetDownloadDir (tor, "/some/where/else");
+  TORRENT_GET_SINCE (revision);
+  check_int_eq (1, tr_variantListSize (torrents));
+  t = tr_variantListChild (torrents, 0);
+  check_int_eq (2, dict_size (t));
+  check (tr_variantDictFindInt (t, TR_KEY_id, &i));
+  check_int_eq (id, i);
+  check (tr_variantDictFindStr (t, TR_KEY_downloadDir, &str, NULL));
+  check_streq ("/some/where/else", str);
+  tr_variantFree (&response);
+
+  /* an older revision still sees that change */
+  TORRENT_GET_SINCE (revision);
+  check_int_eq (1, tr_variantListSize (torrents));
+  check (tr_variantDictFindInt (args, TR_KEY_revision, &revision));
+  tr_variantFree (&response);
+
+  /* a token that we didn't hand out gets everything */
+  TORRENT_GET_SINCE (revision + 100);
+  check (tr_variantDictFind (args, TR_KEY_removed) == NULL);
+  check_int_eq (1, tr_variantListSize (torrents));
+  check_int_eq (4, dict_size (tr_variantListChild (torrents, 0)));
+  tr_variantFree (&response);
+
+  /* removed torrents are listed */
+  tr_torrentRemove (tor, false, NULL);
+  deadline = time (NULL) + 5;
+  while (tr_sessionCountTorrents (session) > 0 && time (NULL) <= deadline)
+    tr_wait_msec (10);
+  TORRENT_GET_SINCE (revision);
+  check (tr_variantDictFindList (args, TR_KEY_removed, &removed));
+  check_int_eq (1, tr_variantListSize (removed));
+  check (tr_variantGetInt (tr_variantListChild (removed, 0), &i));
+  check_int_eq (id, i);
+  check_int_eq (0, tr_variantListSize (torrents));
+  check (tr_variantDictFindInt (args, TR_KEY_revision, &revision));
+  tr_variantFree (&response);
+
+  /* ...but only once */
+  TORRENT_GET_SINCE (revision);
+  check (tr_variantDictFindList (args, TR_KEY_removed, &removed));
+  check_int_eq (0, tr_variantListSize (removed));
+  tr_variantFree (&response);
+
+#undef TORRENT_GET_SINCE
+
+  /* cleanup */
+  libttest_session_close (session);
+  return 0;
+}
+
+/* Not a correctness test so much as a benchmark: a torrent-get that asks
+   for every field of a large library. The library is simulated by listing
+   the same torrent's id TORRENT_COUNT times. For comparison, also time how
+   long it takes just to build the same reply as a tr_variant tree and
+   serialize it, which is what torrent-get used to do. */
+static int
+test_torrent_get_large_library (void)
+{
+  enum { TORRENT_COUNT = 5000 };
+
+  int i;
+  tr_session * session;
+  tr_torrent * tor;
+  struct evbuffer * request;
+  char * reply = NULL;
+  char * reserialized;
+  tr_variant response;
+  tr_variant * args;
+  tr_variant * torrents;
+  uint64_t start;
+  uint64_t stream_msec;
+  uint64_t tree_msec;
+  static const char * fields[] =
+    {
+      "activityDate", "addedDate", "bandwidthPriority", "comment", "corruptEver",
+      "creator", "dateCreated", "desiredAvailable", "doneDate", "downloadDir",
+      "downloadedEver", "downloadLimit", "downloadLimited", "error", "errorString",
+      "eta", "etaIdle", "files", "fileStats", "hashString", "haveUnchecked",
+      "haveValid", "honorsSessionLimits", "id", "isFinished", "isPrivate",
+      "isStalled", "leftUntilDone", "magnetLink", "manualAnnounceTime",
+      "maxConnectedPeers", "metadataPercentComplete", "name", "peer-limit",
+      "peers", "peersConnected", "peersFrom", "peersGettingFromUs",
+      "peersSendingToUs", "percentDone", "pieces", "pieceCount", "pieceSize",
+      "priorities", "queuePosition", "rateDownload", "rateUpload",
+      "recheckProgress", "secondsDownloading", "secondsSeeding", "seedIdleLimit",
+      "seedIdleMode", "seedRatioLimit", "seedRatioMode", "sizeWhenDone",
+      "startDate", "status", "trackers", "trackerStats", "totalSize",
+      "torrentFile", "uploadedEver", "uploadLimit", "uploadLimited",
+      "uploadRatio", "wanted", "webseeds", "webseedsSendingToUs"
+    };
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+  check (tor != NULL);
+
+  request = evbuffer_new ();
+  evbuffer_add_printf (request, "{\"method\":\"torrent-get\",\"arguments\":{\"fields\":[");
+  for (i=0; i<(int)(sizeof (fields) / sizeof (*fields)); ++i)
+    evbuffer_add_printf (request, "%s\"%s\"", i ? "," : "", fields[i]);
+  evbuffer_add_printf (request, "],\"ids\":[");
+  for (i=0; i<TORRENT_COUNT; ++i)
+    evbuffer_add_printf (request, "%s%d", i ? "," : "", tr_torrentId (tor));
+  evbuffer_add_printf (request, "]}}");
+
+  start = tr_time_msec ();
+  tr_rpc_request_exec_json (session, evbuffer_pullup (request, -1),
+                            evbuffer_get_length (request),
+                            rpc_response_str_func, &reply);
+  stream_msec = tr_time_msec () - start;
+  check (reply != NULL);
+
+  check (!tr_variantFromJson (&response, reply, strlen (reply)));
+  check (tr_variantDictFindDict (&response, TR_KEY_arguments, &args));
+  check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents));
+  check_int_eq (TORRENT_COUNT, tr_variantListSize (torrents));
+  check_int_eq (sizeof (fields) / sizeof (*fields),
+                dict_size (tr_variantListChild (torrents, 0)));
+
+  start = tr_time_msec ();
+  reserialized = tr_variantToStr (&response, TR_VARIANT_FMT_JSON_LEAN, NULL);
+  tree_msec = tr_time_msec () - start;
+  check_streq (reserialized, reply);
+
+  if (verbose)
+    fprintf (stderr, "torrent-get, %d torrents x %d fields, %zu bytes: "
+                     "streamed in %"PRIu64" msec; serializing the tree alone took %"PRIu64" msec\n",
+             TORRENT_COUNT, (int)(sizeof (fields) / sizeof (*fields)), strlen (reply),
+             stream_msec, tree_msec);
+
+  tr_free (reserialized);
+  tr_variantFree (&response);
+  tr_free (reply);
+  evbuffer_free (request);
+
+  /* cleanup */
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+static int
+check_batch_reply (tr_variant * reply, int index, int64_t expected_tag, const char * expected_result)
+{
+  int64_t tag;
+  const char * result;
+  tr_variant * child = tr_variantListChild (reply, index);
+
+  check (tr_variantIsDict (child));
+  check (tr_variantDictFindStr (child, TR_KEY_result, &result, NULL));
+  check_streq (expected_result, result);
+  if (expected_tag < 0)
+    check (!tr_variantDictFindInt (child, TR_KEY_tag, &tag));
+  else
+    {
+      check (tr_variantDictFindInt (child, TR_KEY_tag, &tag));
+      check_int_eq (expected_tag, tag);
+    }
+
+  return 0;
+}
+
+static int
+test_batch (void)
+{
+  tr_session * session;
+  tr_torrent * tor;
+  char * json;
+  char * reply = NULL;
+  tr_variant response;
+  tr_variant * args;
+  tr_variant * torrents;
+
+  session = libttest_session_init (NULL);
+  tor = libttest_zero_torrent_init (session);
+  check (tor != NULL);
+
+  /* replies come back in order, whether they're streamed (torrent-get),
+     built as a tr_variant (session-get), or idle (torrent-add) */
+  json = tr_strdup_printf ("["
+                           "{\"method\":\"session-get\",\"tag\":1},"
+                           "{\"method\":\"torrent-get\",\"arguments\":{\"fields\":[\"id\",\"name\"]},\"tag\":2},"
+                           "{\"method\":\"no-such-method\",\"tag\":3},"
+                           "{\"method\":\"torrent-add\",\"tag\":4},"
+                           "{\"method\":\"torrent-stop\",\"arguments\":{\"ids\":[%d]},\"tag\":5},"
+                           "\"not a request\""
+                           "]",
+                           tr_torrentId (tor));
+  tr_rpc_request_exec_json (session, json, -1, rpc_response_str_func, &reply);
+  check (reply != NULL);
+  check (!tr_variantFromJson (&response, reply, strlen (reply)));
+  check (tr_variantIsList (&response));
+  check_int_eq (6, tr_variantListSize (&response));
+  check (!check_batch_reply (&response, 0, 1, "success"));
+  check (!check_batch_reply (&response, 1, 2, "success"));
+  check (!check_batch_reply (&response, 2, 3, "method name not recognized"));
+  check (!check_batch_reply (&response, 3, 4, "no filename or metainfo specified"));
+  check (!check_batch_reply (&response, 4, 5, "success"));
+  check (!check_batch_reply (&response, 5, -1, "no method name"));
+  check (tr_variantDictFindDict (tr_variantListChild (&response, 1), TR_KEY_arguments, &args));
+  check (tr_variantDictFindList (args, TR_KEY_torrents, &torrents));
+  check_int_eq (1, tr_variantListSize (torrents));
+  tr_variantFree (&response);
+  tr_free (reply);
+  tr_free (json);
+
+  /* an empty batch gets an empty reply */
+  reply = NULL;
+  tr_rpc_request_exec_json (session, "[]", -1, rpc_response_str_func, &reply);
+  check (reply != NULL);
+  check (!tr_variantFromJson (&response, reply, strlen (reply)));
+  check (tr_variantIsList (&response));
+  check_int_eq (0, tr_variantListSize (&response));
+  tr_variantFree (&response);
+  tr_free (reply);
+
+  /* cleanup */
+  tr_torrentRemove (tor, false, NULL);
+  libttest_session_close (session);
+  return 0;
+}
+
+/***
+****
+***/
+
 int
 main (void)
 {
   const testFunc tests[] = { test_list,
-                             test_session_get_and_set };
+                             test_session_get_and_set,
+                             test_torrent_get,
+                             test_torrent_get_since,
+                             test_session_stats,
+                             test_session_history,
+                             test_batch,
+                             test_torrent_get_large_library };
 
   return runTests (tests, NUM_TESTS (tests));
 }
@@ -24,6 +24,7 @@
 #include "fdlimit.h"
 #include "log.h"
 #include "platform-quota.h" /* tr_device_info_get_free_space() */
+#include "rate-history.h"
 #include "rpcimpl.h"
 #include "session.h"
 #include "torrent.h"
@@ -32,7 +33,7 @@
 #include "version.h"
 #include "web.h"
 
-#define RPC_VERSION     15
+#define RPC_VERSION     16
 #define RPC_VERSION_MIN 1
 
 #define RECENTLY_ACTIVE_SECONDS 60
@@ -433,532 +434,952 @@ torrentVerify (tr_session               * session,
 ***/
 
 static void
-addFileStats (const tr_torrent * tor, tr_variant * list)
+addFileStats (const tr_info * info, const tr_file_stat * files, tr_json_writer * w)
 {
   tr_file_index_t i;
-  tr_file_index_t n;
-  const tr_info * info = tr_torrentInfo (tor);
-  tr_file_stat * files = tr_torrentFiles (tor, &n);
 
   for (i=0; i<info->fileCount; ++i)
     {
       const tr_file * file = &info->files[i];
-      tr_variant * d = tr_variantListAddDict (list, 3);
-      tr_variantDictAddInt (d, TR_KEY_bytesCompleted, files[i].bytesCompleted);
-      tr_variantDictAddInt (d, TR_KEY_priority, file->priority);
-      tr_variantDictAddBool (d, TR_KEY_wanted, !file->dnd);
+      tr_jsonWriterDictBegin (w);
+      tr_jsonWriterDictAddInt (w, TR_KEY_bytesCompleted, files[i].bytesCompleted);
+      tr_jsonWriterDictAddInt (w, TR_KEY_priority, file->priority);
+      tr_jsonWriterDictAddBool (w, TR_KEY_wanted, !file->dnd);
+      tr_jsonWriterDictEnd (w);
     }
-
-  tr_torrentFilesFree (files, n);
 }
 
 static void
-addFiles (const tr_torrent * tor, tr_variant * list)
+addFiles (const tr_info * info, const tr_file_stat * files, tr_json_writer * w)
 {
   tr_file_index_t i;
-  tr_file_index_t n;
-  const tr_info * info = tr_torrentInfo (tor);
-  tr_file_stat *  files = tr_torrentFiles (tor, &n);
 
   for (i=0; i<info->fileCount; ++i)
     {
       const tr_file * file = &info->files[i];
-      tr_variant * d = tr_variantListAddDict (list, 3);
-      tr_variantDictAddInt (d, TR_KEY_bytesCompleted, files[i].bytesCompleted);
-      tr_variantDictAddInt (d, TR_KEY_length, file->length);
-      tr_variantDictAddStr (d, TR_KEY_name, file->name);
+      tr_jsonWriterDictBegin (w);
+      tr_jsonWriterDictAddInt (w, TR_KEY_bytesCompleted, files[i].bytesCompleted);
+      tr_jsonWriterDictAddInt (w, TR_KEY_length, file->length);
+      tr_jsonWriterDictAddStr (w, TR_KEY_name, file->name);
+      tr_jsonWriterDictEnd (w);
     }
-
-  tr_torrentFilesFree (files, n);
 }
 
 static void
 addWebseeds (const tr_info  * info,
-             tr_variant     * webseeds)
+             tr_json_writer * w)
 {
   unsigned int i;
 
   for (i=0; i< info->webseedCount; ++i)
-    tr_variantListAddStr (webseeds, info->webseeds[i]);
+    tr_jsonWriterStr (w, info->webseeds[i]);
 }
 
 static void
 addTrackers (const tr_info  * info,
-             tr_variant     * trackers)
+             tr_json_writer * w)
 {
   unsigned int i;
 
   for (i=0; i<info->trackerCount; ++i)
     {
       const tr_tracker_info * t = &info->trackers[i];
-      tr_variant * d = tr_variantListAddDict (trackers, 4);
-      tr_variantDictAddStr (d, TR_KEY_announce, t->announce);
-      tr_variantDictAddInt (d, TR_KEY_id, t->id);
-      tr_variantDictAddStr (d, TR_KEY_scrape, t->scrape);
-      tr_variantDictAddInt (d, TR_KEY_tier, t->tier);
+      tr_jsonWriterDictBegin (w);
+      tr_jsonWriterDictAddStr (w, TR_KEY_announce, t->announce);
+      tr_jsonWriterDictAddInt (w, TR_KEY_id, t->id);
+      tr_jsonWriterDictAddStr (w, TR_KEY_scrape, t->scrape);
+      tr_jsonWriterDictAddInt (w, TR_KEY_tier, t->tier);
+      tr_jsonWriterDictEnd (w);
     }
 }
 
 static void
-addTrackerStats (const tr_tracker_stat * st, int n, tr_variant * list)
+addTrackerStats (const tr_tracker_stat * st, int n, tr_json_writer * w)
 {
   int i;
 
   for (i=0; i<n; ++i)
     {
       const tr_tracker_stat * s = &st[i];
-      tr_variant * d = tr_variantListAddDict (list, 26);
-      tr_variantDictAddStr  (d, TR_KEY_announce, s->announce);
-      tr_variantDictAddInt  (d, TR_KEY_announceState, s->announceState);
-      tr_variantDictAddInt  (d, TR_KEY_downloadCount, s->downloadCount);
-      tr_variantDictAddBool (d, TR_KEY_hasAnnounced, s->hasAnnounced);
-      tr_variantDictAddBool (d, TR_KEY_hasScraped, s->hasScraped);
-      tr_variantDictAddStr  (d, TR_KEY_host, s->host);
-      tr_variantDictAddInt  (d, TR_KEY_id, s->id);
-      tr_variantDictAddBool (d, TR_KEY_isBackup, s->isBackup);
-      tr_variantDictAddInt  (d, TR_KEY_lastAnnouncePeerCount, s->lastAnnouncePeerCount);
-      tr_variantDictAddStr  (d, TR_KEY_lastAnnounceResult, s->lastAnnounceResult);
-      tr_variantDictAddInt  (d, TR_KEY_lastAnnounceStartTime, s->lastAnnounceStartTime);
-      tr_variantDictAddBool (d, TR_KEY_lastAnnounceSucceeded, s->lastAnnounceSucceeded);
-      tr_variantDictAddInt  (d, TR_KEY_lastAnnounceTime, s->lastAnnounceTime);
-      tr_variantDictAddBool (d, TR_KEY_lastAnnounceTimedOut, s->lastAnnounceTimedOut);
-      tr_variantDictAddStr  (d, TR_KEY_lastScrapeResult, s->lastScrapeResult);
-      tr_variantDictAddInt  (d, TR_KEY_lastScrapeStartTime, s->lastScrapeStartTime);
-      tr_variantDictAddBool (d, TR_KEY_lastScrapeSucceeded, s->lastScrapeSucceeded);
-      tr_variantDictAddInt  (d, TR_KEY_lastScrapeTime, s->lastScrapeTime);
-      tr_variantDictAddInt  (d, TR_KEY_lastScrapeTimedOut, s->lastScrapeTimedOut);
-      tr_variantDictAddInt  (d, TR_KEY_leecherCount, s->leecherCount);
-      tr_variantDictAddInt  (d, TR_KEY_nextAnnounceTime, s->nextAnnounceTime);
-      tr_variantDictAddInt  (d, TR_KEY_nextScrapeTime, s->nextScrapeTime);
-      tr_variantDictAddStr  (d, TR_KEY_scrape, s->scrape);
-      tr_variantDictAddInt  (d, TR_KEY_scrapeState, s->scrapeState);
-      tr_variantDictAddInt  (d, TR_KEY_seederCount, s->seederCount);
-      tr_variantDictAddInt  (d, TR_KEY_tier, s->tier);
-    }
-}
-
-static void
-addPeers (tr_torrent * tor, tr_variant * list)
+      tr_jsonWriterDictBegin (w);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_announce, s->announce);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_announceState, s->announceState);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_downloadCount, s->downloadCount);
+      tr_jsonWriterDictAddBool (w, TR_KEY_hasAnnounced, s->hasAnnounced);
+      tr_jsonWriterDictAddBool (w, TR_KEY_hasScraped, s->hasScraped);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_host, s->host);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_id, s->id);
+      tr_jsonWriterDictAddBool (w, TR_KEY_isBackup, s->isBackup);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_lastAnnouncePeerCount, s->lastAnnouncePeerCount);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_lastAnnounceResult, s->lastAnnounceResult);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_lastAnnounceStartTime, s->lastAnnounceStartTime);
+      tr_jsonWriterDictAddBool (w, TR_KEY_lastAnnounceSucceeded, s->lastAnnounceSucceeded);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_lastAnnounceTime, s->lastAnnounceTime);
+      tr_jsonWriterDictAddBool (w, TR_KEY_lastAnnounceTimedOut, s->lastAnnounceTimedOut);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_lastScrapeResult, s->lastScrapeResult);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_lastScrapeStartTime, s->lastScrapeStartTime);
+      tr_jsonWriterDictAddBool (w, TR_KEY_lastScrapeSucceeded, s->lastScrapeSucceeded);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_lastScrapeTime, s->lastScrapeTime);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_lastScrapeTimedOut, s->lastScrapeTimedOut);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_leecherCount, s->leecherCount);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_nextAnnounceTime, s->nextAnnounceTime);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_nextScrapeTime, s->nextScrapeTime);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_scrape, s->scrape);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_scrapeState, s->scrapeState);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_seederCount, s->seederCount);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_tier, s->tier);
+      tr_jsonWriterDictEnd (w);
+    }
+}
+
+static void
+addPeers (tr_torrent * tor, tr_json_writer * w)
 {
   int i;
   int peerCount;
   tr_peer_stat * peers = tr_torrentPeers (tor, &peerCount);
 
-  tr_variantInitList (list, peerCount);
-
   for (i=0; i<peerCount; ++i)
     {
-      tr_variant * d = tr_variantListAddDict (list, 16);
       const tr_peer_stat * peer = peers + i;
-      tr_variantDictAddStr  (d, TR_KEY_address, peer->addr);
-      tr_variantDictAddStr  (d, TR_KEY_clientName, peer->client);
-      tr_variantDictAddBool (d, TR_KEY_clientIsChoked, peer->clientIsChoked);
-      tr_variantDictAddBool (d, TR_KEY_clientIsInterested, peer->clientIsInterested);
-      tr_variantDictAddStr  (d, TR_KEY_flagStr, peer->flagStr);
-      tr_variantDictAddBool (d, TR_KEY_isDownloadingFrom, peer->isDownloadingFrom);
-      tr_variantDictAddBool (d, TR_KEY_isEncrypted, peer->isEncrypted);
-      tr_variantDictAddBool (d, TR_KEY_isIncoming, peer->isIncoming);
-      tr_variantDictAddBool (d, TR_KEY_isUploadingTo, peer->isUploadingTo);
-      tr_variantDictAddBool (d, TR_KEY_isUTP, peer->isUTP);
-      tr_variantDictAddBool (d, TR_KEY_peerIsChoked, peer->peerIsChoked);
-      tr_variantDictAddBool (d, TR_KEY_peerIsInterested, peer->peerIsInterested);
-      tr_variantDictAddInt  (d, TR_KEY_port, peer->port);
-      tr_variantDictAddReal (d, TR_KEY_progress, peer->progress);
-      tr_variantDictAddInt  (d, TR_KEY_rateToClient, toSpeedBytes (peer->rateToClient_KBps));
-      tr_variantDictAddInt  (d, TR_KEY_rateToPeer, toSpeedBytes (peer->rateToPeer_KBps));
+      tr_jsonWriterDictBegin (w);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_address, peer->addr);
+      tr_jsonWriterDictAddBool (w, TR_KEY_clientIsChoked, peer->clientIsChoked);
+      tr_jsonWriterDictAddBool (w, TR_KEY_clientIsInterested, peer->clientIsInterested);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_clientName, peer->client);
+      tr_jsonWriterDictAddStr  (w, TR_KEY_flagStr, peer->flagStr);
+      tr_jsonWriterDictAddBool (w, TR_KEY_isDownloadingFrom, peer->isDownloadingFrom);
+      tr_jsonWriterDictAddBool (w, TR_KEY_isEncrypted, peer->isEncrypted);
+      tr_jsonWriterDictAddBool (w, TR_KEY_isIncoming, peer->isIncoming);
+      tr_jsonWriterDictAddBool (w, TR_KEY_isUTP, peer->isUTP);
+      tr_jsonWriterDictAddBool (w, TR_KEY_isUploadingTo, peer->isUploadingTo);
+      tr_jsonWriterDictAddBool (w, TR_KEY_peerIsChoked, peer->peerIsChoked);
+      tr_jsonWriterDictAddBool (w, TR_KEY_peerIsInterested, peer->peerIsInterested);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_port, peer->port);
+      tr_jsonWriterDictAddReal (w, TR_KEY_progress, peer->progress);
+      tr_jsonWriterDictAddInt  (w, TR_KEY_rateToClient, toSpeedBytes (peer->rateToClient_KBps));
+      tr_jsonWriterDictAddInt  (w, TR_KEY_rateToPeer, toSpeedBytes (peer->rateToPeer_KBps));
+      tr_jsonWriterDictEnd (w);
     }
 
   tr_torrentPeersFree (peers, peerCount);
 }
 
+/***
+****  torrent-get's fields
+****
+****  The requested fields are looked up in torrentFields[] once per
+****  request. Most of them are a member of tr_stat that can be copied
+****  straight out; the rest are written by a function. Each torrent's
+****  tr_stat and file stats are only built if a requested field needs
+****  them, and the "pieces" bitfield is cached on the torrent until its
+****  completion changes, so every client polling it shares one copy.
+***/
+
+enum
+{
+  FIELD_NEEDS_STAT  = (1<<0), /* tr_torrentStat () */
+  FIELD_NEEDS_FILES = (1<<1)  /* tr_torrentFiles () */
+};
+
+/* what the fields are written from */
+struct field_ctx
+{
+  tr_torrent       * tor;
+  const tr_info    * inf;
+  const tr_stat    * st;
+  tr_file_stat     * files;
+  tr_file_index_t    fileCount;
+};
+
+typedef void (*field_func)(const struct field_ctx * ctx, tr_json_writer * w, tr_quark key);
+
+enum field_type
+{
+  FIELD_BOOL,   /* a bool in tr_stat */
+  FIELD_INT,    /* an int in tr_stat */
+  FIELD_UINT64, /* a uint64_t in tr_stat */
+  FIELD_TIME,   /* a time_t in tr_stat */
+  FIELD_FLOAT,  /* a float in tr_stat */
+  FIELD_FUNC    /* written by `func' */
+};
+
+struct torrent_field
+{
+  tr_quark          key;
+  enum field_type   type;
+  size_t            offset; /* where the value is in tr_stat */
+  field_func        func;
+  int               needs;
+};
+
+static void
+fieldBandwidthPriority (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentGetPriority (ctx->tor));
+}
+
+static void
+fieldComment (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddStr (w, key, ctx->inf->comment ? ctx->inf->comment : "");
+}
+
+static void
+fieldCreator (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddStr (w, key, ctx->inf->creator ? ctx->inf->creator : "");
+}
+
+static void
+fieldDateCreated (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, ctx->inf->dateCreated);
+}
+
+static void
+fieldDownloadDir (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddStr (w, key, tr_torrentGetDownloadDir (ctx->tor));
+}
+
+static void
+fieldDownloadLimit (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentGetSpeedLimit_KBps (ctx->tor, TR_DOWN));
+}
+
+static void
+fieldDownloadLimited (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddBool (w, key, tr_torrentUsesSpeedLimit (ctx->tor, TR_DOWN));
+}
+
+static void
+fieldError (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, ctx->st->error);
+}
+
+static void
+fieldErrorString (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddStr (w, key, ctx->st->errorString);
+}
+
+static void
+fieldFileStats (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddList (w, key);
+  addFileStats (ctx->inf, ctx->files, w);
+  tr_jsonWriterListEnd (w);
+}
+
+static void
+fieldFiles (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddList (w, key);
+  addFiles (ctx->inf, ctx->files, w);
+  tr_jsonWriterListEnd (w);
+}
+
+static void
+fieldHashString (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddStr (w, key, ctx->inf->hashString);
+}
+
+static void
+fieldHonorsSessionLimits (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddBool (w, key, tr_torrentUsesSessionLimits (ctx->tor));
+}
+
+static void
+fieldId (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentId (ctx->tor));
+}
+
+static void
+fieldIsPrivate (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddBool (w, key, tr_torrentIsPrivate (ctx->tor));
+}
+
+static void
+fieldMagnetLink (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  char * str = tr_torrentGetMagnetLink (ctx->tor);
+  tr_jsonWriterDictAddStr (w, key, str);
+  tr_free (str);
+}
+
+static void
+fieldName (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddStr (w, key, tr_torrentName (ctx->tor));
+}
+
+static void
+fieldPeerLimit (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentGetPeerLimit (ctx->tor));
+}
+
+static void
+fieldPeers (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddList (w, key);
+  addPeers (ctx->tor, w);
+  tr_jsonWriterListEnd (w);
+}
+
+static void
+fieldPeersFrom (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  const int * f = ctx->st->peersFrom;
+
+  tr_jsonWriterDictAddDict (w, key);
+  tr_jsonWriterDictAddInt (w, TR_KEY_fromCache,    f[TR_PEER_FROM_RESUME]);
+  tr_jsonWriterDictAddInt (w, TR_KEY_fromDht,      f[TR_PEER_FROM_DHT]);
+  tr_jsonWriterDictAddInt (w, TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
+  tr_jsonWriterDictAddInt (w, TR_KEY_fromLpd,      f[TR_PEER_FROM_LPD]);
+  tr_jsonWriterDictAddInt (w, TR_KEY_fromLtep,     f[TR_PEER_FROM_LTEP]);
+  tr_jsonWriterDictAddInt (w, TR_KEY_fromPex,      f[TR_PEER_FROM_PEX]);
+  tr_jsonWriterDictAddInt (w, TR_KEY_fromTracker,  f[TR_PEER_FROM_TRACKER]);
+  tr_jsonWriterDictEnd (w);
+}
+
+static void
+fieldPieceCount (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, ctx->inf->pieceCount);
+}
+
+static void
+fieldPieceSize (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, ctx->inf->pieceSize);
+}
+
 static void
-addField (tr_torrent       * const tor,
-          const tr_info    * const inf,
-          const tr_stat    * const st,
-          tr_variant       * const d,
-          const tr_quark           key)
+fieldPieces (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
 {
-  char * str;
+  tr_torrent * tor = ctx->tor;
 
-  switch (key)
+  if (!tr_torrentHasMetadata (tor))
     {
-      case TR_KEY_activityDate:
-        tr_variantDictAddInt (d, key, st->activityDate);
-        break;
+      tr_jsonWriterDictAddStr (w, key, "");
+      return;
+    }
 
-      case TR_KEY_addedDate:
-        tr_variantDictAddInt (d, key, st->addedDate);
-        break;
+  if ((tor->rpcPieces == NULL) || (tor->rpcPiecesGeneration != tor->completion.generation))
+    {
+      size_t byte_count = 0;
+      void * bytes = tr_torrentCreatePieceBitfield (tor, &byte_count);
 
-      case TR_KEY_bandwidthPriority:
-        tr_variantDictAddInt (d, key, tr_torrentGetPriority (tor));
-        break;
+      tr_free (tor->rpcPieces);
+      tor->rpcPieces = tr_base64_encode (bytes, byte_count, NULL);
+      if (tor->rpcPieces == NULL)
+        tor->rpcPieces = tr_strdup ("");
+      tor->rpcPiecesGeneration = tor->completion.generation;
 
-      case TR_KEY_comment:
-        tr_variantDictAddStr (d, key, inf->comment ? inf->comment : "");
-        break;
+      tr_free (bytes);
+    }
 
-      case TR_KEY_corruptEver:
-        tr_variantDictAddInt (d, key, st->corruptEver);
-        break;
+  tr_jsonWriterDictAddStr (w, key, tor->rpcPieces);
+}
 
-      case TR_KEY_creator:
-        tr_variantDictAddStr (d, key, inf->creator ? inf->creator : "");
-        break;
+/* the same as "pieces", but as runs of missing and present pieces */
+static void
+fieldPieceRuns (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  size_t i, n;
+  size_t * runs;
 
-      case TR_KEY_dateCreated:
-        tr_variantDictAddInt (d, key, inf->dateCreated);
-        break;
+  tr_jsonWriterDictAddList (w, key);
 
-      case TR_KEY_desiredAvailable:
-        tr_variantDictAddInt (d, key, st->desiredAvailable);
-        break;
+  if (tr_torrentHasMetadata (ctx->tor))
+    {
+      runs = tr_torrentCreatePieceRuns (ctx->tor, &n);
+      for (i=0; i<n; ++i)
+        tr_jsonWriterInt (w, runs[i]);
+      tr_free (runs);
+    }
 
-      case TR_KEY_doneDate:
-        tr_variantDictAddInt (d, key, st->doneDate);
-        break;
+  tr_jsonWriterListEnd (w);
+}
 
-      case TR_KEY_downloadDir:
-        tr_variantDictAddStr (d, key, tr_torrentGetDownloadDir (tor));
-        break;
+static void
+fieldPriorities (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_file_index_t i;
+  const tr_info * inf = ctx->inf;
 
-      case TR_KEY_downloadedEver:
-        tr_variantDictAddInt (d, key, st->downloadedEver);
-        break;
+  tr_jsonWriterDictAddList (w, key);
+  for (i=0; i<inf->fileCount; ++i)
+    tr_jsonWriterInt (w, inf->files[i].priority);
+  tr_jsonWriterListEnd (w);
+}
 
-      case TR_KEY_downloadLimit:
-        tr_variantDictAddInt (d, key, tr_torrentGetSpeedLimit_KBps (tor, TR_DOWN));
-        break;
+static void
+fieldRateDownload (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, toSpeedBytes (ctx->st->pieceDownloadSpeed_KBps));
+}
 
-      case TR_KEY_downloadLimited:
-        tr_variantDictAddBool (d, key, tr_torrentUsesSpeedLimit (tor, TR_DOWN));
-        break;
+static void
+fieldRateUpload (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, toSpeedBytes (ctx->st->pieceUploadSpeed_KBps));
+}
 
-      case TR_KEY_error:
-        tr_variantDictAddInt (d, key, st->error);
-        break;
+static void
+fieldSeedIdleLimit (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentGetIdleLimit (ctx->tor));
+}
 
-      case TR_KEY_errorString:
-        tr_variantDictAddStr (d, key, st->errorString);
-        break;
+static void
+fieldSeedIdleMode (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentGetIdleMode (ctx->tor));
+}
 
-      case TR_KEY_eta:
-        tr_variantDictAddInt (d, key, st->eta);
-        break;
+static void
+fieldSeedRatioLimit (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddReal (w, key, tr_torrentGetRatioLimit (ctx->tor));
+}
 
-      case TR_KEY_files:
-        addFiles (tor, tr_variantDictAddList (d, key, inf->fileCount));
-        break;
+static void
+fieldSeedRatioMode (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentGetRatioMode (ctx->tor));
+}
 
-      case TR_KEY_fileStats:
-        addFileStats (tor, tr_variantDictAddList (d, key, inf->fileCount));
-        break;
+static void
+fieldStatus (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, ctx->st->activity);
+}
 
-      case TR_KEY_hashString:
-        tr_variantDictAddStr (d, key, tor->info.hashString);
-        break;
+static void
+fieldTorrentFile (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddStr (w, key, ctx->inf->torrent);
+}
 
-      case TR_KEY_haveUnchecked:
-        tr_variantDictAddInt (d, key, st->haveUnchecked);
-        break;
+static void
+fieldTotalSize (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, ctx->inf->totalSize);
+}
 
-      case TR_KEY_haveValid:
-        tr_variantDictAddInt (d, key, st->haveValid);
-        break;
+static void
+fieldTrackerStats (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  int n;
+  tr_tracker_stat * s = tr_torrentTrackers (ctx->tor, &n);
 
-      case TR_KEY_honorsSessionLimits:
-        tr_variantDictAddBool (d, key, tr_torrentUsesSessionLimits (tor));
-        break;
+  tr_jsonWriterDictAddList (w, key);
+  addTrackerStats (s, n, w);
+  tr_jsonWriterListEnd (w);
 
-      case TR_KEY_id:
-        tr_variantDictAddInt (d, key, st->id);
-        break;
+  tr_torrentTrackersFree (s, n);
+}
 
-      case TR_KEY_isFinished:
-        tr_variantDictAddBool (d, key, st->finished);
-        break;
+static void
+fieldTrackers (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddList (w, key);
+  addTrackers (ctx->inf, w);
+  tr_jsonWriterListEnd (w);
+}
 
-      case TR_KEY_isPrivate:
-        tr_variantDictAddBool (d, key, tr_torrentIsPrivate (tor));
-        break;
+static void
+fieldUploadLimit (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddInt (w, key, tr_torrentGetSpeedLimit_KBps (ctx->tor, TR_UP));
+}
 
-      case TR_KEY_isStalled:
-        tr_variantDictAddBool (d, key, st->isStalled);
-        break;
+static void
+fieldUploadLimited (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddBool (w, key, tr_torrentUsesSpeedLimit (ctx->tor, TR_UP));
+}
 
-      case TR_KEY_leftUntilDone:
-        tr_variantDictAddInt (d, key, st->leftUntilDone);
-        break;
+static void
+fieldWanted (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_file_index_t i;
+  const tr_info * inf = ctx->inf;
 
-      case TR_KEY_manualAnnounceTime:
-        tr_variantDictAddInt (d, key, st->manualAnnounceTime);
-        break;
+  tr_jsonWriterDictAddList (w, key);
+  for (i=0; i<inf->fileCount; ++i)
+    tr_jsonWriterInt (w, inf->files[i].dnd ? 0 : 1);
+  tr_jsonWriterListEnd (w);
+}
 
-      case TR_KEY_maxConnectedPeers:
-        tr_variantDictAddInt (d, key,  tr_torrentGetPeerLimit (tor));
-        break;
+static void
+fieldWebseeds (const struct field_ctx * ctx, tr_json_writer * w, tr_quark key)
+{
+  tr_jsonWriterDictAddList (w, key);
+  addWebseeds (ctx->inf, w);
+  tr_jsonWriterListEnd (w);
+}
 
-      case TR_KEY_magnetLink:
-        str = tr_torrentGetMagnetLink (tor);
-        tr_variantDictAddStr (d, key, str);
-        tr_free (str);
-        break;
+#define STAT_FIELD(key,type,member) { key, type, offsetof (tr_stat, member), NULL, FIELD_NEEDS_STAT }
+#define FUNC_FIELD(key,func,needs)  { key, FIELD_FUNC, 0, func, needs }
 
-      case TR_KEY_metadataPercentComplete:
-        tr_variantDictAddReal (d, key, st->metadataPercentComplete);
-        break;
+/* sorted by key. quarks are numbered in string order, so this is
+   also the order that the reply's dicts are written in */
+static const struct torrent_field torrentFields[] =
+{
+  STAT_FIELD (TR_KEY_activityDate,            FIELD_TIME,   activityDate),
+  STAT_FIELD (TR_KEY_addedDate,               FIELD_TIME,   addedDate),
+  FUNC_FIELD (TR_KEY_bandwidthPriority,       fieldBandwidthPriority,   0),
+  FUNC_FIELD (TR_KEY_comment,                 fieldComment,             0),
+  STAT_FIELD (TR_KEY_corruptEver,             FIELD_UINT64, corruptEver),
+  FUNC_FIELD (TR_KEY_creator,                 fieldCreator,             0),
+  FUNC_FIELD (TR_KEY_dateCreated,             fieldDateCreated,         0),
+  STAT_FIELD (TR_KEY_desiredAvailable,        FIELD_UINT64, desiredAvailable),
+  STAT_FIELD (TR_KEY_doneDate,                FIELD_TIME,   doneDate),
+  FUNC_FIELD (TR_KEY_downloadDir,             fieldDownloadDir,         0),
+  FUNC_FIELD (TR_KEY_downloadLimit,           fieldDownloadLimit,       0),
+  FUNC_FIELD (TR_KEY_downloadLimited,         fieldDownloadLimited,     0),
+  STAT_FIELD (TR_KEY_downloadedEver,          FIELD_UINT64, downloadedEver),
+  FUNC_FIELD (TR_KEY_error,                   fieldError,               FIELD_NEEDS_STAT),
+  FUNC_FIELD (TR_KEY_errorString,             fieldErrorString,         FIELD_NEEDS_STAT),
+  STAT_FIELD (TR_KEY_eta,                     FIELD_INT,    eta),
+  STAT_FIELD (TR_KEY_etaIdle,                 FIELD_INT,    etaIdle),
+  FUNC_FIELD (TR_KEY_fileStats,               fieldFileStats,           FIELD_NEEDS_FILES),
+  FUNC_FIELD (TR_KEY_files,                   fieldFiles,               FIELD_NEEDS_FILES),
+  FUNC_FIELD (TR_KEY_hashString,              fieldHashString,          0),
+  STAT_FIELD (TR_KEY_haveUnchecked,           FIELD_UINT64, haveUnchecked),
+  STAT_FIELD (TR_KEY_haveValid,               FIELD_UINT64, haveValid),
+  FUNC_FIELD (TR_KEY_honorsSessionLimits,     fieldHonorsSessionLimits, 0),
+  FUNC_FIELD (TR_KEY_id,                      fieldId,                  0),
+  STAT_FIELD (TR_KEY_isFinished,              FIELD_BOOL,   finished),
+  FUNC_FIELD (TR_KEY_isPrivate,               fieldIsPrivate,           0),
+  STAT_FIELD (TR_KEY_isStalled,               FIELD_BOOL,   isStalled),
+  STAT_FIELD (TR_KEY_leftUntilDone,           FIELD_UINT64, leftUntilDone),
+  FUNC_FIELD (TR_KEY_magnetLink,              fieldMagnetLink,          0),
+  STAT_FIELD (TR_KEY_manualAnnounceTime,      FIELD_TIME,   manualAnnounceTime),
+  FUNC_FIELD (TR_KEY_maxConnectedPeers,       fieldPeerLimit,           0),
+  STAT_FIELD (TR_KEY_metadataPercentComplete, FIELD_FLOAT,  metadataPercentComplete),
+  FUNC_FIELD (TR_KEY_name,                    fieldName,                0),
+  FUNC_FIELD (TR_KEY_peer_limit,              fieldPeerLimit,           0),
+  FUNC_FIELD (TR_KEY_peers,                   fieldPeers,               0),
+  STAT_FIELD (TR_KEY_peersConnected,          FIELD_INT,    peersConnected),
+  FUNC_FIELD (TR_KEY_peersFrom,               fieldPeersFrom,           FIELD_NEEDS_STAT),
+  STAT_FIELD (TR_KEY_peersGettingFromUs,      FIELD_INT,    peersGettingFromUs),
+  STAT_FIELD (TR_KEY_peersSendingToUs,        FIELD_INT,    peersSendingToUs),
+  STAT_FIELD (TR_KEY_percentDone,             FIELD_FLOAT,  percentDone),
+  FUNC_FIELD (TR_KEY_pieceCount,              fieldPieceCount,          0),
+  FUNC_FIELD (TR_KEY_pieceRuns,               fieldPieceRuns,           0),
+  FUNC_FIELD (TR_KEY_pieceSize,               fieldPieceSize,           0),
+  FUNC_FIELD (TR_KEY_pieces,                  fieldPieces,              0),
+  FUNC_FIELD (TR_KEY_priorities,              fieldPriorities,          0),
+  STAT_FIELD (TR_KEY_queuePosition,           FIELD_INT,    queuePosition),
+  FUNC_FIELD (TR_KEY_rateDownload,            fieldRateDownload,        FIELD_NEEDS_STAT),
+  FUNC_FIELD (TR_KEY_rateUpload,              fieldRateUpload,          FIELD_NEEDS_STAT),
+  STAT_FIELD (TR_KEY_recheckProgress,         FIELD_FLOAT,  recheckProgress),
+  STAT_FIELD (TR_KEY_secondsDownloading,      FIELD_INT,    secondsDownloading),
+  STAT_FIELD (TR_KEY_secondsSeeding,          FIELD_INT,    secondsSeeding),
+  FUNC_FIELD (TR_KEY_seedIdleLimit,           fieldSeedIdleLimit,       0),
+  FUNC_FIELD (TR_KEY_seedIdleMode,            fieldSeedIdleMode,        0),
+  FUNC_FIELD (TR_KEY_seedRatioLimit,          fieldSeedRatioLimit,      0),
+  FUNC_FIELD (TR_KEY_seedRatioMode,           fieldSeedRatioMode,       0),
+  STAT_FIELD (TR_KEY_sizeWhenDone,            FIELD_UINT64, sizeWhenDone),
+  STAT_FIELD (TR_KEY_startDate,               FIELD_TIME,   startDate),
+  FUNC_FIELD (TR_KEY_status,                  fieldStatus,              FIELD_NEEDS_STAT),
+  FUNC_FIELD (TR_KEY_torrentFile,             fieldTorrentFile,         0),
+  FUNC_FIELD (TR_KEY_totalSize,               fieldTotalSize,           0),
+  FUNC_FIELD (TR_KEY_trackerStats,            fieldTrackerStats,        0),
+  FUNC_FIELD (TR_KEY_trackers,                fieldTrackers,            0),
+  FUNC_FIELD (TR_KEY_uploadLimit,             fieldUploadLimit,         0),
+  FUNC_FIELD (TR_KEY_uploadLimited,           fieldUploadLimited,       0),
+  STAT_FIELD (TR_KEY_uploadRatio,             FIELD_FLOAT,  ratio),
+  STAT_FIELD (TR_KEY_uploadedEver,            FIELD_UINT64, uploadedEver),
+  FUNC_FIELD (TR_KEY_wanted,                  fieldWanted,              0),
+  FUNC_FIELD (TR_KEY_webseeds,                fieldWebseeds,            0),
+  STAT_FIELD (TR_KEY_webseedsSendingToUs,     FIELD_INT,    webseedsSendingToUs)
+};
 
-      case TR_KEY_name:
-        tr_variantDictAddStr (d, key, tr_torrentName (tor));
-        break;
+#undef FUNC_FIELD
+#undef STAT_FIELD
 
-      case TR_KEY_percentDone:
-        tr_variantDictAddReal (d, key, st->percentDone);
-        break;
+static int
+compareKeyToTorrentField (const void * vkey, const void * vfield)
+{
+  const tr_quark a = *(const tr_quark*)vkey;
+  const tr_quark b = ((const struct torrent_field*)vfield)->key;
 
-      case TR_KEY_peer_limit:
-        tr_variantDictAddInt (d, key, tr_torrentGetPeerLimit (tor));
-        break;
+  if (a < b) return -1;
+  if (a > b) return 1;
+  return 0;
+}
 
-      case TR_KEY_peers:
-        addPeers (tor, tr_variantDictAdd (d, key));
-        break;
+static int
+compareTorrentFields (const void * va, const void * vb)
+{
+  const struct torrent_field * a = *(const struct torrent_field**)va;
+  const struct torrent_field * b = *(const struct torrent_field**)vb;
 
-      case TR_KEY_peersConnected:
-        tr_variantDictAddInt (d, key, st->peersConnected);
-        break;
+  if (a < b) return -1;
+  if (a > b) return 1;
+  return 0;
+}
 
-      case TR_KEY_peersFrom:
-        {
-          tr_variant * tmp = tr_variantDictAddDict (d, key, 7);
-          const int * f = st->peersFrom;
-          tr_variantDictAddInt (tmp, TR_KEY_fromCache,    f[TR_PEER_FROM_RESUME]);
-          tr_variantDictAddInt (tmp, TR_KEY_fromDht,      f[TR_PEER_FROM_DHT]);
-          tr_variantDictAddInt (tmp, TR_KEY_fromIncoming, f[TR_PEER_FROM_INCOMING]);
-          tr_variantDictAddInt (tmp, TR_KEY_fromLpd,      f[TR_PEER_FROM_LPD]);
-          tr_variantDictAddInt (tmp, TR_KEY_fromLtep,     f[TR_PEER_FROM_LTEP]);
-          tr_variantDictAddInt (tmp, TR_KEY_fromPex,      f[TR_PEER_FROM_PEX]);
-          tr_variantDictAddInt (tmp, TR_KEY_fromTracker,  f[TR_PEER_FROM_TRACKER]);
-          break;
-        }
+/* Look up each requested field once for the whole reply. Unknown ones
+   are dropped, and the rest are sorted by name (torrentFields[] order)
+   with duplicates removed, so that replies come out the same as the
+   sorted dicts that tr_variantToBuf () writes */
+static const struct torrent_field **
+getTorrentFields (tr_variant * fields, bool withId, int * setmeCount, int * setmeNeeds)
+{
+  int i;
+  int n = 0;
+  int count;
+  int needs = 0;
+  const int fieldCount = tr_variantListSize (fields);
+  const struct torrent_field ** ret = tr_new (const struct torrent_field *, fieldCount + 1);
 
-      case TR_KEY_peersGettingFromUs:
-        tr_variantDictAddInt (d, key, st->peersGettingFromUs);
-        break;
-
-      case TR_KEY_peersSendingToUs:
-        tr_variantDictAddInt (d, key, st->peersSendingToUs);
-        break;
-
-      case TR_KEY_pieces:
-        if (tr_torrentHasMetadata (tor))
-          {
-            size_t byte_count = 0;
-            void * bytes = tr_torrentCreatePieceBitfield (tor, &byte_count);
-            char * str = tr_base64_encode (bytes, byte_count, NULL);
-            tr_variantDictAddStr (d, key, str!=NULL ? str : "");
-            tr_free (str);
-            tr_free (bytes);
-          }
-        else
-          {
-            tr_variantDictAddStr (d, key, "");
-          }
-        break;
-
-      case TR_KEY_pieceCount:
-        tr_variantDictAddInt (d, key, inf->pieceCount);
-        break;
-
-      case TR_KEY_pieceSize:
-        tr_variantDictAddInt (d, key, inf->pieceSize);
-        break;
-
-      case TR_KEY_priorities:
-        {
-          tr_file_index_t i;
-          tr_variant * p = tr_variantDictAddList (d, key, inf->fileCount);
-          for (i=0; i<inf->fileCount; ++i)
-            tr_variantListAddInt (p, inf->files[i].priority);
-          break;
-        }
+  for (i=0; i<fieldCount; ++i)
+    {
+      size_t len;
+      tr_quark key;
+      const char * str;
+      const struct torrent_field * f;
 
-      case TR_KEY_queuePosition:
-        tr_variantDictAddInt (d, key, st->queuePosition);
-        break;
+      if (tr_variantGetStr (tr_variantListChild (fields, i), &str, &len)
+          && tr_quark_lookup (str, len, &key)
+          && ((f = bsearch (&key, torrentFields, TR_N_ELEMENTS (torrentFields),
+                            sizeof (struct torrent_field), compareKeyToTorrentField))))
+        ret[n++] = f;
+    }
 
-      case TR_KEY_etaIdle:
-        tr_variantDictAddInt (d, key, st->etaIdle);
-        break;
+  if (withId)
+    {
+      const tr_quark idKey = TR_KEY_id;
+      ret[n++] = bsearch (&idKey, torrentFields, TR_N_ELEMENTS (torrentFields),
+                          sizeof (struct torrent_field), compareKeyToTorrentField);
+    }
 
-      case TR_KEY_rateDownload:
-        tr_variantDictAddInt (d, key, toSpeedBytes (st->pieceDownloadSpeed_KBps));
-        break;
+  qsort (ret, n, sizeof (const struct torrent_field *), compareTorrentFields);
 
-      case TR_KEY_rateUpload:
-        tr_variantDictAddInt (d, key, toSpeedBytes (st->pieceUploadSpeed_KBps));
-        break;
+  count = n;
+  for (i=n=0; i<count; ++i)
+    if (n == 0 || ret[n-1] != ret[i])
+      needs |= (ret[n++] = ret[i])->needs;
 
-      case TR_KEY_recheckProgress:
-        tr_variantDictAddReal (d, key, st->recheckProgress);
-        break;
+  *setmeCount = n;
+  *setmeNeeds = needs;
+  return ret;
+}
 
-      case TR_KEY_seedIdleLimit:
-        tr_variantDictAddInt (d, key, tr_torrentGetIdleLimit (tor));
-        break;
+static void
+fieldCtxInit (struct field_ctx * ctx, tr_torrent * tor, int needs)
+{
+  ctx->tor = tor;
+  ctx->inf = tr_torrentInfo (tor);
+  ctx->st = needs & FIELD_NEEDS_STAT ? tr_torrentStat (tor) : NULL;
+  ctx->files = needs & FIELD_NEEDS_FILES ? tr_torrentFiles (tor, &ctx->fileCount) : NULL;
+}
 
-      case TR_KEY_seedIdleMode:
-        tr_variantDictAddInt (d, key, tr_torrentGetIdleMode (tor));
-        break;
+static void
+fieldCtxDestruct (struct field_ctx * ctx)
+{
+  if (ctx->files != NULL)
+    tr_torrentFilesFree (ctx->files, ctx->fileCount);
+}
 
-      case TR_KEY_seedRatioLimit:
-        tr_variantDictAddReal (d, key, tr_torrentGetRatioLimit (tor));
-        break;
+static void
+addField (const struct field_ctx     * ctx,
+          const struct torrent_field * f,
+          tr_json_writer             * w)
+{
+  const char * member = (const char*)ctx->st + f->offset;
 
-      case TR_KEY_seedRatioMode:
-        tr_variantDictAddInt (d, key, tr_torrentGetRatioMode (tor));
-        break;
+  switch (f->type)
+    {
+      case FIELD_BOOL:   tr_jsonWriterDictAddBool (w, f->key, *(const bool*)member); break;
+      case FIELD_INT:    tr_jsonWriterDictAddInt  (w, f->key, *(const int*)member); break;
+      case FIELD_UINT64: tr_jsonWriterDictAddInt  (w, f->key, *(const uint64_t*)member); break;
+      case FIELD_TIME:   tr_jsonWriterDictAddInt  (w, f->key, *(const time_t*)member); break;
+      case FIELD_FLOAT:  tr_jsonWriterDictAddReal (w, f->key, *(const float*)member); break;
+      case FIELD_FUNC:   (*f->func)(ctx, w, f->key); break;
+    }
+}
 
-      case TR_KEY_sizeWhenDone:
-        tr_variantDictAddInt (d, key, st->sizeWhenDone);
-        break;
+static void
+addInfo (tr_torrent                  * tor,
+         tr_json_writer              * w,
+         const struct torrent_field ** fields,
+         int                           fieldCount,
+         int                           needs)
+{
+  tr_jsonWriterDictBegin (w);
 
-      case TR_KEY_startDate:
-        tr_variantDictAddInt (d, key, st->startDate);
-        break;
+  if (fieldCount > 0)
+    {
+      int i;
+      struct field_ctx ctx;
 
-      case TR_KEY_status:
-        tr_variantDictAddInt (d, key, st->activity);
-        break;
+      fieldCtxInit (&ctx, tor, needs);
 
-      case TR_KEY_secondsDownloading:
-        tr_variantDictAddInt (d, key, st->secondsDownloading);
-        break;
+      for (i=0; i<fieldCount; ++i)
+        addField (&ctx, fields[i], w);
 
-      case TR_KEY_secondsSeeding:
-        tr_variantDictAddInt (d, key, st->secondsSeeding);
-        break;
+      fieldCtxDestruct (&ctx);
+    }
 
-      case TR_KEY_trackers:
-        addTrackers (inf, tr_variantDictAddList (d, key, inf->trackerCount));
-        break;
+  tr_jsonWriterDictEnd (w);
+}
 
-      case TR_KEY_trackerStats:
-        {
-          int n;
-          tr_tracker_stat * s = tr_torrentTrackers (tor, &n);
-          addTrackerStats (s, n, tr_variantDictAddList (d, key, n));
-          tr_torrentTrackersFree (s, n);
-          break;
-        }
+/***
+****  Delta torrent-get
+****
+****  A torrent-get with a "since" revision token only sends the fields
+****  that have changed since that revision. Rather than hooking everywhere
+****  a torrent's state can change, each field is written out as usual and
+****  a hash of its JSON is compared with the one from the last request.
+****  If they differ, the field is stamped with this request's revision.
+****  Since every client's request does this, the stamps stay accurate no
+****  matter how many clients are polling or how often.
+***/
 
-      case TR_KEY_torrentFile:
-        tr_variantDictAddStr (d, key, inf->torrent);
-        break;
+struct tr_rpc_field_rev
+{
+  tr_quark key;
+  uint64_t hash;
+  int64_t revision;
+};
 
-      case TR_KEY_totalSize:
-        tr_variantDictAddInt (d, key, inf->totalSize);
-        break;
+/* 64-bit FNV-1a */
+static uint64_t
+hashJson (struct evbuffer * json)
+{
+  const size_t len = evbuffer_get_length (json);
+  const uint8_t * walk = evbuffer_pullup (json, -1);
+  const uint8_t * const end = walk + len;
+  uint64_t hash = 14695981039346656037ull;
 
-      case TR_KEY_uploadedEver:
-        tr_variantDictAddInt (d, key, st->uploadedEver);
-        break;
+  while (walk != end)
+    {
+      hash ^= *walk++;
+      hash *= 1099511628211ull;
+    }
 
-      case TR_KEY_uploadLimit:
-        tr_variantDictAddInt (d, key, tr_torrentGetSpeedLimit_KBps (tor, TR_UP));
-        break;
+  return hash;
+}
 
-      case TR_KEY_uploadLimited:
-        tr_variantDictAddBool (d, key, tr_torrentUsesSpeedLimit (tor, TR_UP));
-        break;
+static int
+compareKeyToFieldRev (const void * key, const void * vrev)
+{
+  const tr_quark a = *(const tr_quark*)key;
+  const tr_quark b = ((const struct tr_rpc_field_rev*)vrev)->key;
 
-      case TR_KEY_uploadRatio:
-        tr_variantDictAddReal (d, key, st->ratio);
-        break;
+  if (a < b) return -1;
+  if (a > b) return 1;
+  return 0;
+}
 
-      case TR_KEY_wanted:
-        {
-          tr_file_index_t i;
-          tr_variant * w = tr_variantDictAddList (d, key, inf->fileCount);
-          for (i=0; i<inf->fileCount; ++i)
-            tr_variantListAddInt (w, inf->files[i].dnd ? 0 : 1);
-          break;
-        }
+static struct tr_rpc_field_rev *
+getFieldRev (tr_torrent * tor, tr_quark key)
+{
+  bool exact;
+  const int pos = tr_lowerBound (&key, tor->rpcFieldRevs, tor->rpcFieldRevCount,
+                                 sizeof (struct tr_rpc_field_rev),
+                                 compareKeyToFieldRev, &exact);
 
-      case TR_KEY_webseeds:
-        addWebseeds (inf, tr_variantDictAddList (d, key, inf->webseedCount));
-        break;
+  if (!exact)
+    {
+      struct tr_rpc_field_rev * rev;
 
-      case TR_KEY_webseedsSendingToUs:
-        tr_variantDictAddInt (d, key, st->webseedsSendingToUs);
-        break;
+      tor->rpcFieldRevs = tr_renew (struct tr_rpc_field_rev, tor->rpcFieldRevs,
+                                    tor->rpcFieldRevCount + 1);
+      rev = tor->rpcFieldRevs + pos;
+      memmove (rev + 1, rev, sizeof (*rev) * (tor->rpcFieldRevCount - pos));
+      ++tor->rpcFieldRevCount;
 
-      default:
-        break;
+      rev->key = key;
+      rev->hash = 0;
+      rev->revision = 0;
     }
+
+  return tor->rpcFieldRevs + pos;
 }
 
+/* Like addInfo (), but only writes the fields that changed after `since',
+   plus the torrent's id. If none did, the torrent is left out altogether.
+   `field_buf' and `torrent_buf' are scratch space. */
 static void
-addInfo (tr_torrent * tor, tr_variant * d, tr_variant * fields)
+addChangedInfo (tr_torrent                  * tor,
+                tr_json_writer              * w,
+                const struct torrent_field ** fields,
+                int                           fieldCount,
+                int                           needs,
+                int64_t                       since,
+                int64_t                       revision,
+                struct evbuffer             * field_buf,
+                struct evbuffer             * torrent_buf)
 {
-  const int n = tr_variantListSize (fields);
+  int i;
+  bool changed = since == 0; /* a full listing has every torrent */
+  tr_json_writer tw;
+  struct field_ctx ctx;
+
+  fieldCtxInit (&ctx, tor, needs);
 
-  tr_variantInitDict (d, n);
+  tr_jsonWriterInit (&tw, torrent_buf);
+  tr_jsonWriterDictBegin (&tw);
 
-  if (n > 0)
+  for (i=0; i<fieldCount; ++i)
     {
-      int i;
-      const tr_info * const inf = tr_torrentInfo (tor);
-      const tr_stat * const st = tr_torrentStat ((tr_torrent*)tor);
+      uint64_t hash;
+      tr_json_writer fw;
+      struct tr_rpc_field_rev * rev;
+      const tr_quark key = fields[i]->key;
 
-      for (i=0; i<n; ++i)
+      tr_jsonWriterInit (&fw, field_buf);
+      addField (&ctx, fields[i], &fw);
+
+      hash = hashJson (field_buf);
+      rev = getFieldRev (tor, key);
+      if (rev->revision == 0 || rev->hash != hash)
         {
-          size_t len;
-          const char * str;
-          if (tr_variantGetStr (tr_variantListChild (fields, i), &str, &len))
-            addField (tor, inf, st, d, tr_quark_new (str, len));
+          rev->hash = hash;
+          rev->revision = revision;
+        }
+
+      if (key == TR_KEY_id)
+        {
+          tr_jsonWriterRaw (&tw, field_buf);
+        }
+      else if (rev->revision > since)
+        {
+          tr_jsonWriterRaw (&tw, field_buf);
+          changed = true;
+        }
+      else
+        {
+          evbuffer_drain (field_buf, evbuffer_get_length (field_buf));
         }
     }
+
+  tr_jsonWriterDictEnd (&tw);
+  fieldCtxDestruct (&ctx);
+
+  if (changed)
+    tr_jsonWriterRaw (w, torrent_buf);
+  else
+    evbuffer_drain (torrent_buf, evbuffer_get_length (torrent_buf));
+}
+
+static void
+addRemovedSince (tr_session * session, tr_json_writer * w, int64_t since)
+{
+  int n = 0;
+  tr_variant * d;
+
+  tr_jsonWriterDictAddList (w, TR_KEY_removed);
+
+  while ((d = tr_variantListChild (&session->removedTorrents, n++)))
+    {
+      int64_t id;
+      int64_t revision;
+      if (tr_variantDictFindInt (d, TR_KEY_revision, &revision) && (revision > since)
+                                      && tr_variantDictFindInt (d, TR_KEY_id, &id))
+        tr_jsonWriterInt (w, id);
+    }
+
+  tr_jsonWriterListEnd (w);
 }
 
 static const char*
 torrentGet (tr_session               * session,
             tr_variant               * args_in,
-            tr_variant               * args_out,
-            struct tr_rpc_idle_data  * idle_data UNUSED)
+            tr_json_writer           * w)
 {
   int i;
   int torrentCount;
   tr_torrent ** torrents = getTorrents (session, args_in, &torrentCount);
-  tr_variant * list = tr_variantDictAddList (args_out, TR_KEY_torrents, torrentCount);
   tr_variant * fields;
   const char * strVal;
   const char * errmsg = NULL;
+  int64_t since = 0;
+  int64_t revision = 0;
+  const bool delta = tr_variantDictFindInt (args_in, TR_KEY_since, &since);
 
-  assert (idle_data == NULL);
+  if (delta)
+    {
+      revision = ++session->rpcRevision;
 
-  if (tr_variantDictFindStr (args_in, TR_KEY_ids, &strVal, NULL) && !strcmp (strVal, "recently-active"))
+      /* If the token isn't one we handed out, send everything.
+         Leaving out "removed" tells the client it's a full listing. */
+      if ((session->rpcFirstRevision < since) && (since < revision))
+        addRemovedSince (session, w, since);
+      else
+        since = 0;
+
+      tr_jsonWriterDictAddInt (w, TR_KEY_revision, revision);
+    }
+  else if (tr_variantDictFindStr (args_in, TR_KEY_ids, &strVal, NULL) && !strcmp (strVal, "recently-active"))
     {
       int n = 0;
       tr_variant * d;
       const time_t now = tr_time ();
       const int interval = RECENTLY_ACTIVE_SECONDS;
-      tr_variant * removed_out = tr_variantDictAddList (args_out, TR_KEY_removed, 0);
+      tr_jsonWriterDictAddList (w, TR_KEY_removed);
       while ((d = tr_variantListChild (&session->removedTorrents, n++)))
         {
           int64_t intVal;
           if (tr_variantDictFindInt (d, TR_KEY_date, &intVal) && (intVal >= now - interval))
             {
               tr_variantDictFindInt (d, TR_KEY_id, &intVal);
-              tr_variantListAddInt (removed_out, intVal);
+              tr_jsonWriterInt (w, intVal);
             }
         }
+      tr_jsonWriterListEnd (w);
     }
 
+  tr_jsonWriterDictAddList (w, TR_KEY_torrents);
+
   if (!tr_variantDictFindList (args_in, TR_KEY_fields, &fields))
-    errmsg = "no fields specified";
-  else for (i=0; i<torrentCount; ++i)
-    addInfo (torrents[i], tr_variantListAdd (list), fields);
+    {
+      errmsg = "no fields specified";
+    }
+  else if (delta)
+    {
+      int fieldCount;
+      int needs;
+      const struct torrent_field ** f = getTorrentFields (fields, true, &fieldCount, &needs);
+      struct evbuffer * field_buf = evbuffer_new ();
+      struct evbuffer * torrent_buf = evbuffer_new ();
+
+      for (i=0; i<torrentCount; ++i)
+        addChangedInfo (torrents[i], w, f, fieldCount, needs, since, revision, field_buf, torrent_buf);
+
+      evbuffer_free (torrent_buf);
+      evbuffer_free (field_buf);
+      tr_free (f);
+    }
+  else
+    {
+      int fieldCount;
+      int needs;
+      const struct torrent_field ** f = getTorrentFields (fields, false, &fieldCount, &needs);
+
+      for (i=0; i<torrentCount; ++i)
+        addInfo (torrents[i], w, f, fieldCount, needs);
+
+      tr_free (f);
+    }
+
+  tr_jsonWriterListEnd (w);
 
   tr_free (torrents);
   return errmsg;
@@ -1611,14 +2032,11 @@ addTorrentImpl (struct tr_rpc_idle_data * data, tr_ctor * ctor)
 
   if (tor && key)
     {
-      tr_variant fields;
-      tr_variantInitList (&fields, 3);
-      tr_variantListAddStr (&fields, "id");
-      tr_variantListAddStr (&fields, "name");
-      tr_variantListAddStr (&fields, "hashString");
-      addInfo (tor, tr_variantDictAdd (data->args_out, key), &fields);
+      tr_variant * d = tr_variantDictAddDict (data->args_out, key, 3);
+      tr_variantDictAddStr (d, TR_KEY_hashString, tor->info.hashString);
+      tr_variantDictAddInt (d, TR_KEY_id, tr_torrentId (tor));
+      tr_variantDictAddStr (d, TR_KEY_name, tr_torrentName (tor));
       notify (data->session, TR_RPC_TORRENT_ADDED, tor);
-      tr_variantFree (&fields);
       result = NULL;
     }
 
@@ -1707,7 +2125,7 @@ torrentAdd (tr_session               * session,
   tr_variantDictFindStr (args_in, TR_KEY_metainfo, &metainfo_base64, NULL);
   if (!filename && !metainfo_base64)
     {
-      return "no filename or metainfo specified";
+      tr_idle_function_done (idle_data, "no filename or metainfo specified");
     }
   else
     {
@@ -1791,8 +2209,7 @@ torrentAdd (tr_session               * session,
             {
               int len;
               char * metainfo = tr_base64_decode (metainfo_base64, -1, &len);
-              tr_ctorSetMetainfo (ctor, (uint8_t*)metainfo, len);
-              tr_free (metainfo);
+              tr_ctorSetMetainfoInPlace (ctor, metainfo, len);
             }
           else if (!strncmp (fname, "magnet:?", 8))
             {
@@ -1968,21 +2385,29 @@ sessionSet (tr_session               * session,
   return NULL;
 }
 
+static void
+addSessionStats (tr_json_writer * w, const tr_quark key, const tr_session_stats * stats)
+{
+  tr_jsonWriterDictAddDict (w, key);
+  tr_jsonWriterDictAddInt (w, TR_KEY_downloadedBytes, stats->downloadedBytes);
+  tr_jsonWriterDictAddInt (w, TR_KEY_filesAdded, stats->filesAdded);
+  tr_jsonWriterDictAddInt (w, TR_KEY_secondsActive, stats->secondsActive);
+  tr_jsonWriterDictAddInt (w, TR_KEY_sessionCount, stats->sessionCount);
+  tr_jsonWriterDictAddInt (w, TR_KEY_uploadedBytes, stats->uploadedBytes);
+  tr_jsonWriterDictEnd (w);
+}
+
 static const char*
 sessionStats (tr_session               * session,
               tr_variant               * args_in UNUSED,
-              tr_variant               * args_out,
-              struct tr_rpc_idle_data  * idle_data UNUSED)
+              tr_json_writer           * w)
 {
   int running = 0;
   int total = 0;
-  tr_variant * d;
   tr_session_stats currentStats = { 0.0f, 0, 0, 0, 0, 0 };
   tr_session_stats cumulativeStats = { 0.0f, 0, 0, 0, 0, 0 };
   tr_torrent * tor = NULL;
 
-  assert (idle_data == NULL);
-
   while ((tor = tr_torrentNext (session, tor)))
     {
       ++total;
@@ -1994,26 +2419,95 @@ sessionStats (tr_session               * session,
   tr_sessionGetStats (session, &currentStats);
   tr_sessionGetCumulativeStats (session, &cumulativeStats);
 
-  tr_variantDictAddInt  (args_out, TR_KEY_activeTorrentCount, running);
-  tr_variantDictAddReal (args_out, TR_KEY_downloadSpeed, tr_sessionGetPieceSpeed_Bps (session, TR_DOWN));
-  tr_variantDictAddInt  (args_out, TR_KEY_pausedTorrentCount, total - running);
-  tr_variantDictAddInt  (args_out, TR_KEY_torrentCount, total);
-  tr_variantDictAddReal (args_out, TR_KEY_uploadSpeed, tr_sessionGetPieceSpeed_Bps (session, TR_UP));
-
-  d = tr_variantDictAddDict (args_out, TR_KEY_cumulative_stats, 5);
-  tr_variantDictAddInt (d, TR_KEY_downloadedBytes, cumulativeStats.downloadedBytes);
-  tr_variantDictAddInt (d, TR_KEY_filesAdded, cumulativeStats.filesAdded);
-  tr_variantDictAddInt (d, TR_KEY_secondsActive, cumulativeStats.secondsActive);
-  tr_variantDictAddInt (d, TR_KEY_sessionCount, cumulativeStats.sessionCount);
-  tr_variantDictAddInt (d, TR_KEY_uploadedBytes, cumulativeStats.uploadedBytes);
-
-  d = tr_variantDictAddDict (args_out, TR_KEY_current_stats, 5);
-  tr_variantDictAddInt (d, TR_KEY_downloadedBytes, currentStats.downloadedBytes);
-  tr_variantDictAddInt (d, TR_KEY_filesAdded, currentStats.filesAdded);
-  tr_variantDictAddInt (d, TR_KEY_secondsActive, currentStats.secondsActive);
-  tr_variantDictAddInt (d, TR_KEY_sessionCount, currentStats.sessionCount);
-  tr_variantDictAddInt (d, TR_KEY_uploadedBytes, currentStats.uploadedBytes);
+  tr_jsonWriterDictAddInt  (w, TR_KEY_activeTorrentCount, running);
+  addSessionStats (w, TR_KEY_cumulative_stats, &cumulativeStats);
+  addSessionStats (w, TR_KEY_current_stats, &currentStats);
+  tr_jsonWriterDictAddReal (w, TR_KEY_downloadSpeed, tr_sessionGetPieceSpeed_Bps (session, TR_DOWN));
+  tr_jsonWriterDictAddInt  (w, TR_KEY_pausedTorrentCount, total - running);
+  tr_jsonWriterDictAddInt  (w, TR_KEY_torrentCount, total);
+  tr_jsonWriterDictAddReal (w, TR_KEY_uploadSpeed, tr_sessionGetPieceSpeed_Bps (session, TR_UP));
+
+  return NULL;
+}
+
+/* the keys must be written in order, like tr_variantToBuf () would */
+static void
+addHistoryList (tr_json_writer       * w,
+                const tr_quark         key,
+                const tr_rate_sample * samples,
+                int                    n)
+{
+  int i;
+
+  tr_jsonWriterDictAddList (w, key);
+  for (i=0; i<n; ++i)
+    {
+      if (key == TR_KEY_downloadedBytes)
+        tr_jsonWriterInt (w, samples[i].downloadedBytes);
+      else if (key == TR_KEY_uploadedBytes)
+        tr_jsonWriterInt (w, samples[i].uploadedBytes);
+      else
+        tr_jsonWriterInt (w, samples[i].peersConnected);
+    }
+  tr_jsonWriterListEnd (w);
+}
+
+static const char*
+sessionHistory (tr_session               * session,
+                tr_variant               * args_in,
+                tr_json_writer           * w)
+{
+  int n;
+  int resolution;
+  tr_rate_sample * samples;
+  tr_rate_sample * sessionSamples;
+  int64_t interval = 60;
+  const time_t now = tr_time ();
+
+  tr_variantDictFindInt (args_in, TR_KEY_interval, &interval);
+  for (resolution=0; resolution<TR_HISTORY_RESOLUTION_COUNT; ++resolution)
+    if (tr_rateHistoryInterval (resolution) == interval)
+      break;
+  if (resolution == TR_HISTORY_RESOLUTION_COUNT)
+    return "invalid interval";
+
+  n = tr_rateHistorySampleCount (resolution);
+  samples = tr_new (tr_rate_sample, n);
+  sessionSamples = tr_new (tr_rate_sample, n);
+  tr_rateHistoryGet (session->rateHistory, TR_HISTORY_SESSION, resolution, now, sessionSamples);
+
+  tr_jsonWriterDictAddInt (w, TR_KEY_date, now - (now % interval));
+  addHistoryList (w, TR_KEY_downloadedBytes, sessionSamples, n);
+  tr_jsonWriterDictAddInt (w, TR_KEY_interval, interval);
+  addHistoryList (w, TR_KEY_peersConnected, sessionSamples, n);
+
+  /* only list the torrents that were asked for */
+  if (tr_variantDictFind (args_in, TR_KEY_ids) != NULL)
+    {
+      int i;
+      int torrentCount;
+      tr_torrent ** torrents = getTorrents (session, args_in, &torrentCount);
+
+      tr_jsonWriterDictAddList (w, TR_KEY_torrents);
+      for (i=0; i<torrentCount; ++i)
+        {
+          tr_rateHistoryGet (session->rateHistory, torrents[i]->historySeries, resolution, now, samples);
+          tr_jsonWriterDictBegin (w);
+          addHistoryList (w, TR_KEY_downloadedBytes, samples, n);
+          tr_jsonWriterDictAddInt (w, TR_KEY_id, tr_torrentId (torrents[i]));
+          addHistoryList (w, TR_KEY_peersConnected, samples, n);
+          addHistoryList (w, TR_KEY_uploadedBytes, samples, n);
+          tr_jsonWriterDictEnd (w);
+        }
+      tr_jsonWriterListEnd (w);
+
+      tr_free (torrents);
+    }
+
+  addHistoryList (w, TR_KEY_uploadedBytes, sessionSamples, n);
 
+  tr_free (sessionSamples);
+  tr_free (samples);
   return NULL;
 }
 
@@ -2133,36 +2627,41 @@ sessionClose (tr_session               * session,
 
 typedef const char* (*handler)(tr_session*, tr_variant*, tr_variant*, struct tr_rpc_idle_data *);
 
+/* immediate methods whose replies can be big write them straight out as JSON */
+typedef const char* (*stream_handler)(tr_session*, tr_variant*, tr_json_writer*);
+
 static struct method
 {
-  const char *  name;
-  bool          immediate;
-  handler       func;
+  const char *    name;
+  bool            immediate;
+  handler         func;
+  stream_handler  stream_func;
 }
 methods[] =
 {
-  { "port-test",             false, portTest            },
-  { "blocklist-update",      false, blocklistUpdate     },
-  { "free-space",            true,  freeSpace           },
-  { "session-close",         true,  sessionClose        },
-  { "session-get",           true,  sessionGet          },
-  { "session-set",           true,  sessionSet          },
-  { "session-stats",         true,  sessionStats        },
-  { "torrent-add",           false, torrentAdd          },
-  { "torrent-get",           true,  torrentGet          },
-  { "torrent-remove",        true,  torrentRemove       },
-  { "torrent-rename-path",   false, torrentRenamePath   },
-  { "torrent-set",           true,  torrentSet          },
-  { "torrent-set-location",  true,  torrentSetLocation  },
-  { "torrent-start",         true,  torrentStart        },
-  { "torrent-start-now",     true,  torrentStartNow     },
-  { "torrent-stop",          true,  torrentStop         },
-  { "torrent-verify",        true,  torrentVerify       },
-  { "torrent-reannounce",    true,  torrentReannounce   },
-  { "queue-move-top",        true,  queueMoveTop        },
-  { "queue-move-up",         true,  queueMoveUp         },
-  { "queue-move-down",       true,  queueMoveDown       },
-  { "queue-move-bottom",     true,  queueMoveBottom     }
+  { "port-test",             false, portTest,           NULL           },
+  { "blocklist-update",      false, blocklistUpdate,    NULL           },
+  { "free-space",            true,  freeSpace,          NULL           },
+  { "session-close",         true,  sessionClose,       NULL           },
+  { "session-get",           true,  sessionGet,         NULL           },
+  { "session-history",       true,  NULL,               sessionHistory },
+  { "session-set",           true,  sessionSet,         NULL           },
+  { "session-stats",         true,  NULL,               sessionStats   },
+  { "torrent-add",           false, torrentAdd,         NULL           },
+  { "torrent-get",           true,  NULL,               torrentGet     },
+  { "torrent-remove",        true,  torrentRemove,      NULL           },
+  { "torrent-rename-path",   false, torrentRenamePath,  NULL           },
+  { "torrent-set",           true,  torrentSet,         NULL           },
+  { "torrent-set-location",  true,  torrentSetLocation, NULL           },
+  { "torrent-start",         true,  torrentStart,       NULL           },
+  { "torrent-start-now",     true,  torrentStartNow,    NULL           },
+  { "torrent-stop",          true,  torrentStop,        NULL           },
+  { "torrent-verify",        true,  torrentVerify,      NULL           },
+  { "torrent-reannounce",    true,  torrentReannounce,  NULL           },
+  { "queue-move-top",        true,  queueMoveTop,       NULL           },
+  { "queue-move-up",         true,  queueMoveUp,        NULL           },
+  { "queue-move-down",       true,  queueMoveDown,      NULL           },
+  { "queue-move-bottom",     true,  queueMoveBottom,    NULL           }
 };
 
 static void
@@ -2222,6 +2721,29 @@ request_exec (tr_session             * session,
 
       tr_variantFree (&response);
     }
+  else if (methods[i].stream_func != NULL)
+    {
+      int64_t tag;
+      tr_json_writer w;
+      struct evbuffer * buf = evbuffer_new ();
+
+      /* keys are written in sorted order to match tr_variantToBuf () */
+      tr_jsonWriterInit (&w, buf);
+      tr_jsonWriterDictBegin (&w);
+      tr_jsonWriterDictAddDict (&w, TR_KEY_arguments);
+      result = (*methods[i].stream_func)(session, args_in, &w);
+      tr_jsonWriterDictEnd (&w);
+      if (result == NULL)
+        result = "success";
+      tr_jsonWriterDictAddStr (&w, TR_KEY_result, result);
+      if (tr_variantDictFindInt (request, TR_KEY_tag, &tag))
+        tr_jsonWriterDictAddInt (&w, TR_KEY_tag, tag);
+      tr_jsonWriterDictEnd (&w);
+      evbuffer_add (buf, "\n", 1);
+
+      (*callback)(session, buf, callback_user_data);
+      evbuffer_free (buf);
+    }
   else if (methods[i].immediate)
     {
       int64_t tag;
@@ -2229,7 +2751,7 @@ request_exec (tr_session             * session,
       tr_variant * args_out;
       struct evbuffer * buf;
 
-      tr_variantInitDict (&response, 3);
+      tr_variantInitArenaDict (&response, 3);
       args_out = tr_variantDictAddDict (&response, TR_KEY_arguments, 0);
       result = (*methods[i].func)(session, args_in, args_out, NULL);
       if (result == NULL)
@@ -2250,7 +2772,7 @@ request_exec (tr_session             * session,
       struct tr_rpc_idle_data * data = tr_new0 (struct tr_rpc_idle_data, 1);
       data->session = session;
       data->response = tr_new0 (tr_variant, 1);
-      tr_variantInitDict (data->response, 3);
+      tr_variantInitArenaDict (data->response, 3);
       if (tr_variantDictFindInt (request, TR_KEY_tag, &tag))
         tr_variantDictAddInt (data->response, TR_KEY_tag, tag);
       data->args_out = tr_variantDictAddDict (data->response, TR_KEY_arguments, 0);
@@ -2260,6 +2782,122 @@ request_exec (tr_session             * session,
     }
 }
 
+/***
+****  Batches
+***/
+
+/* A batch's replies are collected here until the last one's in.
+   Immediate methods reply right away, but idle ones like torrent-add
+   may not finish until after batch_exec () returns */
+struct rpc_batch
+{
+  tr_session            * session;
+  struct evbuffer      ** replies;
+  int                     count;
+  int                     pending;
+  tr_rpc_response_func    callback;
+  void                  * callback_user_data;
+};
+
+struct rpc_batch_call
+{
+  struct rpc_batch * batch;
+  int                index;
+};
+
+static void
+batch_finish_call (struct rpc_batch * batch)
+{
+  int i;
+  struct evbuffer * buf;
+
+  if (--batch->pending > 0)
+    return;
+
+  /* everyone's replied, so send them all back in the order they were asked */
+  buf = evbuffer_new ();
+  evbuffer_add (buf, "[", 1);
+  for (i=0; i<batch->count; ++i)
+    {
+      if (i > 0)
+        evbuffer_add (buf, ",", 1);
+      evbuffer_add_buffer (buf, batch->replies[i]);
+      evbuffer_free (batch->replies[i]);
+    }
+  evbuffer_add (buf, "]\n", 2);
+
+  (*batch->callback)(batch->session, buf, batch->callback_user_data);
+
+  evbuffer_free (buf);
+  tr_free (batch->replies);
+  tr_free (batch);
+}
+
+static void
+batch_response_func (tr_session      * session UNUSED,
+                     struct evbuffer * response,
+                     void            * user_data)
+{
+  struct rpc_batch_call * call = user_data;
+  struct rpc_batch * batch = call->batch;
+
+  size_t len = evbuffer_get_length (response);
+  struct evbuffer_ptr pos;
+
+  /* leave out the trailing newline, so the list isn't ragged */
+  if (len > 0)
+    {
+      evbuffer_ptr_set (response, &pos, len - 1, EVBUFFER_PTR_SET);
+      if (evbuffer_search (response, "\n", 1, &pos).pos != -1)
+        --len;
+    }
+
+  evbuffer_remove_buffer (response, batch->replies[call->index], len);
+  tr_free (call);
+
+  batch_finish_call (batch);
+}
+
+/**
+ * Run each of the requests in the `requests' list, all while holding
+ * the session lock, and reply with a list of their responses.
+ */
+static void
+batch_exec (tr_session             * session,
+            tr_variant             * requests,
+            tr_rpc_response_func     callback,
+            void                   * callback_user_data)
+{
+  int i;
+  struct rpc_batch * batch = tr_new0 (struct rpc_batch, 1);
+
+  batch->session = session;
+  batch->count = tr_variantListSize (requests);
+  batch->replies = tr_new (struct evbuffer *, batch->count);
+  batch->callback = callback ? callback : noop_response_callback;
+  batch->callback_user_data = callback_user_data;
+
+  /* one extra, so the batch can't finish until we're done looping */
+  batch->pending = batch->count + 1;
+
+  for (i=0; i<batch->count; ++i)
+    batch->replies[i] = evbuffer_new ();
+
+  tr_sessionLock (session);
+
+  for (i=0; i<batch->count; ++i)
+    {
+      struct rpc_batch_call * call = tr_new (struct rpc_batch_call, 1);
+      call->batch = batch;
+      call->index = i;
+      request_exec (session, tr_variantListChild (requests, i), batch_response_func, call);
+    }
+
+  tr_sessionUnlock (session);
+
+  batch_finish_call (batch);
+}
+
 void
 tr_rpc_request_exec_json (tr_session            * session,
                           const void            * request_json,
@@ -2274,7 +2912,10 @@ tr_rpc_request_exec_json (tr_session            * session,
     request_len = strlen (request_json);
 
   have_content = !tr_variantFromJson (&top, request_json, request_len);
-  request_exec (session, have_content ? &top : NULL, callback, callback_user_data);
+  if (have_content && tr_variantIsList (&top))
+    batch_exec (session, &top, callback, callback_user_data);
+  else
+    request_exec (session, have_content ? &top : NULL, callback, callback_user_data);
 
   if (have_content)
     tr_variantFree (&top);
@@ -7,11 +7,14 @@
  * $Id$
  */
 
+#include <ctype.h> /* toupper () */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "transmission.h"
+#include "crypto.h" /* tr_sha1 () */
 #include "session.h"
+#include "torrent.h"
 #include "utils.h"
 #include "version.h"
 
@@ -46,4 +49,139 @@ testPeerId (void)
     return 0;
 }
 
-MAIN_SINGLE_TEST (testPeerId)
+static int
+testTorrentLookup (void)
+{
+    enum { TORRENT_COUNT = 300 };
+
+    int i;
+    tr_session * session;
+    tr_torrent * torrents[TORRENT_COUNT];
+    int ids[TORRENT_COUNT];
+    uint8_t hashes[TORRENT_COUNT][SHA_DIGEST_LENGTH];
+
+    session = libttest_session_init (NULL);
+
+    /* enough torrents to make the lookup tables grow a few times */
+    for (i = 0; i < TORRENT_COUNT; ++i)
+    {
+        int err = 0;
+        char hex[SHA_DIGEST_LENGTH*2 + 1];
+        uint8_t hash[SHA_DIGEST_LENGTH];
+        char * magnet;
+        tr_ctor * ctor;
+
+        tr_sha1 (hash, &i, (int)sizeof (i), NULL);
+        tr_sha1_to_hex (hex, hash);
+        magnet = tr_strdup_printf ("magnet:?xt=urn:btih:%s&dn=%d", hex, i);
+        ctor = tr_ctorNew (session);
+        check (!tr_ctorSetMetainfoFromMagnetLink (ctor, magnet));
+        tr_ctorSetPaused (ctor, TR_FORCE, true);
+        torrents[i] = tr_torrentNew (ctor, &err, NULL);
+        check (torrents[i] != NULL);
+        tr_ctorFree (ctor);
+        tr_free (magnet);
+    }
+
+    for (i = 0; i < TORRENT_COUNT; ++i)
+    {
+        tr_torrent * tor = torrents[i];
+        char upper[SHA_DIGEST_LENGTH*2 + 1];
+        int j;
+
+        check (tr_torrentFindFromId (session, tr_torrentId (tor)) == tor);
+        check (tr_torrentFindFromHash (session, tor->info.hash) == tor);
+        check (tr_torrentFindFromHashString (session, tor->info.hashString) == tor);
+        check (tr_torrentFindFromObfuscatedHash (session, tor->obfuscatedHash) == tor);
+
+        for (j = 0; tor->info.hashString[j]; ++j)
+            upper[j] = toupper (tor->info.hashString[j]);
+        upper[j] = '\0';
+        check (tr_torrentFindFromHashString (session, upper) == tor);
+    }
+
+    check (tr_torrentFindFromHashString (session, "") == NULL);
+    check (tr_torrentFindFromHashString (session, "abc") == NULL);
+    check (tr_torrentFindFromHashString (session, "zz39a3ee5e6b4b0d3255bfef95601890afd80709") == NULL);
+
+    /* remove every other torrent */
+    for (i = 0; i < TORRENT_COUNT; i += 2)
+    {
+        ids[i] = tr_torrentId (torrents[i]);
+        memcpy (hashes[i], torrents[i]->info.hash, SHA_DIGEST_LENGTH);
+        tr_torrentRemove (torrents[i], false, NULL);
+        torrents[i] = NULL;
+    }
+    while (tr_sessionCountTorrents (session) > TORRENT_COUNT / 2)
+        tr_wait_msec (10);
+
+    for (i = 0; i < TORRENT_COUNT; i += 2)
+    {
+        check (tr_torrentFindFromId (session, ids[i]) == NULL);
+        check (tr_torrentFindFromHash (session, hashes[i]) == NULL);
+    }
+
+    for (i = 1; i < TORRENT_COUNT; i += 2)
+    {
+        check (tr_torrentFindFromId (session, tr_torrentId (torrents[i])) == torrents[i]);
+        check (tr_torrentFindFromHash (session, torrents[i]->info.hash) == torrents[i]);
+        check (tr_torrentFindFromObfuscatedHash (session, torrents[i]->obfuscatedHash) == torrents[i]);
+    }
+
+    libttest_session_close (session);
+    return 0;
+}
+
+static int
+testPieceHashes (void)
+{
+    tr_session * session;
+    tr_torrent * tor;
+    uint8_t * hashes;
+    size_t len;
+
+    session = libttest_session_init (NULL);
+    tor = libttest_zero_torrent_init (session);
+    len = tor->info.pieceCount * SHA_DIGEST_LENGTH;
+
+    /* a stopped torrent lets go of its hashes once it's been verified... */
+    check (!tor->isRunning);
+    libttest_zero_torrent_populate (tor, true);
+    libttest_blockingTorrentVerify (tor);
+    check_int_eq (0, tr_torrentStat (tor)->leftUntilDone);
+    check (tor->info.pieceHashes == NULL);
+
+    /* ...and gets them back when a piece is checked */
+    check (tr_torrentCheckPiece (tor, 0));
+    check (tor->info.pieceHashes != NULL);
+    hashes = tr_memdup (tor->info.pieceHashes, len);
+
+    /* once they've been idle for a while, they can go again */
+    tr_torrentReleasePieceHashes (tor, false);
+    check (tor->info.pieceHashes != NULL);
+    tr_torrentReleasePieceHashes (tor, true);
+    check (tor->info.pieceHashes == NULL);
+    check (tr_torrentCheckPiece (tor, 0));
+    check (tor->info.pieceHashes != NULL);
+    check (!memcmp (hashes, tor->info.pieceHashes, len));
+
+    /* if the .torrent file is gone, they're kept */
+    check_int_eq (0, remove (tor->info.torrent));
+    tr_torrentReleasePieceHashes (tor, true);
+    check (tor->info.pieceHashes != NULL);
+
+    tr_free (hashes);
+    tr_torrentRemove (tor, false, NULL);
+    libttest_session_close (session);
+    return 0;
+}
+
+int
+main (void)
+{
+    const testFunc tests[] = { testPeerId,
+                               testTorrentLookup,
+                               testPieceHashes };
+
+    return runTests (tests, NUM_TESTS (tests));
+}
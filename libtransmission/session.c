@@ -8,6 +8,7 @@
  */
 
 #include <assert.h>
+#include <ctype.h> /* isxdigit () */
 #include <errno.h> /* ENOENT */
 #include <limits.h> /* INT_MAX */
 #include <stdlib.h>
@@ -30,8 +31,10 @@
 #include "bandwidth.h"
 #include "blocklist.h"
 #include "cache.h"
+#include "catalog.h"
 #include "crypto.h"
 #include "fdlimit.h"
+#include "journal.h"
 #include "list.h"
 #include "log.h"
 #include "net.h"
@@ -40,6 +43,7 @@
 #include "platform.h" /* tr_lock, tr_getTorrentDir () */
 #include "platform-quota.h" /* tr_device_info_free() */
 #include "port-forwarding.h"
+#include "rate-history.h"
 #include "rpc-server.h"
 #include "session.h"
 #include "stats.h"
@@ -60,9 +64,11 @@ enum
 #ifdef TR_LIGHTWEIGHT
   DEFAULT_CACHE_SIZE_MB = 2,
   DEFAULT_PREFETCH_ENABLED = false,
+  DEFAULT_PIECE_CHECK_THREADS = 0,
 #else
   DEFAULT_CACHE_SIZE_MB = 4,
   DEFAULT_PREFETCH_ENABLED = true,
+  DEFAULT_PIECE_CHECK_THREADS = 2,
 #endif
   SAVE_INTERVAL_SECS = 360
 };
@@ -313,7 +319,7 @@ tr_sessionGetDefaultSettings (tr_variant * d)
 {
   assert (tr_variantIsDict (d));
 
-  tr_variantDictReserve (d, 63);
+  tr_variantDictReserve (d, 64);
   tr_variantDictAddBool (d, TR_KEY_blocklist_enabled,               false);
   tr_variantDictAddStr  (d, TR_KEY_blocklist_url,                   "http://www.example.com/blocklist");
   tr_variantDictAddInt  (d, TR_KEY_cache_size_mb,                   DEFAULT_CACHE_SIZE_MB);
@@ -339,6 +345,7 @@ tr_sessionGetDefaultSettings (tr_variant * d)
   tr_variantDictAddInt  (d, TR_KEY_peer_port_random_high,           65535);
   tr_variantDictAddStr  (d, TR_KEY_peer_socket_tos,                 TR_DEFAULT_PEER_SOCKET_TOS_STR);
   tr_variantDictAddBool (d, TR_KEY_pex_enabled,                     true);
+  tr_variantDictAddInt  (d, TR_KEY_piece_check_threads,             DEFAULT_PIECE_CHECK_THREADS);
   tr_variantDictAddBool (d, TR_KEY_port_forwarding_enabled,         true);
   tr_variantDictAddInt  (d, TR_KEY_preallocation,                   TR_PREALLOCATE_SPARSE);
   tr_variantDictAddBool (d, TR_KEY_prefetch_enabled,                DEFAULT_PREFETCH_ENABLED);
@@ -384,7 +391,7 @@ tr_sessionGetSettings (tr_session * s, tr_variant * d)
 {
   assert (tr_variantIsDict (d));
 
-  tr_variantDictReserve (d, 63);
+  tr_variantDictReserve (d, 64);
   tr_variantDictAddBool (d, TR_KEY_blocklist_enabled,            tr_blocklistIsEnabled (s));
   tr_variantDictAddStr  (d, TR_KEY_blocklist_url,                tr_blocklistGetURL (s));
   tr_variantDictAddInt  (d, TR_KEY_cache_size_mb,                tr_sessionGetCacheLimit_MB (s));
@@ -411,6 +418,7 @@ tr_sessionGetSettings (tr_session * s, tr_variant * d)
   tr_variantDictAddStr  (d, TR_KEY_peer_socket_tos,              format_tos (s->peerSocketTOS));
   tr_variantDictAddStr  (d, TR_KEY_peer_congestion_algorithm,    s->peer_congestion_algorithm);
   tr_variantDictAddBool (d, TR_KEY_pex_enabled,                  s->isPexEnabled);
+  tr_variantDictAddInt  (d, TR_KEY_piece_check_threads,          s->pieceCheckThreads);
   tr_variantDictAddBool (d, TR_KEY_port_forwarding_enabled,      tr_sessionIsPortForwardingEnabled (s));
   tr_variantDictAddInt  (d, TR_KEY_preallocation,                s->preallocationMode);
   tr_variantDictAddInt  (d, TR_KEY_prefetch_enabled,             s->isPrefetchEnabled);
@@ -554,9 +562,13 @@ onSaveTimer (evutil_socket_t foo UNUSED, short bar UNUSED, void * vsession)
     tr_logAddError ("Error while flushing completed pieces from cache");
 
   while ((tor = tr_torrentNext (session, tor)))
-    tr_torrentSave (tor);
+    {
+      tr_torrentSave (tor);
+      tr_torrentReleasePieceHashes (tor, false);
+    }
 
   tr_statsSaveDirty (session);
+  tr_rateHistorySave (session->rateHistory);
 
   tr_timerAdd (session->saveTimer, SAVE_INTERVAL_SECS, 0);
 }
@@ -601,6 +613,11 @@ tr_sessionInit (const char  * tag,
   tr_bandwidthConstruct (&session->bandwidth, session, NULL);
   tr_variantInitList (&session->removedTorrents, 0);
 
+  /* seed the revisions from the clock so that a token left over
+     from an earlier run can't be mistaken for one of ours */
+  session->rpcFirstRevision = (int64_t)tr_time () << 16;
+  session->rpcRevision = session->rpcFirstRevision;
+
   /* nice to start logging at the very beginning */
   if (tr_variantDictFindInt (clientSettings, TR_KEY_message_level, &i))
     tr_logSetLevel (i);
@@ -629,6 +646,7 @@ static void
 onNowTimer (evutil_socket_t foo UNUSED, short bar UNUSED, void * vsession)
 {
   int usec;
+  int peerCount = 0;
   const int min = 100;
   const int max = 999999;
   struct timeval tv;
@@ -659,8 +677,23 @@ onNowTimer (evutil_socket_t foo UNUSED, short bar UNUSED, void * vsession)
           else
             ++tor->secondsDownloading;
         }
+
+      if (tor->swarm != NULL)
+        {
+          tr_swarm_stats swarm_stats;
+          tr_swarmGetStats (tor->swarm, &swarm_stats);
+
+          if (swarm_stats.peerCount > 0)
+            {
+              tr_rateHistorySetPeers (session->rateHistory, tor->historySeries, now, swarm_stats.peerCount);
+              peerCount += swarm_stats.peerCount;
+            }
+        }
     }
 
+  if ((session->rateHistory != NULL) && (peerCount > 0))
+    tr_rateHistorySetPeers (session->rateHistory, TR_HISTORY_SESSION, now, peerCount);
+
   /**
   ***  Set the timer
   **/
@@ -709,6 +742,18 @@ tr_sessionInitImpl (void * vdata)
 
   tr_setConfigDir (session, data->configDir);
 
+  {
+    char * filename = tr_buildPath (session->configDir, "resume.journal", NULL);
+    session->resumeJournal = tr_journalNew (filename, tr_getResumeDir (session));
+    tr_free (filename);
+  }
+
+  {
+    char * filename = tr_buildPath (session->configDir, "stats.history", NULL);
+    session->rateHistory = tr_rateHistoryNew (filename);
+    tr_free (filename);
+  }
+
   session->peerMgr = tr_peerMgrNew (session);
 
   session->shared = tr_sharedInit (session);
@@ -827,6 +872,8 @@ sessionSetImpl (void * vdata)
   /* files and directories */
   if (tr_variantDictFindBool (settings, TR_KEY_prefetch_enabled, &boolVal))
     session->isPrefetchEnabled = boolVal;
+  if (tr_variantDictFindInt (settings, TR_KEY_piece_check_threads, &i))
+    session->pieceCheckThreads = MAX (0, i);
   if (tr_variantDictFindInt (settings, TR_KEY_preallocation, &i))
     session->preallocationMode = i;
   if (tr_variantDictFindStr (settings, TR_KEY_download_dir, &str, NULL))
@@ -1843,6 +1890,17 @@ sessionCloseImpl (void * vsession)
   tr_statsClose (session);
   tr_peerMgrFree (session->peerMgr);
 
+  tr_sessionLock (session);
+  if (session->catalog != NULL)
+    tr_catalogSave (session->catalog, false);
+  tr_sessionUnlock (session);
+
+  tr_journalFree (session->resumeJournal);
+  session->resumeJournal = NULL;
+
+  tr_rateHistoryFree (session->rateHistory);
+  session->rateHistory = NULL;
+
   closeBlocklists (session);
 
   tr_fdClose (session);
@@ -1916,12 +1974,11 @@ tr_sessionClose (tr_session * session)
   tr_bandwidthDestruct (&session->bandwidth);
   tr_bitfieldDestruct (&session->turtle.minutes);
   tr_lockFree (session->lock);
-  if (session->metainfoLookup)
-    {
-      tr_variantFree (session->metainfoLookup);
-      tr_free (session->metainfoLookup);
-    }
+  tr_catalogFree (session->catalog);
   tr_device_info_free (session->downloadDir);
+  tr_free (session->torrentsById);
+  tr_free (session->torrentsByHash);
+  tr_free (session->torrentsByObfuscatedHash);
   tr_free (session->torrentDoneScript);
   tr_free (session->tag);
   tr_free (session->configDir);
@@ -1933,30 +1990,129 @@ tr_sessionClose (tr_session * session)
   tr_free (session);
 }
 
+/* torrents are parsed and their resume files read by a small pool of
+   worker threads. Only adding them to the session happens in the event
+   thread, one torrent per event, so RPC requests get served meanwhile. */
+
+#define MAX_LOAD_WORKERS 8
+
 struct sessionLoadTorrentsData
 {
   tr_session * session;
   tr_ctor * ctor;
-  int * setmeCount;
-  tr_torrent ** torrents;
+  tr_lock * lock;
+  char ** paths;
+  int pathCount;
+  int nextPath;
+  int runningWorkers;
+  int added;
+  tr_list * torrents;
+  int torrentCount;
   bool done;
 };
 
+struct preloadedTorrentData
+{
+  struct sessionLoadTorrentsData * data;
+  tr_torrent_preload * preload;
+  const char * path;
+  time_t mtime;
+  uint64_t fileSize;
+};
+
+static tr_catalog * getCatalog (tr_session * session);
+
+/* the catalog now lists exactly the torrents that got loaded */
 static void
-sessionLoadTorrents (void * vdata)
+sessionLoadTorrentsDone (struct sessionLoadTorrentsData * data)
+{
+  tr_sessionLock (data->session);
+  tr_catalogSave (getCatalog (data->session), true);
+  data->session->catalogIsSynced = true;
+  tr_sessionUnlock (data->session);
+
+  tr_lockLock (data->lock);
+  data->done = true;
+  tr_lockUnlock (data->lock);
+}
+
+static void
+addPreloadedTorrent (void * vjob)
+{
+  tr_torrent * tor;
+  struct preloadedTorrentData * job = vjob;
+  struct sessionLoadTorrentsData * data = job->data;
+
+  if (job->preload != NULL)
+    if ((tor = tr_torrentNewPreloaded (data->ctor, job->preload)))
+      {
+        tr_list_prepend (&data->torrents, tor);
+        ++data->torrentCount;
+        tr_sessionLock (data->session);
+        tr_catalogAdd (getCatalog (data->session), strrchr (job->path, TR_PATH_DELIMITER) + 1,
+                       job->mtime, job->fileSize, tr_torrentInfo (tor));
+        tr_sessionUnlock (data->session);
+      }
+
+  tr_free (job);
+
+  if (++data->added == data->pathCount)
+    sessionLoadTorrentsDone (data);
+}
+
+static bool
+preloadNextTorrent (struct sessionLoadTorrentsData * data)
 {
   int i;
-  int n = 0;
   struct stat sb;
-  DIR * odir = NULL;
-  tr_list * l = NULL;
-  tr_list * list = NULL;
+  struct preloadedTorrentData * job;
+
+  tr_lockLock (data->lock);
+  i = data->nextPath < data->pathCount ? data->nextPath++ : -1;
+  tr_lockUnlock (data->lock);
+
+  if (i < 0)
+    return false;
+
+  job = tr_new0 (struct preloadedTorrentData, 1);
+  job->data = data;
+  job->path = data->paths[i];
+  if (!stat (job->path, &sb))
+    {
+      job->mtime = sb.st_mtime;
+      job->fileSize = sb.st_size;
+    }
+  job->preload = tr_torrentPreload (data->session, job->path);
+
+  if (tr_amInEventThread (data->session))
+    addPreloadedTorrent (job);
+  else
+    tr_runInEventThread (data->session, addPreloadedTorrent, job);
+
+  return true;
+}
+
+static void
+sessionLoadTorrentsWorker (void * vdata)
+{
   struct sessionLoadTorrentsData * data = vdata;
-  const char * dirname = tr_getTorrentDir (data->session);
 
-  assert (tr_isSession (data->session));
+  while (preloadNextTorrent (data))
+    ;
+
+  tr_lockLock (data->lock);
+  --data->runningWorkers;
+  tr_lockUnlock (data->lock);
+}
 
-  tr_ctorSetSave (data->ctor, false); /* since we already have them */
+static char **
+getTorrentPaths (const char * dirname, int * setmeCount)
+{
+  int n = 0;
+  int alloc = 0;
+  struct stat sb;
+  DIR * odir = NULL;
+  char ** paths = NULL;
 
   if (!stat (dirname, &sb)
       && S_ISDIR (sb.st_mode)
@@ -1967,34 +2123,19 @@ sessionLoadTorrents (void * vdata)
         {
           if (tr_str_has_suffix (d->d_name, ".torrent"))
             {
-              tr_torrent * tor;
-              char * path = tr_buildPath (dirname, d->d_name, NULL);
-              tr_ctorSetMetainfoFromFile (data->ctor, path);
-              if ((tor = tr_torrentNew (data->ctor, NULL, NULL)))
+              if (n == alloc)
                 {
-                  tr_list_prepend (&list, tor);
-                  ++n;
+                  alloc = alloc ? alloc * 2 : 64;
+                  paths = tr_renew (char *, paths, alloc);
                 }
-              tr_free (path);
+              paths[n++] = tr_buildPath (dirname, d->d_name, NULL);
             }
         }
       closedir (odir);
     }
 
-  data->torrents = tr_new (tr_torrent *, n);
-  for (i=0, l=list; l!=NULL; l=l->next)
-    data->torrents[i++] = (tr_torrent*) l->data;
-  assert (i == n);
-
-    tr_list_free (&list, NULL);
-
-  if (n)
-    tr_logAddInfo (_("Loaded %d torrents"), n);
-
-  if (data->setmeCount)
-    *data->setmeCount = n;
-
-  data->done = true;
+  *setmeCount = n;
+  return paths;
 }
 
 tr_torrent **
@@ -2002,19 +2143,71 @@ tr_sessionLoadTorrents (tr_session * session,
                         tr_ctor    * ctor,
                         int        * setmeCount)
 {
+  int i;
+  tr_list * l;
+  tr_torrent ** torrents;
   struct sessionLoadTorrentsData data;
+  const uint64_t begin = tr_time_msec ();
+
+  assert (tr_isSession (session));
 
+  tr_ctorSetSave (ctor, false); /* since we already have them */
+
+  memset (&data, 0, sizeof (data));
   data.session = session;
   data.ctor = ctor;
-  data.setmeCount = setmeCount;
-  data.torrents = NULL;
-  data.done = false;
+  data.lock = tr_lockNew ();
+  data.paths = getTorrentPaths (tr_getTorrentDir (session), &data.pathCount);
 
-  tr_runInEventThread (session, sessionLoadTorrents, &data);
-  while (!data.done)
-    tr_wait_msec (100);
+  if (data.pathCount == 0)
+    sessionLoadTorrentsDone (&data);
+
+  if (tr_amInEventThread (session))
+    {
+      while (preloadNextTorrent (&data))
+        ;
+    }
+  else if (!data.done)
+    {
+      data.runningWorkers = MIN (MIN (tr_getCpuCount (), MAX_LOAD_WORKERS), data.pathCount);
+
+      for (i=0; i<data.runningWorkers; ++i)
+        tr_threadNew (sessionLoadTorrentsWorker, &data);
+
+      for (;;)
+        {
+          bool finished;
+
+          tr_lockLock (data.lock);
+          finished = data.done && data.runningWorkers == 0;
+          tr_lockUnlock (data.lock);
+
+          if (finished)
+            break;
+
+          tr_wait_msec (10);
+        }
+    }
+
+  torrents = tr_new (tr_torrent *, data.torrentCount);
+  for (i=0, l=data.torrents; l!=NULL; l=l->next)
+    torrents[i++] = (tr_torrent*) l->data;
+  assert (i == data.torrentCount);
+
+  tr_list_free (&data.torrents, NULL);
+  for (i=0; i<data.pathCount; ++i)
+    tr_free (data.paths[i]);
+  tr_free (data.paths);
+  tr_lockFree (data.lock);
+
+  if (data.torrentCount)
+    tr_logAddInfo (_("Loaded %d torrents in %d ms"),
+                   data.torrentCount, (int)(tr_time_msec () - begin));
+
+  if (setmeCount)
+    *setmeCount = data.torrentCount;
 
-  return data.torrents;
+  return torrents;
 }
 
 /***
@@ -2454,23 +2647,37 @@ tr_blocklistGetURL (const tr_session * session)
 ****
 ***/
 
+static tr_catalog *
+getCatalog (tr_session * session)
+{
+  assert (tr_sessionIsLocked (session));
+
+  if (session->catalog == NULL)
+    {
+      char * filename = tr_buildPath (session->configDir, "torrents.catalog", NULL);
+      session->catalog = tr_catalogNew (filename);
+      tr_free (filename);
+    }
+
+  return session->catalog;
+}
+
+/* bring the catalog up to date with the torrents/ directory,
+   parsing only the .torrent files that it doesn't know about yet */
 static void
-metainfoLookupInit (tr_session * session)
+catalogSync (tr_session * session)
 {
   struct stat sb;
-  const char * dirname = tr_getTorrentDir (session);
+  int n = 0;
+  int parsed = 0;
   DIR * odir = NULL;
   tr_ctor * ctor = NULL;
-  tr_variant * lookup;
-  int n = 0;
+  const char * dirname = tr_getTorrentDir (session);
+  tr_catalog * catalog = getCatalog (session);
 
   assert (tr_isSession (session));
 
-  /* walk through the directory and find the mappings */
-  lookup = tr_new0 (tr_variant, 1);
-  tr_variantInitDict (lookup, 0);
-  ctor = tr_ctorNew (session);
-  tr_ctorSetSave (ctor, false); /* since we already have them */
+  ctor = tr_ctorNew (NULL); /* no session, so loaded torrents aren't duplicates */
   if (!stat (dirname, &sb) && S_ISDIR (sb.st_mode) && ((odir = opendir (dirname))))
     {
       struct dirent *d;
@@ -2479,13 +2686,30 @@ metainfoLookupInit (tr_session * session)
           if (tr_str_has_suffix (d->d_name, ".torrent"))
             {
               tr_info inf;
+              const tr_catalog_entry * e;
               char * path = tr_buildPath (dirname, d->d_name, NULL);
-              tr_ctorSetMetainfoFromFile (ctor, path);
-              if (!tr_torrentParse (ctor, &inf))
+
+              if (stat (path, &sb))
+                {
+                  /* it went away */
+                }
+              else if ((e = tr_catalogFindFile (catalog, d->d_name, sb.st_mtime, sb.st_size)))
                 {
                   ++n;
-                  tr_variantDictAddStr (lookup, tr_quark_new(inf.hashString,-1), path);
+                  tr_catalogKeep (catalog, e);
+                }
+              else
+                {
+                  ++parsed;
+                  tr_ctorSetMetainfoFromFile (ctor, path);
+                  if (tr_torrentParse (ctor, &inf) == TR_PARSE_OK)
+                    {
+                      ++n;
+                      tr_catalogAdd (catalog, d->d_name, sb.st_mtime, sb.st_size, &inf);
+                      tr_metainfoFree (&inf);
+                    }
                 }
+
               tr_free (path);
             }
         }
@@ -2493,34 +2717,62 @@ metainfoLookupInit (tr_session * session)
     }
   tr_ctorFree (ctor);
 
-  session->metainfoLookup = lookup;
-  tr_logAddDebug ("Found %d torrents in \"%s\"", n, dirname);
+  tr_catalogSave (catalog, true);
+  session->catalogIsSynced = true;
+  tr_logAddDebug ("Found %d torrents in \"%s\", parsed %d", n, dirname, parsed);
 }
 
-const char*
+char *
 tr_sessionFindTorrentFile (const tr_session * session,
                            const char       * hashString)
 {
-  const char * filename = NULL;
+  int i;
+  uint8_t hash[SHA_DIGEST_LENGTH];
+  const tr_catalog_entry * e;
+  tr_catalog * catalog;
+  char * ret = NULL;
+
+  /* this comes straight from tr_ctorSetMetainfoFromHash () */
+  for (i=0; i<SHA_DIGEST_LENGTH*2; ++i)
+    if (!isxdigit ((unsigned char)hashString[i]))
+      return NULL;
+
+  if (hashString[i] != '\0')
+    return NULL;
+
+  tr_hex_to_sha1 (hash, hashString);
+
+  /* this can run on the client's thread while the event thread
+     is still adding the torrents loaded at startup */
+  tr_sessionLock ((tr_session*)session);
 
-  if (!session->metainfoLookup)
-    metainfoLookupInit ((tr_session*)session);
-  tr_variantDictFindStr (session->metainfoLookup, tr_quark_new(hashString,-1), &filename, NULL);
+  catalog = getCatalog ((tr_session*)session);
+  if (!session->catalogIsSynced)
+    catalogSync ((tr_session*)session);
 
-  return filename;
+  if ((e = tr_catalogFind (catalog, hash)) != NULL)
+    ret = tr_buildPath (tr_getTorrentDir (session), tr_catalogGetFile (catalog, e), NULL);
+
+  tr_sessionUnlock ((tr_session*)session);
+  return ret;
 }
 
 void
-tr_sessionSetTorrentFile (tr_session * session,
-                          const char * hashString,
-                          const char * filename)
-{
-  /* since we walk session->configDir/torrents/ to build the lookup table,
-   * and tr_sessionSetTorrentFile () is just to tell us there's a new file
-   * in that same directory, we don't need to do anything here if the
-   * lookup table hasn't been built yet */
-  if (session->metainfoLookup)
-    tr_variantDictAddStr (session->metainfoLookup, tr_quark_new(hashString,-1), filename);
+tr_sessionSetTorrentFile (tr_session    * session,
+                          const tr_info * info,
+                          const char    * filename)
+{
+  struct stat sb;
+  char * base;
+
+  if (stat (filename, &sb))
+    return;
+
+  base = tr_basename (filename);
+  tr_sessionLock (session);
+  tr_catalogAdd (getCatalog (session), base, sb.st_mtime, sb.st_size, info);
+  tr_sessionUnlock (session);
+  tr_free (base);
 }
 
 /***
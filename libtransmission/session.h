@@ -119,6 +119,10 @@ struct tr_session
 
     tr_variant                   removedTorrents;
 
+    /* revision tokens for delta torrent-get requests. see rpcimpl.c */
+    int64_t                      rpcFirstRevision;
+    int64_t                      rpcRevision;
+
     bool                         stalledEnabled;
     bool                         queueEnabled[2];
     int                          queueSize[2];
@@ -173,9 +177,20 @@ struct tr_session
     int                          peerSocketTOS;
     char *                       peer_congestion_algorithm;
 
+    /* how many worker threads may hash just-downloaded pieces.
+       0 means they're checked synchronously in the libevent thread */
+    int                          pieceCheckThreads;
+
     int                          torrentCount;
     tr_torrent *                 torrentList;
 
+    /* hash tables for finding torrents in torrentList by
+       uniqueId, info hash, or obfuscated hash. see torrent.c */
+    int                          torrentBucketCount;
+    tr_torrent **                torrentsById;
+    tr_torrent **                torrentsByHash;
+    tr_torrent **                torrentsByObfuscatedHash;
+
     char *                       torrentDoneScript;
 
     char *                       tag;
@@ -207,7 +222,16 @@ struct tr_session
     struct tr_announcer        * announcer;
     struct tr_announcer_udp    * announcer_udp;
 
-    tr_variant                 * metainfoLookup;
+    /* the loader and the client's thread both use these,
+       so only touch them while holding the session lock */
+    struct tr_catalog          * catalog;
+    bool                         catalogIsSynced;
+
+    /* pending writes to the resume dir */
+    struct tr_journal          * resumeJournal;
+
+    /* bytes and peers over time, for the session and each torrent */
+    struct tr_rateHistory      * rateHistory;
 
     struct event               * nowTimer;
     struct event               * saveTimer;
@@ -233,12 +257,14 @@ bool         tr_sessionAllowsDHT (const tr_session * session);
 
 bool         tr_sessionAllowsLPD (const tr_session * session);
 
-const char * tr_sessionFindTorrentFile (const tr_session * session,
+/* returns a newly-allocated path to the .torrent file for hashString,
+   or NULL if there isn't one */
+char *       tr_sessionFindTorrentFile (const tr_session * session,
                                         const char *       hashString);
 
-void         tr_sessionSetTorrentFile (tr_session * session,
-                                       const char * hashString,
-                                       const char * filename);
+void         tr_sessionSetTorrentFile (tr_session    * session,
+                                       const tr_info * info,
+                                       const char    * filename);
 
 bool         tr_sessionIsAddressBlocked (const tr_session        * session,
                                          const struct tr_address * addr);
@@ -94,6 +94,19 @@ tr_ctorSetMetainfo (tr_ctor *       ctor,
     return err;
 }
 
+int
+tr_ctorSetMetainfoInPlace (tr_ctor * ctor,
+                           void    * metainfo,
+                           size_t    len)
+{
+    int err;
+
+    clearMetainfo (ctor);
+    err = tr_variantFromBencInPlace (&ctor->metainfo, metainfo, len);
+    ctor->isSet_metainfo = !err;
+    return err;
+}
+
 const char*
 tr_ctorGetSourceFile (const tr_ctor * ctor)
 {
@@ -115,9 +128,8 @@ tr_ctorSetMetainfoFromMagnetLink (tr_ctor * ctor, const char * magnet_link)
 
         tr_magnetCreateMetainfo (magnet_info, &tmp);
         str = tr_variantToStr (&tmp, TR_VARIANT_FMT_BENC, &len);
-        err = tr_ctorSetMetainfo (ctor, (const uint8_t*)str, len);
+        err = tr_ctorSetMetainfoInPlace (ctor, str, len);
 
-        tr_free (str);
         tr_variantFree (&tmp);
         tr_magnetFree (magnet_info);
     }
@@ -135,9 +147,10 @@ tr_ctorSetMetainfoFromFile (tr_ctor *    ctor,
 
     metainfo = tr_loadFile (filename, &len);
     if (metainfo && len)
-        err = tr_ctorSetMetainfo (ctor, metainfo, len);
+        err = tr_ctorSetMetainfoInPlace (ctor, metainfo, len);
     else
     {
+        tr_free (metainfo);
         clearMetainfo (ctor);
         err = 1;
     }
@@ -163,7 +176,6 @@ tr_ctorSetMetainfoFromFile (tr_ctor *    ctor,
         }
     }
 
-    tr_free (metainfo);
     return err;
 }
 
@@ -171,8 +183,8 @@ int
 tr_ctorSetMetainfoFromHash (tr_ctor *    ctor,
                             const char * hashString)
 {
-    int          err;
-    const char * filename;
+    int    err;
+    char * filename;
 
     filename = tr_sessionFindTorrentFile (ctor->session, hashString);
     if (!filename)
@@ -180,6 +192,7 @@ tr_ctorSetMetainfoFromHash (tr_ctor *    ctor,
     else
         err = tr_ctorSetMetainfoFromFile (ctor, filename);
 
+    tr_free (filename);
     return err;
 }
 
@@ -12,11 +12,15 @@
 
 #include <event2/buffer.h>
 
+#include <openssl/sha.h>
+
 #include "transmission.h"
 #include "crypto.h" /* tr_sha1 () */
 #include "log.h"
 #include "magnet.h"
 #include "metainfo.h"
+#include "net.h" /* tr_address */
+#include "platform.h" /* tr_getResumeDir () */
 #include "resume.h"
 #include "torrent.h"
 #include "torrent-magnet.h"
@@ -39,7 +43,18 @@
 enum
 {
   /* don't ask for the same metadata piece more than this often */
-  MIN_REPEAT_INTERVAL_SECS = 3
+  MIN_REPEAT_INTERVAL_SECS = 3,
+
+  /* peers whose pieces were in this many bad sets of metadata are ignored */
+  MAX_METADATA_STRIKES = 2,
+
+  /* how long a peer fetching the metadata by itself can go quiet
+     before some other peer is allowed to take over */
+  SOLO_TIMEOUT_SECS = 30,
+
+  /* pieceSources values that aren't indices into `peers' */
+  SOURCE_NONE = -2,
+  SOURCE_SAVED = -1
 };
 
 struct metadata_node
@@ -48,6 +63,12 @@ struct metadata_node
   int piece;
 };
 
+struct metadata_peer
+{
+  tr_address addr;
+  int strikes;
+};
+
 struct tr_incomplete_metadata
 {
   uint8_t * metadata;
@@ -57,6 +78,29 @@ struct tr_incomplete_metadata
   /** sorted from least to most recently requested */
   struct metadata_node * piecesNeeded;
   int piecesNeededCount;
+
+  /** who sent each piece: an index into `peers', SOURCE_SAVED if it
+      was loaded from an earlier session, or SOURCE_NONE if it's needed */
+  int * pieceSources;
+
+  /** the peers that have sent pieces, and how often they've sent bad ones */
+  struct metadata_peer * peers;
+  int peerCount;
+
+  /** BEP 9 only has the info dict's hash, so there's no telling which
+      piece was bad when it doesn't match. After a mismatch, a single
+      peer fetches the next attempt alone so the blame lands on it. */
+  int failCount;
+  int soloPeer;
+  time_t soloActiveAt;
+
+  /** the SHA1 of the first hashedPieceCount pieces, which is extended
+      as pieces arrive so there's little left to hash at the end */
+  SHA_CTX sha;
+  int hashedPieceCount;
+
+  /** true if pieces have arrived since the metadata was last saved */
+  bool isDirty;
 };
 
 static void
@@ -64,35 +108,192 @@ incompleteMetadataFree (struct tr_incomplete_metadata * m)
 {
   tr_free (m->metadata);
   tr_free (m->piecesNeeded);
+  tr_free (m->pieceSources);
+  tr_free (m->peers);
   tr_free (m);
 }
 
+static int
+getMetadataPieceLength (const struct tr_incomplete_metadata * m, int piece)
+{
+  return piece + 1 < m->pieceCount
+       ? METADATA_PIECE_SIZE
+       : m->metadata_size - piece * METADATA_PIECE_SIZE;
+}
+
+static int
+findMetadataPeer (struct tr_incomplete_metadata * m, const tr_address * addr)
+{
+  int i;
+
+  for (i=0; i<m->peerCount; ++i)
+    if (!tr_address_compare (&m->peers[i].addr, addr))
+      return i;
+
+  m->peers = tr_renew (struct metadata_peer, m->peers, m->peerCount + 1);
+  m->peers[i].addr = *addr;
+  m->peers[i].strikes = 0;
+  return m->peerCount++;
+}
+
+/* forget every piece and start over */
+static void
+resetIncompleteMetadata (struct tr_incomplete_metadata * m)
+{
+  int i;
+
+  for (i=0; i<m->pieceCount; ++i)
+    {
+      m->piecesNeeded[i].piece = i;
+      m->piecesNeeded[i].requestedAt = 0;
+      m->pieceSources[i] = SOURCE_NONE;
+    }
+  m->piecesNeededCount = m->pieceCount;
+
+  SHA1_Init (&m->sha);
+  m->hashedPieceCount = 0;
+}
+
+/* hash as many more pieces as have arrived in order */
+static void
+updateMetadataHash (struct tr_incomplete_metadata * m)
+{
+  while ((m->hashedPieceCount < m->pieceCount)
+      && (m->pieceSources[m->hashedPieceCount] != SOURCE_NONE))
+    {
+      const int piece = m->hashedPieceCount++;
+      SHA1_Update (&m->sha, m->metadata + piece * METADATA_PIECE_SIZE,
+                   getMetadataPieceLength (m, piece));
+    }
+}
+
+static char*
+getIncompleteMetadataFilename (const tr_torrent * tor)
+{
+  char * base = tr_strdup_printf ("%s.metadata", tor->info.hashString);
+  char * filename = tr_buildPath (tr_getResumeDir (tor->session), base, NULL);
+  tr_free (base);
+  return filename;
+}
+
+void
+tr_torrentSaveIncompleteMetadata (tr_torrent * tor)
+{
+  struct tr_incomplete_metadata * m = tor->incompleteMetadata;
+
+  if ((m != NULL) && m->isDirty)
+    {
+      int i;
+      tr_variant top;
+      tr_variant * pieces;
+      char * filename = getIncompleteMetadataFilename (tor);
+
+      tr_variantInitDict (&top, 3);
+      tr_variantDictAddInt (&top, TR_KEY_metadata_size, m->metadata_size);
+      tr_variantDictAddRaw (&top, TR_KEY_info, m->metadata, m->metadata_size);
+      pieces = tr_variantDictAddList (&top, TR_KEY_pieces, m->pieceCount - m->piecesNeededCount);
+      for (i=0; i<m->pieceCount; ++i)
+        if (m->pieceSources[i] != SOURCE_NONE)
+          tr_variantListAddInt (pieces, i);
+
+      if (!tr_variantToFile (&top, TR_VARIANT_FMT_BENC, filename))
+        m->isDirty = false;
+
+      tr_variantFree (&top);
+      tr_free (filename);
+    }
+}
+
+void
+tr_torrentRemoveIncompleteMetadata (tr_torrent * tor)
+{
+  char * filename = getIncompleteMetadataFilename (tor);
+  tr_remove (filename);
+  tr_free (filename);
+}
+
+void
+tr_torrentFreeIncompleteMetadata (tr_torrent * tor)
+{
+  if (tor->incompleteMetadata != NULL)
+    {
+      incompleteMetadataFree (tor->incompleteMetadata);
+      tor->incompleteMetadata = NULL;
+    }
+}
+
+/* pick up where an earlier session left off */
+static void
+loadIncompleteMetadata (tr_torrent * tor, struct tr_incomplete_metadata * m)
+{
+  tr_variant top;
+  char * filename = getIncompleteMetadataFilename (tor);
+
+  if (!tr_variantFromFile (&top, TR_VARIANT_FMT_BENC, filename))
+    {
+      size_t i;
+      size_t n;
+      int64_t size;
+      int64_t piece;
+      size_t len;
+      const uint8_t * raw;
+      tr_variant * pieces;
+
+      if (tr_variantDictFindInt (&top, TR_KEY_metadata_size, &size)
+          && (size == m->metadata_size)
+          && tr_variantDictFindRaw (&top, TR_KEY_info, &raw, &len)
+          && (len == (size_t)m->metadata_size)
+          && tr_variantDictFindList (&top, TR_KEY_pieces, &pieces))
+        {
+          memcpy (m->metadata, raw, len);
+
+          for (i=0, n=tr_variantListSize (pieces); i<n; ++i)
+            if (tr_variantGetInt (tr_variantListChild (pieces, i), &piece)
+                && (0 <= piece) && (piece < m->pieceCount))
+              m->pieceSources[piece] = SOURCE_SAVED;
+
+          for (i=m->piecesNeededCount=0; i<(size_t)m->pieceCount; ++i)
+            if (m->pieceSources[i] == SOURCE_NONE)
+              m->piecesNeeded[m->piecesNeededCount++].piece = i;
+
+          dbgmsg (tor, "loaded %d saved metadata pieces",
+                  m->pieceCount - m->piecesNeededCount);
+          updateMetadataHash (m);
+        }
+
+      tr_variantFree (&top);
+    }
+
+  tr_free (filename);
+}
+
+static void onMetadataPiecesDone (tr_torrent * tor);
+
 void
 tr_torrentSetMetadataSizeHint (tr_torrent * tor, int size)
 {
   if (!tr_torrentHasMetadata (tor))
     {
-      if (tor->incompleteMetadata == NULL)
+      if ((tor->incompleteMetadata == NULL) && (size > 0))
         {
-          int i;
           struct tr_incomplete_metadata * m;
           const int n = (size + (METADATA_PIECE_SIZE - 1)) / METADATA_PIECE_SIZE;
           dbgmsg (tor, "metadata is %d bytes in %d pieces", size, n);
 
-          m = tr_new (struct tr_incomplete_metadata, 1);
+          m = tr_new0 (struct tr_incomplete_metadata, 1);
           m->pieceCount = n;
-          m->metadata = tr_new (uint8_t, size);
+          m->metadata = tr_new0 (uint8_t, size); /* its holes get saved, too */
           m->metadata_size = size;
-          m->piecesNeededCount = n;
           m->piecesNeeded = tr_new (struct metadata_node, n);
-
-          for (i=0; i<n; ++i)
-            {
-              m->piecesNeeded[i].piece = i;
-              m->piecesNeeded[i].requestedAt = 0;
-            }
+          m->pieceSources = tr_new (int, n);
+          m->soloPeer = -1;
+          resetIncompleteMetadata (m);
 
           tor->incompleteMetadata = m;
+
+          loadIncompleteMetadata (tor, m);
+          if (m->piecesNeededCount == 0)
+            onMetadataPiecesDone (tor);
         }
     }
 }
@@ -194,12 +395,139 @@ tr_torrentGetMetadataPiece (tr_torrent * tor, int piece, int * len)
     return ret;
 }
 
+/* every piece is in; see if they add up to the info dict we wanted */
+static void
+onMetadataPiecesDone (tr_torrent * tor)
+{
+  int i;
+  bool success = false;
+  bool checksumPassed = false;
+  bool metainfoParsed = false;
+  uint8_t sha1[SHA_DIGEST_LENGTH];
+  struct tr_incomplete_metadata * m = tor->incompleteMetadata;
+
+  /* we've got a complete set of metainfo... see if it passes the checksum test */
+  updateMetadataHash (m);
+  assert (m->hashedPieceCount == m->pieceCount);
+  SHA1_Final (sha1, &m->sha);
+  if ((checksumPassed = !memcmp (sha1, tor->info.hash, SHA_DIGEST_LENGTH)))
+    {
+      /* checksum passed; now try to parse it as benc */
+      tr_variant infoDict;
+      const int err = tr_variantFromBenc (&infoDict, m->metadata, m->metadata_size);
+      dbgmsg (tor, "err is %d", err);
+      if ((metainfoParsed = !err))
+        {
+          /* yay we have bencoded metainfo... merge it into our .torrent file */
+          tr_variant newMetainfo;
+          char * path = tr_strdup (tor->info.torrent);
+
+          if (!tr_variantFromFile (&newMetainfo, TR_VARIANT_FMT_BENC, path))
+            {
+              bool hasInfo;
+              tr_info info;
+              int infoDictLength;
+
+              /* remove any old .torrent and .resume files */
+              tr_remove (path);
+              tr_torrentRemoveResume (tor);
+
+              dbgmsg (tor, "Saving completed metadata to \"%s\"", path);
+              tr_variantMergeDicts (tr_variantDictAddDict (&newMetainfo, TR_KEY_info, 0), &infoDict);
+
+              memset (&info, 0, sizeof (tr_info));
+              success = tr_metainfoParse (tor->session, &newMetainfo, &info, &hasInfo, &infoDictLength);
+
+              if (success && !tr_getBlockSize (info.pieceSize))
+                {
+                  tr_torrentSetLocalError (tor, "%s", _("Magnet torrent's metadata is not usable"));
+                  success = false;
+                }
+
+              if (success)
+                {
+                  /* keep the new info */
+                  tor->info = info;
+                  tor->infoDictLength = infoDictLength;
+
+                  /* save the new .torrent file */
+                  tr_variantToFile (&newMetainfo, TR_VARIANT_FMT_BENC, tor->info.torrent);
+                  tr_sessionSetTorrentFile (tor->session, &tor->info, tor->info.torrent);
+                  tr_torrentGotNewInfoDict (tor);
+                  tr_torrentSetDirty (tor);
+                }
+
+              tr_variantFree (&newMetainfo);
+            }
+
+          tr_variantFree (&infoDict);
+          tr_free (path);
+        }
+    }
+
+  if (success)
+    {
+      tr_torrentRemoveIncompleteMetadata (tor);
+      tr_torrentFreeIncompleteMetadata (tor);
+      tor->isStopping = true;
+      tor->magnetVerify = true;
+      tor->startAfterVerify = true;
+    }
+    else /* drat. */
+    {
+      /* everyone who sent a piece of this gets a strike */
+      bool * struck = tr_new0 (bool, m->peerCount);
+      for (i=0; i<m->pieceCount; ++i)
+        if (m->pieceSources[i] >= 0)
+          struck[m->pieceSources[i]] = true;
+      for (i=0; i<m->peerCount; ++i)
+        if (struck[i])
+          ++m->peers[i].strikes;
+      tr_free (struck);
+
+      ++m->failCount;
+      m->soloPeer = -1;
+      m->isDirty = false;
+      resetIncompleteMetadata (m);
+      tr_torrentRemoveIncompleteMetadata (tor);
+      dbgmsg (tor, "metadata error; trying again. %d pieces left", m->pieceCount);
+
+      tr_logAddError ("magnet status: checksum passed %d, metainfo parsed %d",
+              (int)checksumPassed, (int)metainfoParsed);
+    }
+}
+
+/* is this peer allowed to work on the metadata right now? */
+static bool
+isMetadataPeerAllowed (struct tr_incomplete_metadata * m, int peer, time_t now)
+{
+  if (m->peers[peer].strikes >= MAX_METADATA_STRIKES)
+    return false;
+
+  if (m->failCount == 0)
+    return true;
+
+  /* after a bad attempt, take turns fetching it alone */
+  if ((m->soloPeer < 0) || (m->soloActiveAt + SOLO_TIMEOUT_SECS < now))
+    {
+      m->soloPeer = peer;
+      m->soloActiveAt = now;
+    }
+
+  return m->soloPeer == peer;
+}
+
 void
-tr_torrentSetMetadataPiece (tr_torrent  * tor, int piece, const void  * data, int len)
+tr_torrentSetMetadataPiece (tr_torrent        * tor,
+                            const tr_address  * addr,
+                            int                 piece,
+                            const void        * data,
+                            int                 len)
 {
   int i;
+  int peer;
   struct tr_incomplete_metadata * m;
-  const int offset = piece * METADATA_PIECE_SIZE;
+  const time_t now = tr_time ();
 
   assert (tr_isTorrent (tor));
 
@@ -211,17 +539,29 @@ tr_torrentSetMetadataPiece (tr_torrent  * tor, int piece, const void  * data, in
     return;
 
   /* does this data pass the smell test? */
-  if (offset + len > m->metadata_size)
+  if ((piece < 0) || (piece >= m->pieceCount) || (len != getMetadataPieceLength (m, piece)))
     return;
 
   /* do we need this piece? */
+  if (m->pieceSources[piece] != SOURCE_NONE)
+    return;
+
+  /* do we want it from this peer? */
+  peer = findMetadataPeer (m, addr);
+  if (!isMetadataPeerAllowed (m, peer, now))
+    return;
+  if (m->soloPeer == peer)
+    m->soloActiveAt = now;
+
   for (i=0; i<m->piecesNeededCount; ++i)
     if (m->piecesNeeded[i].piece == piece)
       break;
-  if (i==m->piecesNeededCount)
-    return;
+  assert (i < m->piecesNeededCount);
 
-  memcpy (m->metadata + offset, data, len);
+  memcpy (m->metadata + piece * METADATA_PIECE_SIZE, data, len);
+  m->pieceSources[piece] = peer;
+  m->isDirty = true;
+  updateMetadataHash (m);
 
   tr_removeElementFromArray (m->piecesNeeded, i,
                              sizeof (struct metadata_node),
@@ -232,96 +572,39 @@ tr_torrentSetMetadataPiece (tr_torrent  * tor, int piece, const void  * data, in
   /* are we done? */
   if (m->piecesNeededCount == 0)
     {
-      bool success = false;
-      bool checksumPassed = false;
-      bool metainfoParsed = false;
-      uint8_t sha1[SHA_DIGEST_LENGTH];
-
-      /* we've got a complete set of metainfo... see if it passes the checksum test */
       dbgmsg (tor, "metainfo piece %d was the last one", piece);
-      tr_sha1 (sha1, m->metadata, m->metadata_size, NULL);
-      if ((checksumPassed = !memcmp (sha1, tor->info.hash, SHA_DIGEST_LENGTH)))
-        {
-          /* checksum passed; now try to parse it as benc */
-          tr_variant infoDict;
-          const int err = tr_variantFromBenc (&infoDict, m->metadata, m->metadata_size);
-          dbgmsg (tor, "err is %d", err);
-          if ((metainfoParsed = !err))
-            {
-              /* yay we have bencoded metainfo... merge it into our .torrent file */
-              tr_variant newMetainfo;
-              char * path = tr_strdup (tor->info.torrent);
-
-              if (!tr_variantFromFile (&newMetainfo, TR_VARIANT_FMT_BENC, path))
-                {
-                  bool hasInfo;
-                  tr_info info;
-                  int infoDictLength;
-
-                  /* remove any old .torrent and .resume files */
-                  tr_remove (path);
-                  tr_torrentRemoveResume (tor);
-
-                  dbgmsg (tor, "Saving completed metadata to \"%s\"", path);
-                  tr_variantMergeDicts (tr_variantDictAddDict (&newMetainfo, TR_KEY_info, 0), &infoDict);
-
-                  memset (&info, 0, sizeof (tr_info));
-                  success = tr_metainfoParse (tor->session, &newMetainfo, &info, &hasInfo, &infoDictLength);
-
-                  if (success && !tr_getBlockSize (info.pieceSize))
-                    {
-                      tr_torrentSetLocalError (tor, "%s", _("Magnet torrent's metadata is not usable"));
-                      success = false;
-                    }
-
-                  if (success)
-                    {
-                      /* keep the new info */
-                      tor->info = info;
-                      tor->infoDictLength = infoDictLength;
-
-                      /* save the new .torrent file */
-                      tr_variantToFile (&newMetainfo, TR_VARIANT_FMT_BENC, tor->info.torrent);
-                      tr_sessionSetTorrentFile (tor->session, tor->info.hashString, tor->info.torrent);
-                      tr_torrentGotNewInfoDict (tor);
-                      tr_torrentSetDirty (tor);
-                    }
+      onMetadataPiecesDone (tor);
+    }
+}
 
-                  tr_variantFree (&newMetainfo);
-                }
+void
+tr_torrentMetadataRequestRejected (tr_torrent * tor, int piece)
+{
+  int i;
+  struct tr_incomplete_metadata * m = tor->incompleteMetadata;
 
-              tr_variantFree (&infoDict);
-              tr_free (path);
-            }
-        }
+  if (m == NULL)
+    return;
 
-      if (success)
-        {
-          incompleteMetadataFree (tor->incompleteMetadata);
-          tor->incompleteMetadata = NULL;
-          tor->isStopping = true;
-          tor->magnetVerify = true;
-          tor->startAfterVerify = true;
-        }
-        else /* drat. */
+  /* let the next peer that comes along ask for it right away */
+  for (i=0; i<m->piecesNeededCount; ++i)
+    {
+      if (m->piecesNeeded[i].piece == piece)
         {
-          const int n = m->pieceCount;
-          for (i=0; i<n; ++i)
-            {
-              m->piecesNeeded[i].piece = i;
-              m->piecesNeeded[i].requestedAt = 0;
-            }
-          m->piecesNeededCount = n;
-          dbgmsg (tor, "metadata error; trying again. %d pieces left", n);
-
-          tr_logAddError ("magnet status: checksum passed %d, metainfo parsed %d",
-                  (int)checksumPassed, (int)metainfoParsed);
+          memmove (m->piecesNeeded + 1, m->piecesNeeded,
+                   sizeof (struct metadata_node) * i);
+          m->piecesNeeded[0].piece = piece;
+          m->piecesNeeded[0].requestedAt = 0;
+          break;
         }
     }
 }
 
 bool
-tr_torrentGetNextMetadataRequest (tr_torrent * tor, time_t now, int * setme_piece)
+tr_torrentGetNextMetadataRequest (tr_torrent        * tor,
+                                  const tr_address  * addr,
+                                  time_t              now,
+                                  int               * setme_piece)
 {
   bool have_request = false;
   struct tr_incomplete_metadata * m;
@@ -331,7 +614,8 @@ tr_torrentGetNextMetadataRequest (tr_torrent * tor, time_t now, int * setme_piec
   m = tor->incompleteMetadata;
 
   if ((m != NULL) && (m->piecesNeededCount > 0)
-                  && (m->piecesNeeded[0].requestedAt + MIN_REPEAT_INTERVAL_SECS < now))
+                  && (m->piecesNeeded[0].requestedAt + MIN_REPEAT_INTERVAL_SECS < now)
+                  && isMetadataPeerAllowed (m, findMetadataPeer (m, addr), now))
     {
       int i;
       const int piece = m->piecesNeeded[0].piece;
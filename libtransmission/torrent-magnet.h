@@ -22,14 +22,31 @@ enum
     METADATA_PIECE_SIZE = (1024 * 16)
 };
 
+struct tr_address;
+
 void* tr_torrentGetMetadataPiece (tr_torrent * tor, int piece, int * len);
 
-void tr_torrentSetMetadataPiece (tr_torrent * tor, int piece, const void * data, int len);
+/** @brief add a piece of metadata that `addr' sent us */
+void tr_torrentSetMetadataPiece (tr_torrent * tor, const struct tr_address * addr,
+                                 int piece, const void * data, int len);
+
+/** @brief let another peer ask for a piece that one peer rejected */
+void tr_torrentMetadataRequestRejected (tr_torrent * tor, int piece);
 
-bool tr_torrentGetNextMetadataRequest (tr_torrent * tor, time_t now, int * setme);
+/** @brief find the next piece of metadata to ask `addr' for */
+bool tr_torrentGetNextMetadataRequest (tr_torrent * tor, const struct tr_address * addr,
+                                       time_t now, int * setme);
 
 void tr_torrentSetMetadataSizeHint (tr_torrent * tor, int metadata_size);
 
 double tr_torrentGetMetadataPercent (const tr_torrent * tor);
 
+/** @brief save the metadata pieces we have so far, if they've changed */
+void tr_torrentSaveIncompleteMetadata (tr_torrent * tor);
+
+/** @brief remove the metadata pieces saved by tr_torrentSaveIncompleteMetadata () */
+void tr_torrentRemoveIncompleteMetadata (tr_torrent * tor);
+
+void tr_torrentFreeIncompleteMetadata (tr_torrent * tor);
+
 #endif
@@ -19,6 +19,7 @@
 #include <dirent.h>
 
 #include <assert.h>
+#include <ctype.h> /* isxdigit () */
 #include <math.h>
 #include <stdarg.h>
 #include <string.h> /* memcmp */
@@ -43,6 +44,8 @@
 #include "peer-mgr.h"
 #include "platform.h" /* TR_PATH_DELIMITER_STR */
 #include "ptrarray.h"
+#include "rate-history.h"
+#include "rpc-server.h" /* tr_rpcPostTorrentEvent () */
 #include "session.h"
 #include "torrent.h"
 #include "torrent-magnet.h"
@@ -80,12 +83,108 @@ tr_torrentId (const tr_torrent * tor)
   return tor ? tor->uniqueId : -1;
 }
 
+/* The session keeps three chained hash tables of its torrents, so that
+   torrents can be found by id, info hash, or obfuscated hash without
+   walking torrentList. The tables grow to keep about one torrent per
+   bucket. SHA1 digests are already evenly spread, so their first bytes
+   make a fine hash key, and so do sequential ids. */
+
+enum
+{
+  MIN_TORRENT_BUCKETS = 64
+};
+
+static inline unsigned int
+getIdBucket (const tr_session * session, int id)
+{
+  return (unsigned int)id & (session->torrentBucketCount - 1);
+}
+
+static inline unsigned int
+getHashBucket (const tr_session * session, const uint8_t * hash)
+{
+  uint32_t val;
+
+  memcpy (&val, hash, sizeof (val));
+
+  return val & (session->torrentBucketCount - 1);
+}
+
+static void
+torrentLookupInsert (tr_session * session, tr_torrent * tor)
+{
+  tr_torrent ** head;
+
+  head = &session->torrentsById[getIdBucket (session, tor->uniqueId)];
+  tor->nextById = *head;
+  *head = tor;
+
+  head = &session->torrentsByHash[getHashBucket (session, tor->info.hash)];
+  tor->nextByHash = *head;
+  *head = tor;
+
+  head = &session->torrentsByObfuscatedHash[getHashBucket (session, tor->obfuscatedHash)];
+  tor->nextByObfuscatedHash = *head;
+  *head = tor;
+}
+
+/* must be called after `tor' has been added to session->torrentList */
+static void
+torrentLookupAdd (tr_session * session, tr_torrent * tor)
+{
+  if (session->torrentCount > session->torrentBucketCount)
+    {
+      tr_torrent * t = NULL;
+      const int n = MAX (MIN_TORRENT_BUCKETS, session->torrentBucketCount * 2);
+
+      tr_free (session->torrentsById);
+      tr_free (session->torrentsByHash);
+      tr_free (session->torrentsByObfuscatedHash);
+
+      session->torrentBucketCount = n;
+      session->torrentsById = tr_new0 (tr_torrent*, n);
+      session->torrentsByHash = tr_new0 (tr_torrent*, n);
+      session->torrentsByObfuscatedHash = tr_new0 (tr_torrent*, n);
+
+      while ((t = tr_torrentNext (session, t)))
+        torrentLookupInsert (session, t);
+    }
+  else
+    {
+      torrentLookupInsert (session, tor);
+    }
+}
+
+static void
+torrentLookupRemove (tr_session * session, tr_torrent * tor)
+{
+  tr_torrent ** walk;
+
+  walk = &session->torrentsById[getIdBucket (session, tor->uniqueId)];
+  while (*walk != tor)
+    walk = &(*walk)->nextById;
+  *walk = tor->nextById;
+
+  walk = &session->torrentsByHash[getHashBucket (session, tor->info.hash)];
+  while (*walk != tor)
+    walk = &(*walk)->nextByHash;
+  *walk = tor->nextByHash;
+
+  walk = &session->torrentsByObfuscatedHash[getHashBucket (session, tor->obfuscatedHash)];
+  while (*walk != tor)
+    walk = &(*walk)->nextByObfuscatedHash;
+  *walk = tor->nextByObfuscatedHash;
+}
+
 tr_torrent*
 tr_torrentFindFromId (tr_session * session, int id)
 {
-  tr_torrent * tor = NULL;
+  tr_torrent * tor;
 
-  while ((tor = tr_torrentNext (session, tor)))
+  if (session->torrentBucketCount == 0)
+    return NULL;
+
+  for (tor=session->torrentsById[getIdBucket (session, id)]; tor!=NULL; tor=tor->nextById)
     if (tor->uniqueId == id)
       return tor;
 
@@ -95,24 +194,31 @@ tr_torrentFindFromId (tr_session * session, int id)
 tr_torrent*
 tr_torrentFindFromHashString (tr_session *  session, const char * str)
 {
-  tr_torrent * tor = NULL;
+  int i;
+  uint8_t hash[SHA_DIGEST_LENGTH];
 
-  while ((tor = tr_torrentNext (session, tor)))
-    if (!evutil_ascii_strcasecmp (str, tor->info.hashString))
-      return tor;
+  for (i=0; i<SHA_DIGEST_LENGTH*2; ++i)
+    if (!isxdigit ((unsigned char)str[i]))
+      return NULL;
 
-  return NULL;
+  if (str[i] != '\0')
+    return NULL;
+
+  tr_hex_to_sha1 (hash, str);
+  return tr_torrentFindFromHash (session, hash);
 }
 
 tr_torrent*
 tr_torrentFindFromHash (tr_session * session, const uint8_t * torrentHash)
 {
-  tr_torrent * tor = NULL;
+  tr_torrent * tor;
+
+  if (session->torrentBucketCount == 0)
+    return NULL;
 
-  while ((tor = tr_torrentNext (session, tor)))
-    if (*tor->info.hash == *torrentHash)
-      if (!memcmp (tor->info.hash, torrentHash, SHA_DIGEST_LENGTH))
-        return tor;
+  for (tor=session->torrentsByHash[getHashBucket (session, torrentHash)]; tor!=NULL; tor=tor->nextByHash)
+    if (!memcmp (tor->info.hash, torrentHash, SHA_DIGEST_LENGTH))
+      return tor;
 
   return NULL;
 }
@@ -136,9 +242,12 @@ tr_torrent*
 tr_torrentFindFromObfuscatedHash (tr_session * session,
                                   const uint8_t * obfuscatedTorrentHash)
 {
-  tr_torrent * tor = NULL;
+  tr_torrent * tor;
+
+  if (session->torrentBucketCount == 0)
+    return NULL;
 
-  while ((tor = tr_torrentNext (session, tor)))
+  for (tor=session->torrentsByObfuscatedHash[getHashBucket (session, obfuscatedTorrentHash)]; tor!=NULL; tor=tor->nextByObfuscatedHash)
     if (!memcmp (tor->obfuscatedHash, obfuscatedTorrentHash, SHA_DIGEST_LENGTH))
       return tor;
 
@@ -684,7 +793,7 @@ calculatePiecePriority (const tr_torrent * tor,
 static void
 tr_torrentInitFilePieces (tr_torrent * tor)
 {
-  int * firstFiles;
+  tr_file_index_t * firstFiles;
   tr_file_index_t f;
   tr_piece_index_t p;
   uint64_t offset = 0;
@@ -698,14 +807,19 @@ tr_torrentInitFilePieces (tr_torrent * tor)
       initFilePieces (inf, f);
     }
 
-  /* build the array of first-file hints to give calculatePiecePriority */
-  firstFiles = tr_new (int, inf->pieceCount);
+  /* build the array of each piece's first file. It's kept for
+     tr_ioFindFileLocation () and used here as calculatePiecePriority ()'s hints */
+  firstFiles = tr_renew (tr_file_index_t, tor->pieceFiles, inf->pieceCount + 1);
   for (p=f=0; p<inf->pieceCount; ++p)
     {
       while (inf->files[f].lastPiece < p)
         ++f;
       firstFiles[p] = f;
     }
+  firstFiles[inf->pieceCount] = inf->fileCount;
+  tor->pieceFiles = firstFiles;
+  tr_logAddTorDbg (tor, "piece-to-file table uses %"TR_PRIuSIZE" bytes",
+                   (size_t)(inf->pieceCount + 1) * sizeof (tr_file_index_t));
 
 #if 0
   /* test to confirm the first-file hints are correct */
@@ -721,14 +835,12 @@ tr_torrentInitFilePieces (tr_torrent * tor)
         if (pieceHasFile (p, &inf->files[f]))
           break;
 
-      assert ((int)f == firstFiles[p]);
+      assert (f == firstFiles[p]);
     }
 #endif
 
   for (p=0; p<inf->pieceCount; ++p)
     inf->pieces[p].priority = calculatePiecePriority (tor, p, firstFiles[p]);
-
-  tr_free (firstFiles);
 }
 
 static void torrentStart (tr_torrent * tor, bool bypass_queue);
@@ -847,8 +959,15 @@ setLocalErrorIfFilesDisappeared (tr_torrent * tor)
   return disappeared;
 }
 
+struct tr_torrent_preload
+{
+  tr_torrent * tor;
+  tr_variant resume;
+  bool hasResume;
+};
+
 static void
-torrentInit (tr_torrent * tor, const tr_ctor * ctor)
+torrentInit (tr_torrent * tor, const tr_ctor * ctor, tr_torrent_preload * preload)
 {
   bool doStart;
   uint64_t loaded;
@@ -866,6 +985,7 @@ torrentInit (tr_torrent * tor, const tr_ctor * ctor)
   tor->uniqueId = nextUniqueId++;
   tor->magicNumber = TORRENT_MAGIC_NUMBER;
   tor->queuePosition = session->torrentCount;
+  tor->historySeries = tr_rateHistoryOpenSeries (session->rateHistory, tor->info.hash);
 
   tr_sha1 (tor->obfuscatedHash, "req2", 4,
            tor->info.hash, SHA_DIGEST_LENGTH,
@@ -896,8 +1016,15 @@ torrentInit (tr_torrent * tor, const tr_ctor * ctor)
   tr_torrentSetAddedDate (tor, tr_time ()); /* this is a default value to be
                                                overwritten by the resume file */
 
-  torrentInitFromInfo (tor);
-  loaded = tr_torrentLoadResume (tor, ~0, ctor);
+  if (preload != NULL)
+    {
+      loaded = tr_torrentLoadResumeFrom (tor, ~0, ctor, preload->hasResume ? &preload->resume : NULL);
+    }
+  else
+    {
+      torrentInitFromInfo (tor);
+      loaded = tr_torrentLoadResume (tor, ~0, ctor);
+    }
   tor->completeness = tr_cpGetStatus (&tor->completion);
   setLocalErrorIfFilesDisappeared (tor);
 
@@ -943,6 +1070,7 @@ torrentInit (tr_torrent * tor, const tr_ctor * ctor)
         it = it->next;
       it->next = tor;
     }
+  torrentLookupAdd (session, tor);
 
   /* if we don't have a local .torrent file already, assume the torrent is new */
   isNewTorrent = stat (tor->info.torrent, &st);
@@ -957,20 +1085,27 @@ torrentInit (tr_torrent * tor, const tr_ctor * ctor)
           const int err = tr_variantToFile (val, TR_VARIANT_FMT_BENC, path);
           if (err)
             tr_torrentSetLocalError (tor, "Unable to save torrent file: %s", tr_strerror (err));
-          tr_sessionSetTorrentFile (tor->session, tor->info.hashString, path);
+          tr_sessionSetTorrentFile (tor->session, &tor->info, path);
         }
     }
 
   tor->tiers = tr_announcerAddTorrent (tor, onTrackerResponse, NULL);
 
+  tr_rpcPostTorrentEvent (session->rpcServer, TR_RPC_EVENT_TORRENT_ADDED, tor);
+
   if (isNewTorrent)
     {
+      /* the verify needs the piece hashes, so keep them until it's done */
       tor->startAfterVerify = doStart;
       tr_torrentVerify (tor, NULL, NULL);
     }
-  else if (doStart)
+  else
     {
-      tr_torrentStart (tor);
+      if (doStart)
+        tr_torrentStart (tor);
+
+      /* a stopped torrent doesn't need its piece hashes until it's started */
+      tr_torrentReleasePieceHashes (tor, true);
     }
 
   tr_sessionUnlock (session);
@@ -1057,7 +1192,7 @@ tr_torrentNew (const tr_ctor * ctor, int * setme_error, int * setme_duplicate_id
       if (hasInfo)
         tor->infoDictLength = len;
 
-      torrentInit (tor, ctor);
+      torrentInit (tor, ctor, NULL);
     }
   else
     {
@@ -1071,6 +1206,73 @@ tr_torrentNew (const tr_ctor * ctor, int * setme_error, int * setme_duplicate_id
   return tor;
 }
 
+tr_torrent_preload *
+tr_torrentPreload (tr_session * session, const char * filename)
+{
+  int len;
+  bool hasInfo;
+  tr_info info;
+  const tr_variant * metainfo;
+  tr_torrent_preload * preload = NULL;
+  tr_ctor * ctor = tr_ctorNew (NULL);
+
+  memset (&info, 0, sizeof (tr_info));
+
+  if (!tr_ctorSetMetainfoFromFile (ctor, filename)
+      && !tr_ctorGetMetainfo (ctor, &metainfo)
+      && tr_metainfoParse (session, metainfo, &info, &hasInfo, &len))
+    {
+      if (hasInfo && !tr_getBlockSize (info.pieceSize))
+        {
+          tr_metainfoFree (&info);
+        }
+      else
+        {
+          tr_torrent * tor = tr_new0 (tr_torrent, 1);
+          tor->session = session;
+          tor->magicNumber = TORRENT_MAGIC_NUMBER;
+          tor->info = info;
+          if (hasInfo)
+            tor->infoDictLength = len;
+          torrentInitFromInfo (tor);
+
+          preload = tr_new0 (tr_torrent_preload, 1);
+          preload->tor = tor;
+          preload->hasResume = !tr_torrentReadResume (tor, &preload->resume);
+        }
+    }
+
+  tr_ctorFree (ctor);
+  return preload;
+}
+
+tr_torrent *
+tr_torrentNewPreloaded (const tr_ctor * ctor, tr_torrent_preload * preload)
+{
+  tr_torrent * tor = preload->tor;
+  tr_session * session = tr_ctorGetSession (ctor);
+
+  assert (tr_isSession (session));
+  assert (tr_amInEventThread (session));
+
+  if (tr_torrentFindFromHash (session, tor->info.hash) != NULL)
+    {
+      tr_cpDestruct (&tor->completion);
+      tr_metainfoFree (&tor->info);
+      tr_free (tor);
+      tor = NULL;
+    }
+  else
+    {
+      torrentInit (tor, ctor, preload);
+    }
+
+  if (preload->hasResume)
+    tr_variantFree (&preload->resume);
+  tr_free (preload);
+  return tor;
+}
+
 /**
 ***
 **/
@@ -1579,9 +1781,15 @@ freeTorrent (tr_torrent * tor)
   tr_announcerRemoveTorrent (session->announcer, tor);
 
   tr_cpDestruct (&tor->completion);
+  tr_torrentFreeIncompleteMetadata (tor);
 
   tr_free (tor->downloadDir);
   tr_free (tor->incompleteDir);
+  tr_free (tor->pieceFiles);
+  tr_free (tor->rpcFieldRevs);
+  tr_free (tor->rpcPieces);
+
+  torrentLookupRemove (session, tor);
 
   if (tor == session->torrentList)
     {
@@ -1724,6 +1932,10 @@ torrentStart (tr_torrent * tor, bool bypass_queue)
   if (setLocalErrorIfFilesDisappeared (tor))
     return;
 
+  /* or if we can't check the pieces it downloads */
+  if (!tr_torrentEnsurePieceHashes (tor))
+    return;
+
   /* otherwise, start it now... */
   tr_sessionLock (tor->session);
 
@@ -1764,19 +1976,43 @@ tr_torrentStartNow (tr_torrent * tor)
 struct verify_data
 {
   bool aborted;
-  tr_torrent * tor;
+  tr_session * session;
+  int torrent_id;
   tr_verify_done_func callback_func;
   void * callback_data;
 };
 
+/* the verify isn't going to happen, or the torrent's gone (tor == NULL).
+   the caller still hears about it, in case callback_data needs freeing */
+static void
+verifyDataAbort (tr_torrent * tor, struct verify_data * data)
+{
+  if (data->callback_func != NULL)
+    (*data->callback_func)(tor, true, data->callback_data);
+
+  tr_free (data);
+}
+
 static void
 onVerifyDoneThreadFunc (void * vdata)
 {
   struct verify_data * data = vdata;
-  tr_torrent * tor = data->tor;
+  tr_torrent * tor = tr_torrentFindFromId (data->session, data->torrent_id);
+
+  /* the torrent may have been removed while this was queued */
+  if (tor == NULL)
+    {
+      verifyDataAbort (NULL, data);
+      return;
+    }
 
   if (!data->aborted)
-    tr_torrentRecheckCompleteness (tor);
+    {
+      tr_torrentRecheckCompleteness (tor);
+
+      /* a stopped torrent doesn't need its piece hashes until it's started */
+      tr_torrentReleasePieceHashes (tor, true);
+    }
 
   if (data->callback_func != NULL)
     (*data->callback_func)(tor, data->aborted, data->callback_data);
@@ -1794,7 +2030,7 @@ static void
 onVerifyDone (tr_torrent * tor, bool aborted, void * vdata)
 {
   struct verify_data * data = vdata;
-  assert (data->tor == tor);
+  assert (data->torrent_id == tor->uniqueId);
   data->aborted = aborted;
   tr_runInEventThread (tor->session, onVerifyDoneThreadFunc, data);
 }
@@ -1804,7 +2040,14 @@ verifyTorrent (void * vdata)
 {
   bool startAfter;
   struct verify_data * data = vdata;
-  tr_torrent * tor = data->tor;
+  tr_torrent * tor = tr_torrentFindFromId (data->session, data->torrent_id);
+
+  if (tor == NULL)
+    {
+      verifyDataAbort (NULL, data);
+      return;
+    }
+
   tr_sessionLock (tor->session);
 
   /* if the torrent's already being verified, stop it */
@@ -1815,10 +2058,15 @@ verifyTorrent (void * vdata)
     tr_torrentStop (tor);
   tor->startAfterVerify = startAfter;
 
-  if (setLocalErrorIfFilesDisappeared (tor))
-    tor->startAfterVerify = false;
+  if (setLocalErrorIfFilesDisappeared (tor) || !tr_torrentEnsurePieceHashes (tor))
+    {
+      tor->startAfterVerify = false;
+      verifyDataAbort (tor, data);
+    }
   else
-    tr_verifyAdd (tor, onVerifyDone, data);
+    {
+      tr_verifyAdd (tor, onVerifyDone, data);
+    }
 
   tr_sessionUnlock (tor->session);
 }
@@ -1831,7 +2079,8 @@ tr_torrentVerify (tr_torrent           * tor,
   struct verify_data * data;
 
   data = tr_new (struct verify_data, 1);
-  data->tor = tor;
+  data->session = tor->session;
+  data->torrent_id = tor->uniqueId;
   data->aborted = false;
   data->callback_func = callback_func;
   data->callback_data = callback_data;
@@ -1848,6 +2097,8 @@ tr_torrentSave (tr_torrent * tor)
       tor->isDirty = false;
       tr_torrentSaveResume (tor);
     }
+
+  tr_torrentSaveIncompleteMetadata (tor);
 }
 
 static void
@@ -1894,6 +2145,7 @@ tr_torrentStop (tr_torrent * tor)
 
       tor->isRunning = false;
       tor->isStopping = false;
+      tor->pieceHashesUsedAt = tr_time ();
       tr_torrentSetDirty (tor);
       tr_runInEventThread (tor->session, stopTorrent, tor);
 
@@ -1909,9 +2161,11 @@ closeTorrent (void * vtor)
 
   assert (tr_isTorrent (tor));
 
-  d = tr_variantListAddDict (&tor->session->removedTorrents, 2);
+  d = tr_variantListAddDict (&tor->session->removedTorrents, 3);
   tr_variantDictAddInt (d, TR_KEY_id, tor->uniqueId);
   tr_variantDictAddInt (d, TR_KEY_date, tr_time ());
+  tr_variantDictAddInt (d, TR_KEY_revision, tor->session->rpcRevision + 1);
+  tr_rpcPostTorrentEvent (tor->session->rpcServer, TR_RPC_EVENT_TORRENT_REMOVED, tor);
 
   tr_logAddTorInfo (tor, "%s", _("Removing torrent"));
 
@@ -1922,6 +2176,8 @@ closeTorrent (void * vtor)
     {
       tr_metainfoRemoveSaved (tor->session, &tor->info);
       tr_torrentRemoveResume (tor);
+      tr_torrentRemoveIncompleteMetadata (tor);
+      tr_rateHistoryRemoveSeries (tor->session->rateHistory, tor->historySeries);
     }
 
   tor->isRunning = false;
@@ -2148,6 +2404,14 @@ tr_torrentRecheckCompleteness (tr_torrent * tor)
 
   tr_torrentLock (tor);
 
+  /* don't announce a download as done when one of its pieces might still
+     fail its checksum test; onDownloadedPieceChecked () comes back here */
+  if (tor->pieceChecksPending > 0)
+    {
+      tr_torrentUnlock (tor);
+      return;
+    }
+
   completeness = tr_cpGetStatus (&tor->completion);
   if (completeness != tor->completeness)
     {
@@ -2168,6 +2432,7 @@ tr_torrentRecheckCompleteness (tr_torrent * tor)
           if (recentChange)
             {
               tr_announcerTorrentCompleted (tor);
+              tr_rpcPostTorrentEvent (tor->session->rpcServer, TR_RPC_EVENT_TORRENT_COMPLETED, tor);
               tor->doneDate = tor->anyDate = tr_time ();
             }
 
@@ -2574,20 +2839,107 @@ tr_torrentSetChecked (tr_torrent * tor, time_t when)
     tor->info.pieces[i].timeChecked = when;
 }
 
-bool
-tr_torrentCheckPiece (tr_torrent * tor, tr_piece_index_t pieceIndex)
+static void
+torrentSetPieceTested (tr_torrent * tor, tr_piece_index_t pieceIndex, bool pass)
 {
-  const bool pass = tr_ioTestPiece (tor, pieceIndex);
-
-  tr_deeplog_tor (tor, "[LAZY] tr_torrentCheckPiece tested piece %"TR_PRIuSIZE", pass==%d", (size_t)pieceIndex, (int)pass);
+  tr_deeplog_tor (tor, "[LAZY] tested piece %"TR_PRIuSIZE", pass==%d", (size_t)pieceIndex, (int)pass);
   tr_torrentSetHasPiece (tor, pieceIndex, pass);
   tr_torrentSetPieceChecked (tor, pieceIndex);
   tor->anyDate = tr_time ();
   tr_torrentSetDirty (tor);
+}
+
+bool
+tr_torrentCheckPiece (tr_torrent * tor, tr_piece_index_t pieceIndex)
+{
+  const bool pass = tr_ioTestPiece (tor, pieceIndex);
+
+  torrentSetPieceTested (tor, pieceIndex, pass);
 
   return pass;
 }
 
+/***
+****  Piece hashes
+***/
+
+enum
+{
+  /* how long a stopped torrent keeps its piece hashes around */
+  PIECE_HASHES_IDLE_SECS = 60
+};
+
+bool
+tr_torrentEnsurePieceHashes (tr_torrent * tor)
+{
+  bool ok = true;
+
+  assert (tr_isTorrent (tor));
+
+  tr_sessionLock (tor->session);
+
+  tor->pieceHashesUsedAt = tr_time ();
+
+  if ((tor->info.pieceHashes == NULL) && tr_torrentHasMetadata (tor))
+    {
+      tr_info info;
+      tr_variant metainfo;
+
+      ok = false;
+      memset (&info, 0, sizeof (tr_info));
+
+      if (!tr_variantFromFile (&metainfo, TR_VARIANT_FMT_BENC, tor->info.torrent))
+        {
+          if (tr_metainfoParse (tor->session, &metainfo, &info, NULL, NULL))
+            {
+              if ((info.pieceCount == tor->info.pieceCount)
+                  && !memcmp (info.hash, tor->info.hash, SHA_DIGEST_LENGTH))
+                {
+                  tor->info.pieceHashes = info.pieceHashes;
+                  info.pieceHashes = NULL;
+                  ok = true;
+                }
+
+              tr_metainfoFree (&info);
+            }
+
+          tr_variantFree (&metainfo);
+        }
+
+      if (ok)
+        tr_logAddTorDbg (tor, "%s", "Reloaded piece hashes");
+      else
+        tr_torrentSetLocalError (tor, _("Unable to read piece hashes from \"%s\""), tor->info.torrent);
+    }
+
+  tr_sessionUnlock (tor->session);
+  return ok;
+}
+
+void
+tr_torrentReleasePieceHashes (tr_torrent * tor, bool force)
+{
+  struct stat sb;
+
+  assert (tr_isTorrent (tor));
+
+  tr_sessionLock (tor->session);
+
+  /* only let go of them if we can get them back later */
+  if ((tor->info.pieceHashes != NULL)
+      && !tor->isRunning
+      && !tor->startAfterVerify
+      && (tor->verifyState == TR_VERIFY_NONE)
+      && (force || (tor->pieceHashesUsedAt + PIECE_HASHES_IDLE_SECS <= tr_time ()))
+      && !stat (tor->info.torrent, &sb))
+    {
+      tr_free (tor->info.pieceHashes);
+      tor->info.pieceHashes = NULL;
+    }
+
+  tr_sessionUnlock (tor->session);
+}
+
 time_t
 tr_torrentGetFileMTime (const tr_torrent * tor, tr_file_index_t i)
 {
@@ -3229,6 +3581,37 @@ tr_torrentPieceCompleted (tr_torrent * tor, tr_piece_index_t pieceIndex)
     }
 }
 
+static void
+onDownloadedPieceChecked (tr_torrent * tor, tr_piece_index_t p, bool pass)
+{
+  assert (tor->pieceChecksPending > 0);
+
+  --tor->pieceChecksPending;
+
+  /* if the piece was reset (e.g. by a verify) while it was being hashed,
+     this result is stale */
+  if (tr_torrentPieceIsComplete (tor, p))
+    {
+      torrentSetPieceTested (tor, p, pass);
+
+      if (pass)
+        {
+          tr_torrentPieceCompleted (tor, p);
+        }
+      else
+        {
+          const uint32_t n = tr_torPieceCountBytes (tor, p);
+          tr_logAddTorErr (tor, _("Piece %"PRIu32", which was just downloaded, failed its checksum test"), p);
+          tor->corruptCur += n;
+          tor->downloadedCur -= MIN (tor->downloadedCur, n);
+          tr_peerMgrGotBadPiece (tor, p);
+        }
+    }
+
+  if (tor->pieceChecksPending == 0)
+    tr_torrentRecheckCompleteness (tor);
+}
+
 void
 tr_torrentGotBlock (tr_torrent * tor, tr_block_index_t block)
 {
@@ -3247,19 +3630,17 @@ tr_torrentGotBlock (tr_torrent * tor, tr_block_index_t block)
       p = tr_torBlockPiece (tor, block);
       if (tr_torrentPieceIsComplete (tor, p))
         {
-          tr_logAddTorDbg (tor, "[LAZY] checking just-completed piece %"TR_PRIuSIZE, (size_t)p);
-
-          if (tr_torrentCheckPiece (tor, p))
+          if (tr_torrentEnsurePieceHashes (tor))
             {
-              tr_torrentPieceCompleted (tor, p);
+              tr_logAddTorDbg (tor, "[LAZY] checking just-completed piece %"TR_PRIuSIZE, (size_t)p);
+              ++tor->pieceChecksPending;
+              tr_verifyPiece (tor, p, onDownloadedPieceChecked);
             }
           else
             {
-              const uint32_t n = tr_torPieceCountBytes (tor, p);
-              tr_logAddTorErr (tor, _("Piece %"PRIu32", which was just downloaded, failed its checksum test"), p);
-              tor->corruptCur += n;
-              tor->downloadedCur -= MIN (tor->downloadedCur, n);
-              tr_peerMgrGotBadPiece (tor, p);
+              /* that stopped the torrent with an error. the piece can't be
+                 checked, but it isn't its peers' fault, so just forget it */
+              tr_torrentSetHasPiece (tor, p, false);
             }
         }
     }
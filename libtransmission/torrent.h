@@ -33,6 +33,12 @@ void        tr_ctorSetSave (tr_ctor * ctor,
 
 int         tr_ctorGetSave (const tr_ctor * ctor);
 
+/** @brief like tr_ctorSetMetainfo (), but the ctor takes over `metainfo',
+           which must come from tr_malloc (), instead of copying it */
+int         tr_ctorSetMetainfoInPlace (tr_ctor * ctor,
+                                       void    * metainfo,
+                                       size_t    len);
+
 void        tr_ctorInitTorrentPriorities (const tr_ctor * ctor, tr_torrent * tor);
 
 void        tr_ctorInitTorrentWanted (const tr_ctor * ctor, tr_torrent * tor);
@@ -41,6 +47,24 @@ void        tr_ctorInitTorrentWanted (const tr_ctor * ctor, tr_torrent * tor);
 ***
 **/
 
+/* a torrent whose metainfo and resume file have been read but which
+   hasn't been added to its session yet */
+typedef struct tr_torrent_preload tr_torrent_preload;
+
+/* parses `filename' and reads its resume file. Safe to call from any
+   thread. Returns NULL if the file can't be parsed. */
+tr_torrent_preload * tr_torrentPreload (tr_session * session,
+                                        const char * filename);
+
+/* adds a preloaded torrent to the session and frees `preload'.
+   Must be called from the event thread. Returns NULL for duplicates. */
+tr_torrent * tr_torrentNewPreloaded (const tr_ctor      * ctor,
+                                     tr_torrent_preload * preload);
+
+/**
+***
+**/
+
 /* just like tr_torrentSetFileDLs but doesn't trigger a fastresume save */
 void        tr_torrentInitFileDLs (tr_torrent              * tor,
                                    const tr_file_index_t   * files,
@@ -189,6 +213,12 @@ struct tr_torrent
     uint16_t                   blockCountInPiece;
     uint16_t                   blockCountInLastPiece;
 
+    /* The first file with data in each piece, followed by fileCount.
+     * The files in piece p are pieceFiles[p] through pieceFiles[p+1],
+     * so finding a block's file only searches the files in its piece.
+     * Costs sizeof (tr_file_index_t) per piece. */
+    tr_file_index_t          * pieceFiles;
+
     struct tr_completion       completion;
 
     tr_completeness            completeness;
@@ -209,6 +239,9 @@ struct tr_torrent
     uint64_t                   corruptCur;
     uint64_t                   corruptPrev;
 
+    /* this torrent's series in session->rateHistory */
+    int                        historySeries;
+
     uint64_t                   etaDLSpeedCalculatedAt;
     unsigned int               etaDLSpeed_Bps;
     uint64_t                   etaULSpeedCalculatedAt;
@@ -219,12 +252,18 @@ struct tr_torrent
     time_t                     doneDate;
     time_t                     startDate;
     time_t                     anyDate;
+    time_t                     pieceHashesUsedAt;
 
     int                        secondsDownloading;
     int                        secondsSeeding;
 
     int                        queuePosition;
 
+    /* just-downloaded pieces that are still being hashed. those pieces
+       are in the completion, so completeness isn't rechecked until this
+       drops back to zero. */
+    int                        pieceChecksPending;
+
     tr_torrent_metadata_func    metadata_func;
     void                      * metadata_func_user_data;
 
@@ -260,6 +299,24 @@ struct tr_torrent
 
     tr_torrent *               next;
 
+    /* chains in the session's torrent lookup tables. see torrent.c */
+    tr_torrent *               nextById;
+    tr_torrent *               nextByHash;
+    tr_torrent *               nextByObfuscatedHash;
+
+    /* when each field last changed, for delta torrent-get. see rpcimpl.c */
+    struct tr_rpc_field_rev  * rpcFieldRevs;
+    int                        rpcFieldRevCount;
+
+    /* the "pieces" RPC field, as of completion.generation. see rpcimpl.c */
+    char                     * rpcPieces;
+    uint32_t                   rpcPiecesGeneration;
+
+    /* what the RPC event stream last saw. see rpc-server.c */
+    bool                       rpcEventSampled;
+    tr_torrent_activity        rpcEventActivity;
+    unsigned int               rpcEventSpeed_Bps[2];
+
     int                        uniqueId;
 
     struct tr_bandwidth        bandwidth;
@@ -436,6 +493,19 @@ bool tr_torrentPieceNeedsCheck (const tr_torrent * tor, tr_piece_index_t pieceIn
  */
 bool tr_torrentCheckPiece (tr_torrent * tor, tr_piece_index_t pieceIndex);
 
+/**
+ * @brief Make sure tor->info.pieceHashes is loaded, rereading the
+ *        .torrent file if it was released.
+ * @return false (and sets a local error) if the hashes couldn't be read
+ */
+bool tr_torrentEnsurePieceHashes (tr_torrent * tor);
+
+/**
+ * @brief Free a stopped torrent's piece hashes if they've been idle for
+ *        a while, or right away if `force' is true.
+ */
+void tr_torrentReleasePieceHashes (tr_torrent * tor, bool force);
+
 time_t tr_torrentGetFileMTime (const tr_torrent * tor, tr_file_index_t i);
 
 uint64_t tr_torrentGetCurrentSizeOnDisk (const tr_torrent * tor);
@@ -492,6 +562,12 @@ tr_torrentCreatePieceBitfield (const tr_torrent * tor, size_t * byte_count)
   return tr_cpCreatePieceBitfield (&tor->completion, byte_count);
 }
 
+static inline size_t *
+tr_torrentCreatePieceRuns (const tr_torrent * tor, size_t * run_count)
+{
+  return tr_cpCreatePieceRuns (&tor->completion, run_count);
+}
+
 static inline uint64_t
 tr_torrentHaveTotal (const tr_torrent * tor)
 {
@@ -1746,10 +1746,12 @@ void tr_torrentAmountFinished (const tr_torrent  * torrent,
 /**
  * Callback function invoked when a torrent finishes being verified.
  *
- * @param torrent the torrent that was verified
- * @param aborted true if the verify ended prematurely for some reason,
- *                such as tr_torrentStop() or tr_torrentSetLocation()
- *                being called during verification.
+ * @param torrent the torrent that was verified, or NULL if it was
+ *                removed before the verify finished
+ * @param aborted true if the verify ended prematurely or never started
+ *                for some reason, such as tr_torrentStop() or
+ *                tr_torrentSetLocation() being called during verification
+ *                or the torrent being removed.
  * @param callback_data the user-defined pointer from tr_torrentVerify()
  */
 typedef void (*tr_verify_done_func)(tr_torrent  * torrent,
@@ -1761,7 +1763,8 @@ typedef void (*tr_verify_done_func)(tr_torrent  * torrent,
  *
  * If callback_func is non-NULL, it will be called from the libtransmission
  * thread after the torrent's completness state is updated after the
- * file verification pass.
+ * file verification pass. It's also called if the verify is aborted or the
+ * torrent is removed first, so it can free callback_data.
  */
 void tr_torrentVerify (tr_torrent           * torrent,
                        tr_verify_done_func    callback_func_or_NULL,
@@ -1789,7 +1792,6 @@ tr_file;
 typedef struct tr_piece
 {
     time_t   timeChecked;              /* the last time we tested this piece */
-    uint8_t  hash[SHA_DIGEST_LENGTH];  /* pieces hash */
     int8_t   priority;                 /* TR_PRI_HIGH, _NORMAL, or _LOW */
     int8_t   dnd;                      /* "do not download" flag */
 }
@@ -1818,6 +1820,12 @@ struct tr_info
     tr_file          * files;
     tr_piece         * pieces;
 
+    /* The pieces' SHA1 hashes, SHA_DIGEST_LENGTH bytes per piece.
+     * libtransmission frees these while a torrent is stopped and
+     * reads them back from the .torrent file when they're needed.
+     * CLIENT CODE: NOT USE THIS FIELD. */
+    uint8_t          * pieceHashes;
+
     /* these trackers are sorted by tier */
     tr_tracker_info  * trackers;
 
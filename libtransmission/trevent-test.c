@@ -0,0 +1,143 @@
+/*
+ * This file Copyright (C) 2015 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include "transmission.h"
+#include "platform.h" /* tr_threadNew () */
+#include "trevent.h"
+#include "utils.h" /* tr_wait_msec () */
+
+#include "libtransmission-test.h"
+
+enum
+{
+  PRODUCER_COUNT = 4,
+  CALLS_PER_PRODUCER = 20000
+};
+
+struct producer;
+
+struct call
+{
+  struct producer * producer;
+  int seq;
+};
+
+struct producer
+{
+  tr_session * session;
+  struct call calls[CALLS_PER_PRODUCER];
+  int calls_run;
+  bool in_order;
+  bool in_event_thread;
+  bool done;
+};
+
+static void
+callFunc (void * vcall)
+{
+  struct call * call = vcall;
+  struct producer * p = call->producer;
+
+  if (call->seq != p->calls_run)
+    p->in_order = false;
+  if (!tr_amInEventThread (p->session))
+    p->in_event_thread = false;
+
+  ++p->calls_run;
+}
+
+static void
+producerFunc (void * vp)
+{
+  int i;
+  struct producer * p = vp;
+
+  for (i = 0; i < CALLS_PER_PRODUCER; ++i)
+    tr_runInEventThread (p->session, callFunc, &p->calls[i]);
+
+  p->done = true;
+}
+
+static void
+markDone (void * vdone)
+{
+  *(bool*)vdone = true;
+}
+
+static int
+test_run_in_event_thread (void)
+{
+  int i;
+  int j;
+  bool flushed;
+  tr_session * session;
+  struct tr_event_queue_stats stats;
+  uint64_t depth_total;
+  uint64_t latency_total;
+  struct producer * producers = tr_new0 (struct producer, PRODUCER_COUNT);
+
+  session = libttest_session_init (NULL);
+
+  for (i = 0; i < PRODUCER_COUNT; ++i)
+    {
+      struct producer * p = &producers[i];
+
+      p->session = session;
+      p->in_order = true;
+      p->in_event_thread = true;
+
+      for (j = 0; j < CALLS_PER_PRODUCER; ++j)
+        {
+          p->calls[j].producer = p;
+          p->calls[j].seq = j;
+        }
+    }
+
+  for (i = 0; i < PRODUCER_COUNT; ++i)
+    tr_threadNew (producerFunc, &producers[i]);
+
+  for (i = 0; i < PRODUCER_COUNT; ++i)
+    while (!producers[i].done)
+      tr_wait_msec (10);
+
+  /* everything queued before this will have run once it's done */
+  flushed = false;
+  tr_runInEventThread (session, markDone, &flushed);
+  while (!flushed)
+    tr_wait_msec (10);
+
+  /* each producer's calls ran once, in order, in the event thread */
+  for (i = 0; i < PRODUCER_COUNT; ++i)
+    {
+      check_int_eq (CALLS_PER_PRODUCER, producers[i].calls_run);
+      check (producers[i].in_order);
+      check (producers[i].in_event_thread);
+    }
+
+  tr_eventGetQueueStats (session, &stats);
+  check (stats.callbacks >= PRODUCER_COUNT * CALLS_PER_PRODUCER + 1);
+  check (stats.wakeups > 0);
+  check (stats.wakeups <= stats.callbacks);
+
+  depth_total = 0;
+  latency_total = 0;
+  for (i = 0; i < TR_EVENT_HISTOGRAM_SIZE; ++i)
+    {
+      depth_total += stats.depth[i];
+      latency_total += stats.latency[i];
+    }
+  check_int_eq (stats.wakeups, depth_total);
+  check_int_eq (stats.callbacks, latency_total);
+
+  libttest_session_close (session);
+  tr_free (producers);
+  return 0;
+}
+
+MAIN_SINGLE_TEST (test_run_in_event_thread)
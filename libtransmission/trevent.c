@@ -13,8 +13,13 @@
 
 #include <signal.h>
 
+#ifdef HAVE_SYS_EVENTFD_H
+ #include <sys/eventfd.h>
+#endif
+
 #include <event2/dns.h>
 #include <event2/event.h>
+#include <event2/util.h> /* evutil_gettimeofday () */
 
 #include "transmission.h"
 #include "log.h"
@@ -124,7 +129,7 @@ piperead (int s, char *buf, int len)
 #include <unistd.h> /* read (), write (), pipe () */
 
 #include "transmission.h"
-#include "platform.h" /* tr_lockLock () */
+#include "platform.h" /* tr_threadNew () */
 #include "trevent.h"
 #include "utils.h"
 
@@ -132,78 +137,161 @@ piperead (int s, char *buf, int len)
 ****
 ***/
 
+#ifdef WIN32
+ #define casPointer(ptr, oldval, newval) \
+   (InterlockedCompareExchangePointer ((PVOID volatile *)(ptr), (newval), (oldval)) == (oldval))
+#else
+ #define casPointer(ptr, oldval, newval) \
+   __sync_bool_compare_and_swap ((ptr), (oldval), (newval))
+#endif
+
+struct tr_run_data
+{
+    struct tr_run_data * next;
+    void  (*func)(void *);
+    void *  user_data;
+    uint64_t queued_usec;
+};
+
 typedef struct tr_event_handle
 {
     uint8_t      die;
     int          fds[2];
-    tr_lock *    lock;
     tr_session *  session;
     tr_thread *  thread;
     struct event_base * base;
     struct event * pipeEvent;
+
+    /* callbacks pushed by other threads, newest first */
+    struct tr_run_data * volatile pending;
+
+    struct tr_event_queue_stats stats;
 }
 tr_event_handle;
 
-struct tr_run_data
-{
-    void  (*func)(void *);
-    void *  user_data;
-};
-
 #define dbgmsg(...) \
     do { \
         if (tr_logGetDeepEnabled ()) \
             tr_logAddDeep (__FILE__, __LINE__, "event", __VA_ARGS__); \
     } while (0)
 
+static uint64_t
+now_usec (void)
+{
+  struct timeval tv;
+
+  evutil_gettimeofday (&tv, NULL);
+
+  return (uint64_t)tv.tv_sec * 1000000u + tv.tv_usec;
+}
+
+/* bucket i holds values in [2^i, 2^(i+1)); 0 goes in bucket 0 */
+static int
+histogramBucket (uint64_t val)
+{
+  int i = 0;
+
+  while ((val >>= 1) != 0 && i < TR_EVENT_HISTOGRAM_SIZE - 1)
+    ++i;
+
+  return i;
+}
+
+/* the wakeup fd is either an eventfd or a pipe.
+   Writing an 8-byte counter works for both. */
+static void
+wakeEventThread (tr_event_handle * eh)
+{
+  const uint64_t one = 1;
+
+  if (pipewrite (eh->fds[1], &one, sizeof (one)) == -1)
+    tr_logAddError ("Unable to write to libtransmisison event queue: %s", tr_strerror(errno));
+}
+
+static void
+clearWakeup (evutil_socket_t fd)
+{
+  char buf[64];
+
+  while (piperead (fd, buf, sizeof (buf)) == sizeof (buf))
+    ;
+}
+
+static void
+freeRunQueue (struct tr_run_data * list)
+{
+  while (list != NULL)
+    {
+      struct tr_run_data * next = list->next;
+      tr_free (list);
+      list = next;
+    }
+}
+
 static void
 readFromPipe (evutil_socket_t   fd,
               short             eventType,
               void            * veh)
 {
-    char              ch;
-    int               ret;
+    size_t            n;
+    uint64_t          now;
     tr_event_handle * eh = veh;
+    struct tr_run_data * list;
+    struct tr_run_data * fifo;
 
     dbgmsg ("readFromPipe: eventType is %hd", eventType);
 
-    /* read the command type */
-    ch = '\0';
+    /* clear the wakeup *before* taking the queue, so that anything
+       pushed after we take it will wake us up again */
+    clearWakeup (fd);
+
     do
+        list = eh->pending;
+    while (!casPointer (&eh->pending, list, NULL));
+
+    if (eh->die)
+    {
+        dbgmsg ("event thread is dying... removing event listener");
+        freeRunQueue (list);
+        event_free (eh->pipeEvent);
+        eh->pipeEvent = NULL;
+        return;
+    }
+
+    /* the queue is newest-first; reverse it to run in submission order */
+    n = 0;
+    fifo = NULL;
+    while (list != NULL)
     {
-        ret = piperead (fd, &ch, 1);
+        struct tr_run_data * next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+        ++n;
     }
-    while (!eh->die && ret < 0 && errno == EAGAIN);
 
-    dbgmsg ("command is [%c], ret is %d, errno is %d", ch, ret, (int)errno);
+    if (n == 0)
+        return;
+
+    ++eh->stats.wakeups;
+    eh->stats.callbacks += n;
+    ++eh->stats.depth[histogramBucket (n)];
 
-    switch (ch)
+    now = now_usec ();
+    while (fifo != NULL)
     {
-        case 'r': /* run in libevent thread */
-        {
-            struct tr_run_data data;
-            const size_t       nwant = sizeof (data);
-            const ssize_t      ngot = piperead (fd, &data, nwant);
-            if (!eh->die && (ngot == (ssize_t)nwant))
-            {
-                dbgmsg ("invoking function in libevent thread");
-              (data.func)(data.user_data);
-            }
-            break;
-        }
+        struct tr_run_data * data = fifo;
+        fifo = data->next;
 
-        case '\0': /* eof */
-        {
-            dbgmsg ("pipe eof reached... removing event listener");
-            event_free (eh->pipeEvent);
-            break;
-        }
+        ++eh->stats.latency[histogramBucket (now > data->queued_usec ? now - data->queued_usec : 0)];
 
-        default:
+        if (!eh->die)
         {
-            assert (0 && "unhandled command type!");
-            break;
+            dbgmsg ("invoking function in libevent thread");
+            (data->func)(data->user_data);
         }
+
+        tr_free (data);
     }
 }
 
@@ -236,7 +324,7 @@ libeventThreadFunc (void * veh)
     eh->session->evdns_base = evdns_base_new (base, true);
     eh->session->events = eh;
 
-    /* listen to the pipe's read fd */
+    /* listen to the wakeup fd */
     eh->pipeEvent = event_new (base, eh->fds[0], EV_READ | EV_PERSIST, readFromPipe, veh);
     event_add (eh->pipeEvent, NULL);
     event_set_log_callback (logFunc);
@@ -246,13 +334,36 @@ libeventThreadFunc (void * veh)
         event_base_dispatch (base);
 
     /* shut down the thread */
-    tr_lockFree (eh->lock);
+    if (eh->pipeEvent != NULL)
+        event_free (eh->pipeEvent);
+    freeRunQueue (eh->pending);
+    tr_netCloseSocket (eh->fds[0]);
+    if (eh->fds[1] != eh->fds[0])
+        tr_netCloseSocket (eh->fds[1]);
     event_base_free (base);
     eh->session->events = NULL;
     tr_free (eh);
     tr_logAddDebug ("Closing libevent thread");
 }
 
+static bool
+createWakeupFds (int fds[2])
+{
+#ifdef HAVE_SYS_EVENTFD_H
+  if ((fds[0] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1)
+    {
+      fds[1] = fds[0];
+      return true;
+    }
+#endif
+
+  if (pipe (fds) == -1)
+    return false;
+
+  evutil_make_socket_nonblocking (fds[0]);
+  return true;
+}
+
 void
 tr_eventInit (tr_session * session)
 {
@@ -261,8 +372,7 @@ tr_eventInit (tr_session * session)
     session->events = NULL;
 
     eh = tr_new0 (tr_event_handle, 1);
-    eh->lock = tr_lockNew ();
-    if (pipe (eh->fds) == -1)
+    if (!createWakeupFds (eh->fds))
       tr_logAddError ("Unable to write to pipe() in libtransmission: %s", tr_strerror(errno));
     eh->session = session;
     eh->thread = tr_threadNew (libeventThreadFunc, eh);
@@ -275,11 +385,31 @@ tr_eventInit (tr_session * session)
 void
 tr_eventClose (tr_session * session)
 {
+    tr_event_handle * eh;
+    const struct tr_event_queue_stats * st;
+
     assert (tr_isSession (session));
 
-    session->events->die = true;
-    tr_logAddDeep (__FILE__, __LINE__, NULL, "closing trevent pipe");
-    tr_netCloseSocket (session->events->fds[1]);
+    eh = session->events;
+    st = &eh->stats;
+    dbgmsg ("event queue: %"PRIu64" callbacks in %"PRIu64" wakeups; "
+            "batch sizes by power of two: %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64"...",
+            st->callbacks, st->wakeups,
+            st->depth[0], st->depth[1], st->depth[2], st->depth[3], st->depth[4], st->depth[5]);
+
+    eh->die = true;
+    tr_logAddDeep (__FILE__, __LINE__, NULL, "closing trevent queue");
+    wakeEventThread (eh);
+}
+
+void
+tr_eventGetQueueStats (const tr_session             * session,
+                       struct tr_event_queue_stats  * setme)
+{
+  assert (tr_isSession (session));
+  assert (session->events != NULL);
+
+  *setme = session->events->stats;
 }
 
 /**
@@ -312,26 +442,24 @@ tr_runInEventThread (tr_session * session,
     }
   else
     {
-      int fd;
-      char ch;
-      ssize_t res_1;
-      ssize_t res_2;
+      struct tr_run_data * head;
       tr_event_handle * e = session->events;
-      struct tr_run_data data;
-
-      tr_lockLock (e->lock);
-
-      fd = e->fds[1];
-      ch = 'r';
-      res_1 = pipewrite (fd, &ch, 1);
+      struct tr_run_data * data = tr_new (struct tr_run_data, 1);
 
-      data.func = func;
-      data.user_data = user_data;
-      res_2 = pipewrite (fd, &data, sizeof (data));
+      data->func = func;
+      data->user_data = user_data;
+      data->queued_usec = now_usec ();
 
-      tr_lockUnlock (e->lock);
+      do
+        {
+          head = e->pending;
+          data->next = head;
+        }
+      while (!casPointer (&e->pending, head, data));
 
-      if ((res_1 == -1) || (res_2 == -1))
-        tr_logAddError ("Unable to write to libtransmisison event queue: %s", tr_strerror(errno));
+      /* only the push that makes the queue non-empty needs to wake
+         the event thread; the rest are picked up in the same batch */
+      if (head == NULL)
+        wakeEventThread (e);
     }
 }
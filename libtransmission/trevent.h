@@ -17,6 +17,25 @@
 /**
 **/
 
+enum
+{
+  TR_EVENT_HISTOGRAM_SIZE = 16
+};
+
+/* Counters for the queue behind tr_runInEventThread ().
+   Histogram bucket i counts values in [2^i, 2^(i+1)). */
+struct tr_event_queue_stats
+{
+  uint64_t callbacks;
+  uint64_t wakeups;
+
+  /* number of callbacks drained per wakeup */
+  uint64_t depth[TR_EVENT_HISTOGRAM_SIZE];
+
+  /* microseconds each callback waited before running */
+  uint64_t latency[TR_EVENT_HISTOGRAM_SIZE];
+};
+
 void   tr_eventInit (tr_session *);
 
 void   tr_eventClose (tr_session *);
@@ -25,4 +44,6 @@ bool   tr_amInEventThread (const tr_session *);
 
 void   tr_runInEventThread (tr_session *, void func (void*), void * user_data);
 
+void   tr_eventGetQueueStats (const tr_session *, struct tr_event_queue_stats * setme);
+
 #endif
@@ -0,0 +1,357 @@
+/*
+ * This file Copyright (C) 2015 Mnemosyne LLC
+ *
+ * It may be used under the GNU GPL versions 2 or 3
+ * or any future license endorsed by Mnemosyne LLC.
+ *
+ * $Id$
+ */
+
+#include <string.h> /* memset () */
+
+#ifdef WITH_UTP
+ #include <libutp/utp.h>
+#endif
+
+#include "transmission.h"
+#include "utils.h" /* tr_time_msec (), tr_wait_msec () */
+
+#include "libtransmission-test.h"
+
+#ifdef WITH_UTP
+
+/* A synthetic load test for libutp: CONN_COUNT connections between
+   two fake hosts, with packets handed straight from one side's
+   send_to callback to the other side's UTP_IsIncomingUTP (). */
+
+enum
+{
+  CONN_COUNT = 1000,
+  BYTES_PER_CONN = 2000,
+  PORT_A = 20000,
+  PORT_B = 30000
+};
+
+struct endpoint
+{
+  struct sockaddr_in addr;
+  int index;
+};
+
+struct conn
+{
+  struct UTPSocket * sock;
+  size_t bytes_read;
+  size_t bytes_to_write;
+  bool connected;
+  bool destroyed;
+  int error;
+};
+
+struct packet
+{
+  struct sockaddr_in from;
+  struct sockaddr_in to;
+  size_t len;
+  byte data[1500];
+};
+
+/* endpoints[i] is host A's end of connection i, endpoints[CONN_COUNT+i] is host B's.
+   conns is laid out the same way. */
+static struct endpoint endpoints[2 * CONN_COUNT];
+static struct conn conns[2 * CONN_COUNT];
+static int incoming_count = 0;
+
+static struct packet * packets = NULL;
+static size_t packet_count = 0;
+static size_t packet_alloc = 0;
+
+static void
+on_read (void * vconn, const byte * bytes UNUSED, size_t count)
+{
+  ((struct conn*)vconn)->bytes_read += count;
+}
+
+static void
+on_write (void * vconn, byte * bytes, size_t count)
+{
+  struct conn * c = vconn;
+
+  memset (bytes, 'x', count);
+  c->bytes_to_write -= count;
+}
+
+static size_t
+get_rb_size (void * vconn UNUSED)
+{
+  return 0;
+}
+
+static void
+on_state (void * vconn, int state)
+{
+  struct conn * c = vconn;
+
+  if (state == UTP_STATE_CONNECT || state == UTP_STATE_WRITABLE)
+    {
+      c->connected = true;
+      if (c->bytes_to_write > 0)
+        UTP_Write (c->sock, c->bytes_to_write);
+    }
+  else if (state == UTP_STATE_DESTROYING)
+    {
+      c->destroyed = true;
+      c->sock = NULL;
+    }
+}
+
+static void
+on_error (void * vconn, int errcode)
+{
+  ((struct conn*)vconn)->error = errcode;
+}
+
+static void
+on_overhead (void * vconn UNUSED, uint8_t send UNUSED, size_t count UNUSED, int type UNUSED)
+{
+}
+
+static struct UTPFunctionTable funcs =
+{
+  on_read, on_write, get_rb_size, on_state, on_error, on_overhead
+};
+
+static void
+send_to (void * vendpoint, const byte * p, size_t len, const struct sockaddr * to, socklen_t tolen UNUSED)
+{
+  struct packet * pkt;
+  const struct endpoint * from = vendpoint;
+
+  if (packet_count == packet_alloc)
+    {
+      packet_alloc = packet_alloc ? packet_alloc * 2 : 1024;
+      packets = tr_renew (struct packet, packets, packet_alloc);
+    }
+
+  pkt = &packets[packet_count++];
+  pkt->from = from->addr;
+  pkt->to = *(const struct sockaddr_in*)to;
+  pkt->len = MIN (len, sizeof (pkt->data));
+  memcpy (pkt->data, p, pkt->len);
+}
+
+static void
+on_incoming (void * vendpoint, struct UTPSocket * sock)
+{
+  const struct endpoint * e = vendpoint;
+  struct conn * c = &conns[e->index];
+
+  c->sock = sock;
+  c->connected = true;
+  UTP_SetCallbacks (sock, &funcs, c);
+  ++incoming_count;
+}
+
+static struct endpoint *
+find_endpoint (const struct sockaddr_in * addr)
+{
+  const int port = ntohs (addr->sin_port);
+
+  if (port >= PORT_B)
+    return &endpoints[CONN_COUNT + port - PORT_B];
+
+  return &endpoints[port - PORT_A];
+}
+
+/* deliver every queued packet, including the replies they cause */
+static size_t
+pump (void)
+{
+  size_t i;
+  size_t n = 0;
+
+  while (packet_count > 0)
+    {
+      struct packet * batch = packets;
+      const size_t batch_count = packet_count;
+
+      packets = NULL;
+      packet_count = packet_alloc = 0;
+
+      for (i = 0; i < batch_count; ++i)
+        {
+          const struct packet * pkt = &batch[i];
+          UTP_IsIncomingUTP (on_incoming, send_to, find_endpoint (&pkt->to),
+                             pkt->data, pkt->len,
+                             (const struct sockaddr*)&pkt->from, sizeof (pkt->from));
+        }
+
+      n += batch_count;
+      tr_free (batch);
+    }
+
+  return n;
+}
+
+static bool
+all_connected (void)
+{
+  int i;
+
+  for (i = 0; i < 2 * CONN_COUNT; ++i)
+    if (!conns[i].connected)
+      return false;
+
+  return incoming_count == CONN_COUNT;
+}
+
+static bool
+all_delivered (void)
+{
+  int i;
+
+  for (i = CONN_COUNT; i < 2 * CONN_COUNT; ++i)
+    if (conns[i].bytes_read != BYTES_PER_CONN)
+      return false;
+
+  return true;
+}
+
+static bool
+all_parked (void)
+{
+  struct UTPGlobalStats stats;
+
+  UTP_GetGlobalStats (&stats);
+
+  return stats._nsockets_parked == 2 * CONN_COUNT;
+}
+
+static bool
+all_destroyed (void)
+{
+  int i;
+
+  for (i = 0; i < 2 * CONN_COUNT; ++i)
+    if (!conns[i].destroyed)
+      return false;
+
+  return true;
+}
+
+static bool
+run_until (bool (*done)(void), int msec)
+{
+  const uint64_t deadline = tr_time_msec () + msec;
+
+  for (;;)
+    {
+      pump ();
+      UTP_CheckTimeouts ();
+      pump ();
+
+      if ((*done)())
+        return true;
+
+      if (tr_time_msec () > deadline)
+        return false;
+
+      tr_wait_msec (5);
+    }
+}
+
+static void
+init_endpoint (struct endpoint * e, const char * ip, int port, int index)
+{
+  memset (e, 0, sizeof (*e));
+  e->addr.sin_family = AF_INET;
+  e->addr.sin_port = htons (port);
+  inet_pton (AF_INET, ip, &e->addr.sin_addr);
+  e->index = index;
+}
+
+static int
+test_utp_load (void)
+{
+  int i;
+  uint64_t start;
+  uint64_t elapsed;
+  struct UTPGlobalStats stats;
+
+  for (i = 0; i < CONN_COUNT; ++i)
+    {
+      init_endpoint (&endpoints[i], "10.0.0.1", PORT_A + i, i);
+      init_endpoint (&endpoints[CONN_COUNT + i], "10.0.0.2", PORT_B + i, CONN_COUNT + i);
+    }
+
+  /* connect each of host A's endpoints to its peer on host B */
+  for (i = 0; i < CONN_COUNT; ++i)
+    {
+      struct UTPSocket * sock;
+      const struct endpoint * peer = &endpoints[CONN_COUNT + i];
+
+      sock = UTP_Create (send_to, &endpoints[i], (const struct sockaddr*)&peer->addr, sizeof (peer->addr));
+      check (sock != NULL);
+      conns[i].sock = sock;
+      UTP_SetCallbacks (sock, &funcs, &conns[i]);
+      UTP_Connect (sock);
+    }
+  check (run_until (all_connected, 5000));
+
+  /* every incoming packet has to find the right one of 2000 sockets */
+  for (i = 0; i < CONN_COUNT; ++i)
+    {
+      conns[i].bytes_to_write = BYTES_PER_CONN;
+      UTP_Write (conns[i].sock, conns[i].bytes_to_write);
+    }
+  check (run_until (all_delivered, 5000));
+
+  /* once the data's acked there's nothing left to do but keepalives,
+     so every socket should end up parked in the timer wheel */
+  check (run_until (all_parked, 5000));
+  for (i = 0; i < 2 * CONN_COUNT; ++i)
+    check_int_eq (0, conns[i].error);
+
+  /* with every socket parked, a tick shouldn't touch any of them */
+  start = tr_time_msec ();
+  for (i = 0; i < 10000; ++i)
+    UTP_CheckTimeouts ();
+  elapsed = tr_time_msec () - start;
+  if (verbose)
+    fprintf (stderr, "10000 ticks over %d idle sockets took %"PRIu64" msec\n", 2 * CONN_COUNT, elapsed);
+  check (all_parked ());
+
+  /* writing to a parked socket wakes it up */
+  conns[0].bytes_to_write = BYTES_PER_CONN;
+  UTP_Write (conns[0].sock, conns[0].bytes_to_write);
+  UTP_GetGlobalStats (&stats);
+  check_int_eq (2 * CONN_COUNT - 1, stats._nsockets_parked);
+  conns[CONN_COUNT].bytes_read = 0;
+  check (run_until (all_delivered, 5000));
+  check (run_until (all_parked, 5000));
+
+  /* close everything */
+  for (i = 0; i < 2 * CONN_COUNT; ++i)
+    if (conns[i].sock != NULL)
+      UTP_Close (conns[i].sock);
+  check (run_until (all_destroyed, 10000));
+
+  UTP_GetGlobalStats (&stats);
+  check_int_eq (0, stats._nsockets);
+  check_int_eq (0, stats._nsockets_parked);
+
+  tr_free (packets);
+  return 0;
+}
+
+#else
+
+static int
+test_utp_load (void)
+{
+  return 0;
+}
+
+#endif
+
+MAIN_SINGLE_TEST (test_utp_load)
@@ -113,17 +113,18 @@ tr_bencParseStr (const uint8_t  * buf,
 }
 
 static tr_variant*
-get_node (tr_ptrArray * stack, tr_quark * key, tr_variant * top, int * err)
+get_node (tr_ptrArray * stack, tr_quark * key, tr_variant * top, tr_variant ** setme_parent, int * err)
 {
   tr_variant * node = NULL;
 
   if (tr_ptrArrayEmpty (stack))
     {
       node = top;
+      *setme_parent = NULL;
     }
   else
     {
-      tr_variant * parent = tr_ptrArrayBack (stack);
+      tr_variant * parent = *setme_parent = tr_ptrArrayBack (stack);
 
       if (tr_variantIsList (parent))
         {
@@ -152,7 +153,8 @@ int
 tr_variantParseBenc (const void    * buf_in,
                      const void    * bufend_in,
                      tr_variant    * top,
-                     const char   ** setme_end)
+                     const char   ** setme_end,
+                     bool            in_place)
 {
   int err = 0;
   const uint8_t * buf = buf_in;
@@ -175,35 +177,42 @@ tr_variantParseBenc (const void    * buf_in,
           int64_t val;
           const uint8_t * end;
           tr_variant * v;
+          tr_variant * parent;
 
           if ((err = tr_bencParseInt (buf, bufend, &end, &val)))
             break;
           buf = end;
 
-          if ((v = get_node (&stack, &key, top, &err)))
+          if ((v = get_node (&stack, &key, top, &parent, &err)))
             tr_variantInitInt (v, val);
         }
       else if (*buf == 'l') /* list */
         {
           tr_variant * v;
+          tr_variant * parent;
 
           ++buf;
 
-          if ((v = get_node (&stack, &key, top, &err)))
+          if ((v = get_node (&stack, &key, top, &parent, &err)))
             {
-              tr_variantInitList (v, 0);
+              tr_variantInitContainerIn (v, TR_VARIANT_TYPE_LIST, parent);
+              if (in_place && (parent == NULL))
+                tr_variantAdoptBuf (v, (void*)buf_in, bufend - (const uint8_t*)buf_in);
               tr_ptrArrayAppend (&stack, v);
             }
         }
       else if (*buf == 'd') /* dict */
         {
           tr_variant * v;
+          tr_variant * parent;
 
           ++buf;
 
-          if ((v = get_node (&stack, &key, top, &err)))
+          if ((v = get_node (&stack, &key, top, &parent, &err)))
             {
-              tr_variantInitDict (v, 0);
+              tr_variantInitContainerIn (v, TR_VARIANT_TYPE_DICT, parent);
+              if (in_place && (parent == NULL))
+                tr_variantAdoptBuf (v, (void*)buf_in, bufend - (const uint8_t*)buf_in);
               tr_ptrArrayAppend (&stack, v);
             }
         }
@@ -226,6 +235,7 @@ tr_variantParseBenc (const void    * buf_in,
       else if (isdigit (*buf)) /* string? */
         {
           tr_variant * v;
+          tr_variant * parent;
           const uint8_t * end;
           const uint8_t * str;
           size_t str_len;
@@ -236,8 +246,8 @@ tr_variantParseBenc (const void    * buf_in,
 
           if (!key && !tr_ptrArrayEmpty(&stack) && tr_variantIsDict(tr_ptrArrayBack(&stack)))
             key = tr_quark_new (str, str_len);
-          else if ((v = get_node (&stack, &key, top, &err)))
-            tr_variantInitStr (v, str, str_len);
+          else if ((v = get_node (&stack, &key, top, &parent, &err)))
+            tr_variantInitStrIn (v, str, str_len, parent);
         }
       else /* invalid bencoded text... march past it */
         {
@@ -292,8 +302,8 @@ static void
 saveStringFunc (const tr_variant * v, void * evbuf)
 {
   size_t len;
-  const char * str;
-  tr_variantGetStr (v, &str, &len);
+  const uint8_t * str;
+  tr_variantGetRaw (v, &str, &len);
   evbuffer_add_printf (evbuf, "%"TR_PRIuSIZE":", len);
   evbuffer_add (evbuf, str, len);
 }
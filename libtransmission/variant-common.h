@@ -39,6 +39,19 @@ void tr_variantToBufBenc (const tr_variant * top, struct evbuffer * buf);
 
 void tr_variantInit (tr_variant * v, char type);
 
+/* For the parsers: start a list or dict allocated from `parent''s arena.
+   If `parent' is NULL, `v' is the top of the tree and gets a new arena. */
+void tr_variantInitContainerIn (tr_variant * v, char type, tr_variant * parent);
+
+/* For the parsers: give an empty container all of its children at once.
+   The children are copied, so `children' can be reused afterwards. */
+void tr_variantSetChildren (tr_variant * container, const tr_variant * children, size_t count);
+
+/* For the parsers: like tr_variantInitStr (), but long strings are
+   copied into `parent''s arena -- or, if they lie inside the buffer
+   that the tree adopted, point into it. `parent' may be NULL. */
+void tr_variantInitStrIn (tr_variant * v, const void * str, size_t len, tr_variant * parent);
+
 int tr_jsonParse (const char    * source, /* Such as a filename. Only when logging an error */
                   const void    * vbuf,
                   size_t          len,
@@ -58,10 +71,17 @@ int tr_bencParseStr (const uint8_t *  buf,
                      const uint8_t ** setme_str,
                      size_t *         setme_strlen);
 
+/* For the parsers: have the tree topped by `top' take over `buf', which
+   must come from tr_malloc (). It's freed along with the tree's arena. */
+void tr_variantAdoptBuf (tr_variant * top, void * buf, size_t buflen);
+
+/* If `in_place' is true, `buf' must come from tr_malloc () and the tree
+   adopts it when its top container is created; see tr_variantAdoptBuf () */
 int tr_variantParseBenc (const void     * buf,
                          const void     * end,
                          tr_variant     * top,
-                         const char ** setme_end);
+                         const char ** setme_end,
+                         bool             in_place);
 
 
 
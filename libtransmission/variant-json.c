@@ -11,141 +11,23 @@
 #include <ctype.h>
 #include <math.h> /* fabs() */
 #include <stdio.h>
+#include <stdint.h> /* uint64_t */
 #include <string.h>
+#include <stdlib.h> /* strtod () */
 #include <errno.h> /* EILSEQ, EINVAL */
 
 #include <event2/buffer.h> /* evbuffer_add() */
 #include <event2/util.h> /* evutil_strtoll () */
 
-#define JSONSL_STATE_USER_FIELDS /* no fields */
-#include "jsonsl.h"
-#include "jsonsl.c"
-
 #define __LIBTRANSMISSION_VARIANT_MODULE___
 #include "transmission.h"
 #include "ConvertUTF.h"
 #include "list.h"
 #include "log.h"
-#include "ptrarray.h"
 #include "utils.h"
 #include "variant.h"
 #include "variant-common.h"
 
-/* arbitrary value... this is much deeper than our code goes */
-#define MAX_DEPTH 64
-
-struct json_wrapper_data
-{
-  int error;
-  bool has_content;
-  tr_variant * top;
-  const char * key;
-  size_t keylen;
-  struct evbuffer * keybuf;
-  struct evbuffer * strbuf;
-  const char * source;
-  tr_ptrArray stack;
-};
-
-static tr_variant*
-get_node (struct jsonsl_st * jsn)
-{
-  tr_variant * parent;
-  tr_variant * node = NULL;
-  struct json_wrapper_data * data = jsn->data;
-
-  parent = tr_ptrArrayEmpty (&data->stack)
-         ? NULL
-         : tr_ptrArrayBack (&data->stack);
-
-  if (!parent)
-    {
-      node = data->top;
-    }
-  else if (tr_variantIsList (parent))
-    {
-      node = tr_variantListAdd (parent);
-    }
-  else if (tr_variantIsDict (parent) && (data->key!=NULL))
-    {
-      node = tr_variantDictAdd (parent, tr_quark_new (data->key, data->keylen));
-
-      data->key = NULL;
-      data->keylen = 0;
-    }
-
-  return node;
-}
-
-
-static void
-error_handler (jsonsl_t                  jsn,
-               jsonsl_error_t            error,
-               struct jsonsl_state_st  * state   UNUSED,
-               const jsonsl_char_t     * buf)
-{
-  struct json_wrapper_data * data = jsn->data;
-
-  if (data->source)
-    {
-      tr_logAddError ("JSON parse failed in %s at pos %"TR_PRIuSIZE": %s -- remaining text \"%.16s\"",
-              data->source,
-              jsn->pos,
-              jsonsl_strerror (error),
-              buf);
-    }
-  else
-    {
-      tr_logAddError ("JSON parse failed at pos %"TR_PRIuSIZE": %s -- remaining text \"%.16s\"",
-              jsn->pos,
-              jsonsl_strerror (error),
-              buf);
-    }
-
-  data->error = EILSEQ;
-}
-
-static int
-error_callback (jsonsl_t                  jsn,
-                jsonsl_error_t            error,
-                struct jsonsl_state_st  * state,
-                jsonsl_char_t           * at)
-{
-  error_handler (jsn, error, state, at);
-  return 0; /* bail */
-}
-
-static void
-action_callback_PUSH (jsonsl_t                  jsn,
-                      jsonsl_action_t           action  UNUSED,
-                      struct jsonsl_state_st  * state,
-                      const jsonsl_char_t     * buf     UNUSED)
-{
-  tr_variant * node;
-  struct json_wrapper_data * data = jsn->data;
-
-  switch (state->type)
-    {
-      case JSONSL_T_LIST:
-        data->has_content = true;
-        node = get_node (jsn);
-        tr_variantInitList (node, 0);
-        tr_ptrArrayAppend (&data->stack, node);
-        break;
-
-      case JSONSL_T_OBJECT:
-        data->has_content = true;
-        node = get_node (jsn);
-        tr_variantInitDict (node, 0);
-        tr_ptrArrayAppend (&data->stack, node);
-        break;
-
-      default:
-        /* nothing else interesting on push */
-        break;
-    }
-}
-
 /* like sscanf(in+2, "%4x", &val) but less slow */
 static bool
 decode_hex_string (const char * in, unsigned int * setme)
@@ -234,8 +116,12 @@ extract_escaped_string (const char       * in,
 
       if (!unescaped)
         {
-          evbuffer_add (buf, in, 1);
-          ++in;
+          /* copy everything up to the next backslash in one go */
+          const char * run_end = memchr (in + 1, '\\', in_end - in - 1);
+          if (run_end == NULL)
+            run_end = in_end;
+          evbuffer_add (buf, in, run_end - in);
+          in = run_end;
         }
     }
 
@@ -243,87 +129,565 @@ extract_escaped_string (const char       * in,
   return (char*) evbuffer_pullup (buf, -1);
 }
 
+/* arbitrary value... this is much deeper than our code goes */
+#define MAX_DEPTH 64
+
+/***
+****  Parsing
+****
+****  This works in two passes, like simdjson does. The first finds the
+****  offset of every "structural" character -- brackets, colons, commas,
+****  quotes, and the first character of each number or literal -- that
+****  isn't inside a string. It looks at 64 bytes at a time and finds the
+****  strings with bit arithmetic instead of a byte-by-byte state machine.
+****  The second walks those offsets and builds the tr_variant, so it
+****  never has to look at the bytes in between.
+***/
+
+/* what each byte is to the indexer */
+enum
+{
+  Q = 1, /* quote */
+  B = 2, /* backslash */
+  O = 4, /* operator: { } [ ] : , */
+  W = 8  /* whitespace */
+};
+
+static const uint8_t json_byte_class[256] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 0, W, W, 0, 0, W, 0, 0, /* 0x00 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x10 */
+  W, 0, Q, 0, 0, 0, 0, 0, 0, 0, 0, 0, O, 0, 0, 0, /* 0x20 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, O, 0, 0, 0, 0, 0, /* 0x30 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x40 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, O, B, O, 0, 0, /* 0x50 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x60 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, O, 0, O, 0, 0, /* 0x70 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x80 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x90 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xA0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xB0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xC0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xD0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xE0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0  /* 0xF0 */
+};
+
+#undef Q
+#undef B
+#undef O
+#undef W
+
+#define EVEN_BITS UINT64_C(0x5555555555555555)
+#define ODD_BITS  UINT64_C(0xAAAAAAAAAAAAAAAA)
+
+/* what the indexer carries from one 64-byte block to the next */
+struct json_index_state
+{
+  uint64_t prev_ends_odd_backslash; /* 1 if the last block ended in an unescaped '\' */
+  uint64_t prev_in_string;          /* all 1s if the last block ended inside a string */
+  uint64_t prev_ends_scalar_pred;   /* 1 if a scalar could start at this block's first byte */
+};
+
+static inline int
+lowest_bit (uint64_t bits)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll (bits);
+#else
+  int i = 0;
+  while (!(bits & 1))
+    {
+      bits >>= 1;
+      ++i;
+    }
+  return i;
+#endif
+}
+
+/* each bit i of the result is the XOR of bits 0..i of `bits' */
+static inline uint64_t
+prefix_xor (uint64_t bits)
+{
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+/* The characters escaped by an odd number of backslashes before them.
+   This is simdjson's find_odd_backslash_sequences (). */
+static inline uint64_t
+find_escaped (uint64_t backslashes, struct json_index_state * state)
+{
+  const uint64_t starts = backslashes & ~(backslashes << 1);
+  const uint64_t even_start_mask = EVEN_BITS ^ state->prev_ends_odd_backslash;
+  const uint64_t even_starts = starts & even_start_mask;
+  const uint64_t odd_starts = starts & ~even_start_mask;
+  const uint64_t even_carries = backslashes + even_starts;
+  uint64_t odd_carries = backslashes + odd_starts;
+  const bool ends_odd_backslash = odd_carries < backslashes; /* overflowed */
+  uint64_t even_carry_ends;
+  uint64_t odd_carry_ends;
+
+  odd_carries |= state->prev_ends_odd_backslash;
+  state->prev_ends_odd_backslash = ends_odd_backslash ? 1 : 0;
+  even_carry_ends = even_carries & ~backslashes;
+  odd_carry_ends = odd_carries & ~backslashes;
+
+  return (even_carry_ends & ODD_BITS) | (odd_carry_ends & EVEN_BITS);
+}
+
+static inline uint64_t
+load_le64 (const uint8_t * bytes)
+{
+  return (uint64_t)bytes[0]       | (uint64_t)bytes[1] << 8
+       | (uint64_t)bytes[2] << 16 | (uint64_t)bytes[3] << 24
+       | (uint64_t)bytes[4] << 32 | (uint64_t)bytes[5] << 40
+       | (uint64_t)bytes[6] << 48 | (uint64_t)bytes[7] << 56;
+}
+
+/* Bit i of the result is bit `bit' of the i'th byte in `word'.
+   The multiply moves each byte's bit into the top byte without overlap. */
+static inline uint64_t
+gather_bits (uint64_t word, int bit)
+{
+  return (((word >> bit) & UINT64_C(0x0101010101010101)) * UINT64_C(0x0102040810204080)) >> 56;
+}
+
+/* Returns a bitmask of the structural characters in a 64-byte block */
+static uint64_t
+index_block (const uint8_t * block, struct json_index_state * state)
+{
+  int i;
+  uint8_t classes[64];
+  uint64_t quotes = 0;
+  uint64_t backslashes = 0;
+  uint64_t ops = 0;
+  uint64_t whitespace = 0;
+  uint64_t in_string;
+  uint64_t structurals;
+  uint64_t scalar_pred;
+
+  for (i=0; i<64; ++i)
+    classes[i] = json_byte_class[block[i]];
+
+  for (i=0; i<64; i+=8)
+    {
+      const uint64_t word = load_le64 (classes + i);
+      quotes      |= gather_bits (word, 0) << i;
+      backslashes |= gather_bits (word, 1) << i;
+      ops         |= gather_bits (word, 2) << i;
+      whitespace  |= gather_bits (word, 3) << i;
+    }
+
+  if (backslashes || state->prev_ends_odd_backslash)
+    quotes &= ~find_escaped (backslashes, state);
+
+  /* the bits from each opening quote up to, but not including, its closing quote */
+  in_string = prefix_xor (quotes) ^ state->prev_in_string;
+  state->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+  /* a scalar starts at any other character that follows one of these */
+  structurals = (ops & ~in_string) | quotes;
+  scalar_pred = structurals | whitespace;
+  structurals |= ((scalar_pred << 1) | state->prev_ends_scalar_pred) & ~whitespace & ~in_string & ~quotes;
+  state->prev_ends_scalar_pred = scalar_pred >> 63;
+
+  return structurals;
+}
+
+/* Fills `setme' with the offset of every structural character in the buffer.
+   Returns false if a string was left open. */
+static bool
+json_index (const uint8_t * buf, size_t len, uint32_t ** setme, size_t * setme_count)
+{
+  size_t pos;
+  size_t n = 0;
+  size_t alloc = len / 8 + 64;
+  uint32_t * indices = tr_new (uint32_t, alloc);
+  struct json_index_state state;
+
+  memset (&state, 0, sizeof (state));
+  state.prev_ends_scalar_pred = 1;
+
+  for (pos=0; pos<len; pos+=64)
+    {
+      uint64_t structurals;
+      uint8_t tail[64];
+      const uint8_t * block = buf + pos;
+
+      /* pad the last block with whitespace */
+      if (len - pos < 64)
+        {
+          memset (tail, ' ', sizeof (tail));
+          memcpy (tail, block, len - pos);
+          block = tail;
+        }
+
+      structurals = index_block (block, &state);
+
+      if (n + 64 > alloc)
+        {
+          alloc *= 2;
+          indices = tr_renew (uint32_t, indices, alloc);
+        }
+
+      while (structurals)
+        {
+          indices[n++] = (uint32_t)(pos + lowest_bit (structurals));
+          structurals &= structurals - 1;
+        }
+    }
+
+  *setme = indices;
+  *setme_count = n;
+  return state.prev_in_string == 0;
+}
+
+struct json_parser
+{
+  const char * buf;
+  size_t len;
+  const uint32_t * indices;
+  size_t count;
+  size_t next;             /* indices[next] is the next token */
+  const char * source;
+  struct evbuffer * strbuf;
+  int error;
+  size_t error_pos;        /* where parsing stopped */
+
+  /* values waiting for their container to close */
+  tr_variant * vals;
+  size_t val_count;
+  size_t val_alloc;
+};
+
+/* a list or dict that hasn't closed yet */
+struct json_frame
+{
+  size_t first_val;        /* its first child in json_parser.vals */
+  char type;
+  tr_quark key;            /* its key in its parent, if that's a dict */
+};
+
+static void
+json_error (struct json_parser * p, size_t pos, const char * message)
+{
+  const size_t n = MIN (p->len - MIN (pos, p->len), 16);
+
+  if (p->source)
+    tr_logAddError ("JSON parse failed in %s at pos %"TR_PRIuSIZE": %s -- remaining text \"%.*s\"",
+                    p->source, pos, message, (int)n, p->buf + pos);
+  else
+    tr_logAddError ("JSON parse failed at pos %"TR_PRIuSIZE": %s -- remaining text \"%.*s\"",
+                    pos, message, (int)n, p->buf + pos);
+
+  p->error = EILSEQ;
+  p->error_pos = pos;
+}
+
+/* The string whose opening quote is at `pos'. Its closing quote is
+   the next token. Returns NULL if this isn't a string. */
 static const char *
-extract_string (jsonsl_t                  jsn,
-                struct jsonsl_state_st  * state,
-                size_t                  * len,
-                struct evbuffer         * buf)
-{
-  const char * ret;
-  const char * in_begin;
-  const char * in_end;
-  size_t in_len;
-
-  /* figure out where the string is */
-  in_begin = jsn->base + state->pos_begin;
-  if (*in_begin == '"')
-    in_begin++;
-  in_end = jsn->base + state->pos_cur;
-  in_len = in_end - in_begin;
-
-  if (memchr (in_begin, '\\', in_len) == NULL)
+json_string (struct json_parser * p, size_t pos, size_t * len)
+{
+  const char * begin;
+  size_t end;
+
+  if ((p->buf[pos] != '"') || (p->next >= p->count))
+    return NULL;
+
+  end = p->indices[p->next++];
+  assert (p->buf[end] == '"');
+  begin = p->buf + pos + 1;
+  *len = end - pos - 1;
+
+  /* most strings don't have escapes and can be used as they are */
+  if (memchr (begin, '\\', *len) != NULL)
+    begin = extract_escaped_string (begin, *len, len, p->strbuf);
+
+  return begin;
+}
+
+/* true, false, null, or a number */
+static bool
+json_scalar (struct json_parser * p, size_t pos, tr_variant * node)
+{
+  const char * begin = p->buf + pos;
+  const char * end = begin;
+  const char * const buf_end = p->buf + p->len;
+  const char * walk;
+  bool is_real = false;
+  size_t len;
+  char numbuf[64];
+  char * num;
+
+  while ((end != buf_end) && !json_byte_class[(uint8_t)*end])
+    ++end;
+
+  if ((end - begin == 4) && !memcmp (begin, "true", 4))
+    {
+      tr_variantInitBool (node, true);
+      return true;
+    }
+
+  if ((end - begin == 5) && !memcmp (begin, "false", 5))
+    {
+      tr_variantInitBool (node, false);
+      return true;
+    }
+
+  if ((end - begin == 4) && !memcmp (begin, "null", 4))
     {
-      /* it's not escaped */
-      ret = in_begin;
-      *len = in_len;
+      tr_variantInitQuark (node, TR_KEY_NONE);
+      return true;
     }
+
+  /* -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][-+]?[0-9]+)? */
+  walk = begin;
+  if ((walk != end) && (*walk == '-'))
+    ++walk;
+  if ((walk == end) || !isdigit ((unsigned char)*walk))
+    return false;
+  if (*walk == '0')
+    ++walk;
   else
+    while ((walk != end) && isdigit ((unsigned char)*walk))
+      ++walk;
+  if ((walk != end) && (*walk == '.'))
     {
-      ret = extract_escaped_string (in_begin, in_len, len, buf);
+      is_real = true;
+      if ((++walk == end) || !isdigit ((unsigned char)*walk))
+        return false;
+      while ((walk != end) && isdigit ((unsigned char)*walk))
+        ++walk;
+    }
+  if ((walk != end) && ((*walk == 'e') || (*walk == 'E')))
+    {
+      is_real = true;
+      if ((++walk != end) && ((*walk == '-') || (*walk == '+')))
+        ++walk;
+      if ((walk == end) || !isdigit ((unsigned char)*walk))
+        return false;
+      while ((walk != end) && isdigit ((unsigned char)*walk))
+        ++walk;
     }
+  if (walk != end)
+    return false;
+
+  /* the input isn't NUL-terminated, so the conversions get a copy */
+  len = end - begin;
+  num = len < sizeof (numbuf) ? numbuf : tr_new (char, len + 1);
+  memcpy (num, begin, len);
+  num[len] = '\0';
 
-  return ret;
+  if (is_real)
+    tr_variantInitReal (node, strtod (num, NULL));
+  else
+    tr_variantInitInt (node, evutil_strtoll (num, NULL, 10));
+
+  if (num != numbuf)
+    tr_free (num);
+
+  return true;
+}
+
+static tr_variant *
+json_push (struct json_parser * p, tr_quark key)
+{
+  tr_variant * v;
+
+  if (p->val_count == p->val_alloc)
+    {
+      p->val_alloc = p->val_alloc ? p->val_alloc * 2 : 64;
+      p->vals = tr_renew (tr_variant, p->vals, p->val_alloc);
+    }
+
+  v = &p->vals[p->val_count++];
+  v->key = key;
+  return v;
 }
 
+/* Containers are built from the bottom up. Each value is pushed onto
+   `p->vals' until its container closes, which then takes all of its
+   children in one allocation instead of growing as they arrive. */
 static void
-action_callback_POP (jsonsl_t                  jsn,
-                     jsonsl_action_t           action  UNUSED,
-                     struct jsonsl_state_st  * state,
-                     const jsonsl_char_t     * buf     UNUSED)
+json_close (struct json_parser * p, const struct json_frame * frame, tr_variant * top, bool is_top)
 {
-  struct json_wrapper_data * data = jsn->data;
+  tr_variant * children = p->vals + frame->first_val;
+  const size_t n = p->val_count - frame->first_val;
 
-  if (state->type == JSONSL_T_STRING)
+  if (is_top)
     {
-      size_t len;
-      const char * str = extract_string (jsn, state, &len, data->strbuf);
-      tr_variantInitStr (get_node (jsn), str, len);
-      data->has_content = true;
+      tr_variantSetChildren (top, children, n);
+      p->val_count = frame->first_val;
     }
-  else if (state->type == JSONSL_T_HKEY)
+  else
     {
-      data->has_content = true;
-      data->key = extract_string (jsn, state, &data->keylen, data->keybuf);
+      tr_variant * node;
+      tr_variant v;
+
+      tr_variantInitContainerIn (&v, frame->type, top);
+      tr_variantSetChildren (&v, children, n);
+      p->val_count = frame->first_val;
+
+      node = json_push (p, frame->key);
+      node->type = v.type;
+      node->val = v.val;
     }
-  else if ((state->type == JSONSL_T_LIST) || (state->type == JSONSL_T_OBJECT))
+}
+
+static void
+json_parse (struct json_parser * p, tr_variant * top)
+{
+  struct json_frame stack[MAX_DEPTH];
+  size_t depth = 0;
+  tr_quark key = 0;
+  size_t pos = 0;
+
+  if (p->count == 0)
     {
-      tr_ptrArrayPop (&data->stack);
+      p->error = EINVAL; /* no content */
+      return;
     }
-  else if (state->type == JSONSL_T_SPECIAL)
+
+  for (;;)
     {
-      if (state->special_flags & JSONSL_SPECIALf_NUMNOINT)
+      /* a value */
+      char c;
+      pos = p->indices[p->next++];
+      c = p->buf[pos];
+
+      if ((c == '{') || (c == '['))
         {
-          const char * begin = jsn->base + state->pos_begin;
-          data->has_content = true;
-          tr_variantInitReal (get_node (jsn), strtod (begin, NULL));
+          const char type = c == '{' ? TR_VARIANT_TYPE_DICT : TR_VARIANT_TYPE_LIST;
+
+          if (depth == MAX_DEPTH)
+            {
+              json_error (p, pos, "too deeply nested");
+              break;
+            }
+
+          if (depth == 0)
+            tr_variantInitContainerIn (top, type, NULL);
+
+          stack[depth].first_val = p->val_count;
+          stack[depth].type = type;
+          stack[depth].key = key;
+          ++depth;
+
+          if (p->next == p->count)
+            {
+              json_error (p, p->len, "unterminated container");
+              break;
+            }
+
+          /* an empty container? */
+          if (p->buf[p->indices[p->next]] == (c == '{' ? '}' : ']'))
+            {
+              pos = p->indices[p->next++];
+              --depth;
+              json_close (p, &stack[depth], top, depth == 0);
+            }
+          else if (c == '{')
+            {
+              goto key;
+            }
+          else
+            {
+              key = 0;
+              continue;
+            }
         }
-      else if (state->special_flags & JSONSL_SPECIALf_NUMERIC)
+      else if (depth == 0)
         {
-          const char * begin = jsn->base + state->pos_begin;
-          data->has_content = true;
-          tr_variantInitInt (get_node (jsn), evutil_strtoll (begin, NULL, 10));
+          json_error (p, pos, "expected an object or an array");
+          break;
         }
-      else if (state->special_flags & JSONSL_SPECIALf_BOOLEAN)
+      else if (c == '"')
         {
-          const bool b = (state->special_flags & JSONSL_SPECIALf_TRUE) != 0;
-          data->has_content = true;
-          tr_variantInitBool (get_node (jsn), b);
+          size_t len;
+          const char * str = json_string (p, pos, &len);
+          tr_variantInitStrIn (json_push (p, key), str, len, top);
         }
-      else if (state->special_flags & JSONSL_SPECIALf_NULL)
+      else if (!json_scalar (p, pos, json_push (p, key)))
         {
-          data->has_content = true;
-          tr_variantInitQuark (get_node (jsn), TR_KEY_NONE);
+          --p->val_count;
+          json_error (p, pos, "unexpected token");
+          break;
         }
+
+      /* after a value: a comma, or the end of its container */
+      for (;;)
+        {
+          if (depth == 0)
+            {
+              if (p->next != p->count)
+                {
+                  pos = p->indices[p->next];
+                  json_error (p, pos, "unexpected text after the top-level value");
+                }
+              return;
+            }
+
+          if (p->next == p->count)
+            {
+              json_error (p, p->len, "unterminated container");
+              return;
+            }
+
+          pos = p->indices[p->next++];
+          c = p->buf[pos];
+
+          if (c != (stack[depth-1].type == TR_VARIANT_TYPE_DICT ? '}' : ']'))
+            break;
+
+          --depth;
+          json_close (p, &stack[depth], top, depth == 0);
+        }
+
+      if (c != ',')
+        {
+          json_error (p, pos, "expected a comma");
+          break;
+        }
+
+      if (p->next == p->count)
+        {
+          json_error (p, pos, "trailing comma");
+          break;
+        }
+
+      if (stack[depth-1].type != TR_VARIANT_TYPE_DICT)
+        {
+          key = 0;
+          continue;
+        }
+
+    key:
+      {
+        size_t len;
+        const char * str;
+
+        pos = p->indices[p->next++];
+        if ((str = json_string (p, pos, &len)) == NULL)
+          {
+            json_error (p, pos, "expected a key");
+            break;
+          }
+        key = tr_quark_new (str, len);
+
+        if ((p->next + 1 >= p->count) || (p->buf[p->indices[p->next]] != ':'))
+          {
+            json_error (p, p->next < p->count ? p->indices[p->next] : p->len, "expected a colon");
+            break;
+          }
+        ++p->next;
+      }
     }
 }
 
@@ -334,44 +698,45 @@ tr_jsonParse (const char     * source,
               tr_variant     * setme_variant,
               const char    ** setme_end)
 {
-  int error;
-  jsonsl_t jsn;
-  struct json_wrapper_data data;
-
-  jsn = jsonsl_new (MAX_DEPTH);
-  jsn->action_callback_PUSH = action_callback_PUSH;
-  jsn->action_callback_POP = action_callback_POP;
-  jsn->error_callback = error_callback;
-  jsn->data = &data;
-  jsonsl_enable_all_callbacks (jsn);
-
-  data.error = 0;
-  data.has_content = false;
-  data.key = NULL;
-  data.top = setme_variant;
-  data.stack = TR_PTR_ARRAY_INIT;
-  data.source = source;
-  data.keybuf = evbuffer_new ();
-  data.strbuf = evbuffer_new ();
-
-  /* parse it */
-  jsonsl_feed (jsn, vbuf, len);
-
-  /* EINVAL if there was no content */
-  if (!data.error && !data.has_content)
-    data.error = EINVAL;
-
-  /* maybe set the end ptr */
-  if (setme_end)
-    *setme_end = ((const char*)vbuf) + jsn->pos;
-
-  /* cleanup */
-  error = data.error;
-  evbuffer_free (data.keybuf);
-  evbuffer_free (data.strbuf);
-  tr_ptrArrayDestruct (&data.stack, NULL);
-  jsonsl_destroy (jsn);
-  return error;
+  struct json_parser p;
+  uint32_t * indices;
+  size_t count;
+
+  memset (&p, 0, sizeof (p));
+  p.buf = vbuf;
+  p.len = len;
+  p.source = source;
+  p.error_pos = len;
+
+  if (len >= UINT32_MAX)
+    {
+      json_error (&p, 0, "too large");
+      return p.error;
+    }
+
+  if (!json_index (vbuf, len, &indices, &count))
+    {
+      json_error (&p, count ? indices[count-1] : 0, "unterminated string");
+    }
+  else
+    {
+      p.indices = indices;
+      p.count = count;
+      p.strbuf = evbuffer_new ();
+      json_parse (&p, setme_variant);
+      evbuffer_free (p.strbuf);
+
+      /* if parsing failed, free the values that didn't make it into the tree */
+      while (p.val_count > 0)
+        tr_variantFree (&p.vals[--p.val_count]);
+      tr_free (p.vals);
+    }
+
+  if (setme_end != NULL)
+    *setme_end = p.buf + p.error_pos;
+
+  tr_free (indices);
+  return p.error;
 }
 
 /****
@@ -474,64 +839,30 @@ jsonPopParent (struct jsonWalk * data)
 }
 
 static void
-jsonIntFunc (const tr_variant * val, void * vdata)
-{
-  struct jsonWalk * data = vdata;
-  evbuffer_add_printf (data->out, "%" PRId64, val->val.i);
-  jsonChildFunc (data);
-}
-
-static void
-jsonBoolFunc (const tr_variant * val,
-              void             * vdata)
+jsonWriteReal (struct evbuffer * out, double d)
 {
-  struct jsonWalk * data = vdata;
-
-  if (val->val.b)
-    evbuffer_add (data->out, "true", 4);
+  if (fabs (d - (int)d) < 0.00001)
+    evbuffer_add_printf (out, "%d", (int)d);
   else
-    evbuffer_add (data->out, "false", 5);
-
-  jsonChildFunc (data);
+    evbuffer_add_printf (out, "%.4f", tr_truncd (d, 4));
 }
 
 static void
-jsonRealFunc (const tr_variant * val,
-              void             * vdata)
+jsonWriteString (struct evbuffer * out, const char * str, size_t len)
 {
-  struct jsonWalk * data = vdata;
-
-  if (fabs (val->val.d - (int)val->val.d) < 0.00001)
-    evbuffer_add_printf (data->out, "%d", (int)val->val.d);
-  else
-    evbuffer_add_printf (data->out, "%.4f", tr_truncd (val->val.d, 4));
-
-  jsonChildFunc (data);
-}
-
-static void
-jsonStringFunc (const tr_variant * val,
-                void             * vdata)
-{
-  char * out;
+  char * outbuf;
   char * outwalk;
   char * outend;
   struct evbuffer_iovec vec[1];
-  struct jsonWalk * data = vdata;
-  const char * str;
-  size_t len;
-  const unsigned char * it;
-  const unsigned char * end;
-
-  tr_variantGetStr (val, &str, &len);
-  it = (const unsigned char *) str;
-  end = it + len;
+  const unsigned char * it = (const unsigned char *) str;
+  const unsigned char * end = it + len;
 
-  evbuffer_reserve_space (data->out, len * 4, vec, 1);
-  out = vec[0].iov_base;
-  outend = out + vec[0].iov_len;
+  /* worst case is a \uXXXXX escape for each 4-byte UTF-8 sequence */
+  evbuffer_reserve_space (out, len * 4 + 2, vec, 1);
+  outbuf = vec[0].iov_base;
+  outend = outbuf + vec[0].iov_len;
 
-  outwalk = out;
+  outwalk = outbuf;
   *outwalk++ = '"';
 
   for (; it!=end; ++it)
@@ -568,8 +899,53 @@ jsonStringFunc (const tr_variant * val,
     }
 
   *outwalk++ = '"';
-  vec[0].iov_len = outwalk - out;
-  evbuffer_commit_space (data->out, vec, 1);
+  vec[0].iov_len = outwalk - outbuf;
+  evbuffer_commit_space (out, vec, 1);
+}
+
+static void
+jsonIntFunc (const tr_variant * val, void * vdata)
+{
+  struct jsonWalk * data = vdata;
+  evbuffer_add_printf (data->out, "%" PRId64, val->val.i);
+  jsonChildFunc (data);
+}
+
+static void
+jsonBoolFunc (const tr_variant * val,
+              void             * vdata)
+{
+  struct jsonWalk * data = vdata;
+
+  if (val->val.b)
+    evbuffer_add (data->out, "true", 4);
+  else
+    evbuffer_add (data->out, "false", 5);
+
+  jsonChildFunc (data);
+}
+
+static void
+jsonRealFunc (const tr_variant * val,
+              void             * vdata)
+{
+  struct jsonWalk * data = vdata;
+
+  jsonWriteReal (data->out, val->val.d);
+
+  jsonChildFunc (data);
+}
+
+static void
+jsonStringFunc (const tr_variant * val,
+                void             * vdata)
+{
+  const char * str;
+  size_t len;
+  struct jsonWalk * data = vdata;
+
+  tr_variantGetStr (val, &str, &len);
+  jsonWriteString (data->out, str, len);
 
   jsonChildFunc (data);
 }
@@ -640,3 +1016,167 @@ tr_variantToBufJson (const tr_variant * top, struct evbuffer * buf, bool lean)
   if (evbuffer_get_length (buf))
     evbuffer_add_printf (buf, "\n");
 }
+
+/***
+****  Streaming writer
+***/
+
+void
+tr_jsonWriterInit (tr_json_writer * w, struct evbuffer * out)
+{
+  w->out = out;
+  w->depth = 0;
+  w->need_comma = false;
+}
+
+/* called before each key or value */
+static void
+jsonWriterSeparate (tr_json_writer * w)
+{
+  if (w->need_comma)
+    evbuffer_add (w->out, ",", 1);
+}
+
+static void
+jsonWriterBegin (tr_json_writer * w, char ch)
+{
+  assert (w->depth < MAX_DEPTH);
+
+  jsonWriterSeparate (w);
+  evbuffer_add (w->out, &ch, 1);
+  w->need_comma = false;
+  ++w->depth;
+}
+
+static void
+jsonWriterEnd (tr_json_writer * w, char ch)
+{
+  assert (w->depth > 0);
+
+  evbuffer_add (w->out, &ch, 1);
+  w->need_comma = true;
+  --w->depth;
+}
+
+void
+tr_jsonWriterDictBegin (tr_json_writer * w)
+{
+  jsonWriterBegin (w, '{');
+}
+
+void
+tr_jsonWriterDictEnd (tr_json_writer * w)
+{
+  jsonWriterEnd (w, '}');
+}
+
+void
+tr_jsonWriterListBegin (tr_json_writer * w)
+{
+  jsonWriterBegin (w, '[');
+}
+
+void
+tr_jsonWriterListEnd (tr_json_writer * w)
+{
+  jsonWriterEnd (w, ']');
+}
+
+void
+tr_jsonWriterKey (tr_json_writer * w, const tr_quark key)
+{
+  size_t len;
+  const char * str = tr_quark_get_string (key, &len);
+
+  jsonWriterSeparate (w);
+  jsonWriteString (w->out, str, len);
+  evbuffer_add (w->out, ":", 1);
+  w->need_comma = false;
+}
+
+void
+tr_jsonWriterInt (tr_json_writer * w, int64_t value)
+{
+  jsonWriterSeparate (w);
+  evbuffer_add_printf (w->out, "%" PRId64, value);
+  w->need_comma = true;
+}
+
+void
+tr_jsonWriterReal (tr_json_writer * w, double value)
+{
+  jsonWriterSeparate (w);
+  jsonWriteReal (w->out, value);
+  w->need_comma = true;
+}
+
+void
+tr_jsonWriterBool (tr_json_writer * w, bool value)
+{
+  jsonWriterSeparate (w);
+  if (value)
+    evbuffer_add (w->out, "true", 4);
+  else
+    evbuffer_add (w->out, "false", 5);
+  w->need_comma = true;
+}
+
+void
+tr_jsonWriterStr (tr_json_writer * w, const char * value)
+{
+  jsonWriterSeparate (w);
+  if (value == NULL)
+    value = "";
+  jsonWriteString (w->out, value, strlen (value));
+  w->need_comma = true;
+}
+
+void
+tr_jsonWriterRaw (tr_json_writer * w, struct evbuffer * json)
+{
+  jsonWriterSeparate (w);
+  evbuffer_add_buffer (w->out, json);
+  w->need_comma = true;
+}
+
+void
+tr_jsonWriterDictAddInt (tr_json_writer * w, const tr_quark key, int64_t value)
+{
+  tr_jsonWriterKey (w, key);
+  tr_jsonWriterInt (w, value);
+}
+
+void
+tr_jsonWriterDictAddReal (tr_json_writer * w, const tr_quark key, double value)
+{
+  tr_jsonWriterKey (w, key);
+  tr_jsonWriterReal (w, value);
+}
+
+void
+tr_jsonWriterDictAddBool (tr_json_writer * w, const tr_quark key, bool value)
+{
+  tr_jsonWriterKey (w, key);
+  tr_jsonWriterBool (w, value);
+}
+
+void
+tr_jsonWriterDictAddStr (tr_json_writer * w, const tr_quark key, const char * value)
+{
+  tr_jsonWriterKey (w, key);
+  tr_jsonWriterStr (w, value);
+}
+
+void
+tr_jsonWriterDictAddDict (tr_json_writer * w, const tr_quark key)
+{
+  tr_jsonWriterKey (w, key);
+  tr_jsonWriterDictBegin (w);
+}
+
+void
+tr_jsonWriterDictAddList (tr_json_writer * w, const tr_quark key)
+{
+  tr_jsonWriterKey (w, key);
+  tr_jsonWriterListBegin (w);
+}
@@ -536,6 +536,143 @@ testParse2 (void)
   return 0;
 }
 
+static int
+testArena (void)
+{
+  int i;
+  int len;
+  char * str;
+  int64_t intVal;
+  tr_variant top;
+  tr_variant tmp;
+  tr_variant * list;
+  tr_variant * dict;
+  const char * strVal;
+  const char * in = "{\"a-long-string-key\":\"a string that won't fit inline\","
+                    "\"list\":[1,2,{\"nested\":\"another string too long to inline\"}],"
+                    "\"short\":\"abc\"}";
+  const tr_quark key_long = tr_quark_new ("a-long-string-key", -1);
+  const tr_quark key_list = tr_quark_new ("list", -1);
+  const tr_quark key_nested = tr_quark_new ("nested", -1);
+  const tr_quark key_short = tr_quark_new ("short", -1);
+  const tr_quark key_added = tr_quark_new ("added", -1);
+
+  /* parsed trees are built in an arena */
+  check (!tr_variantFromJson (&top, in, strlen (in)));
+  check (top.val.l.owns_arena);
+  check (top.val.l.arena != NULL);
+  check (tr_variantDictFindList (&top, key_list, &list));
+  check (list->val.l.arena == top.val.l.arena);
+  check (!list->val.l.owns_arena);
+  check (tr_variantDictFindStr (&top, key_long, &strVal, NULL));
+  check_streq ("a string that won't fit inline", strVal);
+
+  /* ...but can still be changed afterwards, with a mix of arena and heap */
+  for (i=0; i<100; ++i)
+    tr_variantListAddStr (list, "growing the list past its first allocation");
+  tr_variantInitStr (tr_variantListAdd (list), "a string from the heap, not the arena", -1);
+  dict = tr_variantListChild (list, 2);
+  check (tr_variantDictFindStr (dict, key_nested, &strVal, NULL));
+  check_streq ("another string too long to inline", strVal);
+  tr_variantDictAddStr (dict, key_nested, "replaced with yet another long string");
+  tr_variantInitDict (&tmp, 1);
+  tr_variantDictAddStr (&tmp, key_added, "merged in from a heap dict");
+  tr_variantMergeDicts (&top, &tmp);
+  tr_variantFree (&tmp);
+  check (tr_variantDictRemove (&top, key_short));
+  check (tr_variantListRemove (list, 0));
+
+  check_int_eq (103, tr_variantListSize (list));
+  check (tr_variantDictFindStr (tr_variantListChild (list, 1), key_nested, &strVal, NULL));
+  check_streq ("replaced with yet another long string", strVal);
+  check (tr_variantGetStr (tr_variantListChild (list, 102), &strVal, NULL));
+  check_streq ("a string from the heap, not the arena", strVal);
+  check (tr_variantDictFindStr (&top, key_added, &strVal, NULL));
+  check_streq ("merged in from a heap dict", strVal);
+  check (tr_variantDictFind (&top, key_short) == NULL);
+
+  /* a round trip gives back the same tree */
+  str = tr_variantToStr (&top, TR_VARIANT_FMT_BENC, &len);
+  tr_variantFree (&top);
+  check (!tr_variantFromBenc (&top, str, len));
+  check (top.val.l.owns_arena);
+  check (tr_variantDictFindList (&top, key_list, &list));
+  check_int_eq (103, tr_variantListSize (list));
+  check (tr_variantGetStr (tr_variantListChild (list, 50), &strVal, NULL));
+  check_streq ("growing the list past its first allocation", strVal);
+  tr_variantFree (&top);
+  tr_free (str);
+
+  /* trees that are built, rather than parsed, can use an arena too */
+  tr_variantInitArenaDict (&top, 0);
+  list = tr_variantDictAddList (&top, key_list, 0);
+  check (list->val.l.arena == top.val.l.arena);
+  for (i=0; i<1000; ++i)
+    tr_variantDictAddInt (tr_variantListAddDict (list, 1), key_added, i);
+  check_int_eq (1000, tr_variantListSize (list));
+  check (tr_variantDictFindInt (tr_variantListChild (list, 999), key_added, &intVal));
+  check_int_eq (999, intVal);
+  tr_variantFree (&top);
+
+  return 0;
+}
+
+static int
+testInPlace (void)
+{
+  int len;
+  char * buf;
+  char * str;
+  size_t rawLen;
+  const uint8_t * raw;
+  const char * strVal;
+  tr_variant top;
+  tr_variant * list;
+  const char * in = "d6:binary32:0123456789abcdef0123456789abcdef"
+                    "4:listl27:a string too long to inlinei7ee"
+                    "5:short3:abce";
+  const tr_quark key_binary = tr_quark_new ("binary", -1);
+  const tr_quark key_list = tr_quark_new ("list", -1);
+  const tr_quark key_short = tr_quark_new ("short", -1);
+
+  /* long strings point into the buffer, which the tree takes over */
+  buf = tr_strdup (in);
+  check (!tr_variantFromBencInPlace (&top, buf, strlen (in)));
+  check (tr_variantDictFindRaw (&top, key_binary, &raw, &rawLen));
+  check_int_eq (32, rawLen);
+  check ((const char*)raw == buf + 12);
+  check (tr_variantDictFindStr (&top, key_short, &strVal, NULL));
+  check_streq ("abc", strVal);
+
+  /* asking for a zero-terminated string makes a copy */
+  check (tr_variantDictFindList (&top, key_list, &list));
+  check (tr_variantGetRaw (tr_variantListChild (list, 0), &raw, &rawLen));
+  check ((const char*)raw > buf && (const char*)raw < buf + strlen (in));
+  check (tr_variantGetStr (tr_variantListChild (list, 0), &strVal, NULL));
+  check_streq ("a string too long to inline", strVal);
+  check (strVal != (const char*)raw);
+
+  /* the tree can be changed and saved as usual */
+  tr_variantDictAddStr (&top, key_short, "replaced with a string from the heap");
+  str = tr_variantToStr (&top, TR_VARIANT_FMT_BENC, &len);
+  check_streq ("d6:binary32:0123456789abcdef0123456789abcdef"
+               "4:listl27:a string too long to inlinei7ee"
+               "5:short36:replaced with a string from the heape", str);
+  tr_free (str);
+  tr_variantFree (&top);
+
+  /* the buffer's freed on error, or when there's no container to keep it */
+  buf = tr_strdup ("d3:keyi1e");
+  check (tr_variantFromBencInPlace (&top, buf, strlen (buf)));
+  buf = tr_strdup ("32:0123456789abcdef0123456789abcdef");
+  check (!tr_variantFromBencInPlace (&top, buf, strlen (buf)));
+  check (tr_variantGetStr (&top, &strVal, NULL));
+  check_streq ("0123456789abcdef0123456789abcdef", strVal);
+  tr_variantFree (&top);
+
+  return 0;
+}
+
 int
 main (void)
 {
@@ -546,6 +683,8 @@ main (void)
                                     testMerge,
                                     testBool,
                                     testParse2,
+                                    testArena,
+                                    testInPlace,
                                     testStackSmash };
   return runTests (tests, NUM_TESTS (tests));
 }
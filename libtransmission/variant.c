@@ -44,16 +44,6 @@ tr_variantIsContainer (const tr_variant * v)
   return tr_variantIsList (v) || tr_variantIsDict (v);
 }
 
-static bool
-tr_variantIsSomething (const tr_variant * v)
-{
-  return tr_variantIsContainer (v)
-      || tr_variantIsInt (v)
-      || tr_variantIsString (v)
-      || tr_variantIsReal (v)
-      || tr_variantIsBool (v);
-}
-
 void
 tr_variantInit (tr_variant * v, char type)
 {
@@ -61,6 +51,137 @@ tr_variantInit (tr_variant * v, char type)
   memset (&v->val, 0, sizeof(v->val));
 }
 
+/***
+****  Arenas
+****
+****  A parsed tree, or one started by tr_variantInitArenaDict (), takes
+****  its containers' children and its long strings from an arena: a few
+****  big blocks that are handed out front to back and freed together,
+****  rather than one malloc () and free () apiece. Every container in
+****  the tree points to the arena, and the top one owns it.
+***/
+
+#define ARENA_ALIGN 8
+#define ARENA_FIRST_BLOCK_SIZE (4 * 1024)
+#define ARENA_MAX_BLOCK_SIZE (1024 * 1024)
+
+/* past this, a container's children move to the heap, where growing
+   them doesn't leave the old copies behind as dead space in the arena */
+#define ARENA_MAX_VALS_SIZE (64 * 1024)
+
+struct arena_block
+{
+  struct arena_block * next;
+  size_t size;
+};
+
+struct tr_variant_arena
+{
+  struct arena_block * blocks; /* newest first */
+  char * pos;
+  char * end;
+  size_t next_block_size;
+
+  /* the buffer the tree was parsed from, if it adopted it.
+     TR_STRING_TYPE_VIEW strings point into this. */
+  char * source;
+  size_t source_len;
+};
+
+static size_t
+arenaRound (size_t size)
+{
+  return (size + (ARENA_ALIGN-1)) & ~(size_t)(ARENA_ALIGN-1);
+}
+
+static void
+arenaAddBlock (struct tr_variant_arena * arena, size_t size)
+{
+  struct arena_block * block;
+
+  size = MAX (size, arena->next_block_size);
+  block = tr_malloc (sizeof (struct arena_block) + size);
+  block->next = arena->blocks;
+  block->size = size;
+  arena->blocks = block;
+  arena->pos = (char*)(block + 1);
+  arena->end = arena->pos + size;
+
+  if (arena->next_block_size < ARENA_MAX_BLOCK_SIZE)
+    arena->next_block_size *= 2;
+}
+
+static struct tr_variant_arena *
+arenaNew (void)
+{
+  struct tr_variant_arena tmp;
+  struct tr_variant_arena * arena;
+
+  /* the arena keeps its own bookkeeping in its first block */
+  memset (&tmp, 0, sizeof (tmp));
+  tmp.next_block_size = ARENA_FIRST_BLOCK_SIZE;
+  arenaAddBlock (&tmp, 0);
+  arena = (struct tr_variant_arena*) tmp.pos;
+  *arena = tmp;
+  arena->pos += arenaRound (sizeof (struct tr_variant_arena));
+  return arena;
+}
+
+static void
+arenaFree (struct tr_variant_arena * arena)
+{
+  struct arena_block * block = arena->blocks;
+
+  tr_free (arena->source);
+
+  while (block != NULL)
+    {
+      struct arena_block * next = block->next;
+      tr_free (block);
+      block = next;
+    }
+}
+
+static void *
+arenaAlloc (struct tr_variant_arena * arena, size_t size)
+{
+  void * ret;
+
+  size = arenaRound (size);
+  if (size > (size_t)(arena->end - arena->pos))
+    arenaAddBlock (arena, size);
+
+  ret = arena->pos;
+  arena->pos += size;
+  return ret;
+}
+
+/* Grow an allocation, in place if it's the newest one in the block */
+static void *
+arenaRealloc (struct tr_variant_arena * arena,
+              void                    * ptr,
+              size_t                    old_size,
+              size_t                    new_size)
+{
+  char * p = ptr;
+
+  old_size = arenaRound (old_size);
+  new_size = arenaRound (new_size);
+
+  if ((p != NULL) && (p + old_size == arena->pos) && (new_size - old_size <= (size_t)(arena->end - arena->pos)))
+    {
+      arena->pos = p + new_size;
+    }
+  else
+    {
+      p = arenaAlloc (arena, new_size);
+      if (old_size > 0)
+        memcpy (p, ptr, old_size);
+    }
+
+  return p;
+}
+
 /***
 ****
 ***/
@@ -79,6 +200,8 @@ tr_variant_string_clear (struct tr_variant_string * str)
   if (str->type == TR_STRING_TYPE_HEAP)
     tr_free ((char*)(str->str.str));
 
+  /* TR_STRING_TYPE_ARENA and TR_STRING_TYPE_VIEW are freed along with the arena */
+
   *str = STRING_INIT;
 }
 
@@ -92,6 +215,8 @@ tr_variant_string_get_string (const struct tr_variant_string * str)
     {
       case TR_STRING_TYPE_BUF: ret = str->str.buf; break;
       case TR_STRING_TYPE_HEAP: ret = str->str.str; break;
+      case TR_STRING_TYPE_ARENA: ret = str->str.str; break;
+      case TR_STRING_TYPE_VIEW: ret = str->str.str; break;
       case TR_STRING_TYPE_QUARK: ret = str->str.str; break;
       default: ret = NULL;
     }
@@ -113,7 +238,8 @@ tr_variant_string_set_quark (struct tr_variant_string  * str,
 static void
 tr_variant_string_set_string (struct tr_variant_string  * str,
                               const char                * bytes,
-                              int                         len)
+                              int                         len,
+                              struct tr_variant_arena   * arena)
 {
   tr_variant_string_clear (str);
 
@@ -122,7 +248,16 @@ tr_variant_string_set_string (struct tr_variant_string  * str,
   else if (len < 0)
     len = strlen (bytes);
 
-  if ((size_t)len < sizeof(str->str.buf))
+  if ((arena != NULL) && (arena->source != NULL)
+      && ((size_t)len >= sizeof(str->str.buf))
+      && (bytes >= arena->source)
+      && ((size_t)(bytes - arena->source) + len <= arena->source_len))
+    {
+      str->type = TR_STRING_TYPE_VIEW;
+      str->str.str = bytes;
+      str->len = len;
+    }
+  else if ((size_t)len < sizeof(str->str.buf))
     {
       str->type = TR_STRING_TYPE_BUF;
       memcpy (str->str.buf, bytes, len);
@@ -131,10 +266,10 @@ tr_variant_string_set_string (struct tr_variant_string  * str,
     }
   else
     {
-      char * tmp = tr_new (char, len+1);
+      char * tmp = arena ? arenaAlloc (arena, len+1) : tr_new (char, len+1);
       memcpy (tmp, bytes, len);
       tmp[len] = '\0';
-      str->type = TR_STRING_TYPE_HEAP;
+      str->type = arena ? TR_STRING_TYPE_ARENA : TR_STRING_TYPE_HEAP;
       str->str.str = tmp;
       str->len = len;
     }
@@ -150,6 +285,14 @@ getStr (const tr_variant * v)
 {
   assert (tr_variantIsString (v));
 
+  /* views aren't zero-terminated, so callers who need
+     that get a copy that replaces the view */
+  if (v->val.s.type == TR_STRING_TYPE_VIEW)
+    {
+      struct tr_variant_string * s = (struct tr_variant_string *) &v->val.s;
+      tr_variant_string_set_string (s, s->str.str, s->len, NULL);
+    }
+
   return tr_variant_string_get_string (&v->val.s);
 }
 
@@ -264,7 +407,7 @@ tr_variantGetRaw (const tr_variant   * v,
 
   if (success)
     {
-      *setme_raw = (uint8_t*) getStr (v);
+      *setme_raw = (const uint8_t*) tr_variant_string_get_string (&v->val.s);
       *setme_len = v->val.s.len;
     }
 
@@ -388,11 +531,29 @@ tr_variantDictFindRaw (tr_variant      * dict,
 ****
 ***/
 
+static struct tr_variant_arena *
+getArena (const tr_variant * v)
+{
+  return tr_variantIsContainer (v) ? v->val.l.arena : NULL;
+}
+
+static void
+initStr (tr_variant * v, const void * str, int len, struct tr_variant_arena * arena)
+{
+  tr_variantInit (v, TR_VARIANT_TYPE_STR);
+  tr_variant_string_set_string (&v->val.s, str, len, arena);
+}
+
+void
+tr_variantInitStrIn (tr_variant * v, const void * str, size_t len, tr_variant * parent)
+{
+  initStr (v, str, len, getArena (parent));
+}
+
 void
 tr_variantInitRaw (tr_variant * v, const void * src, size_t byteCount)
 {
-  tr_variantInit (v, TR_VARIANT_TYPE_STR);
-  tr_variant_string_set_string (&v->val.s, src, byteCount);
+  initStr (v, src, byteCount, NULL);
 }
 
 void
@@ -405,8 +566,7 @@ tr_variantInitQuark (tr_variant * v, const tr_quark q)
 void
 tr_variantInitStr (tr_variant * v, const void * str, int len)
 {
-  tr_variantInit (v, TR_VARIANT_TYPE_STR);
-  tr_variant_string_set_string (&v->val.s, str, len);
+  initStr (v, str, len, NULL);
 }
 
 void
@@ -430,13 +590,6 @@ tr_variantInitInt (tr_variant * v, int64_t value)
   v->val.i = value;
 }
 
-void
-tr_variantInitList (tr_variant * v, size_t reserve_count)
-{
-  tr_variantInit (v, TR_VARIANT_TYPE_LIST);
-  tr_variantListReserve (v, reserve_count);
-}
-
 static void
 containerReserve (tr_variant * v, size_t count)
 {
@@ -451,11 +604,87 @@ containerReserve (tr_variant * v, size_t count)
       while (n < needed)
         n *= 2u;
 
-      v->val.l.vals = tr_renew (tr_variant, v->val.l.vals, n);
+      if ((v->val.l.arena == NULL) || v->val.l.heap_vals)
+        {
+          v->val.l.vals = tr_renew (tr_variant, v->val.l.vals, n);
+        }
+      else if (sizeof (tr_variant) * n <= ARENA_MAX_VALS_SIZE)
+        {
+          v->val.l.vals = arenaRealloc (v->val.l.arena, v->val.l.vals,
+                                        sizeof (tr_variant) * v->val.l.alloc,
+                                        sizeof (tr_variant) * n);
+        }
+      else
+        {
+          tr_variant * vals = tr_new (tr_variant, n);
+          if (v->val.l.count > 0)
+            memcpy (vals, v->val.l.vals, sizeof (tr_variant) * v->val.l.count);
+          v->val.l.vals = vals;
+          v->val.l.heap_vals = true;
+        }
+
       v->val.l.alloc = n;
     }
 }
 
+static void
+containerInit (tr_variant               * v,
+               char                       type,
+               size_t                     reserve_count,
+               struct tr_variant_arena  * arena)
+{
+  tr_variantInit (v, type);
+  v->val.l.arena = arena;
+  containerReserve (v, reserve_count);
+}
+
+void
+tr_variantInitContainerIn (tr_variant * v, char type, tr_variant * parent)
+{
+  if (parent != NULL)
+    {
+      containerInit (v, type, 0, getArena (parent));
+    }
+  else
+    {
+      containerInit (v, type, 0, arenaNew ());
+      v->val.l.owns_arena = true;
+    }
+}
+
+void
+tr_variantAdoptBuf (tr_variant * top, void * buf, size_t buflen)
+{
+  struct tr_variant_arena * arena = getArena (top);
+
+  assert (tr_variantIsContainer (top));
+  assert (top->val.l.owns_arena);
+  assert (arena->source == NULL);
+
+  arena->source = buf;
+  arena->source_len = buflen;
+}
+
+void
+tr_variantSetChildren (tr_variant * container, const tr_variant * children, size_t count)
+{
+  assert (tr_variantIsContainer (container));
+  assert (container->val.l.count == 0);
+
+  if (count > 0)
+    {
+      containerReserve (container, count);
+      memcpy (container->val.l.vals, children, sizeof (tr_variant) * count);
+      container->val.l.count = count;
+    }
+}
+
+void
+tr_variantInitList (tr_variant * v, size_t reserve_count)
+{
+  containerInit (v, TR_VARIANT_TYPE_LIST, reserve_count, NULL);
+}
+
 void
 tr_variantListReserve (tr_variant * list, size_t count)
 {
@@ -466,8 +695,14 @@ tr_variantListReserve (tr_variant * list, size_t count)
 void
 tr_variantInitDict (tr_variant * v, size_t reserve_count)
 {
-  tr_variantInit (v, TR_VARIANT_TYPE_DICT);
-  tr_variantDictReserve (v, reserve_count);
+  containerInit (v, TR_VARIANT_TYPE_DICT, reserve_count, NULL);
+}
+
+void
+tr_variantInitArenaDict (tr_variant * v, size_t reserve_count)
+{
+  containerInit (v, TR_VARIANT_TYPE_DICT, reserve_count, arenaNew ());
+  v->val.l.owns_arena = true;
 }
 
 void
@@ -525,7 +760,7 @@ tr_variantListAddStr (tr_variant  * list,
                       const char  * val)
 {
   tr_variant * child = tr_variantListAdd (list);
-  tr_variantInitStr (child, val, -1);
+  initStr (child, val, -1, list->val.l.arena);
   return child;
 }
 
@@ -544,7 +779,7 @@ tr_variantListAddRaw (tr_variant  * list,
                       size_t        len)
 {
   tr_variant * child = tr_variantListAdd (list);
-  tr_variantInitRaw (child, val, len);
+  initStr (child, val, len, list->val.l.arena);
   return child;
 }
 
@@ -553,7 +788,7 @@ tr_variantListAddList (tr_variant  * list,
                        size_t        reserve_count)
 {
   tr_variant * child = tr_variantListAdd (list);
-  tr_variantInitList (child, reserve_count);
+  containerInit (child, TR_VARIANT_TYPE_LIST, reserve_count, list->val.l.arena);
   return child;
 }
 
@@ -562,7 +797,7 @@ tr_variantListAddDict (tr_variant  * list,
                        size_t        reserve_count)
 {
   tr_variant * child = tr_variantListAdd (list);
-  tr_variantInitDict (child, reserve_count);
+  containerInit (child, TR_VARIANT_TYPE_DICT, reserve_count, list->val.l.arena);
   return child;
 }
 
@@ -654,7 +889,7 @@ tr_variantDictAddStr (tr_variant      * dict,
                       const char      * val)
 {
   tr_variant * child = dictFindOrAdd (dict, key, TR_VARIANT_TYPE_STR);
-  tr_variantInitStr (child, val, -1);
+  initStr (child, val, -1, dict->val.l.arena);
   return child;
 }
 
@@ -665,7 +900,7 @@ tr_variantDictAddRaw (tr_variant      * dict,
                       size_t            len)
 {
   tr_variant * child = dictFindOrAdd (dict, key, TR_VARIANT_TYPE_STR);
-  tr_variantInitRaw (child, src, len);
+  initStr (child, src, len, dict->val.l.arena);
   return child;
 }
 
@@ -675,7 +910,7 @@ tr_variantDictAddList (tr_variant     * dict,
                        size_t           reserve_count)
 {
   tr_variant * child = tr_variantDictAdd (dict, key);
-  tr_variantInitList (child, reserve_count);
+  containerInit (child, TR_VARIANT_TYPE_LIST, reserve_count, dict->val.l.arena);
   return child;
 }
 
@@ -685,7 +920,7 @@ tr_variantDictAddDict (tr_variant     * dict,
                        size_t           reserve_count)
 {
   tr_variant * child = tr_variantDictAdd (dict, key);
-  tr_variantInitDict (child, reserve_count);
+  containerInit (child, TR_VARIANT_TYPE_DICT, reserve_count, dict->val.l.arena);
   return child;
 }
 
@@ -898,35 +1133,80 @@ tr_variantWalk (const tr_variant               * v,
 *****
 ****/
 
-static void
-freeDummyFunc (const tr_variant * v UNUSED, void * buf UNUSED)
-{}
-
-static void
-freeStringFunc (const tr_variant * v, void * unused UNUSED)
+struct FreeNode
 {
-  tr_variant_string_clear (&((tr_variant*)v)->val.s);
-}
+  tr_variant * v;
+  size_t childIndex;
+};
 
+/* Frees the heap memory under a container. This is a walk like
+   tr_variantWalk ()'s -- and iterative for the same reason -- but
+   doesn't need to look at dict keys or sort anything. */
 static void
-freeContainerEndFunc (const tr_variant * v, void * unused UNUSED)
+freeContainer (tr_variant * top)
 {
-  tr_free (v->val.l.vals);
-}
+  size_t stackSize = 0;
+  size_t stackAlloc = 64;
+  struct FreeNode * stack = tr_new (struct FreeNode, stackAlloc);
 
-static const struct VariantWalkFuncs freeWalkFuncs = { freeDummyFunc,
-                                                       freeDummyFunc,
-                                                       freeDummyFunc,
-                                                       freeStringFunc,
-                                                       freeDummyFunc,
-                                                       freeDummyFunc,
-                                                       freeContainerEndFunc };
+  stack[stackSize].v = top;
+  stack[stackSize].childIndex = 0;
+  ++stackSize;
+
+  while (stackSize > 0)
+    {
+      struct FreeNode * node = &stack[stackSize-1];
+      tr_variant * v = node->v;
+
+      if (node->childIndex < v->val.l.count)
+        {
+          tr_variant * child = v->val.l.vals + node->childIndex++;
+
+          if (tr_variantIsContainer (child))
+            {
+              if (stackAlloc == stackSize)
+                {
+                  stackAlloc *= 2;
+                  stack = tr_renew (struct FreeNode, stack, stackAlloc);
+                }
+              stack[stackSize].v = child;
+              stack[stackSize].childIndex = 0;
+              ++stackSize;
+            }
+          else if (tr_variantIsString (child))
+            {
+              tr_variant_string_clear (&child->val.s);
+            }
+        }
+      else
+        {
+          if ((v->val.l.arena == NULL) || v->val.l.heap_vals)
+            tr_free (v->val.l.vals);
+          --stackSize;
+        }
+    }
+
+  tr_free (stack);
+}
 
 void
 tr_variantFree (tr_variant * v)
 {
-  if (tr_variantIsSomething (v))
-    tr_variantWalk (v, &freeWalkFuncs, NULL, false);
+  if (tr_variantIsString (v))
+    {
+      tr_variant_string_clear (&v->val.s);
+    }
+  else if (tr_variantIsContainer (v))
+    {
+      struct tr_variant_arena * arena = v->val.l.owns_arena ? v->val.l.arena : NULL;
+
+      /* the arena's memory is freed in one go below, but anything
+         added to the tree from the heap still needs to be found */
+      freeContainer (v);
+
+      if (arena != NULL)
+        arenaFree (arena);
+    }
 }
 
 /***
@@ -1249,15 +1529,52 @@ tr_variantFromFile (tr_variant      * setme,
   buf = tr_loadFile (filename, &buflen);
 
   if (errno)
-    err = errno;
+    {
+      err = errno;
+      tr_free (buf);
+    }
+  else if (fmt == TR_VARIANT_FMT_BENC)
+    {
+      err = tr_variantFromBencInPlace (setme, buf, buflen);
+    }
   else
-    err = tr_variantFromBuf (setme, fmt, buf, buflen, filename, NULL);
+    {
+      err = tr_variantFromBuf (setme, fmt, buf, buflen, filename, NULL);
+      tr_free (buf);
+    }
 
-  tr_free (buf);
   errno = old_errno;
   return err;
 }
 
+int
+tr_variantFromBencInPlace (tr_variant * setme,
+                           void       * buf,
+                           size_t       buflen)
+{
+  int err;
+  bool adopted;
+
+  tr_variantInit (setme, 0);
+
+  err = tr_variantParseBenc (buf, ((const char*)buf)+buflen, setme, NULL, true);
+
+  /* the parser hands the buffer to the top container as soon as
+     it makes it. if there wasn't one, nothing points into it. */
+  adopted = tr_variantIsContainer (setme);
+
+  if (err)
+    {
+      tr_variantFree (setme);
+      tr_variantInit (setme, 0);
+    }
+
+  if (!adopted)
+    tr_free (buf);
+
+  return err;
+}
+
 int
 tr_variantFromBuf (tr_variant      * setme,
                    tr_variant_fmt    fmt,
@@ -1273,6 +1590,8 @@ tr_variantFromBuf (tr_variant      * setme,
   tr_strlcpy (lc_numeric, setlocale (LC_NUMERIC, NULL), sizeof (lc_numeric));
   setlocale (LC_NUMERIC, "C");
 
+  tr_variantInit (setme, 0);
+
   switch (fmt)
     {
       case TR_VARIANT_FMT_JSON:
@@ -1281,10 +1600,17 @@ tr_variantFromBuf (tr_variant      * setme,
         break;
 
       default /* TR_VARIANT_FMT_BENC */:
-        err = tr_variantParseBenc (buf, ((const char*)buf)+buflen, setme, setme_end);
+        err = tr_variantParseBenc (buf, ((const char*)buf)+buflen, setme, setme_end, false);
         break;
     }
 
+  /* don't leave the caller a half-built tree (and its arena) to free */
+  if (err)
+    {
+      tr_variantFree (setme);
+      tr_variantInit (setme, 0);
+    }
+
   /* restore the previous locale */
   setlocale (LC_NUMERIC, lc_numeric);
   return err;
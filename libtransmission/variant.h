@@ -18,6 +18,7 @@ extern "C" {
 #include "quark.h"
 
 struct evbuffer;
+struct tr_variant_arena;
 
 /**
  * @addtogroup tr_variant Variant
@@ -35,7 +36,9 @@ typedef enum
 {
   TR_STRING_TYPE_QUARK,
   TR_STRING_TYPE_HEAP,
-  TR_STRING_TYPE_BUF
+  TR_STRING_TYPE_BUF,
+  TR_STRING_TYPE_ARENA,
+  TR_STRING_TYPE_VIEW /* points into the buffer the tree was parsed from */
 }
 tr_string_type;
 
@@ -88,6 +91,9 @@ typedef struct tr_variant
           size_t alloc;
           size_t count;
           struct tr_variant * vals;
+          struct tr_variant_arena * arena; /* the tree's arena, or NULL */
+          bool owns_arena;
+          bool heap_vals; /* vals are from the heap even though there's an arena */
         } l;
     }
   val;
@@ -132,6 +138,19 @@ int tr_variantFromBuf (tr_variant     * setme,
                        const char     * optional_source,
                        const char    ** setme_end);
 
+/**
+ * @brief parse bencoded data without copying its strings.
+ *
+ * `buf' must come from tr_malloc (). The tree takes it over and frees
+ * it along with itself (or right away, on error), and the tree's long
+ * strings point into it instead of being copied. They're only copied if
+ * someone asks for them with tr_variantGetStr (), which has to return
+ * a zero-terminated string; tr_variantGetRaw () never copies them.
+ */
+int tr_variantFromBencInPlace (tr_variant * setme,
+                               void       * buf,
+                               size_t       buflen);
+
 static inline int
 tr_variantFromBenc (tr_variant * setme,
                     const void * buf,
@@ -329,6 +348,16 @@ tr_variantIsDict (const tr_variant * v)
 void         tr_variantInitDict        (tr_variant       * initme,
                                         size_t             reserve_count);
 
+/**
+ * @brief like tr_variantInitDict (), but for large, short-lived trees.
+ *
+ * Everything added under this dict with the tr_variantDictAdd*() and
+ * tr_variantListAdd*() functions is allocated from one arena, which
+ * tr_variantFree () releases all at once. Parsed trees work this way too.
+ */
+void         tr_variantInitArenaDict   (tr_variant       * initme,
+                                        size_t             reserve_count);
+
 void         tr_variantDictReserve     (tr_variant       * dict,
                                         size_t             reserve_count);
 
@@ -413,6 +442,81 @@ bool         tr_variantDictFindRaw     (tr_variant       * dict,
 void         tr_variantMergeDicts      (tr_variant       * dict_target,
                                         const tr_variant * dict_source);
 
+/***
+****  Streaming JSON
+***/
+
+/**
+ * Writes lean JSON straight into an evbuffer as the values are generated,
+ * for large replies that aren't worth building as a tr_variant tree first.
+ * Values are formatted the same way as tr_variantToBuf(TR_VARIANT_FMT_JSON_LEAN),
+ * but dict keys appear in the order they're written rather than sorted.
+ */
+typedef struct tr_json_writer
+{
+  struct evbuffer * out;
+  int depth;
+  bool need_comma;
+}
+tr_json_writer;
+
+void         tr_jsonWriterInit         (tr_json_writer   * writer,
+                                        struct evbuffer  * out);
+
+void         tr_jsonWriterDictBegin    (tr_json_writer   * writer);
+
+void         tr_jsonWriterDictEnd      (tr_json_writer   * writer);
+
+void         tr_jsonWriterListBegin    (tr_json_writer   * writer);
+
+void         tr_jsonWriterListEnd      (tr_json_writer   * writer);
+
+/* the next value written is this key's */
+void         tr_jsonWriterKey          (tr_json_writer   * writer,
+                                        const tr_quark     key);
+
+void         tr_jsonWriterInt          (tr_json_writer   * writer,
+                                        int64_t            value);
+
+void         tr_jsonWriterReal         (tr_json_writer   * writer,
+                                        double             value);
+
+void         tr_jsonWriterBool         (tr_json_writer   * writer,
+                                        bool               value);
+
+/* a NULL string is written as "" */
+void         tr_jsonWriterStr          (tr_json_writer   * writer,
+                                        const char       * value);
+
+void         tr_jsonWriterDictAddInt   (tr_json_writer   * writer,
+                                        const tr_quark     key,
+                                        int64_t            value);
+
+void         tr_jsonWriterDictAddReal  (tr_json_writer   * writer,
+                                        const tr_quark     key,
+                                        double             value);
+
+void         tr_jsonWriterDictAddBool  (tr_json_writer   * writer,
+                                        const tr_quark     key,
+                                        bool               value);
+
+void         tr_jsonWriterDictAddStr   (tr_json_writer   * writer,
+                                        const tr_quark     key,
+                                        const char       * value);
+
+/* move already-written JSON from another buffer into this one: either
+   a single value or, inside a dict, one or more "key":value members */
+void         tr_jsonWriterRaw          (tr_json_writer   * writer,
+                                        struct evbuffer  * json);
+
+/* write the key and open a child container. Close it with
+   tr_jsonWriterDictEnd() or tr_jsonWriterListEnd() */
+void         tr_jsonWriterDictAddDict  (tr_json_writer   * writer,
+                                        const tr_quark     key);
+
+void         tr_jsonWriterDictAddList  (tr_json_writer   * writer,
+                                        const tr_quark     key);
+
 /***
 ****
 ****
@@ -18,12 +18,17 @@
 #include <openssl/sha.h>
 
 #include "transmission.h"
+#include "cache.h" /* tr_cacheReadBlock () */
 #include "completion.h"
+#include "crypto.h" /* tr_sha1 () */
 #include "fdlimit.h"
+#include "inout.h" /* tr_ioTestPiece () */
 #include "list.h"
 #include "log.h"
 #include "platform.h" /* tr_lock () */
+#include "session.h"
 #include "torrent.h"
+#include "trevent.h" /* tr_runInEventThread () */
 #include "utils.h" /* tr_valloc (), tr_free () */
 #include "verify.h"
 
@@ -33,7 +38,11 @@
 
 enum
 {
-  MSEC_TO_SLEEP_PER_SECOND_DURING_VERIFY = 100
+  MSEC_TO_SLEEP_PER_SECOND_DURING_VERIFY = 100,
+
+  /* if the piece-check threads fall this far behind,
+     check new pieces in the caller's thread instead */
+  MAX_PIECE_CHECK_BYTES_QUEUED = 64 * 1024 * 1024
 };
 
 static bool
@@ -112,7 +121,7 @@ verifyTorrent (tr_torrent * tor, bool * stopFlag)
           uint8_t hash[SHA_DIGEST_LENGTH];
 
           SHA1_Final (hash, &sha);
-          hasPiece = !memcmp (hash, tor->info.pieces[pieceIndex].hash, SHA_DIGEST_LENGTH);
+          hasPiece = !memcmp (hash, tor->info.pieceHashes + pieceIndex * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH);
 
           if (hasPiece || hadPiece)
             {
@@ -322,14 +331,208 @@ tr_verifyRemove (tr_torrent * tor)
   tr_lockUnlock (lock);
 }
 
+/***
+****  Single pieces
+***/
+
+struct piece_check_node
+{
+  tr_session           * session;
+  int                    torrent_id;
+  tr_piece_index_t       piece;
+  uint8_t                hash[SHA_DIGEST_LENGTH];
+  uint8_t              * data;
+  uint32_t               length;
+  bool                   pass;
+  tr_verify_piece_func   callback_func;
+};
+
+static tr_list * pieceCheckList = NULL;
+static tr_list * pieceCheckActive = NULL;
+static size_t pieceCheckBytesQueued = 0;
+static int pieceCheckThreadCount = 0;
+
+static tr_lock*
+getPieceCheckLock (void)
+{
+  static tr_lock * lock = NULL;
+
+  if (lock == NULL)
+    lock = tr_lockNew ();
+
+  return lock;
+}
+
+static void
+pieceCheckNodeFree (void * vnode)
+{
+  struct piece_check_node * node = vnode;
+
+  tr_free (node->data);
+  tr_free (node);
+}
+
+static void
+pieceCheckDone (void * vnode)
+{
+  tr_torrent * tor;
+  struct piece_check_node * node = vnode;
+
+  if ((tor = tr_torrentFindFromId (node->session, node->torrent_id)))
+    (*node->callback_func)(tor, node->piece, node->pass);
+
+  pieceCheckNodeFree (node);
+}
+
+static void
+pieceCheckThreadFunc (void * unused UNUSED)
+{
+  tr_lock * lock = getPieceCheckLock ();
+
+  tr_lockLock (lock);
+
+  for (;;)
+    {
+      uint8_t hash[SHA_DIGEST_LENGTH];
+      struct piece_check_node * node = tr_list_pop_front (&pieceCheckList);
+
+      if (node == NULL)
+        break;
+
+      pieceCheckBytesQueued -= node->length;
+      tr_list_append (&pieceCheckActive, node);
+      tr_lockUnlock (lock);
+
+      tr_sha1 (hash, node->data, (int)node->length, NULL);
+      node->pass = !memcmp (hash, node->hash, SHA_DIGEST_LENGTH);
+      tr_free (node->data);
+      node->data = NULL;
+
+      /* hand the result back while still holding the lock,
+         so that tr_verifyClose () can tell when we're done */
+      tr_lockLock (lock);
+      tr_list_remove_data (&pieceCheckActive, node);
+      tr_runInEventThread (node->session, pieceCheckDone, node);
+    }
+
+  --pieceCheckThreadCount;
+  tr_lockUnlock (lock);
+}
+
+/* read through the cache, since a just-downloaded
+   piece's blocks may not have been flushed to disk yet */
+static bool
+readPieceFromCache (tr_torrent * tor, tr_piece_index_t piece, uint32_t length, uint8_t * setme)
+{
+  uint32_t offset = 0;
+
+  while (offset < length)
+    {
+      const uint32_t len = MIN (length - offset, tor->blockSize);
+
+      if (tr_cacheReadBlock (tor->session->cache, tor, piece, offset, len, setme + offset))
+        return false;
+
+      offset += len;
+    }
+
+  return true;
+}
+
 void
-tr_verifyClose (tr_session * session UNUSED)
+tr_verifyPiece (tr_torrent           * tor,
+                tr_piece_index_t       piece,
+                tr_verify_piece_func   callback_func)
 {
+  bool queued = false;
+  tr_session * session = tor->session;
+  const uint32_t length = tr_torPieceCountBytes (tor, piece);
+
+  assert (tr_isTorrent (tor));
+  assert (piece < tor->info.pieceCount);
+
+  if ((session->pieceCheckThreads > 0) && !session->isClosing
+      && tr_torrentEnsurePieceHashes (tor))
+    {
+      bool reserved;
+      tr_lock * lock = getPieceCheckLock ();
+
+      /* reserve space in the queue before reading the piece */
+      tr_lockLock (lock);
+      reserved = pieceCheckBytesQueued + length <= MAX_PIECE_CHECK_BYTES_QUEUED;
+      if (reserved)
+        pieceCheckBytesQueued += length;
+      tr_lockUnlock (lock);
+
+      if (reserved)
+        {
+          struct piece_check_node * node = tr_new0 (struct piece_check_node, 1);
+          node->session = session;
+          node->torrent_id = tr_torrentId (tor);
+          node->piece = piece;
+          node->length = length;
+          node->callback_func = callback_func;
+          memcpy (node->hash, tor->info.pieceHashes + piece * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH);
+          node->data = tr_valloc (length);
+          queued = readPieceFromCache (tor, piece, length, node->data);
+
+          tr_lockLock (lock);
+          if (!queued)
+            {
+              pieceCheckBytesQueued -= length;
+              pieceCheckNodeFree (node);
+            }
+          else
+            {
+              tr_list_append (&pieceCheckList, node);
+              if (pieceCheckThreadCount < session->pieceCheckThreads)
+                {
+                  ++pieceCheckThreadCount;
+                  tr_threadNew (pieceCheckThreadFunc, NULL);
+                }
+            }
+          tr_lockUnlock (lock);
+        }
+    }
+
+  if (!queued)
+    (*callback_func)(tor, piece, tr_ioTestPiece (tor, piece));
+}
+
+static int
+compareNodeToSession (const void * va, const void * vb)
+{
+  const struct piece_check_node * a = va;
+  const tr_session * b = vb;
+  return a->session == b ? 0 : 1;
+}
+
+void
+tr_verifyClose (tr_session * session)
+{
+  struct piece_check_node * node;
+  tr_lock * lock = getPieceCheckLock ();
+
   tr_lockLock (getVerifyLock ());
 
   stopCurrent = true;
   tr_list_free (&verifyList, tr_free);
 
   tr_lockUnlock (getVerifyLock ());
-}
 
+  /* drop this session's queued piece checks,
+     then wait for the ones already being hashed to finish */
+  tr_lockLock (lock);
+  while ((node = tr_list_remove (&pieceCheckList, session, compareNodeToSession)))
+    {
+      pieceCheckBytesQueued -= node->length;
+      pieceCheckNodeFree (node);
+    }
+  while (tr_list_find (pieceCheckActive, session, compareNodeToSession) != NULL)
+    {
+      tr_lockUnlock (lock);
+      tr_wait_msec (10);
+      tr_lockLock (lock);
+    }
+  tr_lockUnlock (lock);
+}
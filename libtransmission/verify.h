@@ -27,6 +27,22 @@ void tr_verifyRemove (tr_torrent * tor);
 
 void tr_verifyClose (tr_session *);
 
+typedef void (*tr_verify_piece_func)(tr_torrent        * torrent,
+                                     tr_piece_index_t    piece,
+                                     bool                pass);
+
+/**
+ * Check a single piece's SHA1 checksum, e.g. one that was just downloaded.
+ *
+ * The piece is read in the calling thread, but hashed on one of the
+ * session's piece-check worker threads so the libevent thread can keep
+ * servicing peers. callback_func is invoked from the libevent thread,
+ * and only if the torrent still exists by then.
+ */
+void tr_verifyPiece (tr_torrent           * tor,
+                     tr_piece_index_t       piece,
+                     tr_verify_piece_func   callback_func);
+
 /* @} */
 
 #endif
@@ -560,6 +560,17 @@ struct UTPSocket {
 
 	size_t idx;
 
+	// Position in g_utp_active, or NOT_ACTIVE while the socket is
+	// parked in the timer wheel
+	size_t active_idx;
+	// Timer wheel slot list, and the tick to wake up at
+	UTPSocket *tw_next;
+	UTPSocket **tw_pprev;
+	uint32 tw_tick;
+
+	// Next socket in the same (addr, conn_id_recv) hash bucket
+	UTPSocket *hash_next;
+
 	uint16 reorder_count;
 	byte duplicate_ack;
 
@@ -776,6 +787,12 @@ struct UTPSocket {
 
 	void update_send_quota();
 
+	// The most send quota we let accumulate when there's nothing to send
+	int32 get_send_quota_limit()
+	{
+		return max<int32>((int32)max_window / 2, 5 * (int32)get_packet_size()) * 100;
+	}
+
 #ifdef _DEBUG
 	void check_invariant();
 #endif
@@ -796,6 +813,289 @@ struct UTPSocket {
 Array<RST_Info> g_rst_info;
 Array<UTPSocket*> g_utp_sockets;
 
+// Sockets that UTP_CheckTimeouts() has to look at on every tick.
+// Sockets with nothing in flight are parked in a timer wheel until
+// their next deadline, or until a packet or an API call wakes them.
+Array<UTPSocket*> g_utp_active;
+
+#define NOT_ACTIVE ((size_t)-1)
+
+// Two-level timer wheel. A tick is 16ms. Level 0 has one slot per tick
+// and spans ~4 seconds; level 1 has 256 ticks per slot and spans ~4.4
+// minutes. Anything further out is woken early and parked again.
+#define TW_TICK_SHIFT 4
+#define TW_L0_BITS 8
+#define TW_L1_BITS 6
+#define TW_L0_SIZE (1 << TW_L0_BITS)
+#define TW_L1_SIZE (1 << TW_L1_BITS)
+#define TW_L0_MASK (TW_L0_SIZE - 1)
+#define TW_L1_MASK (TW_L1_SIZE - 1)
+#define TW_SPAN (TW_L0_SIZE * TW_L1_SIZE)
+
+static UTPSocket *g_tw_l0[TW_L0_SIZE];
+static UTPSocket *g_tw_l1[TW_L1_SIZE];
+static uint32 g_tw_now;
+static bool g_tw_started;
+static size_t g_tw_parked;
+
+// Sockets indexed by (addr, conn_id_recv), so incoming packets don't
+// have to scan every socket
+static UTPSocket **g_utp_hash;
+static size_t g_utp_hash_mask;
+
+static uint32 UTP_HashKey(const PackedSockAddr &addr, uint32 conn_id)
+{
+	uint32 h = conn_id * 0x9e3779b1;
+	for (int i = 0; i < 4; i++) {
+		h = (h ^ addr._sin6d[i]) * 0x9e3779b1;
+	}
+	h = (h ^ addr._port) * 0x9e3779b1;
+	return h ^ (h >> 16);
+}
+
+static UTPSocket **UTP_HashBucket(const PackedSockAddr &addr, uint32 conn_id)
+{
+	return &g_utp_hash[UTP_HashKey(addr, conn_id) & g_utp_hash_mask];
+}
+
+static void UTP_HashLink(UTPSocket *conn)
+{
+	// append, so that the oldest of several matching sockets is found
+	// first, as it was when we searched g_utp_sockets in order
+	UTPSocket **p = UTP_HashBucket(conn->addr, conn->conn_id_recv);
+	while (*p != NULL) {
+		p = &(*p)->hash_next;
+	}
+	conn->hash_next = NULL;
+	*p = conn;
+}
+
+static void UTP_HashUnlink(UTPSocket *conn)
+{
+	UTPSocket **p = UTP_HashBucket(conn->addr, conn->conn_id_recv);
+	while (*p != conn) {
+		assert(*p != NULL);
+		p = &(*p)->hash_next;
+	}
+	*p = conn->hash_next;
+	conn->hash_next = NULL;
+}
+
+static void UTP_HashGrow()
+{
+	UTPSocket **old = g_utp_hash;
+	const size_t old_size = old ? g_utp_hash_mask + 1 : 0;
+	const size_t new_size = max<size_t>(64, old_size * 2);
+
+	g_utp_hash = (UTPSocket**)calloc(new_size, sizeof(UTPSocket*));
+	g_utp_hash_mask = new_size - 1;
+
+	for (size_t i = 0; i < old_size; i++) {
+		UTPSocket *conn = old[i];
+		while (conn != NULL) {
+			UTPSocket *next = conn->hash_next;
+			UTP_HashLink(conn);
+			conn = next;
+		}
+	}
+	free(old);
+}
+
+// Find the socket talking to addr that receives on recv_id.
+// If send_id is given, the socket must also send on it.
+static UTPSocket *UTP_HashFind(const PackedSockAddr &addr, uint32 recv_id, const uint32 *send_id = NULL)
+{
+	if (g_utp_hash == NULL) return NULL;
+
+	for (UTPSocket *conn = *UTP_HashBucket(addr, recv_id); conn != NULL; conn = conn->hash_next) {
+		if (conn->conn_id_recv == recv_id && conn->addr == addr &&
+			(send_id == NULL || conn->conn_id_send == *send_id)) {
+			return conn;
+		}
+	}
+	return NULL;
+}
+
+static void UTP_SetConnIdRecv(UTPSocket *conn, uint32 conn_id)
+{
+	UTP_HashUnlink(conn);
+	conn->conn_id_recv = conn_id;
+	UTP_HashLink(conn);
+}
+
+static void UTP_WheelLink(UTPSocket *conn)
+{
+	UTPSocket **slot;
+	int32 delta = (int32)(conn->tw_tick - g_tw_now);
+
+	if (delta < TW_L0_SIZE) {
+		slot = &g_tw_l0[conn->tw_tick & TW_L0_MASK];
+	} else {
+		if (delta >= TW_SPAN) {
+			conn->tw_tick = g_tw_now + TW_SPAN - 1;
+		}
+		slot = &g_tw_l1[(conn->tw_tick >> TW_L0_BITS) & TW_L1_MASK];
+	}
+
+	conn->tw_next = *slot;
+	conn->tw_pprev = slot;
+	if (*slot != NULL) {
+		(*slot)->tw_pprev = &conn->tw_next;
+	}
+	*slot = conn;
+}
+
+static void UTP_WheelUnlink(UTPSocket *conn)
+{
+	*conn->tw_pprev = conn->tw_next;
+	if (conn->tw_next != NULL) {
+		conn->tw_next->tw_pprev = conn->tw_pprev;
+	}
+	conn->tw_next = NULL;
+	conn->tw_pprev = NULL;
+}
+
+// Move a socket that has been unlinked from the wheel back onto the
+// active list
+static void UTP_Wake(UTPSocket *conn)
+{
+	assert(conn->active_idx == NOT_ACTIVE);
+	g_tw_parked--;
+
+	// check_timeouts() would have kept topping the send quota up to
+	// its limit while we were parked
+	conn->last_send_quota = g_current_ms;
+	conn->send_quota = max<int32>(conn->send_quota, conn->get_send_quota_limit());
+
+	conn->active_idx = g_utp_active.Append(conn);
+}
+
+// Called whenever a packet or an API call touches a socket
+static void UTP_Activate(UTPSocket *conn)
+{
+	if (conn->active_idx != NOT_ACTIVE) return;
+
+	g_current_ms = UTP_GetMilliseconds();
+	UTP_WheelUnlink(conn);
+	UTP_Wake(conn);
+}
+
+static void UTP_RemoveActive(UTPSocket *conn)
+{
+	const size_t i = conn->active_idx;
+	UTPSocket *last = g_utp_active[g_utp_active.GetCount() - 1];
+
+	assert(i < g_utp_active.GetCount());
+	assert(g_utp_active[i] == conn);
+
+	last->active_idx = i;
+	g_utp_active[i] = last;
+	g_utp_active.SetCount(g_utp_active.GetCount() - 1);
+	conn->active_idx = NOT_ACTIVE;
+}
+
+// Returns true if check_timeouts() has nothing to do for this socket
+// before *deadline unless a packet arrives or the user calls into it
+static bool UTP_IsQuiescent(const UTPSocket *conn, uint32 *deadline)
+{
+	switch (conn->state) {
+	case CS_IDLE:
+	case CS_RESET:
+		// waiting for UTP_Connect() or UTP_Close()
+		*deadline = g_current_ms + TW_SPAN * (1 << TW_TICK_SHIFT);
+		return true;
+
+	case CS_CONNECTED:
+		// nothing in flight, nothing queued and no zero window to probe.
+		// The delayed ACK and keepalive are the only timers left.
+		if (conn->cur_window_packets > 0 || conn->max_window_user == 0 ||
+			conn->bytes_since_ack > DELAYED_ACK_BYTE_THRESHOLD) {
+			return false;
+		}
+		*deadline = conn->last_sent_packet + KEEPALIVE_INTERVAL;
+		if ((int32)(conn->ack_time - *deadline) < 0) {
+			*deadline = conn->ack_time;
+		}
+		return true;
+
+	case CS_GOT_FIN:
+	case CS_DESTROY_DELAY:
+		if (conn->cur_window_packets > 0) {
+			return false;
+		}
+		*deadline = conn->rto_timeout;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// Park an active socket in the timer wheel until deadline.
+// Returns false if the deadline is too close to bother.
+static bool UTP_Park(UTPSocket *conn, uint32 deadline)
+{
+	const uint32 tick = (deadline + (1 << TW_TICK_SHIFT) - 1) >> TW_TICK_SHIFT;
+
+	if ((int32)(tick - g_tw_now) < 2) {
+		return false;
+	}
+
+	UTP_RemoveActive(conn);
+	conn->tw_tick = tick;
+	UTP_WheelLink(conn);
+	g_tw_parked++;
+	return true;
+}
+
+// Wake every parked socket in a slot whose tick has come, and put the
+// rest back where they belong
+static void UTP_WheelExpire(UTPSocket **slot)
+{
+	UTPSocket *conn = *slot;
+	*slot = NULL;
+
+	while (conn != NULL) {
+		UTPSocket *next = conn->tw_next;
+		conn->tw_next = NULL;
+		conn->tw_pprev = NULL;
+		if ((int32)(conn->tw_tick - g_tw_now) <= 0) {
+			UTP_Wake(conn);
+		} else {
+			UTP_WheelLink(conn);
+		}
+		conn = next;
+	}
+}
+
+static void UTP_AdvanceWheel()
+{
+	const uint32 now = g_current_ms >> TW_TICK_SHIFT;
+
+	if (!g_tw_started) {
+		g_tw_now = now;
+		g_tw_started = true;
+		return;
+	}
+
+	if ((int32)(now - g_tw_now) > TW_SPAN) {
+		// we haven't been called in minutes; just wake everything
+		g_tw_now = now;
+		for (size_t i = 0; i < TW_L0_SIZE; i++) UTP_WheelExpire(&g_tw_l0[i]);
+		for (size_t i = 0; i < TW_L1_SIZE; i++) UTP_WheelExpire(&g_tw_l1[i]);
+		return;
+	}
+
+	while ((int32)(now - g_tw_now) > 0) {
+		g_tw_now++;
+		if ((g_tw_now & TW_L0_MASK) == 0) {
+			// cascade the next level 1 slot down into level 0
+			UTP_WheelExpire(&g_tw_l1[(g_tw_now >> TW_L0_BITS) & TW_L1_MASK]);
+		}
+		UTP_WheelExpire(&g_tw_l0[g_tw_now & TW_L0_MASK]);
+	}
+}
+
 static void UTP_RegisterSentPacket(size_t length) {
 	if (length <= PACKET_SIZE_MID) {
 		if (length <= PACKET_SIZE_EMPTY) {
@@ -1388,7 +1688,7 @@ void UTPSocket::check_timeouts()
 
 	// make sure we don't accumulate quota when we don't have
 	// anything to send
-	int32 limit = max<int32>((int32)max_window / 2, 5 * (int32)get_packet_size()) * 100;
+	int32 limit = get_send_quota_limit();
 	if (send_quota > limit) send_quota = limit;
 }
 
@@ -2299,6 +2599,14 @@ void UTP_Free(UTPSocket *conn)
 	conn->func.on_state(conn->userdata, UTP_STATE_DESTROYING);
 	UTP_SetCallbacks(conn, NULL, NULL);
 
+	UTP_HashUnlink(conn);
+	if (conn->active_idx != NOT_ACTIVE) {
+		UTP_RemoveActive(conn);
+	} else {
+		UTP_WheelUnlink(conn);
+		g_tw_parked--;
+	}
+
 	assert(conn->idx < g_utp_sockets.GetCount());
 	assert(g_utp_sockets[conn->idx] == conn);
 
@@ -2378,6 +2686,12 @@ UTPSocket *UTP_Create(SendToProc *send_to_proc, void *send_to_userdata, const st
 	conn->inbuf.elements = (void**)calloc(16, sizeof(void*));
 
 	conn->idx = g_utp_sockets.Append(conn);
+	conn->active_idx = g_utp_active.Append(conn);
+
+	if (g_utp_hash == NULL || g_utp_sockets.GetCount() > g_utp_hash_mask + 1) {
+		UTP_HashGrow();
+	}
+	UTP_HashLink(conn);
 
 	LOG_UTPV("0x%08x: UTP_Create", conn);
 
@@ -2443,6 +2757,7 @@ void UTP_Connect(UTPSocket *conn)
 	conn->state = CS_SYN_SENT;
 
 	g_current_ms = UTP_GetMilliseconds();
+	UTP_Activate(conn);
 
 	// Create and send a connect message
 	uint32 conn_seed = UTP_Random();
@@ -2466,7 +2781,7 @@ void UTP_Connect(UTPSocket *conn)
 	conn->last_rcv_win = conn->get_rcv_window();
 
 	conn->conn_seed = conn_seed;
-	conn->conn_id_recv = conn_seed;
+	UTP_SetConnIdRecv(conn, conn_seed);
 	conn->conn_id_send = conn_seed+1;
 	// if you need compatibiltiy with 1.8.1, use this. it increases attackability though.
 	//conn->seq_nr = 1;
@@ -2559,14 +2874,21 @@ bool UTP_IsIncomingUTP(UTPGotIncomingConnection *incoming_proc,
 
 	const byte flags = version == 0 ? pf->flags : pf1->type();
 
-	for (size_t i = 0; i < g_utp_sockets.GetCount(); i++) {
-		UTPSocket *conn = g_utp_sockets[i];
-		//LOG_UTPV("Examining UTPSocket %s for %s and (seed:%u s:%u r:%u) for %u",
-		//		addrfmt(conn->addr, addrbuf), addrfmt(addr, addrbuf2), conn->conn_seed, conn->conn_id_send, conn->conn_id_recv, id);
-		if (conn->addr != addr)
-			continue;
+	// A RST may carry either of the socket's ids. conn_id_send is always
+	// one more or one less than conn_id_recv, depending on who connected.
+	UTPSocket *conn = NULL;
+	if (flags == ST_RESET) {
+		conn = UTP_HashFind(addr, id);
+		if (conn == NULL) conn = UTP_HashFind(addr, id - 1, &id);
+		if (conn == NULL) conn = UTP_HashFind(addr, id + 1, &id);
+	} else if (flags != ST_SYN) {
+		conn = UTP_HashFind(addr, id);
+	}
+
+	if (conn != NULL) {
+		UTP_Activate(conn);
 
-		if (flags == ST_RESET && (conn->conn_id_send == id || conn->conn_id_recv == id)) {
+		if (flags == ST_RESET) {
 			LOG_UTPV("0x%08x: recv RST for existing connection", conn);
 			if (!conn->userdata || conn->state == CS_FIN_SENT) {
 				conn->state = CS_DESTROY;
@@ -2582,7 +2904,7 @@ bool UTP_IsIncomingUTP(UTPGotIncomingConnection *incoming_proc,
 				conn->func.on_error(conn->userdata, err);
 			}
 			return true;
-		} else if (flags != ST_SYN && conn->conn_id_recv == id) {
+		} else {
 			LOG_UTPV("0x%08x: recv processing", conn);
 			const size_t read = UTP_ProcessIncoming(conn, buffer, len);
 			if (conn->userdata) {
@@ -2637,7 +2959,7 @@ bool UTP_IsIncomingUTP(UTPGotIncomingConnection *incoming_proc,
 		// This is value that identifies this connection for them.
 		conn->conn_id_send = id;
 		// This is value that identifies this connection for us.
-		conn->conn_id_recv = id+1;
+		UTP_SetConnIdRecv(conn, id+1);
 		conn->ack_nr = seq_nr;
 		conn->seq_nr = UTP_Random();
 		conn->fast_resend_seq_nr = conn->seq_nr;
@@ -2681,28 +3003,27 @@ bool UTP_HandleICMP(const byte* buffer, size_t len, const struct sockaddr *to, s
 	const byte version = UTP_IsV1(p1);
 	const uint32 id = (version == 0) ? p->connid : uint32(p1->connid);
 
-	for (size_t i = 0; i < g_utp_sockets.GetCount(); ++i) {
-		UTPSocket *conn = g_utp_sockets[i];
-		if (conn->addr == addr &&
-			conn->conn_id_recv == id) {
-			// Don't pass on errors for idle/closed connections
-			if (conn->state != CS_IDLE) {
-				if (!conn->userdata || conn->state == CS_FIN_SENT) {
-					LOG_UTPV("0x%08x: icmp packet causing socket destruction", conn);
-					conn->state = CS_DESTROY;
-				} else {
-					conn->state = CS_RESET;
-				}
-				if (conn->userdata) {
-					const int err = conn->state == CS_SYN_SENT ?
-						ECONNREFUSED :
-						ECONNRESET;
-					LOG_UTPV("0x%08x: icmp packet causing error on socket:%d", conn, err);
-					conn->func.on_error(conn->userdata, err);
-				}
+	UTPSocket *conn = UTP_HashFind(addr, id);
+	if (conn != NULL) {
+		UTP_Activate(conn);
+
+		// Don't pass on errors for idle/closed connections
+		if (conn->state != CS_IDLE) {
+			if (!conn->userdata || conn->state == CS_FIN_SENT) {
+				LOG_UTPV("0x%08x: icmp packet causing socket destruction", conn);
+				conn->state = CS_DESTROY;
+			} else {
+				conn->state = CS_RESET;
+			}
+			if (conn->userdata) {
+				const int err = conn->state == CS_SYN_SENT ?
+					ECONNREFUSED :
+					ECONNRESET;
+				LOG_UTPV("0x%08x: icmp packet causing error on socket:%d", conn, err);
+				conn->func.on_error(conn->userdata, err);
 			}
-			return true;
 		}
+		return true;
 	}
 	return false;
 }
@@ -2723,6 +3044,7 @@ bool UTP_Write(UTPSocket *conn, size_t bytes)
 	}
 
 	g_current_ms = UTP_GetMilliseconds();
+	UTP_Activate(conn);
 
 	conn->update_send_quota();
 
@@ -2759,6 +3081,8 @@ void UTP_RBDrained(UTPSocket *conn)
 {
 	assert(conn);
 
+	UTP_Activate(conn);
+
 	const size_t rcvwin = conn->get_rcv_window();
 
 	if (rcvwin > conn->last_rcv_win) {
@@ -2785,8 +3109,10 @@ void UTP_CheckTimeouts()
 		g_rst_info.Compact();
 	}
 
-	for (size_t i = 0; i != g_utp_sockets.GetCount(); i++) {
-		UTPSocket *conn = g_utp_sockets[i];
+	UTP_AdvanceWheel();
+
+	for (size_t i = 0; i != g_utp_active.GetCount(); i++) {
+		UTPSocket *conn = g_utp_active[i];
 		conn->check_timeouts();
 
 		// Check if the object was deleted
@@ -2794,6 +3120,13 @@ void UTP_CheckTimeouts()
 			LOG_UTPV("0x%08x: Destroying", conn);
 			UTP_Free(conn);
 			i--;
+			continue;
+		}
+
+		// Nothing to do until its next deadline? Park it.
+		uint32 deadline;
+		if (UTP_IsQuiescent(conn, &deadline) && UTP_Park(conn, deadline)) {
+			i--;
 		}
 	}
 }
@@ -2834,6 +3167,8 @@ void UTP_GetStats(UTPSocket *conn, UTPStats *stats)
 void UTP_GetGlobalStats(UTPGlobalStats *stats)
 {
 	*stats = _global_stats;
+	stats->_nsockets = (uint32)g_utp_sockets.GetCount();
+	stats->_nsockets_parked = (uint32)g_tw_parked;
 }
 
 // Close the UTP socket.
@@ -2847,6 +3182,8 @@ void UTP_Close(UTPSocket *conn)
 
 	LOG_UTPV("0x%08x: UTP_Close in state:%s", conn, statenames[conn->state]);
 
+	UTP_Activate(conn);
+
 	switch(conn->state) {
 	case CS_CONNECTED:
 	case CS_CONNECTED_FULL:
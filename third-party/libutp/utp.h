@@ -154,6 +154,8 @@ void UTP_Close(struct UTPSocket *socket);
 struct UTPGlobalStats {
 	uint32 _nraw_recv[5];	// total packets recieved less than 300/600/1200/MTU bytes fpr all connections (global)
 	uint32 _nraw_send[5];	// total packets sent less than 300/600/1200/MTU bytes for all connections (global)
+	uint32 _nsockets;	// sockets currently allocated
+	uint32 _nsockets_parked;	// sockets idle in the timer wheel, skipped by UTP_CheckTimeouts
 };
 
 void UTP_GetGlobalStats(struct UTPGlobalStats *stats);
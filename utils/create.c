@@ -9,7 +9,7 @@
 
 #include <errno.h>
 #include <stdio.h> /* fprintf() */
-#include <stdlib.h> /* strtoul(), EXIT_FAILURE */
+#include <stdlib.h> /* atoi(), strtoul(), EXIT_FAILURE */
 #include <unistd.h> /* getcwd() */
 
 #include <libtransmission/transmission.h>
@@ -30,6 +30,7 @@ static const char * comment = NULL;
 static const char * outfile = NULL;
 static const char * infile = NULL;
 static uint32_t piecesize_kib = 0;
+static int threadCount = 0;
 
 static tr_option options[] =
 {
@@ -38,6 +39,7 @@ static tr_option options[] =
   { 's', "piecesize", "Set how many KiB each piece should be, overriding the preferred default", "s", 1, "<size in KiB>" },
   { 'c', "comment", "Add a comment", "c", 1, "<comment>" },
   { 't', "tracker", "Add a tracker's announce URL", "t", 1, "<url>" },
+  { 'T', "threads", "Set how many threads (at most 8) hash the pieces, instead of one per CPU", "T", 1, "<count>" },
   { 'V', "version", "Show version number and exit", "V", 0, NULL },
   { 0, NULL, NULL, NULL, 0, NULL }
 };
@@ -93,6 +95,10 @@ parseCommandLine (int argc, const char ** argv)
               }
             break;
 
+          case 'T':
+            threadCount = atoi (optarg);
+            break;
+
           case TR_OPT_UNK:
             infile = optarg;
             break;
@@ -183,6 +189,9 @@ main (int argc, char * argv[])
   if (piecesize_kib != 0)
     tr_metaInfoBuilderSetPieceSize (b, piecesize_kib * KiB);
 
+  if (threadCount > 0)
+    tr_metaInfoBuilderSetThreadCount (b, threadCount);
+
   tr_makeMetaInfo (b, outfile, trackers, trackerCount, comment, isPrivate);
   while (!b->isDone)
     {